@@ -135,6 +135,14 @@ void _writegsbase_u64( unsigned __int64 );
 
 extern void _mm_lfence(void);
 extern void _mm_mfence(void);
+extern void _ReadWriteBarrier(void);
+
+//
+// Non-temporal stores.
+//
+
+void _mm_stream_si32(int *, int);
+void _mm_stream_si64x(__int64 *, __int64);
 
 //
 // Bit Scan.
@@ -705,6 +713,22 @@ __outdwordstring(
 }
 
 
+_DEFINE_INTRINSIC(long)
+_InterlockedExchangeAdd(
+    long volatile *Addend,
+    long Value)
+{
+    return __atomic_fetch_add(Addend, Value, __ATOMIC_SEQ_CST);
+}
+
+_DEFINE_INTRINSIC(__int64)
+_InterlockedExchangeAdd64(
+    __int64 volatile *Addend,
+    __int64 Value)
+{
+    return __atomic_fetch_add(Addend, Value, __ATOMIC_SEQ_CST);
+}
+
 _DEFINE_INTRINSIC(long)
 _InterlockedIncrement(
     long *p)
@@ -949,6 +973,88 @@ _mm_mfence(
     );
 }
 
+_DEFINE_INTRINSIC(void)
+_mm_stream_si32(
+    int * _Destination,
+    int _Value)
+{
+    __asm__ __volatile__ (
+        "movnti dword ptr [%0], %1\n\t"
+        :
+        : "r"(_Destination), "r"(_Value)
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_mm_stream_si64x(
+    __int64 * _Destination,
+    __int64 _Value)
+{
+    __asm__ __volatile__ (
+        "movnti qword ptr [%0], %1\n\t"
+        :
+        : "r"(_Destination), "r"(_Value)
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_ReadWriteBarrier(
+    void)
+{
+    // Compiler barrier only.
+    __asm__ __volatile__ (
+        ""
+        :
+        :
+        : "memory"
+    );
+}
+
+
+
+_DEFINE_INTRINSIC(unsigned char)
+_BitScanForward64(
+    unsigned long *Index,
+    unsigned long long Mask)
+{
+    unsigned long long Result = 0;
+
+    if (!Mask)
+        return 0;
+
+    __asm__ __volatile__ (
+        "bsf %0, %1\n\t"
+        : "=r"(Result)
+        : "rm"(Mask)
+        : "cc"
+    );
+
+    *Index = (unsigned long)Result;
+    return 1;
+}
+
+_DEFINE_INTRINSIC(unsigned char)
+_BitScanReverse64(
+    unsigned long *Index,
+    unsigned long long Mask)
+{
+    unsigned long long Result = 0;
+
+    if (!Mask)
+        return 0;
+
+    __asm__ __volatile__ (
+        "bsr %0, %1\n\t"
+        : "=r"(Result)
+        : "rm"(Mask)
+        : "cc"
+    );
+
+    *Index = (unsigned long)Result;
+    return 1;
+}
 
 
 #if 1
@@ -1088,6 +1194,98 @@ _fxrstor64(void *addr)
     __builtin_ia32_fxrstor64(addr);
 }
 
+_DEFINE_INTRINSIC(void)
+_invpcid(unsigned int type, void *descriptor)
+{
+    __asm__ __volatile__ (
+        "invpcid %0, [%1]\n\t"
+        :
+        : "r"((unsigned __int64)type), "r"(descriptor)
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(unsigned __int64)
+_xgetbv(unsigned int xcr)
+{
+    unsigned long low = 0, high = 0;
+
+    __asm__ __volatile__ (
+        "xgetbv\n\t"
+        : "=a"(low), "=d"(high)
+        : "c"(xcr)
+        :
+    );
+
+    return low | ((unsigned __int64)high << 0x20);
+}
+
+_DEFINE_INTRINSIC(void)
+_xsetbv(unsigned int xcr, unsigned __int64 value)
+{
+    __asm__ __volatile__ (
+        "xsetbv\n\t"
+        :
+        : "c"(xcr), "a"((unsigned long)value), "d"((unsigned long)(value >> 0x20))
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_xsave64(void *addr, unsigned __int64 mask)
+{
+    __asm__ __volatile__ (
+        "xsave64 [%0]\n\t"
+        :
+        : "r"(addr), "a"((unsigned long)mask), "d"((unsigned long)(mask >> 0x20))
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_xsaveopt64(void *addr, unsigned __int64 mask)
+{
+    __asm__ __volatile__ (
+        "xsaveopt64 [%0]\n\t"
+        :
+        : "r"(addr), "a"((unsigned long)mask), "d"((unsigned long)(mask >> 0x20))
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_xsaves64(void *addr, unsigned __int64 mask)
+{
+    __asm__ __volatile__ (
+        "xsaves64 [%0]\n\t"
+        :
+        : "r"(addr), "a"((unsigned long)mask), "d"((unsigned long)(mask >> 0x20))
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_xrstor64(void *addr, unsigned __int64 mask)
+{
+    __asm__ __volatile__ (
+        "xrstor64 [%0]\n\t"
+        :
+        : "r"(addr), "a"((unsigned long)mask), "d"((unsigned long)(mask >> 0x20))
+        : "memory"
+    );
+}
+
+_DEFINE_INTRINSIC(void)
+_xrstors64(void *addr, unsigned __int64 mask)
+{
+    __asm__ __volatile__ (
+        "xrstors64 [%0]\n\t"
+        :
+        : "r"(addr), "a"((unsigned long)mask), "d"((unsigned long)(mask >> 0x20))
+        : "memory"
+    );
+}
+
 
 #endif
 
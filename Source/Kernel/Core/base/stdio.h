@@ -17,6 +17,7 @@
 extern void *memset(void *dest, int v, size_t size);
 extern int memcmp(const void *s1, const void *s2, size_t size);
 extern void *memcpy(void *dest, const void *src, size_t size);
+extern void *memmove(void *dest, const void *src, size_t size);
 
 
 extern int vsprintf(char *buffer, const char *format, va_list argptr);
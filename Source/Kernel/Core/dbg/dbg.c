@@ -1,8 +1,10 @@
 
 #include <base/base.h>
 #include <init/bootgfx.h>
+#include <hal/uart.h>
 
 PDBG_TRACE_ROUTINE DbgpTrace = NULL;
+PDBG_TRACE_ROUTINE DbgpTraceSynchronous = NULL;
 DBG_TRACE_LEVEL DbgPrintTraceLevel = TraceLevelDebug;
 
 U16 DbgSerialPortBase[] =
@@ -45,17 +47,21 @@ DbgpNormalTraceSerialN(
     if (TraceLevel < DbgPrintTraceLevel)
         return FALSE;
 
-    U16 Base = DbgSerialPortBase[0]; // COM1
-
-    for (SIZE_T i = 0; i < Length; i++)
-    {
-        // while(!LINE_STATUS.TransmitEmpty)
-        while(!(__inbyte(Base + COM_IO_LINE_STATUS) & 0x20));
+    // Queued to COM1 without waiting for the line.
+    return HalUartWrite(TraceMessage, Length);
+}
 
-        __outbyte(Base + COM_IO_DATA, TraceMessage[i]);
-    }
+BOOLEAN
+KERNELAPI
+DbgpNormalTraceSerialSynchronousN(
+    IN DBG_TRACE_LEVEL TraceLevel,
+    IN CHAR8 *TraceMessage, 
+    IN SIZE_T Length)
+{
+    if (TraceLevel < DbgPrintTraceLevel)
+        return FALSE;
 
-    return TRUE;
+    return HalUartWriteSynchronous(TraceMessage, Length);
 }
 
 BOOLEAN
@@ -68,6 +74,12 @@ DbgTraceN(
     if (!DbgpTrace)
         return FALSE;
 
+    if (TraceLevel < DbgPrintTraceLevel)
+        return FALSE;
+
+    if (DbgLogWrite(DBG_LOG_SINK_TRACE, TraceLevel, 0, 0, TraceMessage, Length))
+        return TRUE;
+
     return DbgpTrace(TraceLevel, TraceMessage, Length);
 }
 
@@ -85,10 +97,17 @@ DbgTraceF(
     if (!DbgpTrace)
         return FALSE;
 
+    // Skip formatting if not printed.
+    if (TraceLevel < DbgPrintTraceLevel)
+        return FALSE;
+
     va_start(Args, Format);
     Length = ClStrFormatU8V(Buffer, ARRAY_SIZE(Buffer), Format, Args);
     va_end(Args);
 
+    if (DbgLogWrite(DBG_LOG_SINK_TRACE, TraceLevel, 0, 0, Buffer, Length))
+        return TRUE;
+
     return DbgpTrace(TraceLevel, Buffer, Length);
 }
 
@@ -101,32 +120,41 @@ DbgTrace(
     return DbgTraceN(TraceLevel, TraceMessage, strlen(TraceMessage));
 }
 
+/**
+ * @brief Writes the trace message bypassing the log thread and the transmit ring.\n
+ *        Waits until the message is written, so that bulk output is not dropped.
+ * 
+ * @param [in] TraceLevel       Trace level.
+ * @param [in] TraceMessage     Message to write.
+ * @param [in] Length           Length of message.
+ * 
+ * @return TRUE if written, FALSE otherwise.
+ */
+BOOLEAN
+KERNELAPI
+DbgTraceSynchronousN(
+    IN DBG_TRACE_LEVEL TraceLevel,
+    IN CHAR8 *TraceMessage, 
+    IN SIZE_T Length)
+{
+    if (!DbgpTraceSynchronous)
+        return FALSE;
+
+    return DbgpTraceSynchronous(TraceLevel, TraceMessage, Length);
+}
+
 
 VOID
 KERNELAPI
 DbgInitializeSerial(
     VOID)
 {
-    U32 BaudRate = COM_DEFAULT_BAUD;
-    U16 Divisor = (U16)(COM_DEFAULT_BAUD / BaudRate);
+    U16 Base = DbgSerialPortBase[0]; // COM1
 
-    for (UINT i = 0; i < COUNTOF(DbgSerialPortBase); i++)
+    if (!E_IS_SUCCESS(HalUartInitialize(Base, DBG_SERIAL_BAUD_RATE)))
     {
-        // Interrupt disabled
-        U16 Base = DbgSerialPortBase[i];
-
-        __outbyte(Base + COM_IO_IER, 0x00);
-
-        // DLAB=1 (MSB of LINECTL)
-        __outbyte(Base + COM_IO_LINE_CTL, 0x80);
-        __outbyte(Base + COM_IO_DIVISOR_LOW, (U8)(Divisor & 0xff));
-        __outbyte(Base + COM_IO_DIVISOR_HIGH, (U8)(Divisor >> 0x08));
-
-        // LINECTL -> Parity none(??xx0), 1 stop bit(0), 8-bit(11) -> ??xx0011
-        __outbyte(Base + COM_IO_LINE_CTL, 0x03);
-
-        // DTR/RTS set
-        __outbyte(Base + COM_IO_MODEM_CTL, 0x03);
+        // Falls back to the default baud rate.
+        HalUartInitialize(Base, COM_DEFAULT_BAUD);
     }
 }
 
@@ -138,8 +166,10 @@ DbgInitialize(
 {
 #if KERNEL_BUILD_TARGET_EMULATOR
     DbgpTrace = DbgpNormalTraceN;
+    DbgpTraceSynchronous = DbgpNormalTraceN;
 #else
     DbgpTrace = DbgpNormalTraceSerialN;
+    DbgpTraceSynchronous = DbgpNormalTraceSerialSynchronousN;
 #endif
 
     DbgPrintTraceLevel = DefaultTraceLevel;
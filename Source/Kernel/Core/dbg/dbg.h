@@ -30,6 +30,31 @@ typedef enum _DBG_TRACE_LEVEL
 
 #define COM_DEFAULT_BAUD            115200L
 
+#ifndef DBG_SERIAL_BAUD_RATE
+#define DBG_SERIAL_BAUD_RATE        COM_DEFAULT_BAUD    //!< Baud rate of the trace port. Up to COM_DEFAULT_BAUD.
+#endif
+
+//
+// Asynchronous log.
+// Trace and boot graphics output are queued to the per-processor ring and written by the log thread.
+// Output is synchronous until the log thread is started, and after DbgFlushLogPanic() is called.
+// Log thread sleeps until the first message is queued to a drained ring. Writer which cannot
+// signal the thread (interrupts disabled or IRQL_CONTEXT_SWITCH and above) leaves it pending to
+// the next writer or to the next processor entering idle.
+//
+
+#ifndef DBG_ASYNC_LOG
+#define DBG_ASYNC_LOG               1           //!< Queue the output to the log thread.
+#endif
+
+#define DBG_LOG_RING_SIZE           0x4000      //!< Ring size per processor. Must be power of 2.
+#define DBG_LOG_MESSAGE_MAX         512         //!< Longer message is truncated.
+#define DBG_LOG_BATCH_SIZE          0x1000      //!< Maximum output per write.
+#define DBG_LOG_PANIC_SPIN_COUNT    0x1000000   //!< Spins waiting for the log thread on panic.
+
+#define DBG_LOG_SINK_TRACE          0x01        //!< Debug trace (serial port or debug port).
+#define DBG_LOG_SINK_SCREEN         0x02        //!< Boot graphics.
+
 
 
 
@@ -71,6 +96,13 @@ DbgTrace(
 	IN DBG_TRACE_LEVEL TraceLevel,
 	IN CHAR8 *TraceMessage);
 
+BOOLEAN
+KERNELAPI
+DbgTraceSynchronousN(
+	IN DBG_TRACE_LEVEL TraceLevel,
+	IN CHAR8 *TraceMessage,
+	IN SIZE_T Length);
+
 #if 0
 VOID
 KERNELAPI
@@ -86,10 +118,36 @@ DbgFootprint(
 
 #define DFOOTPRN(_x)        DbgFootprint((_x), 0xff0000 >> (_x))
 
+BOOLEAN
+KERNELAPI
+DbgLogWrite(
+    IN U8 Sink,
+    IN DBG_TRACE_LEVEL TraceLevel,
+    IN U32 TextColor,
+    IN U32 BackgroundColor,
+    IN CHAR8 *Text,
+    IN SIZE_T Length);
+
+VOID
+KERNELAPI
+DbgStartLogThread(
+    VOID);
+
+VOID
+KERNELAPI
+DbgSignalLogThread(
+    VOID);
+
+VOID
+KERNELAPI
+DbgFlushLogPanic(
+    VOID);
+
 
 
 #define	DASSERT(_expr)	{	\
 	if(!(_expr))	{	\
+		DbgFlushLogPanic();	\
 		DbgTraceF(TraceLevelDebug,	\
 			"\n"	\
 			" ========= Debug Assertion Failed ========= \n"	\
@@ -0,0 +1,462 @@
+/**
+ * @file dbglog.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements asynchronous log for debug trace and boot graphics.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * @note Each processor appends messages to its own ring with interrupts disabled, so the ring
+ *       has single producer and needs no lock. Log thread is the only consumer.\n
+ *       Messages are tagged with the global sequence number and the log thread merges
+ *       the rings in sequence order. Messages are dropped (and counted) if the ring is full.
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <mm/mm.h>
+#include <mm/pool.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/process.h>
+#include <ke/sched_balance.h>
+#include <ke/event.h>
+#include <hal/uart.h>
+
+#define DBG_LOG_RECORD_ALIGNMENT            8
+
+typedef struct _DBG_LOG_RECORD
+{
+    U64 Sequence;
+    U16 Length;                 // Length of the text following the record
+    U8 Sink;                    // See DBG_LOG_SINK_XXX.
+    U8 TraceLevel;
+    U32 TextColor;
+    U32 BackgroundColor;
+} DBG_LOG_RECORD;
+
+typedef struct _DBG_LOG_RING
+{
+    // Written by the owner processor.
+    volatile U64 Head;
+    U64 Dropped;
+    volatile BOOLEAN FlushRequested;    // Log thread is signaled (or pending) and has not drained yet
+    U8 Reserved1[47];
+
+    // Written by the log thread.
+    volatile U64 Tail;
+    U64 DroppedReported;
+    U8 Reserved2[48];
+
+    U8 Buffer[DBG_LOG_RING_SIZE];
+} DBG_LOG_RING;
+
+C_ASSERT(!(DBG_LOG_RING_SIZE & (DBG_LOG_RING_SIZE - 1)));
+
+DBG_LOG_RING *DbgpLogRings[0x100];
+long long DbgpLogSequence;
+volatile BOOLEAN DbgpLogStarted;
+volatile BOOLEAN DbgpLogPanic;
+volatile long DbgpLogDrainLock;
+volatile long DbgpLogSignalPending;
+KEVENT DbgpLogFlushEvent;
+
+// Consecutive records with same attributes are written at once.
+CHAR8 DbgpLogBatch[DBG_LOG_BATCH_SIZE];
+SIZE_T DbgpLogBatchLength;
+DBG_LOG_RECORD DbgpLogBatchRecord;
+
+
+static
+VOID
+DbgpLogCopyIn(
+    IN DBG_LOG_RING *Ring,
+    IN U64 Position,
+    IN PVOID Source,
+    IN SIZE_T Length)
+{
+    SIZE_T Offset = Position & (DBG_LOG_RING_SIZE - 1);
+    SIZE_T Length1 = DBG_LOG_RING_SIZE - Offset;
+
+    if (Length1 > Length)
+        Length1 = Length;
+
+    memcpy(&Ring->Buffer[Offset], Source, Length1);
+    memcpy(&Ring->Buffer[0], (U8 *)Source + Length1, Length - Length1);
+}
+
+static
+VOID
+DbgpLogCopyOut(
+    IN DBG_LOG_RING *Ring,
+    IN U64 Position,
+    OUT PVOID Destination,
+    IN SIZE_T Length)
+{
+    SIZE_T Offset = Position & (DBG_LOG_RING_SIZE - 1);
+    SIZE_T Length1 = DBG_LOG_RING_SIZE - Offset;
+
+    if (Length1 > Length)
+        Length1 = Length;
+
+    memcpy(Destination, &Ring->Buffer[Offset], Length1);
+    memcpy((U8 *)Destination + Length1, &Ring->Buffer[0], Length - Length1);
+}
+
+/**
+ * @brief Appends the message to the log of current processor.
+ *
+ * @param [in] Sink             Output of the message. See DBG_LOG_SINK_XXX.
+ * @param [in] TraceLevel       Trace level (DBG_LOG_SINK_TRACE only).
+ * @param [in] TextColor        Text color (DBG_LOG_SINK_SCREEN only).
+ * @param [in] BackgroundColor  Background color (DBG_LOG_SINK_SCREEN only).
+ * @param [in] Text             Message.
+ * @param [in] Length           Length of the message.
+ *
+ * @return TRUE if the message is queued or dropped.\n
+ *         FALSE if the log is not available. Caller must write the message synchronously.
+ */
+BOOLEAN
+KERNELAPI
+DbgLogWrite(
+    IN U8 Sink,
+    IN DBG_TRACE_LEVEL TraceLevel,
+    IN U32 TextColor,
+    IN U32 BackgroundColor,
+    IN CHAR8 *Text,
+    IN SIZE_T Length)
+{
+    if (!DbgpLogStarted || DbgpLogPanic)
+    {
+        return FALSE;
+    }
+
+    if (Length > DBG_LOG_MESSAGE_MAX)
+    {
+        Length = DBG_LOG_MESSAGE_MAX;
+    }
+
+    U64 Rflags = __readeflags();
+    _disable();
+
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+    DBG_LOG_RING *Ring = Processor ? DbgpLogRings[Processor->ProcessorId] : NULL;
+
+    if (!Ring)
+    {
+        __writeeflags(Rflags);
+        return FALSE;
+    }
+
+    U64 RecordSize = (sizeof(DBG_LOG_RECORD) + Length + DBG_LOG_RECORD_ALIGNMENT - 1) & ~(U64)(DBG_LOG_RECORD_ALIGNMENT - 1);
+    U64 Head = Ring->Head;
+    U64 Used = Head + RecordSize - Ring->Tail;
+
+    if (Used > DBG_LOG_RING_SIZE)
+    {
+        Ring->Dropped++;
+        __writeeflags(Rflags);
+        return TRUE;
+    }
+
+    // Free space must be checked before writing to it.
+    _ReadWriteBarrier();
+
+    DBG_LOG_RECORD Record;
+    Record.Sequence = _InterlockedIncrement64(&DbgpLogSequence);
+    Record.Length = (U16)Length;
+    Record.Sink = Sink;
+    Record.TraceLevel = (U8)TraceLevel;
+    Record.TextColor = TextColor;
+    Record.BackgroundColor = BackgroundColor;
+
+    DbgpLogCopyIn(Ring, Head, &Record, sizeof(Record));
+    DbgpLogCopyIn(Ring, Head + sizeof(Record), Text, Length);
+
+    // Stores are not reordered with other stores.
+    _ReadWriteBarrier();
+    Ring->Head = Head + RecordSize;
+
+    // Head must be visible before the flag is read. Paired with DbgpLogDrain().
+    _mm_mfence();
+
+    // Wake the log thread on the first message after the ring is drained.
+    // Flag also prevents recursion as KeSetEvent() may write traces.
+    if (!Ring->FlushRequested)
+    {
+        Ring->FlushRequested = TRUE;
+        _InterlockedExchange(&DbgpLogSignalPending, 1);
+    }
+
+    __writeeflags(Rflags);
+
+    DbgSignalLogThread();
+
+    return TRUE;
+}
+
+/**
+ * @brief Wakes the log thread if a writer could not signal it.\n
+ *        Does nothing if interrupts are disabled or IRQL is IRQL_CONTEXT_SWITCH or above.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+DbgSignalLogThread(
+    VOID)
+{
+    if (!DbgpLogStarted || !DbgpLogSignalPending || 
+        !(__readeflags() & RFLAG_IF) || KeGetCurrentIrql() >= IRQL_CONTEXT_SWITCH)
+    {
+        return;
+    }
+
+    if (_InterlockedExchange(&DbgpLogSignalPending, 0))
+    {
+        KeSetEvent(&DbgpLogFlushEvent);
+    }
+}
+
+static
+VOID
+DbgpLogFlushBatch(
+    VOID)
+{
+    if (!DbgpLogBatchLength)
+    {
+        return;
+    }
+
+    if (DbgpLogBatchRecord.Sink == DBG_LOG_SINK_SCREEN)
+    {
+        BootGfxPrintTextColorN(DbgpLogBatch, DbgpLogBatchLength,
+            DbgpLogBatchRecord.TextColor, DbgpLogBatchRecord.BackgroundColor);
+    }
+    else if (DbgpTrace)
+    {
+        DbgpTrace((DBG_TRACE_LEVEL)DbgpLogBatchRecord.TraceLevel, DbgpLogBatch, DbgpLogBatchLength);
+    }
+
+    DbgpLogBatchLength = 0;
+}
+
+static
+VOID
+DbgpLogBatchWrite(
+    IN DBG_LOG_RECORD *Record,
+    IN CHAR8 *Text,
+    IN SIZE_T Length)
+{
+    if (DbgpLogBatchLength &&
+        (DbgpLogBatchRecord.Sink != Record->Sink ||
+        DbgpLogBatchRecord.TraceLevel != Record->TraceLevel ||
+        DbgpLogBatchRecord.TextColor != Record->TextColor ||
+        DbgpLogBatchRecord.BackgroundColor != Record->BackgroundColor ||
+        DbgpLogBatchLength + Length > sizeof(DbgpLogBatch)))
+    {
+        DbgpLogFlushBatch();
+    }
+
+    DbgpLogBatchRecord = *Record;
+    memcpy(&DbgpLogBatch[DbgpLogBatchLength], Text, Length);
+    DbgpLogBatchLength += Length;
+}
+
+/**
+ * @brief Writes all queued messages in sequence order.\n
+ *        Caller must hold DbgpLogDrainLock.
+ */
+static
+VOID
+DbgpLogDrain(
+    VOID)
+{
+    CHAR8 Text[DBG_LOG_MESSAGE_MAX];
+    U32 ProcessorCount = KeGetProcessorCount();
+
+    // Cleared before reading the heads, so a message queued after the scan signals again.
+    for (U32 i = 0; i < ProcessorCount; i++)
+    {
+        if (DbgpLogRings[i])
+        {
+            DbgpLogRings[i]->FlushRequested = FALSE;
+        }
+    }
+
+    _mm_mfence();
+
+    for (;;)
+    {
+        DBG_LOG_RING *NextRing = NULL;
+        DBG_LOG_RECORD NextRecord;
+
+        for (U32 i = 0; i < ProcessorCount; i++)
+        {
+            DBG_LOG_RING *Ring = DbgpLogRings[i];
+            DBG_LOG_RECORD Record;
+
+            if (!Ring || Ring->Tail == Ring->Head)
+            {
+                continue;
+            }
+
+            // Record must be read after the head.
+            _ReadWriteBarrier();
+            DbgpLogCopyOut(Ring, Ring->Tail, &Record, sizeof(Record));
+
+            if (!NextRing || (S64)(Record.Sequence - NextRecord.Sequence) < 0)
+            {
+                NextRing = Ring;
+                NextRecord = Record;
+            }
+        }
+
+        if (!NextRing)
+        {
+            break;
+        }
+
+        U64 Tail = NextRing->Tail;
+        DbgpLogCopyOut(NextRing, Tail + sizeof(NextRecord), Text, NextRecord.Length);
+
+        // Producer may reuse the space from now on.
+        _ReadWriteBarrier();
+        NextRing->Tail = Tail + ((sizeof(NextRecord) + NextRecord.Length +
+            DBG_LOG_RECORD_ALIGNMENT - 1) & ~(U64)(DBG_LOG_RECORD_ALIGNMENT - 1));
+
+        DbgpLogBatchWrite(&NextRecord, Text, NextRecord.Length);
+    }
+
+    DbgpLogFlushBatch();
+
+    for (U32 i = 0; i < ProcessorCount; i++)
+    {
+        DBG_LOG_RING *Ring = DbgpLogRings[i];
+
+        if (Ring && Ring->Dropped != Ring->DroppedReported)
+        {
+            SIZE_T Length = ClStrFormatU8(Text, COUNTOF(Text),
+                "[P%d: %lld log messages dropped]\n", i, Ring->Dropped - Ring->DroppedReported);
+
+            Ring->DroppedReported = Ring->Dropped;
+
+            if (DbgpTrace)
+            {
+                DbgpTrace(TraceLevelWarning, Text, Length);
+            }
+
+            BootGfxPrintTextColorN(Text, Length, BGX_COLOR_LIGHT_RED, 0);
+        }
+    }
+}
+
+U64
+KERNELAPI
+DbgpLogThreadStart(
+    IN PVOID Argument)
+{
+    for (;;)
+    {
+        KeWaitForSingleObject(&DbgpLogFlushEvent.Header, WAIT_TIMEOUT_INFINITE);
+
+        if (DbgpLogPanic)
+        {
+            // Messages are written synchronously from now on.
+            break;
+        }
+
+        if (!_InterlockedExchange(&DbgpLogDrainLock, 1))
+        {
+            DbgpLogDrain();
+            _InterlockedExchange(&DbgpLogDrainLock, 0);
+        }
+    }
+
+    for (;;)
+    {
+        KeWaitForSingleObject(&DbgpLogFlushEvent.Header, WAIT_TIMEOUT_INFINITE);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Starts the log thread. Messages are queued from now on.\n
+ *        Must be called after all processors are started.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+DbgStartLogThread(
+    VOID)
+{
+    U32 ProcessorCount = KeGetProcessorCount();
+
+    for (U32 i = 0; i < ProcessorCount; i++)
+    {
+        DBG_LOG_RING *Ring = (DBG_LOG_RING *)MmAllocatePool(PoolTypeNonPaged,
+            sizeof(DBG_LOG_RING), 0x40, 0);
+        if (!Ring)
+        {
+            FATAL("Failed to allocate log ring");
+        }
+
+        Ring->Head = 0;
+        Ring->Dropped = 0;
+        Ring->FlushRequested = FALSE;
+        Ring->Tail = 0;
+        Ring->DroppedReported = 0;
+
+        DbgpLogRings[i] = Ring;
+    }
+
+    DASSERT(E_IS_SUCCESS(KeInitializeEvent(&DbgpLogFlushEvent, SynchronizationEvent, FALSE)));
+
+    KTHREAD *Thread = KiCreateThread(1, &DbgpLogThreadStart, NULL, "DbgLog");
+    DASSERT(Thread);
+    DASSERT(E_IS_SUCCESS(KiSetupInitialContextThread(Thread, 0, (PVOID)__readcr3())));
+    DASSERT(E_IS_SUCCESS(KiInsertThread(&KiSystemProcess, Thread)));
+
+    _mm_mfence();
+    DbgpLogStarted = TRUE;
+
+    DASSERT(KiSchedInsertThreadToProcessor(KiSchedSelectProcessor(Thread), Thread, KSCHED_READY_QUEUE));
+}
+
+/**
+ * @brief Writes queued messages and switches to synchronous output.\n
+ *        Called before the system stops, so that the last messages are not lost.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+DbgFlushLogPanic(
+    VOID)
+{
+    if (DbgpLogStarted && !DbgpLogPanic)
+    {
+        DbgpLogPanic = TRUE;
+        _mm_mfence();
+
+        // Log thread may be writing messages on other processor.
+        for (U32 i = 0; i < DBG_LOG_PANIC_SPIN_COUNT; i++)
+        {
+            if (!_InterlockedExchange(&DbgpLogDrainLock, 1))
+            {
+                DbgpLogDrain();
+                break;
+            }
+
+            _mm_pause();
+        }
+    }
+
+    // Serial output is polled from now on.
+    HalUartFlushPanic();
+}
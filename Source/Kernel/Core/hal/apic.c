@@ -18,12 +18,68 @@
 #include <hal/ioapic.h>
 
 #define IA32_APIC_BASE              0x1b
+#define IA32_APIC_BASE_X2APIC       0x400       // IA32_APIC_BASE_MSR[10] = x2APIC mode enable
+#define IA32_APIC_BASE_ENABLE       0x800       // IA32_APIC_BASE_MSR[11] = APIC global enable
+#define IA32_TSC_DEADLINE           0x6e0
 
 #define SPIN_WAIT(_condition)   \
     while((_condition)) {       \
         _mm_pause();            \
     }
 
+BOOLEAN HalX2ApicEnabled;
+
+static
+U32
+HalpApicRead(
+    IN PTR ApicBase,
+    IN U32 Register)
+{
+    if (HalX2ApicEnabled)
+        return (U32)__readmsr(X2APIC_MSR(Register));
+
+    return *(U32 volatile *)LAPIC_REG(ApicBase, Register);
+}
+
+static
+VOID
+HalpApicWrite(
+    IN PTR ApicBase,
+    IN U32 Register,
+    IN U32 Value)
+{
+    if (HalX2ApicEnabled)
+        __writemsr(X2APIC_MSR(Register), Value);
+    else
+        *(U32 volatile *)LAPIC_REG(ApicBase, Register) = Value;
+}
+
+static
+VOID
+HalpApicWriteIcr(
+    IN PTR ApicBase,
+    IN ULONG ApicId,
+    IN U32 Low)
+{
+    if (HalX2ApicEnabled)
+    {
+        // WRMSR to ICR is not serializing. Stores before the IPI must be visible to the target.
+        _mm_mfence();
+        __writemsr(X2APIC_MSR_ICR, ((U64)ApicId << 32) | Low);
+        return;
+    }
+
+	U32 volatile *ICR0 = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ICR_LOW);
+	U32 volatile *ICR1 = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ICR_HIGH);
+
+	SPIN_WAIT(*ICR0 & LAPIC_ICR_DELIVER_PENDING);
+
+	*ICR1 = LAPIC_ICR_HIGH_DESTINATION_FIELD(ApicId);
+	*ICR0 = Low;
+
+	SPIN_WAIT(*ICR0 & LAPIC_ICR_DELIVER_PENDING);
+}
+
 
 VOID
 KERNELAPI
@@ -37,7 +93,29 @@ HalApicEnable(
     // IA32_APIC_BASE_MSR[11] = APIC global enable/disable (enable = 1, disable = 0)
     //
 
-    __writemsr(IA32_APIC_BASE, Value | 0x800);
+    __writemsr(IA32_APIC_BASE, Value | IA32_APIC_BASE_ENABLE);
+}
+
+BOOLEAN
+KERNELAPI
+HalApicEnableX2Apic(
+    VOID)
+{
+    int Info[4];
+
+    // CPUID.01H:ECX[21] = x2APIC support
+    __cpuid(Info, 0x00000001);
+    if (!(Info[2] & (1 << 21)))
+    {
+        return FALSE;
+    }
+
+    // Switching from disabled state to x2APIC mode directly is not allowed.
+    U64 Value = __readmsr(IA32_APIC_BASE) | IA32_APIC_BASE_ENABLE;
+    __writemsr(IA32_APIC_BASE, Value);
+    __writemsr(IA32_APIC_BASE, Value | IA32_APIC_BASE_X2APIC);
+
+    return TRUE;
 }
 
 PHYSICAL_ADDRESS
@@ -69,8 +147,11 @@ KERNELAPI
 HalApicGetId(
     IN PTR ApicBase)
 {
-    U32 volatile *ApicId = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ID);
-    return (U8)(((*ApicId) >> 24) & 0xff);
+    // x2APIC ID is 32-bit wide. IDs above 255 are not supported.
+    if (HalX2ApicEnabled)
+        return (U8)__readmsr(X2APIC_MSR(LAPIC_ID));
+
+    return (U8)((HalpApicRead(ApicBase, LAPIC_ID) >> 24) & 0xff);
 }
 
 VOID
@@ -84,17 +165,20 @@ HalApicSetDefaultState(
 
     // Mask all LVT entries.
     // Timer, CMCI, LINT0, LINT1, ERROR, PERFCNT, THERMAL => Masked
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_TIMER) = 0x10000;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_CMCI) = 0x10000;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_LINT0) = 0x10000;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_LINT1) = 0x10000;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ERROR) = 0x10000;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_PERFCNT) = 0x10000;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_THERMAL) = 0x10000;
+    HalpApicWrite(ApicBase, LAPIC_TIMER, 0x10000);
+    HalpApicWrite(ApicBase, LAPIC_CMCI, 0x10000);
+    HalpApicWrite(ApicBase, LAPIC_LINT0, 0x10000);
+    HalpApicWrite(ApicBase, LAPIC_LINT1, 0x10000);
+    HalpApicWrite(ApicBase, LAPIC_ERROR, 0x10000);
+    HalpApicWrite(ApicBase, LAPIC_PERFCNT, 0x10000);
+    HalpApicWrite(ApicBase, LAPIC_THERMAL, 0x10000);
 
 
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_DFR) = ~0;
-    *(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_INITIAL_COUNT) = 0;
+    // DFR does not exist in x2APIC mode.
+    if (!HalX2ApicEnabled)
+        HalpApicWrite(ApicBase, LAPIC_DFR, ~0);
+
+    HalpApicWrite(ApicBase, LAPIC_INITIAL_COUNT, 0);
 
     // We use cr8 (not the TPR register) to change TPR
     //*(U32 volatile *)LAPIC_REG(ApicBase, LAPIC_TPR) = 0;
@@ -107,16 +191,16 @@ HalApicSetSpuriousVector(
     IN BOOLEAN Enable, 
     IN U8 Vector)
 {
-	U32 volatile *Register = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_SPURIOUS_INTV);
+	U32 Register = HalpApicRead(ApicBase, LAPIC_SPURIOUS_INTV);
 
 	// LAPIC spurious register
 	// LAPIC_SPURIOUS_INTV_REG[7:0] = Spurious vector
 	// LAPIC_SPURIOUS_INTV_REG[8] = LAPIC enable
 
 	if (Enable)
-		*Register = ((*Register) & ~0xff) | 0x100 | Vector;
+		HalpApicWrite(ApicBase, LAPIC_SPURIOUS_INTV, (Register & ~0xff) | 0x100 | Vector);
 	else
-		*Register &= ~0x100;
+		HalpApicWrite(ApicBase, LAPIC_SPURIOUS_INTV, Register & ~0x100);
 }
 
 VOID
@@ -126,16 +210,35 @@ HalApicSetErrorVector(
     IN BOOLEAN Enable, 
     IN U8 Vector)
 {
-	U32 volatile *Register = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ERROR);
+	U32 Register = HalpApicRead(ApicBase, LAPIC_ERROR);
 
 	// Local APIC error register
 	// LAPIC_ERROR[7:0] = Error vector
 	// LAPIC_ERROR[16] = Masked
 
 	if (Enable)
-		*Register = ((*Register) & ~0xff) | Vector;
+		HalpApicWrite(ApicBase, LAPIC_ERROR, (Register & ~0xff) | Vector);
 	else
-		*Register |= 0x10000;
+		HalpApicWrite(ApicBase, LAPIC_ERROR, Register | 0x10000);
+}
+
+VOID
+KERNELAPI
+HalApicSetPerfCounterVector(
+    IN PTR ApicBase, 
+    IN BOOLEAN Enable, 
+    IN U32 DeliveryMode,
+    IN U8 Vector)
+{
+	// Local APIC performance monitoring counter register
+	// LAPIC_PERFCNT[7:0] = Vector
+	// LAPIC_PERFCNT[10:8] = Delivery mode (000 = Fixed, 100 = NMI)
+	// LAPIC_PERFCNT[16] = Masked (set by processor when the overflow interrupt is delivered)
+
+	if (Enable)
+		HalpApicWrite(ApicBase, LAPIC_PERFCNT, ((DeliveryMode & 0x07) << 8) | Vector);
+	else
+		HalpApicWrite(ApicBase, LAPIC_PERFCNT, 0x10000);
 }
 
 VOID
@@ -145,17 +248,64 @@ HalApicSetTimerVector(
 	IN U32 PeriodicCount, 
 	IN U8 Vector)
 {
-    U32 volatile *DivideConf = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_DIV_CONF);
-    U32 volatile *Timer = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_TIMER);
-    U32 volatile *InitialCount = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_INITIAL_COUNT);
-
     //
     // The timer is started by writing to the initial-count register.
     //
 
-    *DivideConf = (*DivideConf & ~0x0b) | 0x03; // divide by 16
-    *Timer = 0x20000 | Vector; // we'll use periodic mode (APIC.LVT.TMR[18:17] = 01)
-    *InitialCount = PeriodicCount; // start the timer (if PeriodicCount > 0).
+    HalpApicWrite(ApicBase, LAPIC_DIV_CONF, (HalpApicRead(ApicBase, LAPIC_DIV_CONF) & ~0x0b) | 0x03); // divide by 16
+    HalpApicWrite(ApicBase, LAPIC_TIMER, 0x20000 | Vector); // we'll use periodic mode (APIC.LVT.TMR[18:17] = 01)
+    HalpApicWrite(ApicBase, LAPIC_INITIAL_COUNT, PeriodicCount); // start the timer (if PeriodicCount > 0).
+}
+
+VOID
+KERNELAPI
+HalApicSetTimerOneShot(
+    IN PTR ApicBase, 
+	IN U32 Count, 
+	IN U8 Vector)
+{
+    //
+    // Same divider as the periodic mode, so the measured counter can be used as is.
+    //
+
+    HalpApicWrite(ApicBase, LAPIC_DIV_CONF, (HalpApicRead(ApicBase, LAPIC_DIV_CONF) & ~0x0b) | 0x03); // divide by 16
+    HalpApicWrite(ApicBase, LAPIC_TIMER, Vector); // one-shot mode (APIC.LVT.TMR[18:17] = 00)
+    HalpApicWrite(ApicBase, LAPIC_INITIAL_COUNT, Count); // start the timer (if Count > 0).
+}
+
+BOOLEAN
+KERNELAPI
+HalApicIsTscDeadlineSupported(
+    VOID)
+{
+    int Info[4];
+
+    // CPUID.01H:ECX[24] = TSC-deadline mode support
+    __cpuid(Info, 0x00000001);
+    if (!(Info[2] & (1 << 24)))
+    {
+        return FALSE;
+    }
+
+    // TSC must run at a constant rate to convert time to TSC ticks.
+    // CPUID.80000007H:EDX[8] = Invariant TSC
+    __cpuid(Info, 0x80000007);
+    return !!(Info[3] & (1 << 8));
+}
+
+VOID
+KERNELAPI
+HalApicSetTimerDeadline(
+    IN PTR ApicBase, 
+	IN U64 Deadline, 
+	IN U8 Vector)
+{
+    HalpApicWrite(ApicBase, LAPIC_TIMER, 0x40000 | Vector); // TSC-deadline mode (APIC.LVT.TMR[18:17] = 10)
+
+    // The LVT write must be serialized before arming the deadline (SDM 10.5.4.1).
+    _mm_mfence();
+
+    __writemsr(IA32_TSC_DEADLINE, Deadline); // arm the timer (disarmed if Deadline is 0).
 }
 
 VOID
@@ -168,17 +318,17 @@ HalApicSetLINTxVector(
     IN U32 DeliveryMode,
 	IN U8 Vector)
 {
-    U32 volatile *LINT = NULL;
+    U32 LINT = 0;
     if (LINTx == 0)
-        LINT = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_LINT0);
+        LINT = LAPIC_LINT0;
     else if (LINTx == 1)
-        LINT = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_LINT0);
+        LINT = LAPIC_LINT0;
     else
         DASSERT(FALSE);
 
     /* Not masked, Active level, Polarity, Delivery mode, Vector */
-    *LINT = ((!!LevelSensitive) << 16) | ((!!ActiveLow) << 13) | 
-        ((DeliveryMode & 0x07) << 8) | (Vector & 0xff);
+    HalpApicWrite(ApicBase, LINT, ((!!LevelSensitive) << 16) | ((!!ActiveLow) << 13) | 
+        ((DeliveryMode & 0x07) << 8) | (Vector & 0xff));
 }
 
 VOID
@@ -188,11 +338,61 @@ HalApicReadTimerCounter(
     OUT U32 *InitialCounter,
     OUT U32 *CurrentCounter)
 {
-    U32 volatile *InitialCount = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_INITIAL_COUNT);
-    U32 volatile *CurrentCount = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_CURRENT_COUNT);
+    *CurrentCounter = HalpApicRead(ApicBase, LAPIC_CURRENT_COUNT);
+    *InitialCounter = HalpApicRead(ApicBase, LAPIC_INITIAL_COUNT);
+}
+
+VOID
+KERNELAPI
+HalApicSendFixedIpi(
+    IN PTR ApicBase,
+	IN ULONG ApicId, 
+	IN U8 Vector)
+{
+    U32 Low = LAPIC_ICR_VECTOR(Vector) |
+        LAPIC_ICR_DELIVERY_MODE(LAPIC_ICR_DELIVER_FIXED) |
+        LAPIC_ICR_DEST_MODE_PHYSICAL |
+        LAPIC_ICR_LEVEL_ASSERT |
+        LAPIC_ICR_TRIGGERED_EDGE |
+        LAPIC_ICR_DEST_SHORTHAND(LAPIC_ICR_DEST_NO_SHORTHAND);
+
+    // ICR high and low must be written without being interrupted.
+    U64 RFlags = __readeflags();
+    _disable();
+
+	/* No Shorthand, Edge Triggered, Fixed, Physical, Assert */
+    HalpApicWriteIcr(ApicBase, ApicId, Low);
+
+    if (RFlags & RFLAG_IF)
+    {
+        _enable();
+    }
+}
+
+VOID
+KERNELAPI
+HalApicSendIpiShorthand(
+    IN PTR ApicBase,
+	IN U32 Shorthand, 
+	IN U8 Vector)
+{
+    // Destination field is ignored.
+    U32 Low = LAPIC_ICR_VECTOR(Vector) |
+        LAPIC_ICR_DELIVERY_MODE(LAPIC_ICR_DELIVER_FIXED) |
+        LAPIC_ICR_DEST_MODE_PHYSICAL |
+        LAPIC_ICR_LEVEL_ASSERT |
+        LAPIC_ICR_TRIGGERED_EDGE |
+        LAPIC_ICR_DEST_SHORTHAND(Shorthand);
 
-    *CurrentCounter = *CurrentCount;
-    *InitialCounter = *InitialCount;
+    U64 RFlags = __readeflags();
+    _disable();
+
+    HalpApicWriteIcr(ApicBase, 0, Low);
+
+    if (RFlags & RFLAG_IF)
+    {
+        _enable();
+    }
 }
 
 VOID
@@ -200,8 +400,7 @@ KERNELAPI
 HalApicSendEoi(
 	IN PTR ApicBase)
 {
-	U32 volatile *Register = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_EOI);
-	*Register = 0;
+	HalpApicWrite(ApicBase, LAPIC_EOI, 0);
 }
 
 
@@ -225,15 +424,11 @@ HalApicStartProcessor(
     // NOTE: Processor starting address = (ResetVector * 4096).
     // 
 
-	U32 volatile *ICR0 = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ICR_LOW);
-	U32 volatile *ICR1 = (U32 volatile *)LAPIC_REG(ApicBase, LAPIC_ICR_HIGH);
-
 	if (!ResetVector)
 	{
 		FATAL("ResetVector must not be 0!");
 	}
 
-    U32 High = LAPIC_ICR_HIGH_DESTINATION_FIELD(ApicId);
     U32 Low_IIPI = LAPIC_ICR_VECTOR(0) |
         LAPIC_ICR_DELIVERY_MODE(LAPIC_ICR_DELIVER_INIT) |
         LAPIC_ICR_DEST_MODE_PHYSICAL |
@@ -255,17 +450,10 @@ HalApicStartProcessor(
     U64 RFlags = __readeflags();
     _disable();
 
-	// Wait for deliver pending
-    BGXTRACE_DBG("Wait for delivery pending before send INIT IPI\n");
-	SPIN_WAIT(*ICR0 & LAPIC_ICR_DELIVER_PENDING);
-
     // Send INIT IPI.
 	/* No Shorthand, Edge Triggered, INIT, Physical, Assert */
     BGXTRACE_DBG("Send INIT IPI\n");
-	*ICR1 = High;
-	*ICR0 = Low_IIPI;
-    BGXTRACE_DBG("Wait for delivery pending after send INIT IPI\n");
-	SPIN_WAIT(*ICR0 & LAPIC_ICR_DELIVER_PENDING);
+    HalpApicWriteIcr(ApicBase, ApicId, Low_IIPI);
 
     // Wait 10ms.
     BGXTRACE_DBG("Wait for 10ms delay\n");
@@ -275,10 +463,7 @@ HalApicStartProcessor(
 	// Send startup IPI.
 	/* No Shorthand, Edge Triggered, All, Physical, Assert */
     BGXTRACE_DBG("Send STARTUP IPI\n");
-	*ICR1 = High;
-	*ICR0 = Low_SIPI;
-    BGXTRACE_DBG("Wait for delivery pending after send STARTUP IPI\n");
-	SPIN_WAIT(*ICR0 & LAPIC_ICR_DELIVER_PENDING);
+    HalpApicWriteIcr(ApicBase, ApicId, Low_SIPI);
 
     // Wait 200us.
     BGXTRACE_DBG("Wait for 200us delay\n");
@@ -288,10 +473,7 @@ HalApicStartProcessor(
 	// Send startup IPI.
 	/* No Shorthand, Edge Triggered, All, Physical, Assert */
     BGXTRACE_DBG("Send STARTUP IPI\n");
-	*ICR1 = High;
-	*ICR0 = Low_SIPI;
-    BGXTRACE_DBG("Wait for delivery pending after send STARTUP IPI\n");
-	SPIN_WAIT(*ICR0 & LAPIC_ICR_DELIVER_PENDING);
+    HalpApicWriteIcr(ApicBase, ApicId, Low_SIPI);
 
     // Wait 200us.
     BGXTRACE_DBG("Wait for 200us delay\n");
@@ -138,6 +138,22 @@
 #define LAPIC_ICR_HIGH_DESTINATION_FIELD(_v)    ((_v) << (56-32))
 
 
+//
+// x2APIC mode.
+// Registers are accessed with MSRs instead of MMIO, and ICR is written with a single MSR write.
+// Each processor switches to x2APIC mode before its first local APIC access.
+//
+
+#ifndef HAL_X2APIC_ENABLE
+#define HAL_X2APIC_ENABLE                       0       //!< Uses x2APIC mode if supported.
+#endif
+
+#define X2APIC_MSR(_reg)                        (0x800 + ((_reg) >> 4))
+#define X2APIC_MSR_ICR                          X2APIC_MSR(LAPIC_ICR_LOW)   // 64-bit, destination in ICR[63:32]
+
+extern BOOLEAN HalX2ApicEnabled;
+
+
 
 
 VOID
@@ -155,6 +171,11 @@ KERNELAPI
 HalApicSetBase(
     IN PHYSICAL_ADDRESS PhysicalApicBase);
 
+BOOLEAN
+KERNELAPI
+HalApicEnableX2Apic(
+    VOID);
+
 U8
 KERNELAPI
 HalApicGetId(
@@ -179,6 +200,14 @@ HalApicSetErrorVector(
     IN BOOLEAN Enable, 
     IN U8 Vector);
 
+VOID
+KERNELAPI
+HalApicSetPerfCounterVector(
+    IN PTR ApicBase, 
+    IN BOOLEAN Enable, 
+    IN U32 DeliveryMode,
+    IN U8 Vector);
+
 VOID
 KERNELAPI
 HalApicSetTimerVector(
@@ -186,6 +215,25 @@ HalApicSetTimerVector(
 	IN U32 PeriodicCount, 
 	IN U8 Vector);
 
+VOID
+KERNELAPI
+HalApicSetTimerOneShot(
+    IN PTR ApicBase, 
+	IN U32 Count, 
+	IN U8 Vector);
+
+BOOLEAN
+KERNELAPI
+HalApicIsTscDeadlineSupported(
+    VOID);
+
+VOID
+KERNELAPI
+HalApicSetTimerDeadline(
+    IN PTR ApicBase, 
+	IN U64 Deadline, 
+	IN U8 Vector);
+
 VOID
 KERNELAPI
 HalApicSetLINTxVector(
@@ -203,6 +251,20 @@ HalApicReadTimerCounter(
     OUT U32 *InitialCounter,
     OUT U32 *CurrentCounter);
 
+VOID
+KERNELAPI
+HalApicSendFixedIpi(
+    IN PTR ApicBase,
+	IN ULONG ApicId, 
+	IN U8 Vector);
+
+VOID
+KERNELAPI
+HalApicSendIpiShorthand(
+    IN PTR ApicBase,
+	IN U32 Shorthand, 
+	IN U8 Vector);
+
 VOID
 KERNELAPI
 HalApicSendEoi(
@@ -22,6 +22,7 @@
 #include <hal/halinit.h>
 #include <hal/processor.h>
 #include <hal/ptimer.h>
+#include <hal/uart.h>
 
 
 VIRTUAL_ADDRESS HalLowArea1MSpace;
@@ -94,6 +95,12 @@ HalPrepareAPStart(
 
     HalLowArea1MSpace = LowMemoryVirtual;
     HalAPInitPacket = RelocatedPacket;
+
+#if HAL_X2APIC_ENABLE
+    // Local APIC is accessed through HalApicBase after this point.
+    HalX2ApicEnabled = HalApicEnableX2Apic();
+#endif
+
     HalApicBase = ApicVirtualBase;
 }
 
@@ -125,6 +132,15 @@ HalInitialize(
 {
     HalInitializeProcessor();
 
+#if HAL_UART_INTERRUPT_ENABLE
+    // Serial output is written by the THRE interrupt from now on.
+    ESTATUS Status = HalUartEnableInterrupt(ISA_IRQ_SERIAL1);
+    if (!E_IS_SUCCESS(Status))
+    {
+        DbgTraceF(TraceLevelWarning, "Failed to enable UART interrupt (0x%x), output is polled\n", Status);
+    }
+#endif
+
     HalStartProcessors();
 }
 
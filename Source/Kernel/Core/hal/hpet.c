@@ -21,8 +21,6 @@
 #include <hal/acpi.h>
 #include <hal/hpet.h>
 
-extern volatile U64 HalTickCount;
-
 // 
 // HPET driver implementation prerequisites:
 // 1. HPET must support 64-bit wide counter (COUNT_SIZE_CAP = 1).
@@ -306,8 +304,7 @@ HalIsrHighPrecisionTimer(
 
 //    DbgTraceF(TraceLevelDebug, "HPET_ISR: MainCounter 0x%016llx\n", MainCounter);
 
-//    HalTickCount = MainCounter / (0xe8d4a51000ULL / HpetContext->Capabilities.COUNTER_CLK_PERIOD);
-    _InterlockedIncrement64(&HalTickCount);
+    // Tick count is read from the main counter (See HalGetTickCount).
 
     return InterruptAccepted;
 }
@@ -459,7 +456,7 @@ HalpHpetEnable(
     HalHpetWriteRegister64(HpetContext->BaseAddress, HPET_REGISTER_MAIN_COUNTER, 0);
 
     Configuration.TN_INT_TYPE_CNF = 0; // edge-triggered
-    Configuration.TN_INT_ENB_CNF = 1; // interrupt enable
+    Configuration.TN_INT_ENB_CNF = 0; // interrupt disable (tick count is read from the main counter)
     Configuration.TN_TYPE_CNF = 1; // periodic mode
     Configuration.TN_VAL_SET_CNF = 1; // we'll change comparator after write this
     Configuration.TN_32MODE_CNF = 0; // 64-bit mode
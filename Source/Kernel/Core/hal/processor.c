@@ -27,8 +27,16 @@
 #include <hal/ptimer.h>
 #include <hal/processor.h>
 #include <ke/sched.h>
+#include <ke/timer.h>
+#include <ke/tlb.h>
+#include <ke/ipi.h>
+#include <ke/profile.h>
 
 U32 HalMeasuredApicInitialCounter;
+U32 HalMeasuredApicCounterPerMs;
+U64 HalMeasuredTscPerMs;
+BOOLEAN HalTscDeadlineSupported;
+BOOLEAN HalIpiShorthandAllowed;     // All processors are started
 
 /**
  * @brief 64-bit entry of AP start code.
@@ -40,17 +48,28 @@ KERNELAPI
 HalApplicationProcessorStart(
     VOID)
 {
+    // Local APIC is in xAPIC mode after INIT.
+    if (HalX2ApicEnabled && !HalApicEnableX2Apic())
+    {
+        FATAL("x2APIC is not supported");
+    }
+
     KiInitializeProcessor();
     KiInitializeIrqGroups();
+    KiInitializeTimers();
     KiProcessorSchedInitialize();
     HalInitializeProcessor();
 
     // Acknowledge to BSP that processor is successfully started
     _InterlockedExchange8((volatile char *)&HalAPInitPacket->Status, 4);
 
+#if KE_LOCK_BENCHMARK_AT_BOOT
+    KeSpinlockContentionBenchmark();
+#endif
+
     for(;;)
     {
-        __halt();
+        HalIdleProcessor();
     }
 }
 
@@ -74,6 +93,237 @@ HalIsrSpurious(
     return InterruptAccepted;
 }
 
+/**
+ * @brief Stops the periodic tick and arms the local APIC timer to fire once after IdleTime.\n
+ *        TSC-deadline mode is used if supported, one-shot mode otherwise.\n
+ *        Interrupts must be disabled.
+ * 
+ * @param [in] PrivateData      HAL private data of current processor.
+ * @param [in] IdleTime         Time to sleep (in ms).
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalpStopTick(
+    IN HAL_PRIVATE_DATA *PrivateData,
+    IN U64 IdleTime)
+{
+    if (HalTscDeadlineSupported)
+    {
+        HalApicSetTimerDeadline(HalApicBase, __rdtsc() + IdleTime * HalMeasuredTscPerMs, VECTOR_LVT_TIMER);
+    }
+    else
+    {
+        U64 Count = IdleTime * HalMeasuredApicCounterPerMs;
+        HalApicSetTimerOneShot(HalApicBase, Count > 0xffffffff ? 0xffffffff : (U32)Count, VECTOR_LVT_TIMER);
+    }
+
+    PrivateData->TickStoppedStart = HalGetTickCount();
+    PrivateData->TickStoppedCount++;
+}
+
+/**
+ * @brief Restarts the periodic tick stopped by HalpStopTick().\n
+ *        Interrupts must be disabled.
+ * 
+ * @param [in] PrivateData      HAL private data of current processor.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalpRestartTick(
+    IN HAL_PRIVATE_DATA *PrivateData)
+{
+    // Switching back to periodic mode also disarms the TSC deadline.
+    HalApicSetTimerVector(HalApicBase, HalMeasuredApicInitialCounter, VECTOR_LVT_TIMER);
+
+    PrivateData->TickStoppedTime += HalGetTickCount() - PrivateData->TickStoppedStart;
+    PrivateData->TickStopped = FALSE;
+}
+
+/**
+ * @brief Returns how long the current processor can sleep without the tick.
+ * 
+ * @return Idle time (in ms). 0 if the tick must be kept.
+ */
+U64
+KERNELAPI
+HalpGetIdleTime(
+    VOID)
+{
+    KPROCESSOR *Processor = KeGetCurrentProcessor();
+
+    if (Processor->CurrentThread != Processor->IdleThread || 
+        KiSchedGetLoad(Processor->SchedNormalClass) > 0)
+    {
+        return 0;
+    }
+
+    U64 IdleTime = HAL_TICKLESS_IDLE_MAX_MS;
+    U64 ExpirationTimeAbsolute = 0;
+    ESTATUS Status = KiGetNextTimerExpiration(Processor->TimerWheel, &ExpirationTimeAbsolute);
+
+    if (E_IS_SUCCESS(Status))
+    {
+        U64 TickCount = HalGetTickCount();
+        if (ExpirationTimeAbsolute <= TickCount)
+        {
+            return 0;
+        }
+
+        if (IdleTime > ExpirationTimeAbsolute - TickCount)
+        {
+            IdleTime = ExpirationTimeAbsolute - TickCount;
+        }
+    }
+    else if (Status != E_NOT_FOUND)
+    {
+        // Timer wheel is busy. Just keep the tick.
+        return 0;
+    }
+
+    return IdleTime;
+}
+
+/**
+ * @brief Halts the current processor until the next interrupt.\n
+ *        If there is nothing to run, the periodic tick is stopped until the next timer expiration.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalIdleProcessor(
+    VOID)
+{
+#if DBG_ASYNC_LOG
+    // Messages queued from interrupt handlers may not have signaled the log thread.
+    DbgSignalLogThread();
+#endif
+
+#if HAL_TICKLESS_IDLE
+    HAL_PRIVATE_DATA *PrivateData = HalGetPrivateData();
+
+    _disable();
+
+    //
+    // Publish TickStopped before checking the load.
+    // Paired with HalWakeProcessor() which checks TickStopped after inserting a thread,
+    // so either we see the thread or the waker sees the flag.
+    //
+
+    PrivateData->TickStopped = TRUE;
+    _mm_mfence();
+
+    U64 IdleTime = HalpGetIdleTime();
+
+    if (IdleTime >= HAL_TICKLESS_IDLE_MIN_MS)
+    {
+        HalpStopTick(PrivateData, IdleTime);
+    }
+    else
+    {
+        PrivateData->TickStopped = FALSE;
+    }
+
+    // STI delays interrupts until HLT is executed, so no wakeup can be lost in between.
+    __asm__ __volatile__ ("sti\n\thlt\n\t" : : : "memory");
+
+    //
+    // Woken up by other interrupt than the timer. Restart the tick.
+    //
+
+    _disable();
+
+    if (PrivateData->TickStopped)
+    {
+        HalpRestartTick(PrivateData);
+    }
+
+    _enable();
+#else
+    __halt();
+#endif
+}
+
+/**
+ * @brief Wakes up the processor if it is in tickless idle.\n
+ *        Called after a thread is inserted to the processor.
+ * 
+ * @param [in] ProcessorId      Processor to wake up.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalWakeProcessor(
+    IN U32 ProcessorId)
+{
+#if HAL_TICKLESS_IDLE
+    if (ProcessorId == KeGetCurrentProcessorId())
+    {
+        return;
+    }
+
+    HAL_PRIVATE_DATA *PrivateData = (HAL_PRIVATE_DATA *)KiProcessorBlocks[ProcessorId]->HalPrivateData;
+
+    // Inserted thread must be visible before checking TickStopped.
+    _mm_mfence();
+
+    if (!PrivateData || !PrivateData->TickStopped)
+    {
+        return;
+    }
+
+    // Timer vector restarts the tick and lets the idle thread be preempted.
+    HalApicSendFixedIpi(HalApicBase, KiProcessorIdToApicId[ProcessorId], VECTOR_LVT_TIMER);
+#endif
+}
+
+/**
+ * @brief Sends fixed IPI to the processors.\n
+ *        Broadcast shorthands are used if the target is all processors (excluding current one).\n
+ *        Caller must not be rescheduled to other processor during the call.
+ * 
+ * @param [in] ProcessorMask    Target processors. Each bit represents processor id.
+ * @param [in] Vector           Vector number.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalSendIpi(
+    IN U64 ProcessorMask,
+    IN U8 Vector)
+{
+    // Processors which are not started yet must not receive the vector.
+    if (HalIpiShorthandAllowed)
+    {
+        if (ProcessorMask == KiProcessorMask)
+        {
+            HalApicSendIpiShorthand(HalApicBase, LAPIC_ICR_DEST_ALL_BROADCAST, Vector);
+            return;
+        }
+
+        if (ProcessorMask == (KiProcessorMask & ~AFFINITY_PROCESSOR(KeGetCurrentProcessorId())))
+        {
+            HalApicSendIpiShorthand(HalApicBase, LAPIC_ICR_DEST_BROADCAST_EXPT_SELF, Vector);
+            return;
+        }
+    }
+
+    while (ProcessorMask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, ProcessorMask);
+        ProcessorMask &= ProcessorMask - 1;
+
+        HalApicSendFixedIpi(HalApicBase, KiProcessorIdToApicId[ProcessorId], Vector);
+    }
+}
+
 /**
  * @brief ISR for local APIC timer interrupt.
  * 
@@ -90,11 +340,74 @@ HalApicIsrTimer(
     IN PVOID InterruptContext,
     IN PVOID InterruptStackFrame)
 {
-    // Select and switch to the next thread.
+    HAL_PRIVATE_DATA *PrivateData = HalGetPrivateData();
+
+    // Tickless idle is over. Restart the tick before switching to other thread.
+    if (PrivateData->TickStopped)
+    {
+        HalpRestartTick(PrivateData);
+    }
+
+    KiExpireTimers();
+
     KSTACK_FRAME_INTERRUPT *InterruptFrame = (KSTACK_FRAME_INTERRUPT *)InterruptStackFrame;
+
+#if KE_PROFILE
+    // Sample the interrupted context before it is switched out.
+    if (KiProfileSource == ProfileSourceTimer)
+    {
+        KiProfileSample(InterruptFrame);
+    }
+#endif
+
+    // Select and switch to the next thread.
     KiScheduleSwitchContext(InterruptFrame);
 
-    HalGetPrivateData()->ApicTickCount++;
+    PrivateData->ApicTickCount++;
+    HalApicSendEoi(HalApicBase);
+    return InterruptAccepted;
+}
+
+/**
+ * @brief ISR for TLB shootdown IPI.
+ * 
+ * @param [in] Interrupt            Interrupt object.
+ * @param [in] InterruptContext     Interrupt context.
+ * @param [in] InterruptStackFrame  Interrupt stack frame.
+ * 
+ * @return Always InterruptAccepted.
+ */
+KINTERRUPT_RESULT
+KERNELAPI
+HalIsrIpiTlbShootdown(
+    IN PKINTERRUPT Interrupt,
+    IN PVOID InterruptContext,
+    IN PVOID InterruptStackFrame)
+{
+    KiProcessTlbShootdown();
+
+    HalApicSendEoi(HalApicBase);
+    return InterruptAccepted;
+}
+
+/**
+ * @brief ISR for cross-processor function call IPI.
+ * 
+ * @param [in] Interrupt            Interrupt object.
+ * @param [in] InterruptContext     Interrupt context.
+ * @param [in] InterruptStackFrame  Interrupt stack frame.
+ * 
+ * @return Always InterruptAccepted.
+ */
+KINTERRUPT_RESULT
+KERNELAPI
+HalIsrIpiGenericCall(
+    IN PKINTERRUPT Interrupt,
+    IN PVOID InterruptContext,
+    IN PVOID InterruptStackFrame)
+{
+    KiProcessIpiCalls();
+
     HalApicSendEoi(HalApicBase);
     return InterruptAccepted;
 }
@@ -197,6 +510,8 @@ HalStartProcessors(
         Apic = HalAcpiGetNextProcessor(Madt, Apic);
     }
 
+    // All processors which can receive broadcast IPI are started.
+    HalIpiShorthandAllowed = TRUE;
 }
 
 /**
@@ -371,6 +686,26 @@ HalRegisterApicInterrupt(
         FATAL("Failed to allocate/register IRQ for APIC");
     }
 
+    Status = HalRegisterInterrupt(
+        &PrivateData->InterruptObjects.IpiTlbShootdown,
+        &HalIsrIpiTlbShootdown,
+        NULL, IRQL_IPI, VECTOR_IPI_TLB_SHOOTDOWN, NULL);
+
+    if (!E_IS_SUCCESS(Status))
+    {
+        FATAL("Failed to allocate/register IRQ for TLB shootdown");
+    }
+
+    Status = HalRegisterInterrupt(
+        &PrivateData->InterruptObjects.IpiGenericCall,
+        &HalIsrIpiGenericCall,
+        NULL, IRQL_IPI, VECTOR_IPI_GENERIC_CALL, NULL);
+
+    if (!E_IS_SUCCESS(Status))
+    {
+        FATAL("Failed to allocate/register IRQ for IPI call");
+    }
+
 
 //    Status = HalRegisterInterrupt(
 //        &PrivateData->InterruptObjects.ApicError,
@@ -436,6 +771,38 @@ HalMeasureApicCounter(
     return AverageCounterDelta;
 }
 
+/**
+ * @brief Measures TSC for given MeasureUnit (in ms).\n
+ * 
+ * @param [in] MeasureUnit      Measure unit in miliseconds.
+ * 
+ * @return Returns TSC delta.
+ */
+U64
+KERNELAPI
+HalMeasureTscCounter(
+    IN U32 MeasureUnit)
+{
+    DASSERT(HalIsBootstrapProcessor());
+
+    // Wait for tick count to be changed so that we start at the tick boundary.
+    U64 Tick = HalGetTickCount() + 1;
+    while (HalGetTickCount() < Tick)
+        _mm_pause();
+
+    U64 TscStart = __rdtsc();
+
+    Tick += MeasureUnit;
+    while (HalGetTickCount() < Tick)
+        _mm_pause();
+
+    U64 TscDelta = __rdtsc() - TscStart;
+
+    DbgTraceF(TraceLevelDebug, "Measured TSC = %lld\n", TscDelta);
+
+    return TscDelta;
+}
+
 /**
  * @brief Initializes the local APIC NMI vector.
  * 
@@ -492,6 +859,10 @@ HalInitializeProcessor(
     //HalApicSetErrorVector(HalApicBase, TRUE, VECTOR_LVT_ERROR);
     HalSetApicNMIVector();
 
+    // Other processors can send TLB shootdown and call IPI from now on.
+    KiEnableTlbShootdown();
+    KiEnableIpiCall();
+
     if (HalIsBootstrapProcessor())
     {
         //
@@ -510,11 +881,22 @@ HalInitializeProcessor(
         // Measure APIC counter before setup.
         //
 
-        HalMeasuredApicInitialCounter = HalMeasureApicCounter(100) / 10 * 2; /* 1 context switch per 20ms */
+        HalMeasuredApicCounterPerMs = HalMeasureApicCounter(100) / 100;
+        HalMeasuredApicInitialCounter = HalMeasuredApicCounterPerMs * HAL_TICK_PERIOD_MS;
         if (!HalMeasuredApicInitialCounter)
         {
             FATAL("Strange APIC counter");
         }
+
+        //
+        // TSC-deadline mode is preferred for tickless idle.
+        //
+
+        if (HalApicIsTscDeadlineSupported())
+        {
+            HalMeasuredTscPerMs = HalMeasureTscCounter(100) / 100;
+            HalTscDeadlineSupported = !!HalMeasuredTscPerMs;
+        }
     }
 
     //
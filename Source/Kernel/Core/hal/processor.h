@@ -11,6 +11,21 @@ VOID
 #define HAL_PROCESSOR_RESET_VECTOR          0x04
 #define HAL_PROCESSOR_RESET_ADDRESS         (HAL_PROCESSOR_RESET_VECTOR << 12)
 
+#define HAL_TICK_PERIOD_MS                  20      //!< Period of the local APIC timer tick (1 context switch per tick).
+
+//
+// Tickless idle.
+// Idle processor stops the periodic tick and sleeps until the next timer expiration.
+// The sleep is bounded so that idle processors still steal work from busy ones.
+//
+
+#ifndef HAL_TICKLESS_IDLE
+#define HAL_TICKLESS_IDLE                   1
+#endif
+
+#define HAL_TICKLESS_IDLE_MIN_MS            (HAL_TICK_PERIOD_MS * 2)    //!< Tick is kept for shorter sleep.
+#define HAL_TICKLESS_IDLE_MAX_MS            250                         //!< Maximum sleep without tick.
+
 typedef struct _HAL_PRIVATE_DATA
 {
     struct
@@ -18,11 +33,18 @@ typedef struct _HAL_PRIVATE_DATA
         KINTERRUPT ApicSpurious;
         KINTERRUPT ApicTimer;
         KINTERRUPT ApicError;
+        KINTERRUPT IpiTlbShootdown;
+        KINTERRUPT IpiGenericCall;
 
         KINTERRUPT PlatformTimer;
     } InterruptObjects;
 
     U64 ApicTickCount;
+
+    volatile BOOLEAN TickStopped;   //!< Periodic tick is stopped by tickless idle.
+    U64 TickStoppedStart;           //!< Tick count when the tick was stopped.
+    U64 TickStoppedCount;           //!< Number of tickless idle entries.
+    U64 TickStoppedTime;            //!< Total time spent in tickless idle (in ms).
 } HAL_PRIVATE_DATA;
 
 
@@ -56,3 +78,19 @@ VOID
 KERNELAPI
 HalInitializeProcessor(
     VOID);
+
+VOID
+KERNELAPI
+HalIdleProcessor(
+    VOID);
+
+VOID
+KERNELAPI
+HalWakeProcessor(
+    IN U32 ProcessorId);
+
+VOID
+KERNELAPI
+HalSendIpi(
+    IN U64 ProcessorMask,
+    IN U8 Vector);
@@ -27,19 +27,29 @@
 #include <hal/hpet.h>
 
 
-volatile U64 HalTickCount;
+U64 HalCounterPerMs;
 
 /**
- * @brief Returns tick count.
+ * @brief Returns tick count.\n
+ *        Tick count is derived from the platform timer counter, so it keeps running\n
+ *        while the timer interrupts are stopped.
  * 
- * @return 64-bit tick count.
+ * @return 64-bit tick count in milliseconds. 0 if the platform timer is not initialized.
  */
 U64
 KERNELAPI
 HalGetTickCount(
     VOID)
 {
-    return HalTickCount;
+    U64 Counter = 0;
+
+    if (!HalCounterPerMs || 
+        !E_IS_SUCCESS(HalTimerReadCounter(&Counter)))
+    {
+        return 0;
+    }
+
+    return Counter / HalCounterPerMs;
 }
 
 /**
@@ -91,6 +101,18 @@ HalInitializePlatformTimer(
 
     ESTATUS Status = HalHpetInitialize();
 
+    if (E_IS_SUCCESS(Status))
+    {
+        U64 Frequency = 0;
+        Status = HalTimerGetFrequency(&Frequency);
+        HalCounterPerMs = Frequency / 1000;
+
+        if (E_IS_SUCCESS(Status) && !HalCounterPerMs)
+        {
+            Status = E_NOT_SUPPORTED;
+        }
+    }
+
     if (InterruptState)
     {
         _enable();
@@ -0,0 +1,413 @@
+﻿
+/**
+ * @file uart.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements buffered 16550 UART output.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <hal/halinit.h>
+#include <hal/apic.h>
+#include <hal/ioapic.h>
+#include <hal/acpi.h>
+#include <hal/processor.h>
+#include <hal/uart.h>
+
+
+HAL_UART HalpUart;
+
+
+/**
+ * @brief Writes queued bytes to the transmit FIFO if it is empty.\n
+ *        Caller must hold the lock.
+ * 
+ * @param [in] Uart     UART context.
+ * 
+ * @return Number of bytes written.
+ */
+U32
+KERNELAPI
+HalpUartTransmit(
+    IN HAL_UART *Uart)
+{
+    U16 Base = Uart->PortBase;
+    U32 Count = 0;
+
+    if (Uart->Head == Uart->Tail)
+    {
+        return 0;
+    }
+
+    if (!(__inbyte(Base + COM_IO_LINE_STATUS) & COM_LSR_THRE))
+    {
+        // THRE interrupt follows when the FIFO is drained.
+        return 0;
+    }
+
+    while (Count < Uart->FifoDepth && Uart->Head != Uart->Tail)
+    {
+        __outbyte(Base + COM_IO_DATA, Uart->Ring[Uart->Head & (HAL_UART_TX_RING_SIZE - 1)]);
+        Uart->Head++;
+        Count++;
+    }
+
+    return Count;
+}
+
+/**
+ * @brief Writes queued bytes and given buffer by polling.\n
+ *        Caller must hold the lock.
+ * 
+ * @param [in] Uart     UART context.
+ * @param [in] Buffer   Buffer to write.
+ * @param [in] Length   Length of buffer.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalpUartWritePolled(
+    IN HAL_UART *Uart,
+    IN CHAR8 *Buffer,
+    IN SIZE_T Length)
+{
+    U16 Base = Uart->PortBase;
+
+    while (Uart->Head != Uart->Tail)
+    {
+        while (!(__inbyte(Base + COM_IO_LINE_STATUS) & COM_LSR_THRE))
+        {
+            _mm_pause();
+        }
+
+        HalpUartTransmit(Uart);
+    }
+
+    for (SIZE_T i = 0; i < Length; )
+    {
+        while (!(__inbyte(Base + COM_IO_LINE_STATUS) & COM_LSR_THRE))
+        {
+            _mm_pause();
+        }
+
+        // FIFO is empty, fill it at once.
+        for (U32 j = 0; j < Uart->FifoDepth && i < Length; j++, i++)
+        {
+            __outbyte(Base + COM_IO_DATA, Buffer[i]);
+        }
+    }
+}
+
+/**
+ * @brief ISR for UART.
+ * 
+ * @param [in] Interrupt            Interrupt object.
+ * @param [in] InterruptContext     Interrupt context.
+ * @param [in] InterruptStackFrame  Interrupt stack frame.
+ * 
+ * @return Always InterruptAccepted.
+ */
+KINTERRUPT_RESULT
+KERNELAPI
+HalIsrUart(
+    IN PKINTERRUPT Interrupt,
+    IN PVOID InterruptContext,
+    IN PVOID InterruptStackFrame)
+{
+    HAL_UART *Uart = (HAL_UART *)InterruptContext;
+
+    // Reading IIR acknowledges the THRE interrupt.
+    __inbyte(Uart->PortBase + COM_IO_FIFO_CTL);
+
+    BOOLEAN PrevState = FALSE;
+    KeAcquireSpinlockDisableInterrupt(&Uart->Lock, &PrevState);
+
+    Uart->InterruptCount++;
+
+    if (!Uart->Panic)
+    {
+        HalpUartTransmit(Uart);
+    }
+
+    KeReleaseSpinlockRestoreInterrupt(&Uart->Lock, PrevState);
+
+    // EOI after the interrupt source is serviced.
+    HalApicSendEoi(HalApicBase);
+
+    return InterruptAccepted;
+}
+
+/**
+ * @brief Initializes the UART with FIFO enabled.\n
+ *        Output is polled until HalUartEnableInterrupt() is called.
+ * 
+ * @param [in] PortBase     I/O port base of the UART.
+ * @param [in] BaudRate     Baud rate. Must be in range of 2..HAL_UART_BAUD_MAX.
+ * 
+ * @return ESTATUS code.
+ */
+ESTATUS
+KERNELAPI
+HalUartInitialize(
+    IN U16 PortBase,
+    IN U32 BaudRate)
+{
+    HAL_UART *Uart = &HalpUart;
+
+    // Divisor must fit in 16 bits.
+    if (!BaudRate || BaudRate > HAL_UART_BAUD_MAX || 
+        COM_DEFAULT_BAUD / BaudRate > 0xffff)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    if (Uart->Initialized)
+    {
+        return E_ALREADY_EXISTS;
+    }
+
+    U16 Divisor = (U16)(COM_DEFAULT_BAUD / BaudRate);
+
+    // Interrupt disabled
+    __outbyte(PortBase + COM_IO_IER, 0x00);
+
+    // DLAB=1 (MSB of LINECTL)
+    __outbyte(PortBase + COM_IO_LINE_CTL, 0x80);
+    __outbyte(PortBase + COM_IO_DIVISOR_LOW, (U8)(Divisor & 0xff));
+    __outbyte(PortBase + COM_IO_DIVISOR_HIGH, (U8)(Divisor >> 0x08));
+
+    // LINECTL -> Parity none(??xx0), 1 stop bit(0), 8-bit(11) -> ??xx0011
+    __outbyte(PortBase + COM_IO_LINE_CTL, 0x03);
+
+    // Enable and clear FIFO.
+    __outbyte(PortBase + COM_IO_FIFO_CTL, 
+        COM_FCR_ENABLE | COM_FCR_CLEAR_RX | COM_FCR_CLEAR_TX | COM_FCR_TRIGGER_14);
+
+    // 8250/16450 has no FIFO, and 16550 (not A) has broken one.
+    BOOLEAN FifoEnabled = 
+        (__inbyte(PortBase + COM_IO_FIFO_CTL) & COM_IIR_FIFO_ENABLED) == COM_IIR_FIFO_ENABLED;
+
+    // DTR/RTS set
+    __outbyte(PortBase + COM_IO_MODEM_CTL, COM_MCR_DTR | COM_MCR_RTS);
+
+    KeInitializeSpinlock(&Uart->Lock);
+    Uart->PortBase = PortBase;
+    Uart->BaudRate = COM_DEFAULT_BAUD / Divisor;
+    Uart->FifoDepth = FifoEnabled ? HAL_UART_FIFO_DEPTH : 1;
+    Uart->InterruptEnabled = FALSE;
+    Uart->Panic = FALSE;
+    Uart->GSI = 0;
+    Uart->Head = 0;
+    Uart->Tail = 0;
+    Uart->Dropped = 0;
+    Uart->InterruptCount = 0;
+
+    _mm_mfence();
+    Uart->Initialized = TRUE;
+
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Routes the UART interrupt and starts interrupt-driven output.
+ * 
+ * @param [in] IsaIrq       ISA IRQ of the UART.
+ * 
+ * @return ESTATUS code.
+ */
+ESTATUS
+KERNELAPI
+HalUartEnableInterrupt(
+    IN U8 IsaIrq)
+{
+    HAL_UART *Uart = &HalpUart;
+
+    if (!Uart->Initialized || Uart->InterruptEnabled)
+    {
+        return E_NOT_PERFORMED;
+    }
+
+    U8 LegacyGSI = 0;
+    if (!HalLegacyIrqToGSI(IsaIrq, &LegacyGSI))
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    U32 Vector = VECTOR_SERIAL_PORT;
+    ESTATUS Status = HalRegisterInterrupt(&Uart->Interrupt, &HalIsrUart, 
+        Uart, VECTOR_TO_IRQL(Vector), Vector, NULL);
+
+    if (!E_IS_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    U32 GSI = 0;
+    Status = HalAllocateInterruptRedirection(&GSI, 1, LegacyGSI, LegacyGSI + 1);
+    if (!E_IS_SUCCESS(Status))
+    {
+        DASSERT(E_IS_SUCCESS(HalUnregisterInterrupt(&Uart->Interrupt)));
+        return Status;
+    }
+
+    Status = HalSetInterruptRedirection(GSI, Vector, KeGetCurrentProcessorId(), 
+        /* edge-triggered, high active */
+        INTERRUPT_REDIRECTION_FLAG_SET_TRIGGER_MODE | INTERRUPT_REDIRECTION_FLAG_SET_POLARITY);
+
+    if (!E_IS_SUCCESS(Status))
+    {
+        DASSERT(E_IS_SUCCESS(HalFreeInterruptRedirection(GSI, 1)));
+        DASSERT(E_IS_SUCCESS(HalUnregisterInterrupt(&Uart->Interrupt)));
+        return Status;
+    }
+
+    BOOLEAN PrevState = FALSE;
+    KeAcquireSpinlockDisableInterrupt(&Uart->Lock, &PrevState);
+
+    Uart->GSI = GSI;
+
+    // OUT2 connects the interrupt line.
+    __outbyte(Uart->PortBase + COM_IO_MODEM_CTL, COM_MCR_DTR | COM_MCR_RTS | COM_MCR_OUT2);
+    __outbyte(Uart->PortBase + COM_IO_IER, COM_IER_THRE);
+
+    Uart->InterruptEnabled = TRUE;
+
+    KeReleaseSpinlockRestoreInterrupt(&Uart->Lock, PrevState);
+
+    DbgTraceF(TraceLevelDebug, "UART 0x%x: %d baud, FIFO %d bytes, ISA IRQ %d -> GSI %d (vector 0x%02x)\n", 
+        Uart->PortBase, Uart->BaudRate, Uart->FifoDepth, IsaIrq, GSI, Vector);
+
+    return E_SUCCESS;
+}
+
+/**
+ * @brief Queues the buffer to the transmit ring.\n
+ *        Bytes which do not fit in the ring are dropped.
+ * 
+ * @param [in] Buffer   Buffer to write.
+ * @param [in] Length   Length of buffer.
+ * 
+ * @return TRUE if succeeds, FALSE if the UART is not initialized.
+ */
+BOOLEAN
+KERNELAPI
+HalUartWrite(
+    IN CHAR8 *Buffer,
+    IN SIZE_T Length)
+{
+    HAL_UART *Uart = &HalpUart;
+
+    if (!Uart->Initialized)
+    {
+        return FALSE;
+    }
+
+    BOOLEAN PrevState = FALSE;
+    KeAcquireSpinlockDisableInterrupt(&Uart->Lock, &PrevState);
+
+    if (!Uart->InterruptEnabled || Uart->Panic)
+    {
+        HalpUartWritePolled(Uart, Buffer, Length);
+    }
+    else
+    {
+        U64 Free = HAL_UART_TX_RING_SIZE - (Uart->Tail - Uart->Head);
+        SIZE_T Count = Length < Free ? Length : (SIZE_T)Free;
+
+        for (SIZE_T i = 0; i < Count; i++)
+        {
+            Uart->Ring[(Uart->Tail + i) & (HAL_UART_TX_RING_SIZE - 1)] = Buffer[i];
+        }
+
+        Uart->Tail += Count;
+        Uart->Dropped += Length - Count;
+
+        // Starts the transmission if idle. Rest is written by THRE interrupt.
+        HalpUartTransmit(Uart);
+    }
+
+    KeReleaseSpinlockRestoreInterrupt(&Uart->Lock, PrevState);
+
+    return TRUE;
+}
+
+/**
+ * @brief Writes queued bytes and given buffer, waiting for the line.\n
+ *        Used for bulk output which must not be dropped.
+ * 
+ * @param [in] Buffer   Buffer to write.
+ * @param [in] Length   Length of buffer.
+ * 
+ * @return TRUE if succeeds, FALSE if the UART is not initialized.
+ */
+BOOLEAN
+KERNELAPI
+HalUartWriteSynchronous(
+    IN CHAR8 *Buffer,
+    IN SIZE_T Length)
+{
+    HAL_UART *Uart = &HalpUart;
+
+    if (!Uart->Initialized)
+    {
+        return FALSE;
+    }
+
+    BOOLEAN PrevState = FALSE;
+    KeAcquireSpinlockDisableInterrupt(&Uart->Lock, &PrevState);
+
+    HalpUartWritePolled(Uart, Buffer, Length);
+
+    KeReleaseSpinlockRestoreInterrupt(&Uart->Lock, PrevState);
+
+    return TRUE;
+}
+
+/**
+ * @brief Writes all queued bytes and switches to polled output.\n
+ *        Called before the system stops, so that the last output is not lost.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+HalUartFlushPanic(
+    VOID)
+{
+    HAL_UART *Uart = &HalpUart;
+
+    if (!Uart->Initialized || Uart->Panic)
+    {
+        return;
+    }
+
+    BOOLEAN PrevState = FALSE;
+    KeAcquireSpinlockDisableInterrupt(&Uart->Lock, &PrevState);
+
+    Uart->Panic = TRUE;
+    __outbyte(Uart->PortBase + COM_IO_IER, 0x00);
+    HalpUartWritePolled(Uart, NULL, 0);
+
+    KeReleaseSpinlockRestoreInterrupt(&Uart->Lock, PrevState);
+}
+
+/**
+ * @brief Returns the number of bytes dropped as the transmit ring was full.
+ * 
+ * @return Dropped byte count.
+ */
+U64
+KERNELAPI
+HalUartGetDroppedCount(
+    VOID)
+{
+    return HalpUart.Dropped;
+}
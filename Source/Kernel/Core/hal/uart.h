@@ -0,0 +1,99 @@
+﻿
+#pragma once
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/interrupt.h>
+
+//
+// Buffered 16550 UART driver.
+// Output is queued to the transmit ring and written to the FIFO by THRE (Transmitter Holding
+// Register Empty) interrupt, up to the FIFO depth per interrupt. Writer never waits for the
+// line; bytes are dropped and counted instead if the ring is full.
+// Output is polled until the interrupt is enabled, and after HalUartFlushPanic() is called.
+//
+
+#ifndef HAL_UART_INTERRUPT_ENABLE
+#define HAL_UART_INTERRUPT_ENABLE           1           //!< Transmits by THRE interrupt.
+#endif
+
+#define HAL_UART_TX_RING_SIZE               0x4000      //!< Transmit ring size. Must be power of 2.
+#define HAL_UART_FIFO_DEPTH                 16          //!< Transmit FIFO depth of 16550A.
+#define HAL_UART_BAUD_MAX                   COM_DEFAULT_BAUD
+
+//
+// Register bits.
+//
+
+#define COM_IER_THRE                        0x02        // Transmitter holding register empty
+
+#define COM_IIR_NO_PENDING                  0x01        // No interrupt pending
+#define COM_IIR_ID_MASK                     0x0e
+#define COM_IIR_ID_THRE                     0x02
+#define COM_IIR_FIFO_ENABLED                0xc0        // Both set if FIFO is usable (16550A)
+
+#define COM_FCR_ENABLE                      0x01
+#define COM_FCR_CLEAR_RX                    0x02
+#define COM_FCR_CLEAR_TX                    0x04
+#define COM_FCR_TRIGGER_14                  0xc0        // Receive trigger level 14 bytes
+
+#define COM_MCR_DTR                         0x01
+#define COM_MCR_RTS                         0x02
+#define COM_MCR_OUT2                        0x08        // Connects the interrupt line on PC
+
+#define COM_LSR_THRE                        0x20        // Transmit FIFO (or holding register) is empty
+
+typedef struct _HAL_UART
+{
+    U16 PortBase;
+    U32 BaudRate;
+    U32 FifoDepth;                          // Bytes written per THRE
+
+    KSPIN_LOCK Lock;                        // Taken with interrupts disabled
+    BOOLEAN Initialized;
+    volatile BOOLEAN InterruptEnabled;
+    volatile BOOLEAN Panic;                 // Polled output only
+    U32 GSI;
+
+    U64 Head;                               // Next byte to be written to the FIFO
+    U64 Tail;                               // Next byte to be queued
+    U64 Dropped;                            // Bytes dropped as the ring was full
+    U64 InterruptCount;
+
+    KINTERRUPT Interrupt;
+    U8 Ring[HAL_UART_TX_RING_SIZE];
+} HAL_UART;
+
+
+ESTATUS
+KERNELAPI
+HalUartInitialize(
+    IN U16 PortBase,
+    IN U32 BaudRate);
+
+ESTATUS
+KERNELAPI
+HalUartEnableInterrupt(
+    IN U8 IsaIrq);
+
+BOOLEAN
+KERNELAPI
+HalUartWrite(
+    IN CHAR8 *Buffer,
+    IN SIZE_T Length);
+
+BOOLEAN
+KERNELAPI
+HalUartWriteSynchronous(
+    IN CHAR8 *Buffer,
+    IN SIZE_T Length);
+
+VOID
+KERNELAPI
+HalUartFlushPanic(
+    VOID);
+
+U64
+KERNELAPI
+HalUartGetDroppedCount(
+    VOID);
@@ -59,6 +59,46 @@ BootGfxReleaseLock(
         _enable();
 }
 
+VOID
+KERNELAPI
+BootGfxInvalidateRect(
+    IN BOOT_GFX_SCREEN *Screen,
+    IN U32 X,
+    IN U32 Y,
+    IN U32 Width,
+    IN U32 Height)
+{
+    U32 Right = X + Width;
+    U32 Bottom = Y + Height;
+
+    if (Right > Screen->FrameBuffer.HorizontalResolution)
+        Right = Screen->FrameBuffer.HorizontalResolution;
+    if (Bottom > Screen->FrameBuffer.VerticalResolution)
+        Bottom = Screen->FrameBuffer.VerticalResolution;
+
+    if (X >= Right || Y >= Bottom)
+        return;
+
+    if (Screen->DirtyLeft >= Screen->DirtyRight)
+    {
+        Screen->DirtyLeft = X;
+        Screen->DirtyTop = Y;
+        Screen->DirtyRight = Right;
+        Screen->DirtyBottom = Bottom;
+        return;
+    }
+
+    // Grow to the bounding rectangle.
+    if (X < Screen->DirtyLeft)
+        Screen->DirtyLeft = X;
+    if (Y < Screen->DirtyTop)
+        Screen->DirtyTop = Y;
+    if (Right > Screen->DirtyRight)
+        Screen->DirtyRight = Right;
+    if (Bottom > Screen->DirtyBottom)
+        Screen->DirtyBottom = Bottom;
+}
+
 BOOLEAN
 KERNELAPI
 BootFonCharBlt(
@@ -66,6 +106,8 @@ BootFonCharBlt(
 	IN U8 *Bits, // size: ((CharWidth + 7) >> 3) * CharHeight
 	IN U32 CharWidth,
 	IN U32 CharHeight,
+	IN U32 TextColor,
+	IN U32 BackgroundColor,
 	IN BOOLEAN TransparentBackground)
 {
 	if (Screen->TextCursorX >= Screen->TextResolutionX ||
@@ -88,6 +130,8 @@ BootFonCharBlt(
 
 	U32 *BltBuffer = (U32 *)Screen->FrameBuffer.FrameBufferCopy;
 
+	BootGfxInvalidateRect(Screen, X, Y, CharWidth, CharHeight);
+
 	for (U32 i = 0; i < u; i++) // x
 	{
 		for (U32 j = 0; j < v; j++) // y
@@ -112,9 +156,9 @@ BootFonCharBlt(
 				}
 
 				if (b & (1 << (7 - k)))
-					BltBuffer[DestX + DestY * Screen->FrameBuffer.ScanLineWidth] = (Screen->TextColor & 0xffffff);
+					BltBuffer[DestX + DestY * Screen->FrameBuffer.ScanLineWidth] = (TextColor & 0xffffff);
 				else if (!TransparentBackground)
-					BltBuffer[DestX + DestY * Screen->FrameBuffer.ScanLineWidth] = (Screen->TextBackgroundColor & 0xffffff);
+					BltBuffer[DestX + DestY * Screen->FrameBuffer.ScanLineWidth] = (BackgroundColor & 0xffffff);
 			}
 		}
 	}
@@ -139,6 +183,8 @@ BootFonPrintTextN(
 	IN PFON_HEADER FontFile,
 	IN CHAR8 *Text, 
 	IN SIZE_T TextLength, 
+	IN U32 TextColor,
+	IN U32 BackgroundColor,
 	IN BOOLEAN TransparentBackground, 
 	OUT SIZE_T *PrintLength)
 {
@@ -237,7 +283,7 @@ BootFonPrintTextN(
 			}
 
 			// Scroll if fails
-			if (!BootFonCharBlt(Screen, Bits, Width, FontFile->PixHeight, TransparentBackground))
+			if (!BootFonCharBlt(Screen, Bits, Width, FontFile->PixHeight, TextColor, BackgroundColor, TransparentBackground))
 				Scroll = TRUE;
 			else
 				i++;
@@ -497,6 +543,8 @@ BootGfxScrollBufferInternal(
 		}
 	}
 
+	BootGfxInvalidateRect(&PiBootGfx.Screen, X1, Y1, SX, SY);
+
 	return TRUE;
 }
 
@@ -505,16 +553,59 @@ KERNELAPI
 BootGfxUpdateScreen(
     IN BOOT_GFX_SCREEN *Screen)
 {
-    UPTR Destination = Screen->FrameBuffer.FrameBuffer;
-    UPTR Source = Screen->FrameBuffer.FrameBufferCopy;
+    if (Screen->DirtyLeft >= Screen->DirtyRight)
+    {
+        return;
+    }
+
+    //
+    // Copy the dirty rectangle only.
+    // Framebuffer is mapped as WC. Non-temporal stores fill the WC buffers without
+    // reading the destination, and keep the copy buffer from being evicted from the cache.
+    //
+
     SIZE_T ScanLineSize = Screen->FrameBuffer.ScanLineWidth * sizeof(U32);
+    SIZE_T Offset = Screen->DirtyTop * ScanLineSize + Screen->DirtyLeft * sizeof(U32);
+    U32 Width = Screen->DirtyRight - Screen->DirtyLeft;
 
-    for (U32 y = 0; y < Screen->FrameBuffer.VerticalResolution; y++)
+    UPTR Destination = Screen->FrameBuffer.FrameBuffer + Offset;
+    UPTR Source = Screen->FrameBuffer.FrameBufferCopy + Offset;
+
+    for (U32 y = Screen->DirtyTop; y < Screen->DirtyBottom; y++)
     {
-        memcpy((void *)Destination, (void *)Source, ScanLineSize);
+        U32 *Destination32 = (U32 *)Destination;
+        U32 *Source32 = (U32 *)Source;
+        U32 Count = Width;
+
+        if (((UPTR)Destination32 & 7) && Count)
+        {
+            _mm_stream_si32((int *)Destination32++, *Source32++);
+            Count--;
+        }
+
+        for (; Count >= 2; Count -= 2)
+        {
+            _mm_stream_si64x((__int64 *)Destination32, (__int64)(Source32[0] | ((U64)Source32[1] << 32)));
+            Destination32 += 2;
+            Source32 += 2;
+        }
+
+        if (Count)
+        {
+            _mm_stream_si32((int *)Destination32, *Source32);
+        }
+
         Destination += ScanLineSize;
         Source += ScanLineSize;
     }
+
+    // Drain the WC buffers.
+    _mm_sfence();
+
+    Screen->DirtyLeft = 0;
+    Screen->DirtyTop = 0;
+    Screen->DirtyRight = 0;
+    Screen->DirtyBottom = 0;
 }
 
 BOOLEAN
@@ -526,10 +617,8 @@ BootGfxScrollBuffer(
 	U32 Width = Screen->TextResolutionX * Screen->TextWidth;
 	U32 Height = Screen->TextResolutionY * Screen->TextHeight;
 
-	BOOLEAN Result = BootGfxScrollBufferInternal(0, 0, Width, Height, ScrollHeight);
-    BootGfxUpdateScreen(Screen);
-
-    return Result;
+	// Caller updates the screen after printing the remaining text.
+	return BootGfxScrollBufferInternal(0, 0, Width, Height, ScrollHeight);
 }
 
 U32
@@ -581,6 +670,9 @@ BootGfxFillBuffer(
 	if (Y1 + SY > ResolutionY)
 		SY = ResolutionY - Y1;
 
+    BOOLEAN PrevState = FALSE;
+    BootGfxAcquireLock(&PiBootGfx.Screen, &PrevState);
+
 	for (v = Y1; v < Y1 + SY; v++)
 	{
 		for (u = X1; u < X1 + SX; u++)
@@ -589,18 +681,51 @@ BootGfxFillBuffer(
 		}
 	}
 
+    BootGfxInvalidateRect(&PiBootGfx.Screen, X1, Y1, SX, SY);
     BootGfxUpdateScreen(&PiBootGfx.Screen);
 
+    BootGfxReleaseLock(&PiBootGfx.Screen, PrevState);
+
 	return TRUE;
 }
 
+/**
+ * @brief Prints the text synchronously with given colors.\n
+ *        Used by the log thread and the panic path.
+ *
+ * @param [in] Text             Text to print.
+ * @param [in] Length           Length of the text.
+ * @param [in] TextColor        Text color.
+ * @param [in] BackgroundColor  Background color.
+ *
+ * @return TRUE if succeeds, FALSE otherwise.
+ */
+BOOLEAN
+KERNELAPI
+BootGfxPrintTextColorN(
+	IN CHAR8 *Text,
+	IN SIZE_T Length,
+	IN U32 TextColor,
+	IN U32 BackgroundColor)
+{
+	SIZE_T PrintLength;
+	return BootFonPrintTextN(&PiBootGfx.Screen, PiBootGfx.BootFont, Text, Length,
+		TextColor, BackgroundColor, FALSE, &PrintLength);
+}
+
 BOOLEAN
 KERNELAPI
 BootGfxPrintText(
 	IN CHAR8 *Text)
 {
-	SIZE_T PrintLength;
-	return BootFonPrintTextN(&PiBootGfx.Screen, PiBootGfx.BootFont, Text, strlen(Text), FALSE, &PrintLength);
+	SIZE_T Length = strlen(Text);
+	U32 TextColor = PiBootGfx.Screen.TextColor;
+	U32 BackgroundColor = PiBootGfx.Screen.TextBackgroundColor;
+
+	if (DbgLogWrite(DBG_LOG_SINK_SCREEN, TraceLevelAll, TextColor, BackgroundColor, Text, Length))
+		return TRUE;
+
+	return BootGfxPrintTextColorN(Text, Length, TextColor, BackgroundColor);
 }
 
 BOOLEAN
@@ -611,14 +736,19 @@ BootGfxPrintTextFormat(
 {
 	CHAR8 Buffer[512];
 	SIZE_T BufferLength;
-	SIZE_T PrintLength;
 	va_list args;
 
+	U32 TextColor = PiBootGfx.Screen.TextColor;
+	U32 BackgroundColor = PiBootGfx.Screen.TextBackgroundColor;
+
 	va_start(args, Format);
 	BufferLength = ClStrFormatU8V(Buffer, ARRAY_SIZE(Buffer), Format, args);
 	va_end(args);
 
-	return BootFonPrintTextN(&PiBootGfx.Screen, PiBootGfx.BootFont, Buffer, BufferLength, FALSE, &PrintLength);
+	if (DbgLogWrite(DBG_LOG_SINK_SCREEN, TraceLevelAll, TextColor, BackgroundColor, Buffer, BufferLength))
+		return TRUE;
+
+	return BootGfxPrintTextColorN(Buffer, BufferLength, TextColor, BackgroundColor);
 }
 
 VOID
@@ -632,6 +762,9 @@ BootGfxFatalStop(
 	SIZE_T PrintLength;
 	va_list args;
 
+	// Write queued messages first. Output is synchronous from now on.
+	DbgFlushLogPanic();
+
 	va_start(args, Format);
 	BufferLength = ClStrFormatU8V(Buffer, ARRAY_SIZE(Buffer), Format, args);
 	va_end(args);
@@ -642,7 +775,7 @@ BootGfxFatalStop(
 
 	BootGfxSetBkColor(0);
 	BootGfxSetTextColor(0xff0000);
-	BootFonPrintTextN(&PiBootGfx.Screen, PiBootGfx.BootFont, Buffer, BufferLength, FALSE, &PrintLength);
+	BootFonPrintTextN(&PiBootGfx.Screen, PiBootGfx.BootFont, Buffer, BufferLength, 0xff0000, 0, FALSE, &PrintLength);
 
 	// System stop.
 	_disable();
@@ -783,6 +916,12 @@ BootGfxInitialize(
 	PiBootGfx.Screen.TextColor = 0xcccccc;
 	PiBootGfx.Screen.TextBackgroundColor = 0x000000;
 
+    // First update overwrites the firmware output.
+    PiBootGfx.Screen.DirtyLeft = 0;
+    PiBootGfx.Screen.DirtyTop = 0;
+    PiBootGfx.Screen.DirtyRight = ModeInfo->HorizontalResolution;
+    PiBootGfx.Screen.DirtyBottom = ModeInfo->VerticalResolution;
+
     PiBootGfx.Screen.Lock = 0;
 
 	DbgTraceF(TraceLevelEvent, "Boot graphics initialized\n");
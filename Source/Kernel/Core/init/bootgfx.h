@@ -174,6 +174,13 @@ typedef struct _BOOT_GFX_SCREEN {
 	U32 TextWidth;
 	U32 TextHeight;
 
+    // Dirty rectangle of FrameBufferCopy which is not copied to the framebuffer yet.
+    // Empty if DirtyLeft >= DirtyRight.
+    U32 DirtyLeft;
+    U32 DirtyTop;
+    U32 DirtyRight; // exclusive
+    U32 DirtyBottom; // exclusive
+
     U32 Lock;
 } BOOT_GFX_SCREEN, *PBOOT_GFX_SCREEN;
 
@@ -256,6 +263,14 @@ KERNELAPI
 BootGfxUpdateScreen(
     IN BOOT_GFX_SCREEN *Screen);
 
+BOOLEAN
+KERNELAPI
+BootGfxPrintTextColorN(
+	IN CHAR8 *Text,
+	IN SIZE_T Length,
+	IN U32 TextColor,
+	IN U32 BackgroundColor);
+
 BOOLEAN
 KERNELAPI
 BootGfxPrintText(
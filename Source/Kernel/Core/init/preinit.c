@@ -102,17 +102,6 @@ PiPreInitialize(
         FATAL("Failed to initialize memory (0x%08x)", Status);
     }
 
-    //
-    // Set framebuffer attributes to WC.
-    // This greatly improves copy speed (compared to UC).
-    //
-
-    MiArchX64SetPageAttribute(MiPML4TBase, MiRPML4TBase, 
-        LoaderBlockTemp->LoaderData.VideoFramebufferBase, 
-        LoaderBlockTemp->LoaderData.VideoFramebufferSize, 
-        ARCH_X64_PAT_WRITE_COMBINING);
-
-
     //
     // Dump XADs.
     //
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <base/base.h>
+
+//
+// Processor affinity.
+// Bit N represents processor N, same as KiProcessorMask. Processor id must be less than 64.
+//
+
+typedef U64                                 KAFFINITY;
+
+#define AFFINITY_ALL                        ((KAFFINITY)-1)
+#define AFFINITY_PROCESSOR(_id)             ((KAFFINITY)1 << (_id))
+#define AFFINITY_CONTAINS(_affinity, _id)   (!!((_affinity) & AFFINITY_PROCESSOR(_id)))
+
@@ -0,0 +1,73 @@
+/**
+ * @file event.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements event object.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/wait.h>
+#include <ke/event.h>
+
+
+ESTATUS
+KeInitializeEvent(
+    OUT KEVENT *Event,
+    IN KEVENT_TYPE Type,
+    IN BOOLEAN InitialState)
+{
+    if (Type != NotificationEvent && 
+        Type != SynchronizationEvent)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    KiInitializeWaitHeader(&Event->Header, 
+        Type == SynchronizationEvent ? WAIT_FLAG_WAKE_ONE : 0, NULL);
+
+    if (InitialState)
+    {
+        Event->Header.State |= WAIT_STATE_SIGNALED;
+    }
+
+    return E_SUCCESS;
+}
+
+VOID
+KeSetEvent(
+    IN KEVENT *Event)
+{
+    KIRQL PrevIrql;
+
+    KiLockWaitHeader(&Event->Header, &PrevIrql);
+
+    if (!TEST_WAIT_SIGNALED(&Event->Header))
+    {
+        KiSignalWaitHeader(&Event->Header);
+    }
+
+    KiUnlockWaitHeader(&Event->Header, PrevIrql);
+}
+
+VOID
+KeResetEvent(
+    IN KEVENT *Event)
+{
+    KIRQL PrevIrql;
+
+    KiLockWaitHeader(&Event->Header, &PrevIrql);
+    Event->Header.State &= ~WAIT_STATE_SIGNALED;
+    KiUnlockWaitHeader(&Event->Header, PrevIrql);
+}
+
+BOOLEAN
+KeReadStateEvent(
+    IN KEVENT *Event)
+{
+    return !!TEST_WAIT_SIGNALED(&Event->Header);
+}
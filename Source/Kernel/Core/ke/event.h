@@ -0,0 +1,34 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/wait.h>
+
+typedef enum _KEVENT_TYPE
+{
+    NotificationEvent,      // Stays signaled until reset. Wakes all waiters.
+    SynchronizationEvent,   // Reset by the waiter which is satisfied. Wakes one waiter.
+} KEVENT_TYPE;
+
+typedef struct _KEVENT
+{
+    KWAIT_HEADER Header;
+} KEVENT;
+
+
+ESTATUS
+KeInitializeEvent(
+    OUT KEVENT *Event,
+    IN KEVENT_TYPE Type,
+    IN BOOLEAN InitialState);
+
+VOID
+KeSetEvent(
+    IN KEVENT *Event);
+
+VOID
+KeResetEvent(
+    IN KEVENT *Event);
+
+BOOLEAN
+KeReadStateEvent(
+    IN KEVENT *Event);
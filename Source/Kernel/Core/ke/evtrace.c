@@ -0,0 +1,309 @@
+/**
+ * @file evtrace.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements binary event tracing.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <mm/pool.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/event.h>
+#include <ke/wait.h>
+#include <ke/ipi.h>
+#include <ke/evtrace.h>
+#include <hal/ptimer.h>
+
+
+volatile U32 KiEventTraceMask;
+
+U64 KiEventTraceStartTsc;
+U64 KiEventTraceStartTick;
+U64 KiEventTraceStopTsc;
+U64 KiEventTraceStopTick;
+
+
+VOID
+KiInitializeEventTrace(
+    IN KPROCESSOR *Processor)
+{
+    // Allocated by the first KeStartEventTrace().
+    Processor->EventTrace = NULL;
+}
+
+VOID
+KiTraceEvent(
+    IN U16 EventId,
+    IN U8 ArgCount,
+    IN U64 Arg0,
+    IN U64 Arg1,
+    IN U64 Arg2,
+    IN U64 Arg3)
+{
+    U64 Rflags = __readeflags();
+    _disable();
+
+    // Checks again as the trace may have been stopped before interrupts are disabled.
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+
+    if (Processor && Processor->EventTrace && (KiEventTraceMask & KTRACE_EVENT_MASK(EventId)))
+    {
+        KTRACE_BUFFER *Buffer = Processor->EventTrace;
+        KTRACE_RECORD *Record = &Buffer->Records[Buffer->Head & (KE_EVENT_TRACE_RECORDS - 1)];
+
+        Record->Timestamp = __rdtsc();
+        Record->EventId = EventId;
+        Record->ProcessorId = Processor->ProcessorId;
+        Record->ArgCount = ArgCount;
+        Record->Reserved = 0;
+        Record->Args[0] = Arg0;
+        Record->Args[1] = Arg1;
+        Record->Args[2] = Arg2;
+        Record->Args[3] = Arg3;
+
+        Buffer->Head++;
+    }
+
+    __writeeflags(Rflags);
+}
+
+VOID
+KERNELAPI
+KiEventTraceBarrier(
+    IN PVOID Context)
+{
+    // Nothing to do. Records are written with interrupts disabled,
+    // so no record is being written on this processor.
+}
+
+static
+SIZE_T
+KiFormatTraceHex(
+    OUT CHAR8 *Buffer,
+    IN U8 *Data,
+    IN SIZE_T Size)
+{
+    static const CHAR8 HexDigits[] = "0123456789abcdef";
+
+    for (SIZE_T i = 0; i < Size; i++)
+    {
+        Buffer[i * 2] = HexDigits[Data[i] >> 4];
+        Buffer[i * 2 + 1] = HexDigits[Data[i] & 0x0f];
+    }
+
+    return Size * 2;
+}
+
+static
+VOID
+VARCALL
+KiWriteTraceLine(
+    IN CHAR8 *Format,
+    ...)
+{
+    va_list Args;
+    CHAR8 Buffer[256];
+    SIZE_T Length;
+
+    va_start(Args, Format);
+    Length = ClStrFormatU8V(Buffer, ARRAY_SIZE(Buffer), Format, Args);
+    va_end(Args);
+
+    DbgTraceSynchronousN(TraceLevelError, Buffer, Length);
+}
+
+/**
+ * @brief Starts recording the events. Records of the previous trace are discarded.
+ *
+ * @param [in] EventMask    Events to be recorded. Each bit represents KTRACE_EVENT_ID.
+ *
+ * @return ESTATUS code.\n
+ *         E_NOT_SUPPORTED if the tracepoints are not compiled in.\n
+ *         E_NOT_ENOUGH_MEMORY if the trace buffers cannot be allocated.
+ */
+ESTATUS
+KERNELAPI
+KeStartEventTrace(
+    IN U32 EventMask)
+{
+#if KE_EVENT_TRACE
+    if (!EventMask || (EventMask & ~KTRACE_EVENT_MASK_ALL))
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    if (KiEventTraceMask)
+    {
+        return E_ALREADY_EXISTS;
+    }
+
+    U64 Mask = KiProcessorMask;
+
+    while (Mask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, Mask);
+        Mask &= Mask - 1;
+
+        KPROCESSOR *Processor = KiProcessorBlocks[ProcessorId];
+
+        // Buffers are kept after the trace is stopped, so they are allocated only once.
+        if (!Processor->EventTrace)
+        {
+            KTRACE_BUFFER *Buffer = (KTRACE_BUFFER *)MmAllocatePool(PoolTypeNonPaged,
+                sizeof(KTRACE_BUFFER), 0x10, 0);
+            if (!Buffer)
+            {
+                return E_NOT_ENOUGH_MEMORY;
+            }
+
+            Processor->EventTrace = Buffer;
+        }
+
+        Processor->EventTrace->Head = 0;
+    }
+
+    KiEventTraceStartTick = HalGetTickCount();
+    KiEventTraceStartTsc = __rdtsc();
+    KiEventTraceStopTick = KiEventTraceStartTick;
+    KiEventTraceStopTsc = KiEventTraceStartTsc;
+
+    _mm_mfence();
+    KiEventTraceMask = EventMask;
+
+    return E_SUCCESS;
+#else
+    return E_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Stops recording the events.\n
+ *        Returns after the records being written on other processors are completed.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeStopEventTrace(
+    VOID)
+{
+    if (!KiEventTraceMask)
+    {
+        return;
+    }
+
+    KiEventTraceMask = 0;
+    KiEventTraceStopTsc = __rdtsc();
+    KiEventTraceStopTick = HalGetTickCount();
+    _mm_mfence();
+
+    KeIpiGenericCall(KiProcessorMask, &KiEventTraceBarrier, NULL, TRUE);
+}
+
+/**
+ * @brief Stops the trace and writes the records to the debug port.\n
+ *        Output waits for the line, so it may take a while on serial port.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeDumpEventTrace(
+    VOID)
+{
+    KeStopEventTrace();
+
+    U64 ElapsedMs = KiEventTraceStopTick - KiEventTraceStartTick;
+    U64 TscPerMs = ElapsedMs ? (KiEventTraceStopTsc - KiEventTraceStartTsc) / ElapsedMs : 0;
+
+    KiWriteTraceLine("\n" KTRACE_DUMP_PREFIX " H %d %d %lld %lld\n",
+        KTRACE_DUMP_VERSION, KeGetProcessorCount(), TscPerMs, KiEventTraceStartTsc);
+
+    //
+    // Thread names for the context switch records.
+    //
+
+    KIRQL PrevIrql;
+    KeAcquireSpinlockRaiseIrql(&KiThreadListLock, IRQL_CONTEXT_SWITCH, &PrevIrql);
+
+    for (DLIST_ENTRY *Link = KiThreadListHead.Next; Link != &KiThreadListHead; Link = Link->Next)
+    {
+        KTHREAD *Thread = CONTAINING_RECORD(Link, KTHREAD, ThreadList);
+        KiWriteTraceLine(KTRACE_DUMP_PREFIX " T %lld %s\n", Thread->ThreadId, Thread->Name);
+    }
+
+    KeReleaseSpinlockLowerIrql(&KiThreadListLock, PrevIrql);
+
+    U64 Mask = KiProcessorMask;
+
+    while (Mask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, Mask);
+        Mask &= Mask - 1;
+
+        KTRACE_BUFFER *Buffer = KiProcessorBlocks[ProcessorId]->EventTrace;
+        if (!Buffer)
+        {
+            continue;
+        }
+
+        U64 Head = Buffer->Head;
+        U64 Start = Head > KE_EVENT_TRACE_RECORDS ? Head - KE_EVENT_TRACE_RECORDS : 0;
+
+        KiWriteTraceLine(KTRACE_DUMP_PREFIX " P %d %lld %lld\n", ProcessorId, Head, Start);
+
+        for (U64 i = Start; i < Head; i++)
+        {
+            KTRACE_RECORD *Record = &Buffer->Records[i & (KE_EVENT_TRACE_RECORDS - 1)];
+            CHAR8 Line[sizeof(KTRACE_DUMP_PREFIX) + 4 + sizeof(KTRACE_RECORD) * 2];
+            SIZE_T Length = 0;
+
+            memcpy(Line, KTRACE_DUMP_PREFIX " R ", sizeof(KTRACE_DUMP_PREFIX) + 2);
+            Length += sizeof(KTRACE_DUMP_PREFIX) + 2;
+
+            // Unused arguments are not written.
+            Length += KiFormatTraceHex(&Line[Length], (U8 *)Record,
+                FIELD_OFFSET(KTRACE_RECORD, Args) + Record->ArgCount * sizeof(U64));
+            Line[Length++] = '\n';
+
+            DbgTraceSynchronousN(TraceLevelError, Line, Length);
+        }
+    }
+
+    KiWriteTraceLine(KTRACE_DUMP_PREFIX " E\n");
+}
+
+/**
+ * @brief Traces all events for KE_EVENT_TRACE_AT_BOOT_MS and dumps them.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeEventTraceAtBoot(
+    VOID)
+{
+    KEVENT Event;
+
+    if (!E_IS_SUCCESS(KeStartEventTrace(KTRACE_EVENT_MASK_ALL)))
+    {
+        return;
+    }
+
+    DASSERT(E_IS_SUCCESS(KeInitializeEvent(&Event, SynchronizationEvent, FALSE)));
+
+    // Nobody signals the event. Just sleep.
+    KeWaitForSingleObject(&Event.Header, KE_EVENT_TRACE_AT_BOOT_MS);
+
+    KeDumpEventTrace();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <base/base.h>
+
+typedef struct _KPROCESSOR          KPROCESSOR;
+
+//
+// Binary event tracing.
+// Each processor records fixed-size records to its own ring with interrupts disabled, so no lock
+// is needed. Ring keeps the latest KE_EVENT_TRACE_RECORDS records (older ones are overwritten).
+// Tracepoint only tests KiEventTraceMask while tracing is stopped.
+// Rings are allocated by the first KeStartEventTrace(), so tracing costs no memory until used.
+//
+// KeDumpEventTrace() writes the records to the debug port as text lines prefixed with
+// KTRACE_DUMP_PREFIX, which can be converted to Chrome trace JSON by Utility/Tools/TraceDecode.
+//
+
+#ifndef KE_EVENT_TRACE
+#define KE_EVENT_TRACE                      1           //!< Compiles the tracepoints in.
+#endif
+
+#ifndef KE_EVENT_TRACE_AT_BOOT
+#define KE_EVENT_TRACE_AT_BOOT              0           //!< Traces all events for a while at boot and dumps them if non-zero.
+#endif
+
+#define KE_EVENT_TRACE_RECORDS              0x1000      //!< Records per processor. Must be power of 2.
+#define KE_EVENT_TRACE_AT_BOOT_MS           1000        //!< Trace duration at boot.
+
+#define KTRACE_DUMP_PREFIX                  "#KTRACE"
+#define KTRACE_DUMP_VERSION                 1
+#define KTRACE_ARGS_MAX                     4
+
+typedef enum _KTRACE_EVENT_ID
+{
+    EventTraceContextSwitch,                // PreviousThreadId, NextThreadId, PreviousWaiting
+    EventTraceInterruptEnter,               // Vector
+    EventTraceInterruptExit,                // Vector
+    EventTracePoolAllocate,                 // Type, Size, Address
+    EventTracePoolFree,                     // Address
+    EventTraceTimerInsert,                  // Timer, ExpirationTimeAbsolute, Interval
+    EventTraceTimerExpire,                  // Timer, ExpirationTimeAbsolute
+    EventTraceXadReclaim,                   // Start, End, Type, PreviousType
+    EventTracePageMap,                      // VirtualAddress, PhysicalAddress, Size, PteFlags
+    EventTraceMaximum,
+} KTRACE_EVENT_ID;
+
+#define KTRACE_EVENT_MASK(_id)              (1U << (_id))
+#define KTRACE_EVENT_MASK_ALL               (KTRACE_EVENT_MASK(EventTraceMaximum) - 1)
+
+typedef struct _KTRACE_RECORD
+{
+    U64 Timestamp;                          // TSC
+    U16 EventId;
+    U8 ProcessorId;
+    U8 ArgCount;
+    U32 Reserved;
+    U64 Args[KTRACE_ARGS_MAX];
+} KTRACE_RECORD;
+
+typedef struct _KTRACE_BUFFER
+{
+    U64 Head;                               // Records written since the trace is started
+    KTRACE_RECORD Records[KE_EVENT_TRACE_RECORDS];
+} KTRACE_BUFFER;
+
+
+extern volatile U32 KiEventTraceMask;
+
+#if KE_EVENT_TRACE
+
+#define KTRACE_EVENT_N(_id, _count, _a0, _a1, _a2, _a3)     do {                        \
+        if (KiEventTraceMask & KTRACE_EVENT_MASK(_id))                                  \
+            KiTraceEvent((_id), (_count), (U64)(_a0), (U64)(_a1), (U64)(_a2), (U64)(_a3)); \
+    } while (0)
+
+#else
+
+#define KTRACE_EVENT_N(_id, _count, _a0, _a1, _a2, _a3)     ((VOID)0)
+
+#endif
+
+#define KTRACE_EVENT1(_id, _a0)                     KTRACE_EVENT_N(_id, 1, _a0, 0, 0, 0)
+#define KTRACE_EVENT2(_id, _a0, _a1)                KTRACE_EVENT_N(_id, 2, _a0, _a1, 0, 0)
+#define KTRACE_EVENT3(_id, _a0, _a1, _a2)           KTRACE_EVENT_N(_id, 3, _a0, _a1, _a2, 0)
+#define KTRACE_EVENT4(_id, _a0, _a1, _a2, _a3)      KTRACE_EVENT_N(_id, 4, _a0, _a1, _a2, _a3)
+
+
+VOID
+KiInitializeEventTrace(
+    IN KPROCESSOR *Processor);
+
+VOID
+KiTraceEvent(
+    IN U16 EventId,
+    IN U8 ArgCount,
+    IN U64 Arg0,
+    IN U64 Arg1,
+    IN U64 Arg2,
+    IN U64 Arg3);
+
+ESTATUS
+KERNELAPI
+KeStartEventTrace(
+    IN U32 EventMask);
+
+VOID
+KERNELAPI
+KeStopEventTrace(
+    VOID);
+
+VOID
+KERNELAPI
+KeDumpEventTrace(
+    VOID);
+
+VOID
+KERNELAPI
+KeEventTraceAtBoot(
+    VOID);
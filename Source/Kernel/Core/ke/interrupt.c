@@ -17,6 +17,7 @@
 #include <ke/irql.h>
 #include <ke/interrupt.h>
 #include <ke/kprocessor.h>
+#include <ke/evtrace.h>
 #include <init/bootgfx.h>
 #include <hal/apic.h>
 
@@ -462,7 +463,16 @@ KeConnectInterrupt(
         return E_INVALID_PARAMETER;
     }
 
-    KIRQ_GROUP *IrqGroup = &KeGetCurrentProcessor()->IrqGroups[Irql];
+    // Interrupt is serviced by the processor which connects it.
+    KPROCESSOR *Processor = KeGetCurrentProcessor();
+
+    if (Interrupt->InterruptAffinity && 
+        !AFFINITY_CONTAINS(Interrupt->InterruptAffinity, Processor->ProcessorId))
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    KIRQ_GROUP *IrqGroup = &Processor->IrqGroups[Irql];
 
     KiAcquireIrqGroupLock(IrqGroup);
 
@@ -477,6 +487,7 @@ KeConnectInterrupt(
 
         _InterlockedExchange8((volatile char *)&Interrupt->InterruptVector, Vector);
         DListInsertAfter(&IrqGroup->Irq[Index].InterruptListHead, &Interrupt->InterruptList);
+        Interrupt->InterruptAffinity = AFFINITY_PROCESSOR(Processor->ProcessorId);
         Interrupt->Connected = TRUE;
     }
 
@@ -549,7 +560,8 @@ KeDisconnectInterrupt(
  * @param [out] Interrupt           Interrupt object.
  * @param [in] InterruptRoutine     Interrupt service routine.
  * @param [in] InterruptContext     Interrupt context.
- * @param [in] Reserved             Reserved for future use.
+ * @param [in] InterruptAffinity    Processors which the interrupt can be connected to.\n
+ *                                  0 means the processor which connects the interrupt.
  * 
  * @return ESTATUS status code.
  */
@@ -559,7 +571,7 @@ KeInitializeInterrupt(
     OUT PKINTERRUPT Interrupt,
     IN PKINTERRUPT_ROUTINE InterruptRoutine,
     IN PVOID InterruptContext,
-    IN U64 Reserved /*InterruptAffinity*/)
+    IN KAFFINITY InterruptAffinity)
 {
     memset(Interrupt, 0, sizeof(*Interrupt));
 
@@ -568,6 +580,7 @@ KeInitializeInterrupt(
     Interrupt->InterruptContext = InterruptContext;
     Interrupt->InterruptRoutine = InterruptRoutine;
     Interrupt->InterruptVector = 0;
+    Interrupt->InterruptAffinity = InterruptAffinity;
     DListInitializeHead(&Interrupt->InterruptList);
 
     return E_SUCCESS;
@@ -591,6 +604,8 @@ KiCallInterruptChain(
     ULONG Index = VECTOR_TO_GROUP_IRQ_INDEX(Vector);
     KIRQ_GROUP *IrqGroup = VECTOR_TO_IRQ_GROUP_POINTER(Vector);
 
+    KTRACE_EVENT1(EventTraceInterruptEnter, Vector);
+
     KiAcquireIrqGroupLock(IrqGroup);
 
     DASSERT(IrqGroup->Irq[Index].Allocated);
@@ -637,6 +652,8 @@ KiCallInterruptChain(
     DASSERT(Dispatched);
     
     KiReleaseIrqGroupLock(IrqGroup);
+
+    KTRACE_EVENT1(EventTraceInterruptExit, Vector);
 }
 
 /**
@@ -655,7 +672,11 @@ KiInitializeIrqGroups(
     {
         KIRQ_GROUP *Group = &IrqGroups[Irql];
 
+        // Statistics instance = (ProcessorId << 8) | Irql
         KeInitializeSpinlock(&Group->GroupLock);
+        KeRegisterSpinlockStatistics(&Group->GroupLock, "IrqGroup", 
+            ((U32)KeGetCurrentProcessorId() << 8) | Irql);
+
         Group->PreviousIrql = IRQL_LOWEST;
         Group->GroupIrql = Irql;
 
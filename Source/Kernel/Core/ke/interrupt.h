@@ -1,6 +1,7 @@
 #pragma once
 
 #include <base/base.h>
+#include <ke/affinity.h>
 
 
 //
@@ -66,6 +67,7 @@
 #define VECTOR_LVT_TIMER                    (IRQL_TO_VECTOR_START(IRQL_CONTEXT_SWITCH) + 0)
 #define VECTOR_LVT_ERROR                    (IRQL_TO_VECTOR_START(IRQL_CONTEXT_SWITCH) + 1)
 #define VECTOR_PLATFORM_TIMER               (IRQL_TO_VECTOR_START(IRQL_DEVICE_1) + 0)
+#define VECTOR_SERIAL_PORT                  (IRQL_TO_VECTOR_START(IRQL_DEVICE_1) + 1)
 
 
 typedef enum _KINTERRUPT_RESULT
@@ -96,7 +98,7 @@ typedef struct _KINTERRUPT
     U8 InterruptVector;                     // Index of IDT[]. (InterruptVector[7:4] = IRQL = TPR[7:4])
     BOOLEAN Connected;                      // TRUE if connected to the interrupt chain
     BOOLEAN AutoEoi;                        // TRUE if InterruptRoutine() handles the EOI.
-//    KAFFINITY InterruptAffinity;
+    KAFFINITY InterruptAffinity;            // Allowed processors. Set to the servicing processor when connected
 //    ULONG32 Flags;
 
     DLIST_ENTRY InterruptList;
@@ -176,7 +178,7 @@ KeInitializeInterrupt(
     OUT PKINTERRUPT Interrupt,
     IN PKINTERRUPT_ROUTINE InterruptRoutine,
     IN PVOID InterruptContext,
-    IN U64 Reserved /*InterruptAffinity*/);
+    IN KAFFINITY InterruptAffinity);
 
 VOID
 KERNELAPI
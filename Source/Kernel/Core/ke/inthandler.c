@@ -22,6 +22,8 @@
 #include <hal/acpi.h>
 #include <hal/apic.h>
 #include <ke/thread.h>
+#include <ke/xstate.h>
+#include <ke/profile.h>
 
 // forward reference.
 VOID
@@ -569,15 +571,23 @@ KiDispatchException(
         // Ensure that interrupt is disabled when handling #NM
         DASSERT(!(__readeflags() & RFLAG_IF));
 
-        // Clear CR0.TS before execute fxrstor64 as it raises #NM
+        // Clear CR0.TS before restore as it raises #NM
         __writecr0(__readcr0() & ~ARCH_X64_CR0_TS);
 
-        // Restore the SSE state.
+        // Restore the extended state.
         KTHREAD *Thread = KeGetCurrentThread();
-        _fxrstor64(&Thread->ThreadContext.FXSTATE);
+        KiRestoreExtendedState(Thread->XState);
         return;
     }
 
+#if KE_PROFILE
+    if (ExceptionId == 2 && KiProfileNmi(Frame))
+    {
+        // Performance counter overflow
+        return;
+    }
+#endif
+
     FATAL(
         " ********** Exception (ID %d, Frame 0x%016llx) **********\n"
         "RAX = 0x%016llx, RBX = 0x%016llx, RCX = 0x%016llx, RDX = 0x%016llx, \n"
@@ -0,0 +1,222 @@
+/**
+ * @file ipi.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements cross-processor function call.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <mm/pool.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/ipi.h>
+#include <hal/processor.h>
+
+
+VOID
+KiInitializeIpiCall(
+    IN KPROCESSOR *Processor)
+{
+    KIPI_CALL_QUEUE *Queue = (KIPI_CALL_QUEUE *)MmAllocatePool(PoolTypeNonPaged,
+        sizeof(KIPI_CALL_QUEUE), 0x10, 0);
+    if (!Queue)
+    {
+        FATAL("Failed to allocate IPI call queue");
+    }
+
+    Queue->Head = NULL;
+    Queue->Ready = FALSE;
+
+    for (U32 i = 0; i < COUNTOF(Queue->Calls); i++)
+    {
+        Queue->Calls[i].Next = NULL;
+        Queue->Calls[i].Routine = NULL;
+        Queue->Calls[i].Context = NULL;
+        Queue->Calls[i].Busy = 0;
+    }
+
+    Processor->IpiCallQueue = Queue;
+}
+
+VOID
+KiEnableIpiCall(
+    VOID)
+{
+    KeGetCurrentProcessor()->IpiCallQueue->Ready = TRUE;
+}
+
+static
+BOOLEAN
+KiPushIpiCall(
+    IN KIPI_CALL_QUEUE *Queue,
+    IN KIPI_CALL *Call)
+{
+    KIPI_CALL *Head;
+
+    do
+    {
+        Head = Queue->Head;
+        Call->Next = Head;
+    } while (_InterlockedCompareExchangePointer((PVOID volatile *)&Queue->Head, Call, Head) != Head);
+
+    // IPI is needed only if the queue was empty.
+    return !Head;
+}
+
+VOID
+KiProcessIpiCalls(
+    VOID)
+{
+    KIPI_CALL_QUEUE *Queue = KeGetCurrentProcessor()->IpiCallQueue;
+
+    if (!Queue || !Queue->Head)
+    {
+        return;
+    }
+
+    U64 Rflags = __readeflags();
+    _disable();
+
+    KIPI_CALL *List = (KIPI_CALL *)_InterlockedExchange64((volatile long long *)&Queue->Head, 0);
+    KIPI_CALL *Call = NULL;
+
+    // Reverse the list to call in the order of arrival.
+    while (List)
+    {
+        KIPI_CALL *Next = List->Next;
+        List->Next = Call;
+        Call = List;
+        List = Next;
+    }
+
+    while (Call)
+    {
+        KIPI_CALL *Next = Call->Next;
+
+        Call->Routine(Call->Context);
+
+        // Sender may reuse the call block from now on.
+        _InterlockedExchange(&Call->Busy, 0);
+        Call = Next;
+    }
+
+    __writeeflags(Rflags);
+}
+
+static
+VOID
+KiWaitIpiCall(
+    IN KIPI_CALL_QUEUE *CurrentQueue,
+    IN KIPI_CALL *Call)
+{
+    while (Call->Busy)
+    {
+        // Serves calls from other processors in case interrupts are disabled.
+        if (CurrentQueue->Ready)
+        {
+            KiProcessIpiCalls();
+        }
+
+        _mm_pause();
+    }
+}
+
+/**
+ * @brief Calls the routine on each of given processors.
+ *
+ * @param [in] ProcessorMask    Target processors. Each bit represents processor id.\n
+ *                              Current processor is called by IPI too if included.
+ * @param [in] Routine          Routine to be called at IRQL_IPI.
+ * @param [in] Context          Context passed to the routine.
+ * @param [in] Wait             If TRUE, waits until all targets return from the routine.\n
+ *                              Otherwise, Context must be valid until the routine is called.
+ *
+ * @return ESTATUS code.\n
+ *         E_INVALID_PARAMETER if no target processor is ready.
+ */
+ESTATUS
+KERNELAPI
+KeIpiGenericCall(
+    IN U64 ProcessorMask,
+    IN PKIPI_ROUTINE Routine,
+    IN PVOID Context,
+    IN BOOLEAN Wait)
+{
+    if (!Routine)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    // Stay on this processor as call blocks are per-processor.
+    KIRQL PrevIrql = KeGetCurrentIrql();
+    if (PrevIrql < IRQL_CONTEXT_SWITCH)
+    {
+        KeRaiseIrql(IRQL_CONTEXT_SWITCH);
+    }
+
+    KIPI_CALL_QUEUE *CurrentQueue = KeGetCurrentProcessor()->IpiCallQueue;
+    U64 TargetMask = 0;
+    U64 IpiMask = 0;
+    U64 Mask = ProcessorMask & KiProcessorMask;
+
+    while (Mask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, Mask);
+        Mask &= Mask - 1;
+
+        KIPI_CALL_QUEUE *Queue = KiProcessorBlocks[ProcessorId]->IpiCallQueue;
+        if (!Queue || !Queue->Ready)
+        {
+            continue;
+        }
+
+        KIPI_CALL *Call = &CurrentQueue->Calls[ProcessorId];
+
+        // Previous call to the processor may not be finished yet.
+        KiWaitIpiCall(CurrentQueue, Call);
+
+        Call->Routine = Routine;
+        Call->Context = Context;
+        Call->Busy = 1;
+
+        if (KiPushIpiCall(Queue, Call))
+        {
+            IpiMask |= AFFINITY_PROCESSOR(ProcessorId);
+        }
+
+        TargetMask |= AFFINITY_PROCESSOR(ProcessorId);
+    }
+
+    if (IpiMask)
+    {
+        HalSendIpi(IpiMask, VECTOR_IPI_GENERIC_CALL);
+    }
+
+    if (Wait)
+    {
+        Mask = TargetMask;
+
+        while (Mask)
+        {
+            unsigned long ProcessorId;
+            _BitScanForward64(&ProcessorId, Mask);
+            Mask &= Mask - 1;
+
+            KiWaitIpiCall(CurrentQueue, &CurrentQueue->Calls[ProcessorId]);
+        }
+    }
+
+    if (PrevIrql < IRQL_CONTEXT_SWITCH)
+    {
+        KeLowerIrql(PrevIrql);
+    }
+
+    return TargetMask ? E_SUCCESS : E_INVALID_PARAMETER;
+}
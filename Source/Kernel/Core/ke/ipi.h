@@ -0,0 +1,62 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/interrupt.h>
+
+typedef struct _KPROCESSOR          KPROCESSOR;
+
+//
+// Cross-processor function call.
+// Each processor has a lock-free call queue. Sender pushes a call block to the queue of each
+// target and sends IPI only if the queue was empty, so calls from several senders are handled
+// by one IPI. Call blocks are owned by the sender (one per target processor), so no allocation
+// is needed. The block is reused after the target has finished the previous call.
+//
+// The routine is called at IRQL_IPI with interrupts disabled, so it must not wait for
+// other processors or acquire locks which are held with interrupts enabled.
+//
+
+#define VECTOR_IPI_GENERIC_CALL             (IRQL_TO_VECTOR_START(IRQL_IPI) + 1)
+
+#define KIPI_PROCESSORS_MAX                 64          //!< Same as the number of bits in KiProcessorMask.
+
+typedef
+VOID
+(KERNELAPI *PKIPI_ROUTINE)(
+    IN PVOID Context);
+
+typedef struct _KIPI_CALL
+{
+    struct _KIPI_CALL *Next;                // Links to call queue of the target
+    PKIPI_ROUTINE Routine;
+    PVOID Context;
+    volatile long Busy;                     // Set until the target returns from the routine
+} KIPI_CALL;
+
+typedef struct _KIPI_CALL_QUEUE
+{
+    KIPI_CALL * volatile Head;              // Pending calls (LIFO)
+    volatile BOOLEAN Ready;                 // IPI handler is connected
+    KIPI_CALL Calls[KIPI_PROCESSORS_MAX];   // Calls sent by this processor, indexed by target
+} KIPI_CALL_QUEUE;
+
+
+VOID
+KiInitializeIpiCall(
+    IN KPROCESSOR *Processor);
+
+VOID
+KiEnableIpiCall(
+    VOID);
+
+VOID
+KiProcessIpiCalls(
+    VOID);
+
+ESTATUS
+KERNELAPI
+KeIpiGenericCall(
+    IN U64 ProcessorMask,
+    IN PKIPI_ROUTINE Routine,
+    IN PVOID Context,
+    IN BOOLEAN Wait);
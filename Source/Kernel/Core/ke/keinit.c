@@ -18,8 +18,10 @@
 #include <ke/thread.h>
 #include <ke/process.h>
 #include <ke/sched.h>
+#include <ke/timer.h>
 #include <mm/mm.h>
 #include <mm/pool.h>
+#include <misc/memtest.h>
 #include <init/bootgfx.h>
 #include <hal/acpi.h>
 #include <hal/apic.h>
@@ -70,6 +72,17 @@ KiInitialize(
 {
     KiTestProcessorFeature();
 
+#if CL_MEMORY_TEST_AT_BOOT
+    if (!ClTestMemoryRoutines())
+    {
+        FATAL("Memory routine self-test failed");
+    }
+#endif
+
+#if CL_MEMORY_BENCHMARK_AT_BOOT
+    ClBenchmarkMemoryRoutines();
+#endif
+
     for (ULONG i = 0; i < 0x100; i++)
     {
         KiApicIdToProcessorId[i] = PROCESSOR_INVALID_MAPPING;
@@ -79,6 +92,7 @@ KiInitialize(
     KiInitializeProcessor();
     KiInitializeIrqGroups();
     KiCreateInitialProcessThreads();
+    KiInitializeTimers();
     KiProcessorSchedInitialize();
 }
 
@@ -15,6 +15,12 @@
 #include <ke/keinit.h>
 #include <ke/interrupt.h>
 #include <ke/kprocessor.h>
+#include <ke/xstate.h>
+#include <ke/pcid.h>
+#include <ke/tlb.h>
+#include <ke/ipi.h>
+#include <ke/evtrace.h>
+#include <ke/profile.h>
 #include <mm/mm.h>
 #include <mm/pool.h>
 #include <init/bootgfx.h>
@@ -259,6 +265,9 @@ KiInitializeProcessor(
     Value &= ~ARCH_X64_CR4_TSD;
     __writecr4(Value);
 
+    // OSXSAVE=1 and XCR0 if XSAVE is supported.
+    KiInitializeExtendedState();
+
 
     //
     // Initialize the PAT.
@@ -392,8 +401,21 @@ KiInitializeProcessor(
     Processor->ProcessorId = ProcessorId;
     Processor->HalPrivateData = NULL;
 
+    Processor->PoolCache = MiAllocateProcessorPoolCache();
+    if (!Processor->PoolCache)
+    {
+        FATAL("Failed to allocate pool cache");
+    }
+
+    // Sets CR4.PCIDE while CR3 is loaded with PCID 0.
+    KiInitializeProcessorPcid(Processor);
+    KiInitializeTlbShootdown(Processor);
+    KiInitializeIpiCall(Processor);
+    KiInitializeEventTrace(Processor);
+    KiInitializeProfile(Processor);
+
     KiProcessorBlocks[ProcessorId] = Processor;
-    KiProcessorMask |= (1 << ProcessorId);
+    KiProcessorMask |= AFFINITY_PROCESSOR(ProcessorId);
     KiProcessorCount++;
 }
 
@@ -415,6 +437,30 @@ KeGetCurrentProcessorId(
     return (U8)ProcessorId;
 }
 
+/**
+ * @brief Returns current processor block if it is ready.\n
+ *        Unlike KeGetCurrentProcessor(), this can be called before the local APIC
+ *        and processor block are initialized (e.g. from the pool allocator).
+ * 
+ * @return Current processor block. NULL if not initialized yet.
+ */
+KPROCESSOR *
+KERNELAPI
+KeTryGetCurrentProcessor(
+    VOID)
+{
+    U16 ProcessorId;
+
+    if (!HalApicBase)
+        return NULL;
+
+    ProcessorId = KiApicIdToProcessorId[HalApicGetId(HalApicBase)];
+    if (ProcessorId >= COUNTOF(KiProcessorBlocks))
+        return NULL;
+
+    return KiProcessorBlocks[ProcessorId];
+}
+
 /**
  * @brief Returns current processor block.
  * 
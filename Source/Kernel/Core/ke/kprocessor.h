@@ -2,6 +2,7 @@
 
 #include <base/base.h>
 #include <ke/irql.h>
+#include <ke/affinity.h>
 
 
 //
@@ -211,6 +212,12 @@ typedef struct _ARCH_X64_XDTR
 
 typedef struct _KTHREAD                     KTHREAD;
 typedef struct _KSCHED_CLASS                KSCHED_CLASS;
+typedef struct _POOL_PROCESSOR_CACHE        POOL_PROCESSOR_CACHE;
+typedef struct _KTIMER_WHEEL                KTIMER_WHEEL;
+typedef struct _KTLB_SHOOTDOWN_QUEUE        KTLB_SHOOTDOWN_QUEUE;
+typedef struct _KIPI_CALL_QUEUE             KIPI_CALL_QUEUE;
+typedef struct _KTRACE_BUFFER               KTRACE_BUFFER;
+typedef struct _KPROFILE_TABLE              KPROFILE_TABLE;
 
 typedef struct _KPROCESSOR
 {
@@ -224,7 +231,22 @@ typedef struct _KPROCESSOR
     KIRQ_GROUP IrqGroups[IRQ_GROUPS_MAX];
 
     KTHREAD *CurrentThread;
+    KTHREAD *IdleThread;
     KSCHED_CLASS *SchedNormalClass;
+    KTIMER_WHEEL *TimerWheel;
+
+    POOL_PROCESSOR_CACHE *PoolCache;
+
+    BOOLEAN PcidEnabled;            // CR4.PCIDE is set
+    BOOLEAN InvpcidSupported;
+    U32 PcidNext;                   // Next PCID to be allocated in current generation
+    U64 PcidGeneration;             // PCIDs of other generations are invalid
+    volatile U64 ActiveAddressSpace; // Page table base loaded in CR3
+
+    KTLB_SHOOTDOWN_QUEUE *TlbShootdown;
+    KIPI_CALL_QUEUE *IpiCallQueue;
+    KTRACE_BUFFER *EventTrace;
+    KPROFILE_TABLE *Profile;
 } KPROCESSOR;
 
 
@@ -263,3 +285,8 @@ KPROCESSOR *
 KERNELAPI
 KeGetCurrentProcessor(
     VOID);
+
+KPROCESSOR *
+KERNELAPI
+KeTryGetCurrentProcessor(
+    VOID);
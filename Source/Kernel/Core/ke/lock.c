@@ -2,7 +2,7 @@
 /**
  * @file lock.c
  * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
- * @brief Implements simple spinlock.
+ * @brief Implements ticket spinlock.
  * @version 0.1
  * @date 201?-??-??
  * 
@@ -14,8 +14,194 @@
 #include <base/base.h>
 #include <ke/ke.h>
 #include <ke/lock.h>
+#include <ke/kprocessor.h>
 #include <init/bootgfx.h>
 
+#if KE_LOCK_STATISTICS
+
+KLOCK_STATISTICS KiLockStatistics[KE_LOCK_STATISTICS_MAX];
+volatile long KiLockStatisticsCount;
+
+/**
+ * @brief Updates the statistics after the spinlock is acquired.
+ * 
+ * @param [in] Lock         Spinlock.
+ * @param [in] SpinStart    TSC when the wait began. 0 if acquired without waiting.
+ * 
+ * @return None.
+ */
+static
+VOID
+KERNELAPI
+KiLockStatisticsAcquired(
+    IN PKSPIN_LOCK Lock,
+    IN U64 SpinStart)
+{
+    KLOCK_STATISTICS *Statistics = Lock->Statistics;
+
+    if (!Statistics)
+    {
+        return;
+    }
+
+    U64 Tsc = __rdtsc();
+
+    Statistics->Acquisitions++;
+    Statistics->AcquireTsc = Tsc;
+
+    if (SpinStart)
+    {
+        U64 SpinCycles = Tsc - SpinStart;
+
+        Statistics->Contentions++;
+        Statistics->SpinCycles += SpinCycles;
+
+        if (Statistics->SpinCyclesMax < SpinCycles)
+            Statistics->SpinCyclesMax = SpinCycles;
+    }
+}
+
+/**
+ * @brief Updates the statistics before the spinlock is released.
+ * 
+ * @param [in] Lock     Spinlock.
+ * 
+ * @return None.
+ */
+static
+VOID
+KERNELAPI
+KiLockStatisticsReleasing(
+    IN PKSPIN_LOCK Lock)
+{
+    KLOCK_STATISTICS *Statistics = Lock->Statistics;
+
+    if (!Statistics)
+    {
+        return;
+    }
+
+    U64 HoldCycles = __rdtsc() - Statistics->AcquireTsc;
+
+    if (Statistics->HoldCyclesMax < HoldCycles)
+        Statistics->HoldCyclesMax = HoldCycles;
+}
+
+#else
+
+#define KiLockStatisticsAcquired(_lock, _spin_start)    ((VOID)0)
+#define KiLockStatisticsReleasing(_lock)                ((VOID)0)
+
+#endif
+
+/**
+ * @brief Takes a ticket of the spinlock.
+ * 
+ * @param [in] Lock     Spinlock.
+ * 
+ * @return Ticket.
+ */
+static
+U16
+KERNELAPI
+KiTakeSpinlockTicket(
+    IN PKSPIN_LOCK Lock)
+{
+    return (U16)((U32)_InterlockedExchangeAdd(&Lock->Lock, KSPIN_LOCK_TICKET_INCREMENT) >> 16);
+}
+
+/**
+ * @brief Waits until the ticket is served.\n
+ *        Only reads the lock while waiting. Backoff is proportional to the position in the queue.
+ * 
+ * @param [in] Lock     Spinlock.
+ * @param [in] Ticket   Ticket returned by KiTakeSpinlockTicket.
+ * 
+ * @return None.
+ */
+static
+VOID
+KERNELAPI
+KiWaitSpinlockTicket(
+    IN PKSPIN_LOCK Lock,
+    IN U16 Ticket)
+{
+#if KE_LOCK_STATISTICS
+    U64 SpinStart = (Lock->Owner != Ticket) ? __rdtsc() : 0;
+#endif
+
+    for (;;)
+    {
+        U16 Owner = Lock->Owner;
+        if (Owner == Ticket)
+            break;
+
+        for (U16 i = (U16)(Ticket - Owner); i > 0; i--)
+            _mm_pause();
+    }
+
+    _ReadWriteBarrier();
+
+    KiLockStatisticsAcquired(Lock, SpinStart);
+}
+
+/**
+ * @brief Tries to take the ticket only if the spinlock is free.\n
+ *        The lock is tested without atomic operation first.
+ * 
+ * @param [in] Lock     Spinlock.
+ * 
+ * @return TRUE if succeeds, FALSE otherwise.
+ */
+static
+BOOLEAN
+KERNELAPI
+KiTryTakeSpinlockTicket(
+    IN PKSPIN_LOCK Lock)
+{
+    long Value = Lock->Lock;
+
+    if ((U16)Value != (U16)((U32)Value >> 16))
+    {
+        // Owned or queued
+        return FALSE;
+    }
+
+    if (_InterlockedCompareExchange(&Lock->Lock, 
+        (long)((U32)Value + KSPIN_LOCK_TICKET_INCREMENT), Value) != Value)
+    {
+        return FALSE;
+    }
+
+    KiLockStatisticsAcquired(Lock, 0);
+
+    return TRUE;
+}
+
+/**
+ * @brief Serves the next ticket.
+ * 
+ * @param [in] Lock     Spinlock.
+ * 
+ * @return None.
+ */
+static
+VOID
+KERNELAPI
+KiReleaseSpinlockTicket(
+    IN PKSPIN_LOCK Lock)
+{
+    U16 Owner = Lock->Owner;
+
+    ASSERT(Owner != Lock->Next);
+
+    KiLockStatisticsReleasing(Lock);
+
+    // Only the owner writes Owner, so plain store is enough (stores are not reordered on x64).
+    _ReadWriteBarrier();
+    Lock->Owner = (U16)(Owner + 1);
+}
+
 /**
  * @brief Initializes the spinlock.
  * 
@@ -29,6 +215,10 @@ KeInitializeSpinlock(
     OUT PKSPIN_LOCK Lock)
 {
     _InterlockedExchange(&Lock->Lock, 0);
+
+#if KE_LOCK_STATISTICS
+    Lock->Statistics = NULL;
+#endif
 }
 
 /**
@@ -43,7 +233,7 @@ KERNELAPI
 KeTryAcquireSpinlock(
     IN PKSPIN_LOCK Lock)
 {
-    return !_InterlockedExchange(&Lock->Lock, 1);
+    return KiTryTakeSpinlockTicket(Lock);
 }
 
 /**
@@ -58,8 +248,7 @@ KERNELAPI
 KeAcquireSpinlock(
     IN PKSPIN_LOCK Lock)
 {
-    while (!KeTryAcquireSpinlock(Lock))
-        _mm_pause();
+    KiWaitSpinlockTicket(Lock, KiTakeSpinlockTicket(Lock));
 }
 
 /**
@@ -74,9 +263,7 @@ KERNELAPI
 KeReleaseSpinlock(
     IN PKSPIN_LOCK Lock)
 {
-    long Prev = _InterlockedExchange(&Lock->Lock, 0);
-
-    ASSERT(Prev);
+    KiReleaseSpinlockTicket(Lock);
 }
 
 /**
@@ -91,7 +278,9 @@ KERNELAPI
 KeIsSpinlockAcquired(
     IN PKSPIN_LOCK Lock)
 {
-    return !!_InterlockedCompareExchange(&Lock->Lock, 0, 0);
+    long Value = Lock->Lock;
+
+    return (U16)Value != (U16)((U32)Value >> 16);
 }
 
 /**
@@ -128,7 +317,7 @@ KeTryAcquireSpinlockMultiple(
 
     while (AcquiredCount)
     {
-        KeReleaseSpinlock(LockList[AcquiredCount]);
+        KeReleaseSpinlock(LockList[AcquiredCount - 1]);
         AcquiredCount--;
     }
 
@@ -202,9 +391,7 @@ KeTryAcquireSpinlockDisableInterrupt(
     BOOLEAN CurrentState = !!(__readeflags() & RFLAG_IF);
     _disable();
 
-    long Prev = _InterlockedExchange(&Lock->Lock, 1);
-
-    if (Prev)
+    if (!KiTryTakeSpinlockTicket(Lock))
     {
         // Failed to acquire the lock
         if (CurrentState)
@@ -233,8 +420,12 @@ KeAcquireSpinlockDisableInterrupt(
     IN PKSPIN_LOCK Lock,
     OUT BOOLEAN *PrevState)
 {
-    while (!KeTryAcquireSpinlockDisableInterrupt(Lock, PrevState))
-        _mm_pause();
+    BOOLEAN CurrentState = !!(__readeflags() & RFLAG_IF);
+    _disable();
+
+    KiWaitSpinlockTicket(Lock, KiTakeSpinlockTicket(Lock));
+
+    *PrevState = CurrentState;
 }
 
 /**
@@ -251,9 +442,7 @@ KeReleaseSpinlockRestoreInterrupt(
     IN PKSPIN_LOCK Lock,
     IN BOOLEAN PrevState)
 {
-    long Prev = _InterlockedExchange(&Lock->Lock, 0);
-
-    ASSERT(Prev);
+    KiReleaseSpinlockTicket(Lock);
 
     if (PrevState)
     {
@@ -302,7 +491,7 @@ KeTryAcquireSpinlockMultipleDisableInterrupt(
 
     while (AcquiredCount)
     {
-        KeReleaseSpinlock(LockList[AcquiredCount]);
+        KeReleaseSpinlock(LockList[AcquiredCount - 1]);
         AcquiredCount--;
     }
 
@@ -391,9 +580,7 @@ KeTryAcquireSpinlockRaiseIrql(
 {
     KIRQL CurrentIrql = KeRaiseIrql(Irql);
 
-    long Prev = _InterlockedExchange(&Lock->Lock, 1);
-
-    if (Prev)
+    if (!KiTryTakeSpinlockTicket(Lock))
     {
         // Failed to acquire the lock
         KeLowerIrql(CurrentIrql);
@@ -420,8 +607,11 @@ KeAcquireSpinlockRaiseIrql(
     IN KIRQL Irql,
     OUT KIRQL *PrevIrql)
 {
-    while (!KeTryAcquireSpinlockRaiseIrql(Lock, Irql, PrevIrql))
-        _mm_pause();
+    KIRQL CurrentIrql = KeRaiseIrql(Irql);
+
+    KiWaitSpinlockTicket(Lock, KiTakeSpinlockTicket(Lock));
+
+    *PrevIrql = CurrentIrql;
 }
 
 /**
@@ -438,9 +628,7 @@ KeReleaseSpinlockLowerIrql(
     IN PKSPIN_LOCK Lock,
     IN KIRQL PrevIrql)
 {
-    long Prev = _InterlockedExchange(&Lock->Lock, 0);
-
-    ASSERT(Prev);
+    KiReleaseSpinlockTicket(Lock);
 
     KeLowerIrql(PrevIrql);
 }
@@ -487,7 +675,7 @@ KeTryAcquireSpinlockMultipleRaiseIrql(
 
     while (AcquiredCount)
     {
-        KeReleaseSpinlock(LockList[AcquiredCount]);
+        KeReleaseSpinlock(LockList[AcquiredCount - 1]);
         AcquiredCount--;
     }
 
@@ -548,3 +736,477 @@ KeReleaseSpinlockMultipleLowerIrql(
     KeLowerIrql(PrevIrql);
 }
 
+
+
+//
+// Reader-writer spinlock.
+//
+
+/**
+ * @brief Initializes the reader-writer spinlock.
+ * 
+ * @param [out] Lock    Reader-writer spinlock.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeInitializeRwSpinlock(
+    OUT PKRW_SPIN_LOCK Lock)
+{
+    _InterlockedExchange(&Lock->Lock, 0);
+}
+
+/**
+ * @brief Tries to acquire the reader-writer spinlock as shared.\n
+ *        Fails if a writer holds or waits for the lock.
+ * 
+ * @param [in] Lock     Reader-writer spinlock.
+ * 
+ * @return TRUE if succeeds, FALSE otherwise.
+ */
+BOOLEAN
+KERNELAPI
+KeTryAcquireRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    long Value = Lock->Lock;
+
+    if (Value & (KRW_SPIN_LOCK_WRITER | KRW_SPIN_LOCK_WRITER_WAITING_MASK))
+    {
+        return FALSE;
+    }
+
+    DASSERT((Value & KRW_SPIN_LOCK_READER_MASK) != KRW_SPIN_LOCK_READER_MASK);
+
+    return _InterlockedCompareExchange(&Lock->Lock, Value + 1, Value) == Value;
+}
+
+/**
+ * @brief Acquires the reader-writer spinlock as shared.
+ * 
+ * @param [in] Lock     Reader-writer spinlock.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeAcquireRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    while (!KeTryAcquireRwSpinlockShared(Lock))
+        _mm_pause();
+}
+
+/**
+ * @brief Releases the shared reader-writer spinlock.
+ * 
+ * @param [in] Lock     Reader-writer spinlock.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeReleaseRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    long Prev = _InterlockedExchangeAdd(&Lock->Lock, -1);
+
+    ASSERT(Prev & KRW_SPIN_LOCK_READER_MASK);
+}
+
+/**
+ * @brief Tries to acquire the reader-writer spinlock as exclusive.
+ * 
+ * @param [in] Lock     Reader-writer spinlock.
+ * 
+ * @return TRUE if succeeds, FALSE otherwise.
+ */
+BOOLEAN
+KERNELAPI
+KeTryAcquireRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    long Value = Lock->Lock;
+
+    if (Value & (KRW_SPIN_LOCK_WRITER | KRW_SPIN_LOCK_READER_MASK))
+    {
+        return FALSE;
+    }
+
+    return _InterlockedCompareExchange(&Lock->Lock, 
+        (long)((U32)Value | KRW_SPIN_LOCK_WRITER), Value) == Value;
+}
+
+/**
+ * @brief Acquires the reader-writer spinlock as exclusive.\n
+ *        The writer is counted as waiting first, which blocks new readers.
+ * 
+ * @param [in] Lock     Reader-writer spinlock.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeAcquireRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    _InterlockedExchangeAdd(&Lock->Lock, KRW_SPIN_LOCK_WRITER_WAITING_INCREMENT);
+
+    for (;;)
+    {
+        long Value = Lock->Lock;
+
+        if (!(Value & (KRW_SPIN_LOCK_WRITER | KRW_SPIN_LOCK_READER_MASK)))
+        {
+            // Remove ourselves from waiting writers and take the ownership at once.
+            long NewValue = (long)(((U32)Value - KRW_SPIN_LOCK_WRITER_WAITING_INCREMENT) | KRW_SPIN_LOCK_WRITER);
+
+            if (_InterlockedCompareExchange(&Lock->Lock, NewValue, Value) == Value)
+                break;
+        }
+
+        _mm_pause();
+    }
+}
+
+/**
+ * @brief Releases the exclusive reader-writer spinlock.
+ * 
+ * @param [in] Lock     Reader-writer spinlock.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeReleaseRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    // Waiting writers may be counted concurrently, so clear the writer bit atomically.
+    for (;;)
+    {
+        long Value = Lock->Lock;
+
+        ASSERT(Value & KRW_SPIN_LOCK_WRITER);
+
+        if (_InterlockedCompareExchange(&Lock->Lock, 
+            (long)((U32)Value & ~KRW_SPIN_LOCK_WRITER), Value) == Value)
+            break;
+    }
+}
+
+/**
+ * @brief Raises IRQL and acquires the reader-writer spinlock as shared.
+ * 
+ * @param [in] Lock         Reader-writer spinlock.
+ * @param [in] Irql         IRQL to raise.
+ * @param [out] PrevIrql    Previous IRQL.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeAcquireRwSpinlockSharedRaiseIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL Irql,
+    OUT KIRQL *PrevIrql)
+{
+    KIRQL CurrentIrql = KeRaiseIrql(Irql);
+
+    KeAcquireRwSpinlockShared(Lock);
+
+    *PrevIrql = CurrentIrql;
+}
+
+/**
+ * @brief Releases the shared reader-writer spinlock and restores the IRQL.
+ * 
+ * @param [in] Lock         Reader-writer spinlock.
+ * @param [in] PrevIrql     Previous IRQL.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeReleaseRwSpinlockSharedLowerIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL PrevIrql)
+{
+    KeReleaseRwSpinlockShared(Lock);
+    KeLowerIrql(PrevIrql);
+}
+
+/**
+ * @brief Raises IRQL and acquires the reader-writer spinlock as exclusive.
+ * 
+ * @param [in] Lock         Reader-writer spinlock.
+ * @param [in] Irql         IRQL to raise.
+ * @param [out] PrevIrql    Previous IRQL.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeAcquireRwSpinlockExclusiveRaiseIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL Irql,
+    OUT KIRQL *PrevIrql)
+{
+    KIRQL CurrentIrql = KeRaiseIrql(Irql);
+
+    KeAcquireRwSpinlockExclusive(Lock);
+
+    *PrevIrql = CurrentIrql;
+}
+
+/**
+ * @brief Releases the exclusive reader-writer spinlock and restores the IRQL.
+ * 
+ * @param [in] Lock         Reader-writer spinlock.
+ * @param [in] PrevIrql     Previous IRQL.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeReleaseRwSpinlockExclusiveLowerIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL PrevIrql)
+{
+    KeReleaseRwSpinlockExclusive(Lock);
+    KeLowerIrql(PrevIrql);
+}
+
+
+//
+// Contention benchmark.
+//
+
+#define KI_LOCK_BENCHMARK_TICKET            0
+#define KI_LOCK_BENCHMARK_TEST_AND_SET      1
+#define KI_LOCK_BENCHMARK_TYPES             2
+
+KSPIN_LOCK KiLockBenchmarkLock;
+volatile long KiLockBenchmarkTasLock;
+volatile U64 KiLockBenchmarkCounter;
+volatile long KiLockBenchmarkArrived[KI_LOCK_BENCHMARK_TYPES];
+volatile long KiLockBenchmarkDeparted[KI_LOCK_BENCHMARK_TYPES];
+U64 KiLockBenchmarkCycles[KI_LOCK_BENCHMARK_TYPES][0x100];
+
+/**
+ * @brief Runs one benchmark pass on the current processor.\n
+ *        All processors start together and acquire the same lock KE_LOCK_BENCHMARK_ITERATIONS times.
+ * 
+ * @param [in] Type     KI_LOCK_BENCHMARK_Xxx.
+ * 
+ * @return None.
+ */
+static
+VOID
+KERNELAPI
+KiSpinlockBenchmarkPass(
+    IN U32 Type)
+{
+    long ProcessorCount = KeGetProcessorCount();
+    U8 ProcessorId = KeGetCurrentProcessorId();
+
+    _InterlockedIncrement((long *)&KiLockBenchmarkArrived[Type]);
+    while (KiLockBenchmarkArrived[Type] < ProcessorCount)
+        _mm_pause();
+
+    U64 Start = __rdtsc();
+
+    for (U32 i = 0; i < KE_LOCK_BENCHMARK_ITERATIONS; i++)
+    {
+        if (Type == KI_LOCK_BENCHMARK_TICKET)
+        {
+            KeAcquireSpinlock(&KiLockBenchmarkLock);
+            KiLockBenchmarkCounter++;
+            KeReleaseSpinlock(&KiLockBenchmarkLock);
+        }
+        else
+        {
+            // Previous implementation (exchange until acquired), for comparison.
+            while (_InterlockedExchange(&KiLockBenchmarkTasLock, 1))
+                _mm_pause();
+
+            KiLockBenchmarkCounter++;
+            _InterlockedExchange(&KiLockBenchmarkTasLock, 0);
+        }
+    }
+
+    KiLockBenchmarkCycles[Type][ProcessorId] = __rdtsc() - Start;
+
+    _InterlockedIncrement((long *)&KiLockBenchmarkDeparted[Type]);
+    while (KiLockBenchmarkDeparted[Type] < ProcessorCount)
+        _mm_pause();
+}
+
+/**
+ * @brief Measures the spinlock under contention of all processors.\n
+ *        Every processor must call this function. Processor 0 prints the result.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeSpinlockContentionBenchmark(
+    VOID)
+{
+    static const CHAR *TypeNames[KI_LOCK_BENCHMARK_TYPES] = { "ticket", "test-and-set" };
+    U8 ProcessorCount = KeGetProcessorCount();
+
+    for (U32 Type = 0; Type < KI_LOCK_BENCHMARK_TYPES; Type++)
+    {
+        KiSpinlockBenchmarkPass(Type);
+    }
+
+    if (KeGetCurrentProcessorId() != 0)
+    {
+        return;
+    }
+
+    if (KiLockBenchmarkCounter != (U64)ProcessorCount * KE_LOCK_BENCHMARK_ITERATIONS * KI_LOCK_BENCHMARK_TYPES)
+    {
+        FATAL("Spinlock benchmark counter mismatch (%lld)", KiLockBenchmarkCounter);
+    }
+
+    for (U32 Type = 0; Type < KI_LOCK_BENCHMARK_TYPES; Type++)
+    {
+        U64 CyclesMin = (U64)-1;
+        U64 CyclesMax = 0;
+
+        for (U32 i = 0; i < ProcessorCount; i++)
+        {
+            U64 Cycles = KiLockBenchmarkCycles[Type][i];
+
+            if (CyclesMin > Cycles)
+                CyclesMin = Cycles;
+
+            if (CyclesMax < Cycles)
+                CyclesMax = Cycles;
+        }
+
+        // Cycles per acquisition of all processors, and spread between fastest/slowest processor.
+        DbgTraceF(TraceLevelDebug, "Spinlock %-12s: %d processors, %lld cycles/acquire, min %lld, max %lld cycles/acquire per processor\n",
+            TypeNames[Type], ProcessorCount, 
+            CyclesMax / ((U64)ProcessorCount * KE_LOCK_BENCHMARK_ITERATIONS), 
+            CyclesMin / KE_LOCK_BENCHMARK_ITERATIONS, CyclesMax / KE_LOCK_BENCHMARK_ITERATIONS);
+    }
+}
+
+
+#if KE_LOCK_STATISTICS
+
+//
+// Lock statistics.
+//
+
+/**
+ * @brief Registers the spinlock to collect statistics.\n
+ *        Lock must not be held by anyone.
+ * 
+ * @param [in] Lock         Spinlock.
+ * @param [in] Name         Name of the lock. Must be valid while the system is running.
+ * @param [in] Instance     Instance number to distinguish locks of the same name.
+ * 
+ * @return TRUE if succeeds, FALSE if the statistics table is full.
+ */
+BOOLEAN
+KERNELAPI
+KeRegisterSpinlockStatistics(
+    IN PKSPIN_LOCK Lock,
+    IN const CHAR *Name,
+    IN U32 Instance)
+{
+    long Index = _InterlockedExchangeAdd(&KiLockStatisticsCount, 1);
+
+    if (Index >= KE_LOCK_STATISTICS_MAX)
+    {
+        _InterlockedExchangeAdd(&KiLockStatisticsCount, -1);
+        return FALSE;
+    }
+
+    KLOCK_STATISTICS *Statistics = &KiLockStatistics[Index];
+
+    memset(Statistics, 0, sizeof(*Statistics));
+    Statistics->Name = Name;
+    Statistics->Instance = Instance;
+
+    _ReadWriteBarrier();
+    Lock->Statistics = Statistics;
+
+    return TRUE;
+}
+
+/**
+ * @brief Prints the statistics of the most contended spinlocks.\n
+ *        Locks are ordered by total spin cycles. Values are read without locking, so they can be slightly off.
+ * 
+ * @param [in] Count    Maximum number of locks to print.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeDumpSpinlockStatistics(
+    IN U32 Count)
+{
+    long StatisticsCount = KiLockStatisticsCount;
+    U64 LastSpinCycles = (U64)-1;
+    long LastIndex = -1;
+
+    if (StatisticsCount > KE_LOCK_STATISTICS_MAX)
+    {
+        StatisticsCount = KE_LOCK_STATISTICS_MAX;
+    }
+
+    DbgTraceF(TraceLevelDebug, "%-16s %8s %12s %12s %14s %12s %12s\n",
+        "Lock", "Instance", "Acquire", "Contended", "SpinCycles", "SpinMax", "HoldMax");
+
+    //
+    // Selects the next entry in (SpinCycles descending, index ascending) order on each pass,
+    // so that no temporary buffer is needed.
+    //
+
+    for (U32 Printed = 0; Printed < Count; Printed++)
+    {
+        long Selected = -1;
+        U64 SelectedSpinCycles = 0;
+
+        for (long i = 0; i < StatisticsCount; i++)
+        {
+            U64 SpinCycles = KiLockStatistics[i].SpinCycles;
+
+            if (SpinCycles > LastSpinCycles || 
+                (SpinCycles == LastSpinCycles && i <= LastIndex))
+            {
+                // Already printed
+                continue;
+            }
+
+            if (Selected < 0 || SpinCycles > SelectedSpinCycles)
+            {
+                Selected = i;
+                SelectedSpinCycles = SpinCycles;
+            }
+        }
+
+        if (Selected < 0)
+        {
+            break;
+        }
+
+        KLOCK_STATISTICS *Statistics = &KiLockStatistics[Selected];
+
+        DbgTraceF(TraceLevelDebug, "%-16s %8d %12lld %12lld %14lld %12lld %12lld\n",
+            Statistics->Name, Statistics->Instance, 
+            Statistics->Acquisitions, Statistics->Contentions, 
+            SelectedSpinCycles, Statistics->SpinCyclesMax, Statistics->HoldCyclesMax);
+
+        LastSpinCycles = SelectedSpinCycles;
+        LastIndex = Selected;
+    }
+}
+
+#endif
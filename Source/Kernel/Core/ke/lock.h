@@ -3,15 +3,80 @@
 #include <base/base.h>
 #include <ke/irql.h>
 
+//
+// Ticket spinlock.
+// Acquirer takes a ticket by incrementing Next, then waits until Owner reaches its ticket.
+// Release increments Owner, so waiters are served in FIFO order.
+// Both fields share one 32-bit word so that the lock can be tested or taken atomically.
+//
+
+#define KSPIN_LOCK_TICKET_INCREMENT             0x10000     //!< Increments Next.
+
+#ifndef KE_LOCK_BENCHMARK_AT_BOOT
+#define KE_LOCK_BENCHMARK_AT_BOOT               0           //!< Runs KeSpinlockContentionBenchmark() on all processors at boot if non-zero.
+#endif
+
+#define KE_LOCK_BENCHMARK_ITERATIONS            0x10000
+
+#ifndef KE_LOCK_STATISTICS
+#define KE_LOCK_STATISTICS                      0           //!< Collects per-lock contention statistics if non-zero.
+#endif
+
+#define KE_LOCK_STATISTICS_MAX                  0x400       //!< Maximum number of registered locks.
+#define KE_LOCK_STATISTICS_DUMP_COUNT           16          //!< Number of locks printed at boot.
+
+//
+// Lock statistics.
+// Fields are updated by the lock owner only, so no atomic operation is needed.
+//
+
+typedef struct _KLOCK_STATISTICS
+{
+    const CHAR *Name;
+    U32 Instance;                       // Distinguishes locks of the same name
+    U64 Acquisitions;
+    U64 Contentions;                    // Acquisitions which had to wait
+    U64 SpinCycles;                     // Total cycles spent waiting
+    U64 SpinCyclesMax;
+    U64 HoldCyclesMax;
+    U64 AcquireTsc;                     // TSC at last acquisition
+} KLOCK_STATISTICS;
+
 #pragma pack(push, 4)
 
 typedef struct _KSPIN_LOCK
 {
-    volatile long Lock;
+    union
+    {
+        volatile long Lock;
+        struct
+        {
+            volatile U16 Owner;         // Ticket being served
+            volatile U16 Next;          // Next ticket to hand out
+        };
+    };
+#if KE_LOCK_STATISTICS
+    KLOCK_STATISTICS *Statistics;       // NULL if not registered
+#endif
 } KSPIN_LOCK, *PKSPIN_LOCK;
 
 #pragma pack(pop)
 
+//
+// Reader-writer spinlock (writer-preferring).
+// New readers are blocked while any writer is waiting, so writers cannot starve.
+//
+
+#define KRW_SPIN_LOCK_READER_MASK               0x0000ffff  //!< Number of readers holding the lock.
+#define KRW_SPIN_LOCK_WRITER_WAITING_INCREMENT  0x00010000
+#define KRW_SPIN_LOCK_WRITER_WAITING_MASK       0x7fff0000  //!< Number of writers waiting.
+#define KRW_SPIN_LOCK_WRITER                    0x80000000  //!< Writer holds the lock.
+
+typedef struct _KRW_SPIN_LOCK
+{
+    volatile long Lock;
+} KRW_SPIN_LOCK, *PKRW_SPIN_LOCK;
+
 
 
 VOID
@@ -150,6 +215,105 @@ KeReleaseSpinlockMultipleLowerIrql(
     IN KIRQL PrevIrql);
 
 
+//
+// Reader-writer spinlock.
+//
+
+VOID
+KERNELAPI
+KeInitializeRwSpinlock(
+    OUT PKRW_SPIN_LOCK Lock);
+
+BOOLEAN
+KERNELAPI
+KeTryAcquireRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock);
+
+VOID
+KERNELAPI
+KeAcquireRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock);
+
+VOID
+KERNELAPI
+KeReleaseRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock);
+
+BOOLEAN
+KERNELAPI
+KeTryAcquireRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock);
+
+VOID
+KERNELAPI
+KeAcquireRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock);
+
+VOID
+KERNELAPI
+KeReleaseRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock);
+
+VOID
+KERNELAPI
+KeAcquireRwSpinlockSharedRaiseIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL Irql,
+    OUT KIRQL *PrevIrql);
+
+VOID
+KERNELAPI
+KeReleaseRwSpinlockSharedLowerIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL PrevIrql);
+
+VOID
+KERNELAPI
+KeAcquireRwSpinlockExclusiveRaiseIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL Irql,
+    OUT KIRQL *PrevIrql);
+
+VOID
+KERNELAPI
+KeReleaseRwSpinlockExclusiveLowerIrql(
+    IN PKRW_SPIN_LOCK Lock,
+    IN KIRQL PrevIrql);
+
+
+VOID
+KERNELAPI
+KeSpinlockContentionBenchmark(
+    VOID);
+
+
+//
+// Lock statistics.
+// Registration must be done after KeInitializeSpinlock() as it resets the statistics link.
+//
+
+#if KE_LOCK_STATISTICS
+
+BOOLEAN
+KERNELAPI
+KeRegisterSpinlockStatistics(
+    IN PKSPIN_LOCK Lock,
+    IN const CHAR *Name,
+    IN U32 Instance);
+
+VOID
+KERNELAPI
+KeDumpSpinlockStatistics(
+    IN U32 Count);
+
+#else
+
+#define KeRegisterSpinlockStatistics(_lock, _name, _instance)      ((VOID)0)
+#define KeDumpSpinlockStatistics(_count)                           ((VOID)0)
+
+#endif
+
+
 #define KeTryAcquireSpinlockRaiseIrqlToContextSwitch(_lock, _prev_irql) \
     KeTryAcquireSpinlockRaiseIrql((_lock), IRQL_CONTEXT_SWITCH, (_prev_irql))
 
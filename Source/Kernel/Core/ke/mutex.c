@@ -0,0 +1,251 @@
+/**
+ * @file mutex.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements mutex object with adaptive spinning and priority inheritance.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/sched_balance.h>
+#include <ke/wait.h>
+#include <ke/mutex.h>
+
+
+VOID
+KiUpdateInheritedPriority(
+    IN KTHREAD *Thread)
+{
+    U32 InheritedPriority = 0;
+
+    // Caller holds the thread lock.
+    for (DLIST_ENTRY *Link = Thread->MutexList.Next; Link != &Thread->MutexList; Link = Link->Next)
+    {
+        KMUTEX *Mutex = CONTAINING_RECORD(Link, KMUTEX, MutexList);
+
+        if (InheritedPriority < Mutex->WaiterPriority)
+        {
+            InheritedPriority = Mutex->WaiterPriority;
+        }
+    }
+
+    Thread->InheritedPriority = InheritedPriority;
+    Thread->Priority = Thread->BasePriority > InheritedPriority ? Thread->BasePriority : InheritedPriority;
+}
+
+VOID
+KiAcquireMutexOwnership(
+    IN KMUTEX *Mutex,
+    IN KTHREAD *Thread)
+{
+    // Caller holds the mutex lock.
+    if (Mutex->Owner == Thread)
+    {
+        Mutex->RecursionCount++;
+        return;
+    }
+
+    DASSERT(!Mutex->Owner);
+
+    // Threads still waiting lend their priority to the new owner.
+    U32 WaiterPriority = 0;
+
+    for (DLIST_ENTRY *Link = Mutex->Header.WaiterBlockLinks.Next; 
+        Link != &Mutex->Header.WaiterBlockLinks; Link = Link->Next)
+    {
+        KWAITER_BLOCK *WaiterBlock = CONTAINING_RECORD(Link, KWAITER_BLOCK, WaiterBlockLinks);
+
+        if (WaiterPriority < WaiterBlock->Thread->Priority)
+        {
+            WaiterPriority = WaiterBlock->Thread->Priority;
+        }
+    }
+
+    Mutex->Header.State &= ~WAIT_STATE_SIGNALED;
+    Mutex->Owner = Thread;
+    Mutex->RecursionCount = 1;
+    Mutex->WaiterPriority = WaiterPriority;
+
+    KIRQL PrevIrql = KiLockThread(Thread);
+    DListInsertBefore(&Thread->MutexList, &Mutex->MutexList);
+    KiUpdateInheritedPriority(Thread);
+    KiUnlockThread(Thread, PrevIrql);
+}
+
+VOID
+KeInitializeMutex(
+    OUT KMUTEX *Mutex)
+{
+    KiInitializeWaitHeader(&Mutex->Header, WAIT_FLAG_WAKE_ONE, NULL);
+    Mutex->Header.Type = WaitObjectMutex;
+    Mutex->Header.State |= WAIT_STATE_SIGNALED;
+    Mutex->Owner = NULL;
+    Mutex->RecursionCount = 0;
+    Mutex->WaiterPriority = 0;
+    DListInitializeHead(&Mutex->MutexList);
+}
+
+BOOLEAN
+KiIsThreadRunning(
+    IN KTHREAD *Thread)
+{
+    U32 ProcessorId = Thread->LastProcessorId;
+
+    return ProcessorId < KeGetProcessorCount() && KiProcessorBlocks[ProcessorId] && 
+        KiProcessorBlocks[ProcessorId]->CurrentThread == Thread;
+}
+
+VOID
+KiLendPriorityToOwner(
+    IN KMUTEX *Mutex,
+    IN KTHREAD *Thread)
+{
+    U32 Priority = Thread->Priority;
+    KIRQL PrevIrql;
+
+    KiLockWaitHeader(&Mutex->Header, &PrevIrql);
+
+    // Follows the owners blocked on other mutexes.
+    // Next mutex is locked while the owner is still blocked on it, so it cannot go away.
+    for (U32 Depth = 1; ; Depth++)
+    {
+        // Owner can be changed after we failed to acquire.
+        KTHREAD *Owner = Mutex->Owner;
+
+        if (!Owner || Owner == Thread || Mutex->WaiterPriority >= Priority)
+        {
+            break;
+        }
+
+        Mutex->WaiterPriority = Priority;
+
+        KIRQL PrevIrqlOwner = KiLockThread(Owner);
+        KiUpdateInheritedPriority(Owner);
+        Priority = Owner->Priority;
+
+        // Lock order is mutex then thread, so the next mutex can only be tried.
+        KMUTEX *NextMutex = Owner->BlockingMutex;
+        KIRQL NextIrql;
+
+        if (NextMutex && (Depth >= KMUTEX_INHERITANCE_DEPTH_MAX || 
+            !KiTryLockWaitHeader(&NextMutex->Header, &NextIrql)))
+        {
+            NextMutex = NULL;
+        }
+
+        KiUnlockThread(Owner, PrevIrqlOwner);
+
+        if (!NextMutex)
+        {
+            // Ready owner is still queued at its old priority.
+            KiSchedRequeueThread(Owner);
+            break;
+        }
+
+        KiUnlockWaitHeader(&Mutex->Header, NextIrql);
+        Mutex = NextMutex;
+    }
+
+    KiUnlockWaitHeader(&Mutex->Header, PrevIrql);
+}
+
+ESTATUS
+KeAcquireMutex(
+    IN KMUTEX *Mutex,
+    IN U64 Timeout)
+{
+    KTHREAD *Thread = KeGetCurrentThread();
+
+    if (KeWaitForSingleObject(&Mutex->Header, 0) == E_SUCCESS)
+    {
+        return E_SUCCESS;
+    }
+
+    // Spin while the owner is running. Lock is not taken until the mutex looks free.
+    for (U32 SpinCount = 0; SpinCount < KMUTEX_SPIN_COUNT_MAX && Timeout != 0; SpinCount++)
+    {
+        KTHREAD *Owner = *(KTHREAD *volatile *)&Mutex->Owner;
+
+        if (!Owner)
+        {
+            if (KeWaitForSingleObject(&Mutex->Header, 0) == E_SUCCESS)
+            {
+                return E_SUCCESS;
+            }
+
+            continue;
+        }
+
+        if (!KiIsThreadRunning(Owner))
+        {
+            break;
+        }
+
+        _mm_pause();
+    }
+
+    if (Timeout == 0)
+    {
+        return E_TIMEOUT;
+    }
+
+    // Lets the threads lending priority to us follow the chain.
+    KIRQL PrevIrql = KiLockThread(Thread);
+    Thread->BlockingMutex = Mutex;
+    KiUnlockThread(Thread, PrevIrql);
+
+    KiLendPriorityToOwner(Mutex, Thread);
+
+    ESTATUS Status = KeWaitForSingleObject(&Mutex->Header, Timeout);
+
+    PrevIrql = KiLockThread(Thread);
+    Thread->BlockingMutex = NULL;
+    KiUnlockThread(Thread, PrevIrql);
+
+    return Status;
+}
+
+ESTATUS
+KeReleaseMutex(
+    IN KMUTEX *Mutex)
+{
+    KTHREAD *Thread = KeGetCurrentThread();
+    KIRQL PrevIrql;
+
+    KiLockWaitHeader(&Mutex->Header, &PrevIrql);
+
+    if (Mutex->Owner != Thread)
+    {
+        KiUnlockWaitHeader(&Mutex->Header, PrevIrql);
+        return E_INVALID_PARAMETER;
+    }
+
+    if (--Mutex->RecursionCount)
+    {
+        KiUnlockWaitHeader(&Mutex->Header, PrevIrql);
+        return E_SUCCESS;
+    }
+
+    Mutex->Owner = NULL;
+    Mutex->WaiterPriority = 0;
+
+    // Give back the priority lent by the waiters.
+    KIRQL PrevIrqlThread = KiLockThread(Thread);
+    DListRemoveEntry(&Mutex->MutexList);
+    KiUpdateInheritedPriority(Thread);
+    KiUnlockThread(Thread, PrevIrqlThread);
+
+    // Hands off to the first waiter.
+    KiSignalWaitHeader(&Mutex->Header);
+
+    KiUnlockWaitHeader(&Mutex->Header, PrevIrql);
+
+    return E_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/wait.h>
+
+//
+// Mutex spins while the owner is running on other processor, as the owner is likely to
+// release it before we would be switched out. It blocks if the owner is not running.
+// Blocked waiter lends its priority to the owner until the mutex is released.
+// If the owner is blocked on another mutex, the priority is passed along the chain of owners.
+// Owner which is ready is requeued at the new priority. Chain stops at the depth limit, or when
+// the next mutex is busy as its lock can only be tried.
+//
+
+#define KMUTEX_SPIN_COUNT_MAX               0x1000      //!< Spin count before blocking.
+#define KMUTEX_INHERITANCE_DEPTH_MAX        8           //!< Owners boosted along the chain.
+
+typedef struct _KMUTEX
+{
+    KWAIT_HEADER Header;        // Signaled if not owned.
+    KTHREAD *Owner;
+    U32 RecursionCount;
+    U32 WaiterPriority;         // Highest priority of the waiters which is lent to the owner
+    DLIST_ENTRY MutexList;      // Links to KTHREAD.MutexList of the owner
+} KMUTEX;
+
+
+VOID
+KiAcquireMutexOwnership(
+    IN KMUTEX *Mutex,
+    IN KTHREAD *Thread);
+
+VOID
+KeInitializeMutex(
+    OUT KMUTEX *Mutex);
+
+ESTATUS
+KeAcquireMutex(
+    IN KMUTEX *Mutex,
+    IN U64 Timeout);
+
+ESTATUS
+KeReleaseMutex(
+    IN KMUTEX *Mutex);
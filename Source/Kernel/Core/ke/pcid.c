@@ -0,0 +1,186 @@
+/**
+ * @file pcid.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements PCID-tagged address space switch.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/process.h>
+#include <ke/pcid.h>
+#include <ke/tlb.h>
+
+
+VOID
+KiInitializeProcessorPcid(
+    IN KPROCESSOR *Processor)
+{
+    Processor->PcidEnabled = FALSE;
+    Processor->InvpcidSupported = FALSE;
+    Processor->PcidNext = PCID_FIRST;
+    Processor->PcidGeneration = 1;
+    Processor->ActiveAddressSpace = __readcr3() & ~ARCH_X64_CR3_PCID_MASK;
+
+#if KE_PCID_ENABLE
+    int Info[4];
+
+    __cpuid(Info, 0x00000001);
+    if (!(Info[2] & (1 << 17)))
+    {
+        // ECX[17] = PCID
+        return;
+    }
+
+    // CR4.PCIDE can be set only if CR3[11:0] is zero.
+    if (__readcr3() & ARCH_X64_CR3_PCID_MASK)
+    {
+        return;
+    }
+
+    __cpuidex(Info, 0x00000007, 0);
+    if (Info[1] & (1 << 10))
+    {
+        // EBX[10] = INVPCID
+        Processor->InvpcidSupported = TRUE;
+    }
+
+    __writecr4(__readcr4() | ARCH_X64_CR4_PCIDE);
+    Processor->PcidEnabled = TRUE;
+
+    DbgTraceF(TraceLevelDebug, "PCID enabled (processor %d, INVPCID %d)\n", 
+        Processor->ProcessorId, Processor->InvpcidSupported);
+#endif
+}
+
+VOID
+KiSwitchAddressSpace(
+    IN KPROCESSOR *Processor,
+    IN KTHREAD *NextThread)
+{
+    U64 Base = NextThread->ThreadContext.CR3 & ~ARCH_X64_CR3_PCID_MASK;
+
+    // Same page tables. TLB entries of the current PCID are still valid.
+    if ((__readcr3() & ~ARCH_X64_CR3_PCID_MASK) == Base)
+    {
+        return;
+    }
+
+    // Shootdowns of these page tables may have skipped this processor while it was using others.
+    Processor->ActiveAddressSpace = Base;
+    if (KiConsumeLazyTlbFlush(Processor) && Processor->PcidEnabled)
+    {
+        Processor->PcidGeneration++;
+        Processor->PcidNext = PCID_FIRST;
+    }
+
+    KPROCESS *Process = NextThread->OwnerProcess;
+
+    if (!Processor->PcidEnabled || !Process)
+    {
+        // Flushes all non-global entries (PCID 0 if enabled).
+        __writecr3(Base);
+        return;
+    }
+
+    KPROCESS_PCID *Pcid = &Process->Pcid[Processor->ProcessorId];
+    U64 NoFlush = ARCH_X64_CR3_NO_FLUSH;
+
+    if (Pcid->Generation != Processor->PcidGeneration)
+    {
+        if (Processor->PcidNext > PCID_MAX)
+        {
+            Processor->PcidGeneration++;
+            Processor->PcidNext = PCID_FIRST;
+        }
+
+        Pcid->Generation = Processor->PcidGeneration;
+        Pcid->Pcid = Processor->PcidNext++;
+
+        // Entries left by the previous user of the PCID are flushed on load.
+        NoFlush = 0;
+    }
+
+    __writecr3(Base | Pcid->Pcid | NoFlush);
+}
+
+VOID
+KiInvalidateTlbAddress(
+    IN PVOID Address)
+{
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+
+    // Current PCID.
+    __invlpg(Address);
+
+    // Only PCID 0 is used if the processor block is not ready.
+    if (!Processor || !Processor->PcidEnabled)
+    {
+        return;
+    }
+
+    // Context switch must not allocate PCIDs in the middle.
+    U64 Rflags = __readeflags();
+    _disable();
+
+    if (Processor->InvpcidSupported && 
+        Processor->PcidNext - PCID_FIRST <= PCID_INVALIDATE_TARGETED_MAX)
+    {
+        INVPCID_DESCRIPTOR Descriptor;
+        Descriptor.Address = (U64)Address;
+
+        for (U32 Pcid = PCID_FIRST; Pcid < Processor->PcidNext; Pcid++)
+        {
+            Descriptor.Pcid = Pcid;
+            _invpcid(INVPCID_TYPE_INDIVIDUAL_ADDRESS, &Descriptor);
+        }
+    }
+    else
+    {
+        // PCIDs of other processes are flushed when they are allocated again.
+        Processor->PcidGeneration++;
+        Processor->PcidNext = PCID_FIRST;
+    }
+
+    __writeeflags(Rflags);
+}
+
+VOID
+KiFlushTlbAll(
+    VOID)
+{
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+
+    if (!Processor || !Processor->PcidEnabled)
+    {
+        // Flushes all non-global entries.
+        __writecr3(__readcr3());
+        return;
+    }
+
+    U64 Rflags = __readeflags();
+    _disable();
+
+    if (Processor->InvpcidSupported)
+    {
+        INVPCID_DESCRIPTOR Descriptor = { 0 };
+        _invpcid(INVPCID_TYPE_ALL_CONTEXT, &Descriptor);
+    }
+    else
+    {
+        // Flushes the current PCID. Others are flushed when they are allocated again.
+        Processor->PcidGeneration++;
+        Processor->PcidNext = PCID_FIRST;
+        __writecr3(__readcr3() & ~ARCH_X64_CR3_NO_FLUSH);
+    }
+
+    __writeeflags(Rflags);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <base/base.h>
+
+typedef struct _KPROCESSOR          KPROCESSOR;
+typedef struct _KTHREAD             KTHREAD;
+
+//
+// Process-context identifiers (PCID).
+// Each processor allocates PCIDs to processes on its own, so no lock or IPI is needed.
+// When a processor runs out of PCIDs, it starts a new generation and the PCIDs of the
+// previous generation become invalid. PCID is flushed when it is loaded for the first time
+// in the generation, and is loaded without flush after that.
+//
+// Kernel mappings are shared by all processes and not global, so TLB entries of kernel
+// addresses can be tagged with any PCID used on the processor. Invalidating them flushes
+// each PCID in use with INVPCID if there are a few, otherwise starts a new generation.
+//
+
+#ifndef KE_PCID_ENABLE
+#define KE_PCID_ENABLE                      1           //!< Uses PCID if supported.
+#endif
+
+#define PCID_FIRST                          1           //!< PCID 0 is used until the first address space switch.
+#define PCID_MAX                            0xfff
+#define PCID_INVALIDATE_TARGETED_MAX        8           //!< PCIDs invalidated one by one with INVPCID.
+#define PCID_PROCESSORS_MAX                 64          //!< Same as the number of bits in KiProcessorMask.
+
+#define ARCH_X64_CR3_PCID_MASK              0xfffULL
+#define ARCH_X64_CR3_NO_FLUSH               (1ULL << 63)
+
+#define INVPCID_TYPE_INDIVIDUAL_ADDRESS     0
+#define INVPCID_TYPE_SINGLE_CONTEXT         1
+#define INVPCID_TYPE_ALL_CONTEXT_GLOBAL     2
+#define INVPCID_TYPE_ALL_CONTEXT            3
+
+typedef struct _KPROCESS_PCID
+{
+    U64 Generation;
+    U32 Pcid;
+    U32 Reserved;
+} KPROCESS_PCID;
+
+typedef struct _INVPCID_DESCRIPTOR
+{
+    U64 Pcid;
+    U64 Address;
+} INVPCID_DESCRIPTOR;
+
+
+VOID
+KiInitializeProcessorPcid(
+    IN KPROCESSOR *Processor);
+
+VOID
+KiSwitchAddressSpace(
+    IN KPROCESSOR *Processor,
+    IN KTHREAD *NextThread);
+
+VOID
+KiInvalidateTlbAddress(
+    IN PVOID Address);
+
+VOID
+KiFlushTlbAll(
+    VOID);
@@ -13,8 +13,10 @@
 #include <base/base.h>
 #include <misc/common.h>
 #include <ke/lock.h>
+#include <init/bootgfx.h>
 #include <mm/pool.h>
 #include <mm/mm.h>
+#include <mm/slab.h>
 #include <ke/interrupt.h>
 #include <ke/inthandler.h>
 #include <ke/kprocessor.h>
@@ -25,6 +27,7 @@
 U64 KiProcessIdSeed;
 DLIST_ENTRY KiProcessListHead;
 KSPIN_LOCK KiProcessListLock;
+SLAB_CACHE KiProcessCache;
 
 KPROCESS KiIdleProcess;
 KPROCESS KiSystemProcess;
@@ -41,6 +44,17 @@ KiCreateInitialProcessThreads(
     DListInitializeHead(&KiThreadListHead);
     KiProcessIdSeed = 0x40;
 
+    KeInitializeSpinlock(&KiProcessListLock);
+    KeInitializeSpinlock(&KiThreadListLock);
+    KeRegisterSpinlockStatistics(&KiProcessListLock, "ProcessList", 0);
+    KeRegisterSpinlockStatistics(&KiThreadListLock, "ThreadList", 0);
+
+    if (!E_IS_SUCCESS(MmInitializeSlabCache(&KiProcessCache, "Process", PoolTypeNonPaged, sizeof(KPROCESS), 0x10, NULL, NULL)) ||
+        !E_IS_SUCCESS(MmInitializeSlabCache(&KiThreadCache, "Thread", PoolTypeNonPaged, sizeof(KTHREAD), 0x40, NULL, NULL)))
+    {
+        FATAL("Failed to initialize process/thread cache");
+    }
+
     KiInitializeProcess(&KiIdleProcess, 0, "Idle");
     DASSERT(E_IS_SUCCESS(KiInsertProcess(&KiIdleProcess)));
 
@@ -91,7 +105,7 @@ KiAllocateProcess(
     IN U64 ProcessId,
     IN CHAR *ProcessName)
 {
-    KPROCESS *Process = (KPROCESS *)MmAllocatePool(PoolTypeNonPaged, sizeof(KPROCESS), 0x10, 0);
+    KPROCESS *Process = (KPROCESS *)MmAllocateSlabObject(&KiProcessCache);
 
     if (!Process)
     {
@@ -139,7 +153,7 @@ KiDeleteProcess(
 {
     // @todo: Free members before process deletion
     //        Not implemented
-    MmFreePool(Process);
+    MmFreeSlabObject(&KiProcessCache, Process);
 }
 
 
@@ -2,9 +2,11 @@
 #pragma once
 
 #include <ke/lock.h>
+#include <ke/pcid.h>
 
 typedef struct _KTHREAD             KTHREAD;
 typedef struct _MMXAD_TREE          MMXAD_TREE;
+typedef struct _SLAB_CACHE          SLAB_CACHE;
 
 #define PROCESS_NAME_MAX_LENGTH     128
 
@@ -25,6 +27,7 @@ typedef struct _KPROCESS
     MMXAD_TREE *UserVads;                   // VAD tree for user addresses.
     PVOID TopLevelPageTablePhysicalBase;    // Physical address of PML4T base.
     PVOID TopLevelPageTableVirtualBase;     // Virtual address of PML4T base.
+    KPROCESS_PCID Pcid[PCID_PROCESSORS_MAX];    // PCID allocated by each processor.
 
     //
     // Etc.
@@ -37,6 +40,7 @@ typedef struct _KPROCESS
 
 extern DLIST_ENTRY KiProcessListHead;
 extern KSPIN_LOCK KiProcessListLock;
+extern SLAB_CACHE KiProcessCache;
 
 extern KPROCESS KiIdleProcess;
 extern KPROCESS KiSystemProcess;
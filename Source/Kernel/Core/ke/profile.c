@@ -0,0 +1,434 @@
+/**
+ * @file profile.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements statistical profiler.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <mm/pool.h>
+#include <ke/interrupt.h>
+#include <ke/inthandler.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/event.h>
+#include <ke/wait.h>
+#include <ke/ipi.h>
+#include <ke/profile.h>
+#include <hal/apic.h>
+#include <hal/halinit.h>
+#include <hal/ptimer.h>
+
+
+volatile KPROFILE_SOURCE KiProfileSource;
+
+KPROFILE_SOURCE KiProfileLastSource;
+U32 KiProfilePeriod;
+BOOLEAN KiProfilePmuEnabled;        // Set once the counter is programmed. Never cleared.
+U64 KiProfileStartTick;
+U64 KiProfileStopTick;
+
+
+VOID
+KiInitializeProfile(
+    IN KPROCESSOR *Processor)
+{
+    // Allocated by the first KeStartProfile().
+    Processor->Profile = NULL;
+}
+
+/**
+ * @brief Counts the sample. Must be called with interrupts disabled.
+ *
+ * @param [in] InterruptFrame   Interrupt stack frame of the sampled context.
+ *
+ * @return None.
+ */
+VOID
+KiProfileSample(
+    IN KSTACK_FRAME_INTERRUPT *InterruptFrame)
+{
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+
+    if (!Processor || !Processor->Profile)
+    {
+        return;
+    }
+
+    KPROFILE_TABLE *Table = Processor->Profile;
+    U64 Rip = InterruptFrame->Rip;
+    U64 ThreadId = Processor->CurrentThread ? Processor->CurrentThread->ThreadId : 0;
+    U64 Hash = (Rip ^ (ThreadId << 48)) * 0x9e3779b97f4a7c15ULL;
+    U32 Index = (U32)(Hash >> 32);
+
+    Table->Samples++;
+
+    for (U32 i = 0; i < KE_PROFILE_PROBE_MAX; i++, Index++)
+    {
+        KPROFILE_BUCKET *Bucket = &Table->Buckets[Index & (KE_PROFILE_BUCKETS - 1)];
+
+        if (Bucket->Rip == Rip && Bucket->ThreadId == ThreadId)
+        {
+            Bucket->Count++;
+            return;
+        }
+
+        if (!Bucket->Rip)
+        {
+            Bucket->Rip = Rip;
+            Bucket->ThreadId = ThreadId;
+            Bucket->Count = 1;
+            return;
+        }
+    }
+
+    Table->Dropped++;
+}
+
+#if KE_PROFILE
+static
+BOOLEAN
+KiProfileIsPmuSupported(
+    VOID)
+{
+    int Info[4];
+
+    __cpuid(Info, 0x00000000);
+    if ((U32)Info[0] < 0x0a)
+    {
+        return FALSE;
+    }
+
+    // CPUID.0AH:EAX[7:0] = Version, EAX[15:8] = General-purpose counters,
+    // EAX[31:24] = Length of EBX bit vector, EBX[0] = Core cycle event not available
+    __cpuid(Info, 0x0000000a);
+
+    U32 Version = Info[0] & 0xff;
+    U32 Counters = (Info[0] >> 8) & 0xff;
+    U32 VectorLength = (Info[0] >> 24) & 0xff;
+
+    // Version 2 is needed for global status/overflow control.
+    return Version >= 2 && Counters >= 1 && VectorLength >= 1 && !(Info[1] & 1);
+}
+#endif
+
+VOID
+KERNELAPI
+KiProfileStartCounter(
+    IN PVOID Context)
+{
+    __writemsr(IA32_PERFEVTSEL0, 0);
+
+    // Counter is sign-extended from bit 31, so it overflows after KiProfilePeriod events.
+    __writemsr(IA32_PMC0, (U64)-(S64)KiProfilePeriod);
+    __writemsr(IA32_PERF_GLOBAL_OVF_CTRL, 1);
+
+    HalApicSetPerfCounterVector(HalApicBase, TRUE, 4 /*delivery mode = NMI*/, 0);
+
+    __writemsr(IA32_PERF_GLOBAL_CTRL, __readmsr(IA32_PERF_GLOBAL_CTRL) | 1);
+    __writemsr(IA32_PERFEVTSEL0, PERFEVT_UNHALTED_CORE_CYCLES |
+        PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_INT | PERFEVTSEL_EN);
+}
+
+VOID
+KERNELAPI
+KiProfileStopCounter(
+    IN PVOID Context)
+{
+    __writemsr(IA32_PERFEVTSEL0, 0);
+    __writemsr(IA32_PERF_GLOBAL_CTRL, __readmsr(IA32_PERF_GLOBAL_CTRL) & ~1ULL);
+    __writemsr(IA32_PERF_GLOBAL_OVF_CTRL, 1);
+
+    HalApicSetPerfCounterVector(HalApicBase, FALSE, 0, 0);
+}
+
+VOID
+KERNELAPI
+KiProfileBarrier(
+    IN PVOID Context)
+{
+    // Nothing to do. Samples are taken with interrupts disabled,
+    // so no sample is being taken on this processor.
+}
+
+/**
+ * @brief Handles the counter overflow NMI.
+ *
+ * @param [in] InterruptFrame   Interrupt stack frame of the interrupted context.
+ *
+ * @return TRUE if the NMI was raised by the profile counter.
+ */
+BOOLEAN
+KiProfileNmi(
+    IN KSTACK_FRAME_INTERRUPT *InterruptFrame)
+{
+    if (!KiProfilePmuEnabled)
+    {
+        return FALSE;
+    }
+
+    if (!(__readmsr(IA32_PERF_GLOBAL_STATUS) & 1))
+    {
+        return FALSE;
+    }
+
+    // Overflow after stop is consumed without re-arming the counter.
+    if (KiProfileSource == ProfileSourceCycles)
+    {
+        KiProfileSample(InterruptFrame);
+
+        __writemsr(IA32_PMC0, (U64)-(S64)KiProfilePeriod);
+
+        // LVT entry is masked when the overflow interrupt is delivered.
+        HalApicSetPerfCounterVector(HalApicBase, TRUE, 4 /*delivery mode = NMI*/, 0);
+    }
+
+    __writemsr(IA32_PERF_GLOBAL_OVF_CTRL, 1);
+
+    return TRUE;
+}
+
+static
+VOID
+VARCALL
+KiWriteProfileLine(
+    IN CHAR8 *Format,
+    ...)
+{
+    va_list Args;
+    CHAR8 Buffer[256];
+    SIZE_T Length;
+
+    va_start(Args, Format);
+    Length = ClStrFormatU8V(Buffer, ARRAY_SIZE(Buffer), Format, Args);
+    va_end(Args);
+
+    DbgTraceSynchronousN(TraceLevelError, Buffer, Length);
+}
+
+/**
+ * @brief Starts sampling. Samples of the previous profile are discarded.
+ *
+ * @param [in] Source   Sample source.
+ * @param [in] Period   Cycles per sample for ProfileSourceCycles (0 for default).\n
+ *                      Ignored for ProfileSourceTimer which samples on every tick.
+ *
+ * @return ESTATUS code.\n
+ *         E_NOT_SUPPORTED if the profiler is not compiled in, or the source is not supported.\n
+ *         E_NOT_ENOUGH_MEMORY if the profile tables cannot be allocated.
+ */
+ESTATUS
+KERNELAPI
+KeStartProfile(
+    IN KPROFILE_SOURCE Source,
+    IN U32 Period)
+{
+#if KE_PROFILE
+    if (Source == ProfileSourceNone || Source >= ProfileSourceMaximum)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    if (KiProfileSource != ProfileSourceNone)
+    {
+        return E_ALREADY_EXISTS;
+    }
+
+    if (Source == ProfileSourceCycles)
+    {
+        // Not available under QEMU TCG. Use ProfileSourceTimer instead.
+        if (!KiProfileIsPmuSupported())
+        {
+            return E_NOT_SUPPORTED;
+        }
+
+        if (!Period)
+        {
+            Period = KE_PROFILE_DEFAULT_PERIOD;
+        }
+
+        if (Period > 0x7fffffff)
+        {
+            return E_INVALID_PARAMETER;
+        }
+    }
+    else
+    {
+        Period = 0;
+    }
+
+    U64 Mask = KiProcessorMask;
+
+    while (Mask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, Mask);
+        Mask &= Mask - 1;
+
+        KPROCESSOR *Processor = KiProcessorBlocks[ProcessorId];
+
+        // Tables are kept after the profile is stopped, so they are allocated only once.
+        if (!Processor->Profile)
+        {
+            KPROFILE_TABLE *Table = (KPROFILE_TABLE *)MmAllocatePool(PoolTypeNonPaged,
+                sizeof(KPROFILE_TABLE), 0x10, 0);
+            if (!Table)
+            {
+                return E_NOT_ENOUGH_MEMORY;
+            }
+
+            Processor->Profile = Table;
+        }
+
+        memset(Processor->Profile, 0, sizeof(KPROFILE_TABLE));
+    }
+
+    KiProfilePeriod = Period;
+    KiProfileLastSource = Source;
+    KiProfileStartTick = HalGetTickCount();
+    KiProfileStopTick = KiProfileStartTick;
+
+    _mm_mfence();
+    KiProfileSource = Source;
+
+    if (Source == ProfileSourceCycles)
+    {
+        KiProfilePmuEnabled = TRUE;
+        KeIpiGenericCall(KiProcessorMask, &KiProfileStartCounter, NULL, TRUE);
+    }
+
+    return E_SUCCESS;
+#else
+    return E_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Stops sampling.\n
+ *        Returns after the samples being taken on other processors are completed.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeStopProfile(
+    VOID)
+{
+    KPROFILE_SOURCE Source = KiProfileSource;
+
+    if (Source == ProfileSourceNone)
+    {
+        return;
+    }
+
+    KiProfileSource = ProfileSourceNone;
+    KiProfileStopTick = HalGetTickCount();
+    _mm_mfence();
+
+    KeIpiGenericCall(KiProcessorMask,
+        Source == ProfileSourceCycles ? &KiProfileStopCounter : &KiProfileBarrier, NULL, TRUE);
+}
+
+/**
+ * @brief Stops sampling and writes the samples to the debug port.\n
+ *        Output waits for the line, so it may take a while on serial port.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeDumpProfile(
+    VOID)
+{
+    KeStopProfile();
+
+    KiWriteProfileLine("\n" KPROF_DUMP_PREFIX " H %d %d %d %d %lld %llx\n",
+        KPROF_DUMP_VERSION, KeGetProcessorCount(), KiProfileLastSource, KiProfilePeriod,
+        KiProfileStopTick - KiProfileStartTick, KiLoadedBase);
+
+    //
+    // Thread names for the samples.
+    //
+
+    KIRQL PrevIrql;
+    KeAcquireSpinlockRaiseIrql(&KiThreadListLock, IRQL_CONTEXT_SWITCH, &PrevIrql);
+
+    for (DLIST_ENTRY *Link = KiThreadListHead.Next; Link != &KiThreadListHead; Link = Link->Next)
+    {
+        KTHREAD *Thread = CONTAINING_RECORD(Link, KTHREAD, ThreadList);
+        KiWriteProfileLine(KPROF_DUMP_PREFIX " T %lld %s\n", Thread->ThreadId, Thread->Name);
+    }
+
+    KeReleaseSpinlockLowerIrql(&KiThreadListLock, PrevIrql);
+
+    U64 Mask = KiProcessorMask;
+
+    while (Mask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, Mask);
+        Mask &= Mask - 1;
+
+        KPROFILE_TABLE *Table = KiProcessorBlocks[ProcessorId]->Profile;
+        if (!Table)
+        {
+            continue;
+        }
+
+        KiWriteProfileLine(KPROF_DUMP_PREFIX " P %d %lld %lld\n",
+            ProcessorId, Table->Samples, Table->Dropped);
+
+        for (U32 i = 0; i < KE_PROFILE_BUCKETS; i++)
+        {
+            KPROFILE_BUCKET *Bucket = &Table->Buckets[i];
+            if (!Bucket->Rip)
+            {
+                continue;
+            }
+
+            // RIP relative to the kernel base. Host tool adds the image base of core.sys.
+            KiWriteProfileLine(KPROF_DUMP_PREFIX " S %d %lld %llx %lld\n",
+                ProcessorId, Bucket->ThreadId, Bucket->Rip - KiLoadedBase, Bucket->Count);
+        }
+    }
+
+    KiWriteProfileLine(KPROF_DUMP_PREFIX " E\n");
+}
+
+/**
+ * @brief Profiles for KE_PROFILE_AT_BOOT_MS and dumps the result.\n
+ *        Uses the performance counter if available, local APIC timer otherwise.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeProfileAtBoot(
+    VOID)
+{
+    KEVENT Event;
+
+    ESTATUS Status = KeStartProfile(ProfileSourceCycles, KE_PROFILE_DEFAULT_PERIOD);
+    if (Status == E_NOT_SUPPORTED)
+    {
+        Status = KeStartProfile(ProfileSourceTimer, 0);
+    }
+
+    if (!E_IS_SUCCESS(Status))
+    {
+        return;
+    }
+
+    DASSERT(E_IS_SUCCESS(KeInitializeEvent(&Event, SynchronizationEvent, FALSE)));
+
+    // Nobody signals the event. Just sleep.
+    KeWaitForSingleObject(&Event.Header, KE_PROFILE_AT_BOOT_MS);
+
+    KeDumpProfile();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <base/base.h>
+
+typedef struct _KPROCESSOR          KPROCESSOR;
+typedef struct _KSTACK_FRAME_INTERRUPT  KSTACK_FRAME_INTERRUPT;
+
+//
+// Statistical profiler.
+// Samples interrupted RIP and current thread, and counts them in per-processor hash tables.
+// Samples are taken with interrupts disabled on the sampled processor, so no lock is needed.
+// Tables are allocated by the first KeStartProfile(), so the profiler costs no memory until used.
+//
+// ProfileSourceTimer samples from the local APIC timer interrupt. Works everywhere (including
+// QEMU TCG), but code running with interrupts disabled is not sampled and nothing is sampled
+// while the tick is stopped.
+// ProfileSourceCycles samples on architectural performance counter overflow (unhalted core
+// cycles) which is delivered as NMI, so code running with interrupts disabled is sampled too.
+//
+// KeDumpProfile() writes the tables to the debug port as text lines prefixed with
+// KPROF_DUMP_PREFIX. RIP is written as offset from the kernel base, so it can be resolved
+// against core.sys by Utility/Tools/Profile.
+//
+
+#ifndef KE_PROFILE
+#define KE_PROFILE                          1           //!< Compiles the sampling hooks in.
+#endif
+
+#ifndef KE_PROFILE_AT_BOOT
+#define KE_PROFILE_AT_BOOT                  0           //!< Profiles for a while at boot and dumps the result if non-zero.
+#endif
+
+#define KE_PROFILE_BUCKETS                  0x1000      //!< Hash buckets per processor. Must be power of 2.
+#define KE_PROFILE_PROBE_MAX                0x10        //!< Sample is dropped if no bucket is found within this.
+#define KE_PROFILE_AT_BOOT_MS               1000        //!< Profile duration at boot.
+#define KE_PROFILE_DEFAULT_PERIOD           1000000     //!< Cycles per sample for ProfileSourceCycles.
+
+#define KPROF_DUMP_PREFIX                   "#KPROF"
+#define KPROF_DUMP_VERSION                  1
+
+//
+// Architectural performance monitoring MSRs.
+//
+
+#define IA32_PMC0                           0xc1
+#define IA32_PERFEVTSEL0                    0x186
+#define IA32_PERF_GLOBAL_STATUS             0x38e
+#define IA32_PERF_GLOBAL_CTRL               0x38f
+#define IA32_PERF_GLOBAL_OVF_CTRL           0x390
+
+#define PERFEVTSEL_USR                      (1ULL << 16)
+#define PERFEVTSEL_OS                       (1ULL << 17)
+#define PERFEVTSEL_INT                      (1ULL << 20)
+#define PERFEVTSEL_EN                       (1ULL << 22)
+
+#define PERFEVT_UNHALTED_CORE_CYCLES        0x003c      // Event select 0x3c, umask 0x00
+
+typedef enum _KPROFILE_SOURCE
+{
+    ProfileSourceNone,
+    ProfileSourceTimer,                     // Local APIC timer interrupt
+    ProfileSourceCycles,                    // Performance counter overflow NMI
+    ProfileSourceMaximum,
+} KPROFILE_SOURCE;
+
+typedef struct _KPROFILE_BUCKET
+{
+    U64 Rip;                                // Zero if bucket is free
+    U64 ThreadId;
+    U64 Count;
+} KPROFILE_BUCKET;
+
+typedef struct _KPROFILE_TABLE
+{
+    U64 Samples;                            // Samples taken since the profile is started
+    U64 Dropped;                            // Samples not counted as the table is full
+    KPROFILE_BUCKET Buckets[KE_PROFILE_BUCKETS];
+} KPROFILE_TABLE;
+
+
+extern volatile KPROFILE_SOURCE KiProfileSource;
+extern PTR KiLoadedBase;
+
+
+VOID
+KiInitializeProfile(
+    IN KPROCESSOR *Processor);
+
+VOID
+KiProfileSample(
+    IN KSTACK_FRAME_INTERRUPT *InterruptFrame);
+
+BOOLEAN
+KiProfileNmi(
+    IN KSTACK_FRAME_INTERRUPT *InterruptFrame);
+
+ESTATUS
+KERNELAPI
+KeStartProfile(
+    IN KPROFILE_SOURCE Source,
+    IN U32 Period);
+
+VOID
+KERNELAPI
+KeStopProfile(
+    VOID);
+
+VOID
+KERNELAPI
+KeDumpProfile(
+    VOID);
+
+VOID
+KERNELAPI
+KeProfileAtBoot(
+    VOID);
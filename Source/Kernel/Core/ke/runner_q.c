@@ -15,6 +15,21 @@
 #include <ke/thread.h>
 #include <ke/runner_q.h>
 
+static
+U32
+KiRqCountLevel(
+    IN KRUNNER_QUEUE *RunnerQueue,
+    IN ULONG Level)
+{
+    DLIST_ENTRY *ListHead = &RunnerQueue->ListHead[Level];
+    U32 Count = 0;
+
+    for (DLIST_ENTRY *Link = ListHead->Next; Link != ListHead; Link = Link->Next)
+        Count++;
+
+    return Count;
+}
+
 ESTATUS
 KiRqInitialize(
     IN KRUNNER_QUEUE *RunnerQueue,
@@ -31,6 +46,7 @@ KiRqInitialize(
 
     RunnerQueue->SchedClass = SchedClass;
     RunnerQueue->QueuedState = 0;
+    RunnerQueue->Count = 0;
 
     return E_SUCCESS;
 }
@@ -60,6 +76,7 @@ KiRqEnqueue(
     }
 
     RunnerQueue->QueuedState |= (1ULL << Level);
+    RunnerQueue->Count++;
 
     Thread->RunnerQueue = RunnerQueue;
     Thread->RunnerLevel = Level;
@@ -145,6 +162,8 @@ KiRqDequeue(
             RunnerQueue->QueuedState &= ~(1ULL << TargetLevel);
         }
 
+        RunnerQueue->Count--;
+
         TargetThread->RunnerQueue = NULL;
         TargetThread->RunnerLevel = -1;
     }
@@ -173,6 +192,8 @@ KiRqRemove(
         RunnerQueue->QueuedState &= ~(1ULL << Level);
     }
 
+    RunnerQueue->Count--;
+
     Thread->RunnerQueue = NULL;
     Thread->RunnerLevel = -1;
 
@@ -230,9 +251,19 @@ KiRqSwap(
         TempState = RunnerQueue1->QueuedState;
         RunnerQueue1->QueuedState = RunnerQueue2->QueuedState;
         RunnerQueue2->QueuedState = TempState;
+
+        U32 TempCount = RunnerQueue1->Count;
+        RunnerQueue1->Count = RunnerQueue2->Count;
+        RunnerQueue2->Count = TempCount;
     }
     else
     {
+        U32 Count1 = KiRqCountLevel(RunnerQueue1, Level);
+        U32 Count2 = KiRqCountLevel(RunnerQueue2, Level);
+
+        RunnerQueue1->Count = RunnerQueue1->Count - Count1 + Count2;
+        RunnerQueue2->Count = RunnerQueue2->Count - Count2 + Count1;
+
         DListMoveAfter(&TempListHead1, &RunnerQueue1->ListHead[Level]);
         DListMoveAfter(&TempListHead2, &RunnerQueue2->ListHead[Level]);
         DListMoveAfter(&RunnerQueue1->ListHead[Level], &TempListHead2);
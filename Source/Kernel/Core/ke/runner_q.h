@@ -14,6 +14,7 @@ typedef struct _KRUNNER_QUEUE
     ULONG Levels;
     DLIST_ENTRY ListHead[RUNNER_QUEUE_MAX_LEVELS];
     U64 QueuedState;    // Bitmap which represents queued state
+    U32 Count;          // Number of queued threads
     KSCHED_CLASS *SchedClass;
 } KRUNNER_QUEUE;
 
@@ -21,6 +21,9 @@
 #include <ke/thread.h>
 #include <ke/process.h>
 #include <ke/sched.h>
+#include <ke/xstate.h>
+#include <ke/pcid.h>
+#include <ke/evtrace.h>
 
 U64
 KiTestSystemThreadStart(
@@ -101,6 +104,9 @@ KiProcessorSchedInitialize(
         &KiSchedNormalInsertThread, &KiSchedNormalRemoveThread, 
         &KiSchedNormalPeekThread, &KiSchedNormalNextThread, NULL, KSCHED_NORMAL_CLASS_LEVELS));
 
+    NormalClass->ProcessorId = Processor->ProcessorId;
+    KeRegisterSpinlockStatistics(&NormalClass->Lock, "SchedNormal", Processor->ProcessorId);
+
     //
     // Create idle thread.
     //
@@ -113,7 +119,13 @@ KiProcessorSchedInitialize(
 
     DASSERT(E_IS_SUCCESS(KiInsertThread(&KiIdleProcess, IdleThread)));
 
+    // Idle thread never leaves its processor.
+    IdleThread->LastProcessorId = Processor->ProcessorId;
+    IdleThread->Affinity = AFFINITY_PROCESSOR(Processor->ProcessorId);
+    IdleThread->IdealProcessor = Processor->ProcessorId;
+
     Processor->CurrentThread = IdleThread;
+    Processor->IdleThread = IdleThread;
     Processor->SchedNormalClass = NormalClass;
 
 
@@ -128,7 +140,7 @@ KiProcessorSchedInitialize(
 
     DASSERT(E_IS_SUCCESS(KiInsertThread(&KiSystemProcess, TestThread)));
 
-    DASSERT(KiSchedInsertThread(KeGetCurrentProcessor()->SchedNormalClass, TestThread, KSCHED_READY_QUEUE));
+    DASSERT(KiSchedInsertThreadToProcessor(KiSchedSelectProcessor(TestThread), TestThread, KSCHED_READY_QUEUE));
 }
 
 VOID
@@ -158,54 +170,119 @@ KiScheduleNextThread(
 
     KPROCESSOR *Processor = KeGetCurrentProcessor();
     KTHREAD *CurrentThread = Processor->CurrentThread;
+    KSCHED_CLASS *Scheduler = Processor->SchedNormalClass;
 
     KTHREAD *NextThread = NULL;
+    KTHREAD *PushThread = NULL;
+    KTHREAD *ReadyThread = NULL;
+
+    // Other processors can migrate queued threads, so the lock is held until the context is saved.
+    KeAcquireSpinlock(&Scheduler->Lock);
 
     CurrentThread->ContextSwitchCount++;
+    CurrentThread->LastRunTick = Scheduler->Balance.TickCount;
+
+    KeAcquireSpinlock(&CurrentThread->Lock);
+    BOOLEAN InWaiting = CurrentThread->InWaiting;
+    KeReleaseSpinlock(&CurrentThread->Lock);
+
+    if (!InWaiting)
+    {
+        if (AFFINITY_CONTAINS(CurrentThread->Affinity, Processor->ProcessorId))
+        {
+            DASSERT(KiSchedInsertThread(Scheduler, CurrentThread, KSCHED_IDLE_QUEUE));
+        }
+        else
+        {
+            // Affinity is changed. Move to the allowed processor after the context is saved.
+            PushThread = CurrentThread;
+        }
+    }
 
-    if (!CurrentThread->InWaiting)
+    // Only the idle thread is left. Steal from the busiest processor.
+    if (KiSchedGetLoad(Scheduler) <= 1)
     {
-        DASSERT(KiSchedInsertThread(Processor->SchedNormalClass, CurrentThread, KSCHED_IDLE_QUEUE));
+        KiSchedStealThread(Processor);
     }
     
-    DASSERT(KiSchedNextThread(Processor->SchedNormalClass, &NextThread));
+    DASSERT(KiSchedNextThread(Scheduler, &NextThread));
     DASSERT(NextThread);
 
     Processor->CurrentThread = NextThread;
+    NextThread->LastProcessorId = Processor->ProcessorId;
 
     // We don't need to save/load context from same thread. (especially CR3!)
     if (CurrentThread == NextThread)
     {
+        DASSERT(!PushThread);
+        KeReleaseSpinlock(&Scheduler->Lock);
         return E_NOT_PERFORMED;
     }
 
+    KTRACE_EVENT3(EventTraceContextSwitch, CurrentThread->ThreadId, NextThread->ThreadId, InWaiting);
+
     // Save current thread context.
     KiLoadFrameToContext(InterruptFrame, &CurrentThread->ThreadContext);
-    CurrentThread->ThreadContext.CR3 = __readcr3();
+    CurrentThread->ThreadContext.CR3 = __readcr3() & ~ARCH_X64_CR3_PCID_MASK;
 
+    if (KiXStateEagerSwitch)
+    {
+        KiSaveExtendedState(CurrentThread->XState);
+    }
     // Check whether the SSE instruction was executed during thread quantum.
-    if (!(__readcr0() & ARCH_X64_CR0_TS))
+    else if (!(__readcr0() & ARCH_X64_CR0_TS))
     {
         // Save SSE state as this thread uses SSE instructions
-        _fxsave64(&CurrentThread->ThreadContext.FXSTATE);
+        KiSaveExtendedState(CurrentThread->XState);
 
         // Set CR0.TS to catch next #NM
         __writecr0(__readcr0() | ARCH_X64_CR0_TS);
     }
 
+    if (InWaiting)
+    {
+        // Context is saved. From now on, the thread is readied by whoever unwaits it.
+        KeAcquireSpinlock(&CurrentThread->Lock);
+
+        if (CurrentThread->InWaiting)
+        {
+            CurrentThread->WaitParked = TRUE;
+        }
+        else
+        {
+            // Unwaited while switching out.
+            ReadyThread = CurrentThread;
+        }
+
+        KeReleaseSpinlock(&CurrentThread->Lock);
+    }
+
+    KeReleaseSpinlock(&Scheduler->Lock);
+
+    if (PushThread)
+    {
+        PushThread->MigrationCount++;
+        DASSERT(KiSchedInsertThreadToProcessor(KiSchedSelectProcessor(PushThread), PushThread, KSCHED_READY_QUEUE));
+    }
+
+    if (ReadyThread)
+    {
+        DASSERT(KiSchedReadyThread(ReadyThread));
+    }
+
     // Load context from next thread.
     KiLoadContextToFrame(InterruptFrame, &NextThread->ThreadContext);
 
     // Reload CR3 only if needed.
-    // Note that writing the CR3 flushes the TLB.
-    if (__readcr3() != NextThread->ThreadContext.CR3)
+    // TLB is not flushed if the PCID of the next process is still valid.
+    KiSwitchAddressSpace(Processor, NextThread);
+
+    // In lazy switch, SSE state is restored in #NM handler
+    if (KiXStateEagerSwitch)
     {
-        __writecr3(NextThread->ThreadContext.CR3);
+        KiRestoreExtendedState(NextThread->XState);
     }
 
-    // We don't have to restore SSE state here
-    // We'll restore SSE state in #NM handler
-
     if (PreviousThread)
     {
         *PreviousThread = CurrentThread;
@@ -225,11 +302,13 @@ KiScheduleSwitchContext(
 {
     DASSERT(KeGetCurrentIrql() == IRQL_CONTEXT_SWITCH);
 
-    BOOLEAN Expired = FALSE;
     KPROCESSOR *Processor = KeGetCurrentProcessor();
     KTHREAD *CurrentThread = Processor->CurrentThread;
 
     DASSERT(CurrentThread);
+
+    // Balance the load first. Idle thread is preempted if there is something to run.
+    BOOLEAN Expired = KiSchedBalanceTick(Processor);
     
     KiConsumeTimeslice(CurrentThread, 1, &Expired);
 
@@ -241,7 +320,9 @@ KiScheduleSwitchContext(
     // Recalculate the timeslice and quantum by priority.
     U32 LastTimeslices = CurrentThread->CurrentTimeslices;
 
-    CurrentThread->Priority = CurrentThread->BasePriority;
+    // Keep the priority inherited from mutex waiters.
+    CurrentThread->Priority = CurrentThread->BasePriority > CurrentThread->InheritedPriority ? 
+        CurrentThread->BasePriority : CurrentThread->InheritedPriority;
     CurrentThread->ThreadQuantum = // PRIORITY_TO_THREAD_QUANTUM(LastPriority)
         CurrentThread->Priority >= 2 ? CurrentThread->Priority / 2 : 1;
 
@@ -366,3 +447,49 @@ KiYieldThread(
     return (ESTATUS)Result;
 }
 
+ESTATUS
+KeSetThreadAffinity(
+    IN KTHREAD *Thread,
+    IN KAFFINITY Affinity)
+{
+    Affinity &= KeGetProcessorMask();
+
+    // Idle threads are bound to their processor.
+    if (!Affinity || Thread->OwnerProcess == &KiIdleProcess)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    KIRQL PrevIrql = KiLockThread(Thread);
+    Thread->Affinity = Affinity;
+    KiUnlockThread(Thread, PrevIrql);
+
+    // Queued thread is moved now. 
+    // Thread running on other processor is moved when it is switched out.
+    KiSchedMigrateQueuedThread(Thread);
+
+    if (Thread == KeGetCurrentThread() && 
+        !AFFINITY_CONTAINS(Affinity, KeGetCurrentProcessorId()))
+    {
+        KiYieldThread();
+    }
+
+    return E_SUCCESS;
+}
+
+ESTATUS
+KeSetThreadIdealProcessor(
+    IN KTHREAD *Thread,
+    IN U32 ProcessorId)
+{
+    if (ProcessorId != THREAD_IDEAL_PROCESSOR_NONE && 
+        (ProcessorId >= KeGetProcessorCount() || !AFFINITY_CONTAINS(Thread->Affinity, ProcessorId)))
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    // Takes effect on next placement or balancing.
+    Thread->IdealProcessor = ProcessorId;
+
+    return E_SUCCESS;
+}
@@ -2,6 +2,7 @@
 #pragma once
 #include <ke/sched_base.h>
 #include <ke/sched_normal.h>
+#include <ke/sched_balance.h>
 
 
 VOID
@@ -19,3 +20,13 @@ KiYieldThreadInternal(
 ESTATUS
 KiYieldThread(
     VOID);
+
+ESTATUS
+KeSetThreadAffinity(
+    IN KTHREAD *Thread,
+    IN KAFFINITY Affinity);
+
+ESTATUS
+KeSetThreadIdealProcessor(
+    IN KTHREAD *Thread,
+    IN U32 ProcessorId);
@@ -0,0 +1,455 @@
+/**
+ * @file sched_balance.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements load balancing between processors.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/sched_balance.h>
+#include <hal/processor.h>
+
+//
+// Each processor owns its scheduler class, so threads only move between processors here.
+// The puller holds its own class lock and only try-locks the source class,
+// which keeps the lock order free of deadlock without ordering the processors.
+// Other paths never hold two class locks at the same time.
+// Threads are only placed on processors allowed by their affinity.
+//
+
+U32
+KiSchedGetLoad(
+    IN KSCHED_CLASS *Scheduler)
+{
+    // Idle thread of the processor is either running or queued, so the number of queued threads
+    // equals the number of runnable threads except the idle thread.
+    return Scheduler->ReadyQueue->Count + Scheduler->ReadySwapQueue->Count + Scheduler->IdleQueue->Count;
+}
+
+static
+BOOLEAN
+KiSchedIsCacheHot(
+    IN KTHREAD *Thread,
+    IN KSCHED_CLASS *This,
+    IN KSCHED_CLASS *Source)
+{
+    // Thread which has never run has nothing in cache.
+    if (!Thread->ContextSwitchCount)
+    {
+        return FALSE;
+    }
+
+    // Moving back to the ideal processor is always worth it.
+    if (Thread->IdealProcessor == This->ProcessorId)
+    {
+        return FALSE;
+    }
+
+    return Source->Balance.TickCount - Thread->LastRunTick < KSCHED_MIGRATION_COST_TICKS;
+}
+
+static
+KPROCESSOR *
+KiSchedFindBusiestProcessor(
+    IN KPROCESSOR *Processor,
+    OUT U32 *BusiestLoad)
+{
+    KPROCESSOR *Busiest = NULL;
+    U32 MaximumLoad = 0;
+
+    for (U32 i = 0; i < KeGetProcessorCount(); i++)
+    {
+        KPROCESSOR *Target = KiProcessorBlocks[i];
+
+        // Scheduler of the processor is not initialized yet.
+        if (!Target || Target == Processor || !Target->SchedNormalClass)
+        {
+            continue;
+        }
+
+        // Read without lock. Load can be changed before the pull.
+        U32 Load = KiSchedGetLoad(Target->SchedNormalClass);
+        if (MaximumLoad < Load)
+        {
+            MaximumLoad = Load;
+            Busiest = Target;
+        }
+    }
+
+    *BusiestLoad = MaximumLoad;
+
+    return Busiest;
+}
+
+static
+KTHREAD *
+KiSchedFindMigratableThread(
+    IN KSCHED_CLASS *This,
+    IN KPROCESSOR *Source,
+    IN BOOLEAN AllowHot)
+{
+    KSCHED_CLASS *SourceClass = Source->SchedNormalClass;
+    KRUNNER_QUEUE *Queues[] = { SourceClass->ReadyQueue, SourceClass->ReadySwapQueue, SourceClass->IdleQueue };
+
+    // Search the busiest queue first.
+    for (U32 i = 1; i < COUNTOF(Queues); i++)
+    {
+        for (U32 j = i; j > 0 && Queues[j - 1]->Count < Queues[j]->Count; j--)
+        {
+            KRUNNER_QUEUE *Temp = Queues[j - 1];
+            Queues[j - 1] = Queues[j];
+            Queues[j] = Temp;
+        }
+    }
+
+    for (U32 i = 0; i < COUNTOF(Queues); i++)
+    {
+        KRUNNER_QUEUE *RunnerQueue = Queues[i];
+        U64 QueuedState = RunnerQueue->QueuedState;
+        unsigned long Level = 0;
+
+        // Highest level first.
+        while (_BitScanReverse64(&Level, QueuedState))
+        {
+            DLIST_ENTRY *ListHead = &RunnerQueue->ListHead[Level];
+
+            QueuedState &= ~(1ULL << Level);
+
+            for (DLIST_ENTRY *Link = ListHead->Next; Link != ListHead; Link = Link->Next)
+            {
+                KTHREAD *Thread = CONTAINING_RECORD(Link, KTHREAD, RunnerLinks);
+
+                if (Thread == Source->IdleThread || 
+                    !AFFINITY_CONTAINS(Thread->Affinity, This->ProcessorId))
+                {
+                    continue;
+                }
+
+                if (!AllowHot && KiSchedIsCacheHot(Thread, This, SourceClass))
+                {
+                    This->Balance.HotSkipCount++;
+                    continue;
+                }
+
+                return Thread;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static
+BOOLEAN
+KiSchedPullThread(
+    IN KPROCESSOR *Processor,
+    IN KPROCESSOR *Source)
+{
+    KSCHED_CLASS *This = Processor->SchedNormalClass;
+    KSCHED_CLASS *SourceClass = Source->SchedNormalClass;
+
+    // Caller holds the lock of this class.
+    if (!KeTryAcquireSpinlock(&SourceClass->Lock))
+    {
+        return FALSE;
+    }
+
+    BOOLEAN AllowHot = This->Balance.Failures >= KSCHED_BALANCE_FAILURES_MAX;
+    KTHREAD *Thread = KiSchedFindMigratableThread(This, Source, AllowHot);
+
+    if (Thread)
+    {
+        DASSERT(KiSchedRemoveThread(SourceClass, Thread));
+        DASSERT(KiSchedInsertThread(This, Thread, KSCHED_READY_QUEUE));
+        Thread->MigrationCount++;
+        This->Balance.Failures = 0;
+    }
+    else
+    {
+        This->Balance.Failures++;
+    }
+
+    KeReleaseSpinlock(&SourceClass->Lock);
+
+    return !!Thread;
+}
+
+BOOLEAN
+KiSchedStealThread(
+    IN KPROCESSOR *Processor)
+{
+    KSCHED_CLASS *This = Processor->SchedNormalClass;
+    U32 BusiestLoad = 0;
+    KPROCESSOR *Busiest = KiSchedFindBusiestProcessor(Processor, &BusiestLoad);
+
+    // Busiest processor runs one of them, so at least 2 threads are needed to steal one.
+    if (!Busiest || BusiestLoad < 2)
+    {
+        return FALSE;
+    }
+
+    if (!KiSchedPullThread(Processor, Busiest))
+    {
+        return FALSE;
+    }
+
+    This->Balance.StolenCount++;
+
+    return TRUE;
+}
+
+KPROCESSOR *
+KiSchedSelectProcessor(
+    IN KTHREAD *Thread)
+{
+    KAFFINITY Affinity = Thread->Affinity & KeGetProcessorMask();
+    KPROCESSOR *Current = KeGetCurrentProcessor();
+
+    DASSERT(Affinity);
+
+    // Ideal processor first, then the last processor as its cache may still be warm.
+    U32 PreferredIds[] = { Thread->IdealProcessor, Thread->ContextSwitchCount ? Thread->LastProcessorId : THREAD_IDEAL_PROCESSOR_NONE };
+
+    for (U32 i = 0; i < COUNTOF(PreferredIds); i++)
+    {
+        U32 ProcessorId = PreferredIds[i];
+
+        if (ProcessorId < KeGetProcessorCount() && AFFINITY_CONTAINS(Affinity, ProcessorId) && 
+            KiProcessorBlocks[ProcessorId] && KiProcessorBlocks[ProcessorId]->SchedNormalClass)
+        {
+            return KiProcessorBlocks[ProcessorId];
+        }
+    }
+
+    // Least loaded processor. Current processor wins the tie.
+    KPROCESSOR *Best = NULL;
+    U32 BestLoad = 0;
+
+    if (AFFINITY_CONTAINS(Affinity, Current->ProcessorId) && Current->SchedNormalClass)
+    {
+        Best = Current;
+        BestLoad = KiSchedGetLoad(Current->SchedNormalClass);
+    }
+
+    for (U32 i = 0; i < KeGetProcessorCount(); i++)
+    {
+        KPROCESSOR *Target = KiProcessorBlocks[i];
+
+        if (!AFFINITY_CONTAINS(Affinity, i) || !Target || !Target->SchedNormalClass)
+        {
+            continue;
+        }
+
+        U32 Load = KiSchedGetLoad(Target->SchedNormalClass);
+        if (!Best || BestLoad > Load)
+        {
+            Best = Target;
+            BestLoad = Load;
+        }
+    }
+
+    // No allowed processor has started scheduling yet.
+    return Best ? Best : Current;
+}
+
+BOOLEAN
+KiSchedInsertThreadToProcessor(
+    IN KPROCESSOR *Processor,
+    IN KTHREAD *Thread,
+    IN U32 Queue)
+{
+    KSCHED_CLASS *Scheduler = Processor->SchedNormalClass;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinlockRaiseIrqlToContextSwitch(&Scheduler->Lock, &PrevIrql);
+    BOOLEAN Result = KiSchedInsertThread(Scheduler, Thread, Queue);
+    KeReleaseSpinlockLowerIrql(&Scheduler->Lock, PrevIrql);
+
+    // Processor may be sleeping in tickless idle.
+    if (Result)
+    {
+        HalWakeProcessor(Processor->ProcessorId);
+    }
+
+    return Result;
+}
+
+BOOLEAN
+KiSchedReadyThread(
+    IN KTHREAD *Thread)
+{
+    KAFFINITY Affinity = Thread->Affinity & KeGetProcessorMask();
+    U32 ProcessorId = Thread->LastProcessorId;
+
+    // Wakes on the processor which it waited on, as its cache may still be warm.
+    if (ProcessorId < KeGetProcessorCount() && AFFINITY_CONTAINS(Affinity, ProcessorId) && 
+        KiProcessorBlocks[ProcessorId] && KiProcessorBlocks[ProcessorId]->SchedNormalClass)
+    {
+        return KiSchedInsertThreadToProcessor(KiProcessorBlocks[ProcessorId], Thread, KSCHED_READY_QUEUE);
+    }
+
+    Thread->MigrationCount++;
+
+    return KiSchedInsertThreadToProcessor(KiSchedSelectProcessor(Thread), Thread, KSCHED_READY_QUEUE);
+}
+
+BOOLEAN
+KiSchedMigrateQueuedThread(
+    IN KTHREAD *Thread)
+{
+    KSCHED_CLASS *Scheduler = NULL;
+    KIRQL PrevIrql;
+
+    for (;;)
+    {
+        KRUNNER_QUEUE *RunnerQueue = Thread->RunnerQueue;
+
+        // Running or waiting. It is moved when switched out.
+        if (!RunnerQueue)
+        {
+            return FALSE;
+        }
+
+        Scheduler = RunnerQueue->SchedClass;
+        KeAcquireSpinlockRaiseIrqlToContextSwitch(&Scheduler->Lock, &PrevIrql);
+
+        // Thread can be dequeued or migrated before we take the lock.
+        if (Thread->RunnerQueue && Thread->RunnerQueue->SchedClass == Scheduler)
+        {
+            break;
+        }
+
+        KeReleaseSpinlockLowerIrql(&Scheduler->Lock, PrevIrql);
+    }
+
+    if (AFFINITY_CONTAINS(Thread->Affinity, Scheduler->ProcessorId))
+    {
+        KeReleaseSpinlockLowerIrql(&Scheduler->Lock, PrevIrql);
+        return FALSE;
+    }
+
+    DASSERT(KiSchedRemoveThread(Scheduler, Thread));
+    KeReleaseSpinlockLowerIrql(&Scheduler->Lock, PrevIrql);
+
+    Thread->MigrationCount++;
+
+    return KiSchedInsertThreadToProcessor(KiSchedSelectProcessor(Thread), Thread, KSCHED_READY_QUEUE);
+}
+
+BOOLEAN
+KiSchedRequeueThread(
+    IN KTHREAD *Thread)
+{
+    KSCHED_CLASS *Scheduler = NULL;
+    KIRQL PrevIrql;
+
+    for (;;)
+    {
+        KRUNNER_QUEUE *RunnerQueue = Thread->RunnerQueue;
+
+        // Running or waiting. New priority is used when it is queued again.
+        if (!RunnerQueue)
+        {
+            return FALSE;
+        }
+
+        Scheduler = RunnerQueue->SchedClass;
+        KeAcquireSpinlockRaiseIrqlToContextSwitch(&Scheduler->Lock, &PrevIrql);
+
+        // Thread can be dequeued or migrated before we take the lock.
+        if (Thread->RunnerQueue && Thread->RunnerQueue->SchedClass == Scheduler)
+        {
+            break;
+        }
+
+        KeReleaseSpinlockLowerIrql(&Scheduler->Lock, PrevIrql);
+    }
+
+    // Stays in the same queue, only the level is changed.
+    KRUNNER_QUEUE *RunnerQueue = Thread->RunnerQueue;
+
+    if (Thread->RunnerLevel != Thread->Priority)
+    {
+        DASSERT(E_IS_SUCCESS(KiRqRemove(Thread)));
+        DASSERT(E_IS_SUCCESS(KiRqEnqueue(RunnerQueue, Thread, Thread->Priority, 0)));
+    }
+
+    KeReleaseSpinlockLowerIrql(&Scheduler->Lock, PrevIrql);
+
+    return TRUE;
+}
+
+BOOLEAN
+KiSchedBalanceTick(
+    IN KPROCESSOR *Processor)
+{
+    KSCHED_CLASS *This = Processor->SchedNormalClass;
+    KSCHED_BALANCE *Balance = &This->Balance;
+
+    KeAcquireSpinlock(&This->Lock);
+
+    U32 Load = KiSchedGetLoad(This);
+
+    Balance->TickCount++;
+    Balance->QueueDepthSum += Load;
+
+    if (Balance->QueueDepthMax < Load)
+        Balance->QueueDepthMax = Load;
+
+    if (Processor->CurrentThread == Processor->IdleThread && !Load)
+    {
+        // Nothing to run. Steal from the busiest processor.
+        KiSchedStealThread(Processor);
+    }
+    else if (!(Balance->TickCount % KSCHED_BALANCE_INTERVAL))
+    {
+        U32 BusiestLoad = 0;
+        KPROCESSOR *Busiest = KiSchedFindBusiestProcessor(Processor, &BusiestLoad);
+
+        if (Busiest && BusiestLoad >= Load + KSCHED_BALANCE_IMBALANCE_MIN && 
+            KiSchedPullThread(Processor, Busiest))
+        {
+            Balance->PulledCount++;
+        }
+    }
+
+    // Preempt the idle thread as soon as there is something to run.
+    BOOLEAN Reschedule = Processor->CurrentThread == Processor->IdleThread && KiSchedGetLoad(This) > 0;
+
+    KeReleaseSpinlock(&This->Lock);
+
+    return Reschedule;
+}
+
+VOID
+KeDumpSchedulerStatistics(
+    VOID)
+{
+    for (U32 i = 0; i < KeGetProcessorCount(); i++)
+    {
+        KPROCESSOR *Processor = KiProcessorBlocks[i];
+        KSCHED_CLASS *Scheduler = Processor ? Processor->SchedNormalClass : NULL;
+
+        if (!Scheduler)
+        {
+            continue;
+        }
+
+        // Read without lock.
+        KSCHED_BALANCE *Balance = &Scheduler->Balance;
+        U64 AverageDepth100 = Balance->TickCount ? Balance->QueueDepthSum * 100 / Balance->TickCount : 0;
+
+        DbgTraceF(TraceLevelDebug, 
+            "P%d: depth %d (avg %lld.%02lld, max %d), pulled %lld, stolen %lld, hot skipped %lld\n", 
+            i, KiSchedGetLoad(Scheduler), AverageDepth100 / 100, AverageDepth100 % 100, Balance->QueueDepthMax, 
+            Balance->PulledCount, Balance->StolenCount, Balance->HotSkipCount);
+    }
+}
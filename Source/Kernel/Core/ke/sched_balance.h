@@ -0,0 +1,49 @@
+#pragma once
+#include <ke/sched_base.h>
+
+typedef struct _KPROCESSOR          KPROCESSOR;
+
+#define KSCHED_BALANCE_INTERVAL             4   // Scheduler ticks between periodic balancing
+#define KSCHED_BALANCE_IMBALANCE_MIN        2   // Pulls only if the busiest processor has this many more threads
+#define KSCHED_BALANCE_FAILURES_MAX         4   // Cache-hot threads can be migrated after this many failures
+#define KSCHED_MIGRATION_COST_TICKS         2   // Thread switched out within this many ticks is cache-hot
+
+
+U32
+KiSchedGetLoad(
+    IN KSCHED_CLASS *Scheduler);
+
+BOOLEAN
+KiSchedStealThread(
+    IN KPROCESSOR *Processor);
+
+KPROCESSOR *
+KiSchedSelectProcessor(
+    IN KTHREAD *Thread);
+
+BOOLEAN
+KiSchedInsertThreadToProcessor(
+    IN KPROCESSOR *Processor,
+    IN KTHREAD *Thread,
+    IN U32 Queue);
+
+BOOLEAN
+KiSchedReadyThread(
+    IN KTHREAD *Thread);
+
+BOOLEAN
+KiSchedMigrateQueuedThread(
+    IN KTHREAD *Thread);
+
+BOOLEAN
+KiSchedRequeueThread(
+    IN KTHREAD *Thread);
+
+BOOLEAN
+KiSchedBalanceTick(
+    IN KPROCESSOR *Processor);
+
+VOID
+KeDumpSchedulerStatistics(
+    VOID);
+
@@ -44,9 +44,9 @@ KiSchedInitialize(
         if (!ReadyQueue || !IdleQueue || !ReadySwapQueue)
             break;
 
-        if (!E_IS_SUCCESS(KiRqInitialize(ReadyQueue, NULL, PriorityLevels)) ||
-            !E_IS_SUCCESS(KiRqInitialize(IdleQueue, NULL, PriorityLevels)) ||
-            !E_IS_SUCCESS(KiRqInitialize(ReadySwapQueue, NULL, PriorityLevels)))
+        if (!E_IS_SUCCESS(KiRqInitialize(ReadyQueue, Scheduler, PriorityLevels)) ||
+            !E_IS_SUCCESS(KiRqInitialize(IdleQueue, Scheduler, PriorityLevels)) ||
+            !E_IS_SUCCESS(KiRqInitialize(ReadySwapQueue, Scheduler, PriorityLevels)))
             break;
 
         Result = TRUE;
@@ -75,7 +75,7 @@ KiSchedInitialize(
     Scheduler->Next = Next;
     Scheduler->SchedulerContext = SchedulerContext;
     Scheduler->PriorityLevels = PriorityLevels;
-    Scheduler->Lock = 0;
+    KeInitializeSpinlock(&Scheduler->Lock);
 
     Scheduler->ReadyQueue = ReadyQueue;
     Scheduler->IdleQueue = IdleQueue;
@@ -1,5 +1,6 @@
 
 #pragma once
+#include <ke/lock.h>
 #include <ke/runner_q.h>
 
 
@@ -41,10 +42,27 @@ BOOLEAN
     OUT KTHREAD **Thread,
     IN PVOID SchedulerContext);
 
+//
+// Load balancing state and statistics of the scheduler class.
+// Queue depth is sampled on every scheduler tick.
+//
+
+typedef struct _KSCHED_BALANCE
+{
+    U64 TickCount;                  // Scheduler ticks
+    U32 Failures;                   // Consecutive balance attempts which found only cache-hot threads
+    U32 QueueDepthMax;
+    U64 QueueDepthSum;              // Average = QueueDepthSum / TickCount
+    U64 PulledCount;                // Threads pulled by periodic balancing
+    U64 StolenCount;                // Threads stolen while idle
+    U64 HotSkipCount;               // Candidates skipped as cache-hot
+} KSCHED_BALANCE;
+
 typedef struct _KSCHED_CLASS
 {
-    U32 Lock;
+    KSPIN_LOCK Lock;                // Protects queues. Other processors take this lock to migrate threads.
     U32 PriorityLevels;
+    U32 ProcessorId;                // Owner processor
 
     PKSCHEDULER_INSERT_THREAD Insert;
     PKSCHEDULER_REMOVE_THREAD Remove;
@@ -57,6 +75,8 @@ typedef struct _KSCHED_CLASS
     KRUNNER_QUEUE *ReadyQueue;
     KRUNNER_QUEUE *ReadySwapQueue;
 
+    KSCHED_BALANCE Balance;
+
     U32 Body[1];
 } KSCHED_CLASS;
 
@@ -0,0 +1,84 @@
+/**
+ * @file semaphore.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements semaphore object.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/wait.h>
+#include <ke/semaphore.h>
+
+
+ESTATUS
+KeInitializeSemaphore(
+    OUT KSEMAPHORE *Semaphore,
+    IN U32 Count,
+    IN U32 Limit)
+{
+    if (!Limit || Count > Limit)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    KiInitializeWaitHeader(&Semaphore->Header, WAIT_FLAG_WAKE_ONE, NULL);
+    Semaphore->Header.Type = WaitObjectSemaphore;
+    Semaphore->Count = Count;
+    Semaphore->Limit = Limit;
+
+    if (Count)
+    {
+        Semaphore->Header.State |= WAIT_STATE_SIGNALED;
+    }
+
+    return E_SUCCESS;
+}
+
+ESTATUS
+KeReleaseSemaphore(
+    IN KSEMAPHORE *Semaphore,
+    IN U32 Adjustment,
+    OUT U32 *PreviousCount OPTIONAL)
+{
+    KIRQL PrevIrql;
+
+    if (!Adjustment)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    KiLockWaitHeader(&Semaphore->Header, &PrevIrql);
+
+    U32 Count = Semaphore->Count;
+
+    if (Adjustment > Semaphore->Limit - Count)
+    {
+        KiUnlockWaitHeader(&Semaphore->Header, PrevIrql);
+        return E_INVALID_PARAMETER;
+    }
+
+    // Count is handed off to the waiters as much as possible.
+    Semaphore->Count += Adjustment;
+    KiSignalWaitHeader(&Semaphore->Header);
+
+    KiUnlockWaitHeader(&Semaphore->Header, PrevIrql);
+
+    if (PreviousCount)
+    {
+        *PreviousCount = Count;
+    }
+
+    return E_SUCCESS;
+}
+
+U32
+KeReadStateSemaphore(
+    IN KSEMAPHORE *Semaphore)
+{
+    return Semaphore->Count;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/wait.h>
+
+typedef struct _KSEMAPHORE
+{
+    KWAIT_HEADER Header;
+    U32 Count;              // Signaled if non-zero. Each satisfied wait decrements it.
+    U32 Limit;
+} KSEMAPHORE;
+
+
+ESTATUS
+KeInitializeSemaphore(
+    OUT KSEMAPHORE *Semaphore,
+    IN U32 Count,
+    IN U32 Limit);
+
+ESTATUS
+KeReleaseSemaphore(
+    IN KSEMAPHORE *Semaphore,
+    IN U32 Adjustment,
+    OUT U32 *PreviousCount OPTIONAL);
+
+U32
+KeReadStateSemaphore(
+    IN KSEMAPHORE *Semaphore);
@@ -17,15 +17,18 @@
 #include <init/bootgfx.h>
 #include <mm/pool.h>
 #include <mm/mm.h>
+#include <mm/slab.h>
 #include <ke/interrupt.h>
 #include <ke/inthandler.h>
 #include <ke/kprocessor.h>
 #include <ke/thread.h>
 #include <ke/process.h>
+#include <ke/xstate.h>
 
 U64 KiThreadIdSeed;
 DLIST_ENTRY KiThreadListHead;
 KSPIN_LOCK KiThreadListLock;
+SLAB_CACHE KiThreadCache;
 
 KTHREAD *
 KeGetCurrentThread(
@@ -58,6 +61,12 @@ KiInitializeThread(
     Thread->RunnerQueue = NULL;
     Thread->State = ThreadStateInitialize;
     Thread->InWaiting = FALSE;
+    Thread->WaitKey = WAIT_KEY_NONE;
+    KiInitializeTimer(&Thread->WaitTimer);
+    DListInitializeHead(&Thread->MutexList);
+    Thread->BlockingMutex = NULL;
+    Thread->Affinity = AFFINITY_ALL;
+    Thread->IdealProcessor = THREAD_IDEAL_PROCESSOR_NONE;
 
     if (ThreadName)
     {
@@ -233,7 +242,7 @@ KiAllocateThread(
     IN U64 ThreadId,
     IN CHAR *ThreadName)
 {
-    KTHREAD *Thread = (KTHREAD *)MmAllocatePool(PoolTypeNonPaged, sizeof(KTHREAD), 0x10, 0);
+    KTHREAD *Thread = (KTHREAD *)MmAllocateSlabObject(&KiThreadCache);
 
     if (!Thread)
     {
@@ -242,6 +251,13 @@ KiAllocateThread(
 
     KiInitializeThread(Thread, BasePriority, ThreadId, ThreadName);
 
+    Thread->XState = KiAllocateExtendedStateArea();
+    if (!Thread->XState)
+    {
+        MmFreeSlabObject(&KiThreadCache, Thread);
+        return NULL;
+    }
+
     return Thread;
 }
 
@@ -320,5 +336,6 @@ KiDeleteThread(
 {
     // @todo: Free members before process deletion
     //        Not implemented
-    MmFreePool(Thread);
+    KiFreeExtendedStateArea(Thread->XState);
+    MmFreeSlabObject(&KiThreadCache, Thread);
 }
@@ -2,13 +2,17 @@
 #pragma once
 
 #include <ke/lock.h>
+#include <ke/affinity.h>
 #include <ke/wait.h>
+#include <ke/timer.h>
 
 typedef struct _KSCHED_CLASS        KSCHED_CLASS;
 typedef struct _KRUNNER_QUEUE       KRUNNER_QUEUE;
 typedef struct _KPROCESS            KPROCESS;
 
 typedef struct _PHYSICAL_ADDRESSES  PHYSICAL_ADDRESSES;
+typedef struct _SLAB_CACHE          SLAB_CACHE;
+typedef struct _KMUTEX              KMUTEX;
 
 typedef enum _THREAD_STATE
 {
@@ -88,6 +92,15 @@ typedef struct _KTHREAD_FXSAVE64
     U8 NotUsed[16 * 3];
 } KTHREAD_FXSAVE64;
 
+typedef struct _KTHREAD_XSAVE64
+{
+    KTHREAD_FXSAVE64 Legacy;
+    U64 XStateBv;       // Components which are not in the initial state
+    U64 XCompBv;        // Bit 63 is set if the compacted format is used (XSAVES)
+    U64 Reserved[6];
+    // Extended region follows.
+} KTHREAD_XSAVE64;
+
 typedef struct _KTHREAD_CONTEXT
 {
     // GPRs (R0 - R15)
@@ -125,12 +138,11 @@ typedef struct _KTHREAD_CONTEXT
     // CR3 (Top-level paging structure pointer)
     U64 CR3;        // @todo: Remove this field. Use KTHTEAD.OwnerProcess->TopLevelPageTablePhysicalBase instead.
     U64 CR8;        // Previous IRQL
-
-    KTHREAD_FXSAVE64 FXSTATE;
 } KTHREAD_CONTEXT;
 #pragma pack(pop)
 
 #define THREAD_NAME_MAX_LENGTH              128
+#define THREAD_IDEAL_PROCESSOR_NONE         0xffffffff
 
 typedef
 U64
@@ -139,6 +151,7 @@ U64
 
 #define THREAD_BUILTIN_WAITER_BLOCK_COUNT       MAXIMUM_WAITER_BLOCKS_ALLOWED
 #define MAXIMUM_WAITER_BLOCKS_ALLOWED           64
+#define MAXIMUM_WAIT_OBJECTS                    (MAXIMUM_WAITER_BLOCKS_ALLOWED - 1)     // Last one is for the timeout timer
 
 typedef struct _KTHREAD
 {
@@ -160,6 +173,7 @@ typedef struct _KTHREAD
     DLIST_ENTRY RunnerLinks;        // Link to runner queue
     U32 BasePriority;               // Base priority
     U32 Priority;                   // Dynamic priority
+    U32 InheritedPriority;          // Highest priority of the threads waiting for owned mutexes
 
 	U32 CurrentTimeslices;
     S32 RemainingTimeslices;
@@ -171,18 +185,33 @@ typedef struct _KTHREAD
     THREAD_STATE State;
 
     BOOLEAN InWaiting;              // Non-zero if thread is in wait state (waiting objects to be signaled)
+    BOOLEAN WaitParked;             // Non-zero if thread is switched out in wait state (not in any runner queue)
+    KWAIT_TYPE WaitType;
+    U32 WaitCount;                  // Number of objects waiting, except the timeout timer
+    U32 WaitKey;                    // Index of the object which satisfied the wait, WAIT_KEY_NONE to check again
+    KTIMER WaitTimer;               // Timer for wait timeout
+    DLIST_ENTRY MutexList;          // Owned mutexes
+    KMUTEX *BlockingMutex;          // Mutex being acquired by KeAcquireMutex(), protected by the thread lock
+
+    U32 LastProcessorId;            // Processor which ran this thread last
+    U64 LastRunTick;                // Scheduler tick of LastProcessorId when the thread was switched out
+
+    KAFFINITY Affinity;             // Processors allowed to run this thread (hard affinity)
+    U32 IdealProcessor;             // Preferred processor, THREAD_IDEAL_PROCESSOR_NONE if not specified
 
     //
     // Statistics.
     //
 
 	U64 ContextSwitchCount;
+    U64 MigrationCount;
 
     //
     // Thread context.
     //
 
     KTHREAD_CONTEXT ThreadContext;
+    KTHREAD_XSAVE64 *XState;        // Extended state area. Its size depends on the processor (see KiXStateSize).
 
     //
     // Thread stack.
@@ -215,6 +244,7 @@ typedef struct _KSTACK_FRAME_INTERRUPT          KSTACK_FRAME_INTERRUPT;
 
 extern DLIST_ENTRY KiThreadListHead;
 extern KSPIN_LOCK KiThreadListLock;
+extern SLAB_CACHE KiThreadCache;
 
 
 
@@ -13,13 +13,22 @@
 
 #include <base/base.h>
 #include <ke/lock.h>
+#include <init/bootgfx.h>
 #include <ke/interrupt.h>
+#include <ke/kprocessor.h>
 #include <mm/pool.h>
 #include <ke/timer.h>
+#include <ke/evtrace.h>
 #include <hal/ptimer.h>
 
-KTIMER_LIST KiTimerList;
-
+//
+// Each processor owns a timer wheel and a timer is inserted to the wheel of the
+// processor which started it. Insert and cancel only link/unlink the timer, and
+// expiration is processed by the owner processor from its local APIC timer interrupt.
+//
+// Lock order is timer (wait header) -> wheel. Expiration already holds the wheel lock,
+// so it only try-locks the timer and retries on the next tick if the timer is busy.
+//
 
 
 VOID
@@ -30,135 +39,138 @@ KiInitializeTimer(
 
     KiInitializeWaitHeader(&Timer->WaitHeader, 0, NULL);
     DListInitializeHead(&Timer->TimerList);
+    Timer->Wheel = NULL;
     Timer->Interval = 0;
     Timer->ExpirationTimeAbsolute = 0;
 }
 
-KTIMER_NODE *
-KERNELAPI
-KiTimerNodeAllocate(
-    IN PVOID CallerContext)
+VOID
+KiInitializeTimerWheel(
+    OUT KTIMER_WHEEL *Wheel,
+    IN U32 ProcessorId)
 {
-    KTIMER_NODE *Node = (KTIMER_NODE *)MmAllocatePool(PoolTypeNonPaged, sizeof(*Node), 0x10, 0);
-    if (!Node)
-        return NULL;
+    memset(Wheel, 0, sizeof(*Wheel));
 
-    memset(Node, 0, sizeof(*Node));
-    DListInitializeHead(&Node->ListHead);
+    KeInitializeSpinlock(&Wheel->Lock);
+    Wheel->ProcessorId = ProcessorId;
+    Wheel->CurrentTime = HalGetTickCount();
+
+    for (U32 i = 0; i < KTIMER_WHEEL_ROOT_SIZE; i++)
+    {
+        DListInitializeHead(&Wheel->Root[i]);
+    }
 
-    return Node;
+    for (U32 Level = 0; Level < KTIMER_WHEEL_LEVELS; Level++)
+    {
+        for (U32 i = 0; i < KTIMER_WHEEL_LEVEL_SIZE; i++)
+        {
+            DListInitializeHead(&Wheel->Level[Level][i]);
+        }
+    }
 }
 
 VOID
-KERNELAPI
-KiTimerNodeDelete(
-    IN PVOID CallerContext,
-    IN KTIMER_NODE *TimerNode)
+KiInitializeTimers(
+    VOID)
 {
-    DASSERT(DListIsEmpty(&TimerNode->ListHead));
-    //DListRemoveEntry(&TimerNode->ListHead);
+    KPROCESSOR *Processor = KeGetCurrentProcessor();
 
-    MmFreePool(TimerNode);
+    KTIMER_WHEEL *Wheel = (KTIMER_WHEEL *)MmAllocatePool(PoolTypeNonPaged, sizeof(KTIMER_WHEEL), 0x10, 0);
+    if (!Wheel)
+    {
+        FATAL("Failed to allocate timer wheel");
+    }
+
+    KiInitializeTimerWheel(Wheel, Processor->ProcessorId);
+    KeRegisterSpinlockStatistics(&Wheel->Lock, "TimerWheel", Processor->ProcessorId);
+
+    Processor->TimerWheel = Wheel;
 }
 
-U64 *
-KERNELAPI
-KiTimerNodeGetKey(
-    IN PVOID CallerContext,
-    IN KTIMER_NODE *TimerNode)
+VOID
+KiLockTimerWheel(
+    IN KTIMER_WHEEL *Wheel,
+    OUT KIRQL *Irql)
 {
-    return &TimerNode->Key;
+    KeAcquireSpinlockRaiseIrqlToContextSwitch(&Wheel->Lock, Irql);
 }
 
 VOID
-KERNELAPI
-KiTimerNodeSetKey(
-    IN PVOID CallerContext,
-    IN KTIMER_NODE *TimerNode,
-    IN U64 *Key)
+KiUnlockTimerWheel(
+    IN KTIMER_WHEEL *Wheel,
+    IN KIRQL PrevIrql)
 {
-    TimerNode->Key = *Key;
+    KeReleaseSpinlockLowerIrql(&Wheel->Lock, PrevIrql);
 }
 
-INT
-KERNELAPI
-KiTimerNodeCompareKey(
-    IN PVOID CallerContext,
-    IN U64 *Key1,
-    IN U64 *Key2)
+VOID
+KiInsertTimerToWheel(
+    IN KTIMER_WHEEL *Wheel,
+    IN KTIMER *Timer)
 {
-    if (*Key1 < *Key2)
+    U64 Expiration = Timer->ExpirationTimeAbsolute;
+
+    // Already expired. Processed on the next tick.
+    if (Expiration < Wheel->CurrentTime)
+    {
+        Expiration = Wheel->CurrentTime;
+    }
+
+    U64 Delta = Expiration - Wheel->CurrentTime;
+
+    // Too far. Cascaded again when it reaches the end of the wheel.
+    if (Delta > KTIMER_WHEEL_SPAN_MAX)
     {
-        return -1;
+        Delta = KTIMER_WHEEL_SPAN_MAX;
+        Expiration = Wheel->CurrentTime + Delta;
     }
-    else if (*Key1 > *Key2)
+
+    DLIST_ENTRY *Slot = NULL;
+
+    if (Delta < KTIMER_WHEEL_ROOT_SIZE)
     {
-        return 1;
+        Slot = &Wheel->Root[Expiration & KTIMER_WHEEL_ROOT_MASK];
     }
     else
     {
-        return 0;
+        U32 Shift = KTIMER_WHEEL_ROOT_BITS;
+        U32 Level = 0;
+
+        while (Delta >= (1ULL << (Shift + KTIMER_WHEEL_LEVEL_BITS)))
+        {
+            Shift += KTIMER_WHEEL_LEVEL_BITS;
+            Level++;
+        }
+
+        DASSERT(Level < KTIMER_WHEEL_LEVELS);
+        Slot = &Wheel->Level[Level][(Expiration >> Shift) & KTIMER_WHEEL_LEVEL_MASK];
     }
-}
 
-SIZE_T
-KiTimerNodeToString(
-    IN PVOID CallerContext,
-    IN U64 *Key,
-    OUT CHAR *Buffer,
-    IN SIZE_T BufferLength)
-{
-    Buffer[0] = 0;
-    return 1;//sprintf(Buffer, "%llu", *Key);
+    DListInsertBefore(Slot, &Timer->TimerList);
 }
 
 VOID
-KiInitializeTimerList(
-    IN KTIMER_LIST *TimerList)
+KiRemoveTimerFromWheel(
+    IN KTIMER *Timer)
 {
-    RS_BINARY_TREE_OPERATIONS Operations = 
-    {
-        .AllocateNode = (PRS_BINARY_TREE_ALLOCATE_NODE)&KiTimerNodeAllocate,
-        .DeleteNode = (PRS_BINARY_TREE_DELETE_NODE)&KiTimerNodeDelete,
-        .GetKey = (PRS_BINARY_TREE_GET_NODE_KEY)&KiTimerNodeGetKey,
-        .SetKey = (PRS_BINARY_TREE_SET_NODE_KEY)&KiTimerNodeSetKey,
-        .CompareKey = (PRS_BINARY_TREE_COMPARE_KEY)&KiTimerNodeCompareKey,
-        .KeyToString = (PRS_BINARY_TREE_KEY_TO_STRING)&KiTimerNodeToString,
-    };
-
-    memset(TimerList, 0, sizeof(*TimerList));
-    RsBtInitialize(&TimerList->Tree, &Operations, NULL);
-}
+    KTIMER_WHEEL *Wheel = Timer->Wheel;
+    KIRQL PrevIrql;
 
-BOOLEAN
-KiTryLockTimerList(
-    IN KTIMER_LIST *TimerList,
-    OUT KIRQL *Irql)
-{
-    return KeTryAcquireSpinlockRaiseIrqlToContextSwitch(&TimerList->Lock, Irql);
-}
+    DASSERT(Timer->Inserted && Wheel);
 
-VOID
-KiLockTimerList(
-    IN KTIMER_LIST *TimerList,
-    OUT KIRQL *Irql)
-{
-    while (!KiTryLockTimerList(TimerList, Irql))
-        _mm_pause();
-}
+    KiLockTimerWheel(Wheel, &PrevIrql);
 
-VOID
-KiUnlockTimerList(
-    IN KTIMER_LIST *TimerList,
-    IN KIRQL PrevIrql)
-{
-    KeReleaseSpinlockLowerIrql(&TimerList->Lock, PrevIrql);
-}
+    DListRemoveEntry(&Timer->TimerList);
+    Wheel->Count--;
 
+    KiUnlockTimerWheel(Wheel, PrevIrql);
+
+    Timer->Inserted = FALSE;
+    Timer->Wheel = NULL;
+}
 
 ESTATUS
 KiInsertTimer(
-    IN KTIMER_LIST *TimerList,
     IN KTIMER *Timer,
     IN KTIMER_TYPE Type,
     IN U64 ExpirationTimeRelative)
@@ -169,148 +181,245 @@ KiInsertTimer(
         return E_INVALID_PARAMETER;
     }
 
+    if (Type == TimerPeriodic && !ExpirationTimeRelative)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    //
+    // Lock both timer and timer wheel before insert.
+    // IRQL is raised by the timer lock, so the current processor does not change from here.
     //
-    // Lock both timer and timer list before insert.
-    // 
 
+    U64 TickCount = HalGetTickCount();
     KIRQL PrevIrql;
     KIRQL PrevIrql2;
 
-    do
+    KiLockWaitHeader(&Timer->WaitHeader, &PrevIrql);
+
+    // Restart the timer if inserted.
+    if (Timer->Inserted)
     {
-        if (!KiTryLockWaitHeader(&Timer->WaitHeader, &PrevIrql))
-            continue;
+        KiRemoveTimerFromWheel(Timer);
+    }
 
-        if (!KiTryLockTimerList(TimerList, &PrevIrql2))
-        {
-            KiUnlockWaitHeader(&Timer->WaitHeader, PrevIrql);
-            continue;
-        }
+    KTIMER_WHEEL *Wheel = KeGetCurrentProcessor()->TimerWheel;
+    KiLockTimerWheel(Wheel, &PrevIrql2);
+
+    Timer->ExpirationTimeAbsolute = TickCount + ExpirationTimeRelative;
+    Timer->Interval = (Type == TimerPeriodic) ? ExpirationTimeRelative : 0;
+    Timer->Type = Type;
+    Timer->WaitHeader.State &= ~WAIT_STATE_SIGNALED;
+
+    KiInsertTimerToWheel(Wheel, Timer);
+    Wheel->Count++;
+
+    Timer->Wheel = Wheel;
+    Timer->Inserted = TRUE;
 
-        break;
-    } while (FALSE);
+    KTRACE_EVENT3(EventTraceTimerInsert, Timer, Timer->ExpirationTimeAbsolute, Timer->Interval);
 
+    KiUnlockTimerWheel(Wheel, PrevIrql2);
+    KiUnlockWaitHeader(&Timer->WaitHeader, PrevIrql);
+
+    return E_SUCCESS;
+}
+
+ESTATUS
+KiRemoveTimer(
+    IN KTIMER *Timer)
+{
+    KIRQL PrevIrql;
     ESTATUS Status = E_SUCCESS;
 
-    U64 ExpirationTimeAbsolute = HalGetTickCount() + ExpirationTimeRelative;
-    RS_BINARY_TREE_LINK *BaseNode = NULL;
+    KiLockWaitHeader(&Timer->WaitHeader, &PrevIrql);
 
-    if (!RsBtLookup(&TimerList->Tree, &ExpirationTimeAbsolute, &BaseNode))
+    if (Timer->Inserted)
     {
-        if (!RsBtInsert(&TimerList->Tree, &ExpirationTimeAbsolute))
-        {
-            Status = E_FAILED;
-            goto Cleanup;
-        }
+        KiRemoveTimerFromWheel(Timer);
+    }
+    else
+    {
+        // Not started or already expired.
+        Status = E_INVALID_PARAMETER;
+    }
+
+    KiUnlockWaitHeader(&Timer->WaitHeader, PrevIrql);
+
+    return Status;
+}
 
-        DASSERT(RsBtLookup(&TimerList->Tree, &ExpirationTimeAbsolute, &BaseNode));
+ESTATUS
+KiGetNextTimerExpiration(
+    IN KTIMER_WHEEL *Wheel,
+    OUT U64 *ExpirationTimeAbsolute)
+{
+    // Caller may be running with interrupts disabled. Do not spin.
+    if (!KeTryAcquireSpinlock(&Wheel->Lock))
+    {
+        return E_NOT_PERFORMED;
     }
 
-    DASSERT(BaseNode);
+    ESTATUS Status = E_NOT_FOUND;
 
-    KTIMER_NODE *TimerNode = (KTIMER_NODE *)BaseNode;
+    if (Wheel->Count)
+    {
+        //
+        // Scan the root up to the next cascade, which may bring timers down to the root.
+        // Timers in the upper levels never expire before that.
+        //
 
-    // Add to timer listhead.
-    Timer->ExpirationTimeAbsolute = ExpirationTimeAbsolute;
-    Timer->Type = Type;
-    Timer->Inserted = TRUE;
-    DListInsertAfter(&TimerNode->ListHead, &Timer->TimerList);
+        U64 Time = Wheel->CurrentTime;
 
+        for (U32 i = 0; i < KTIMER_WHEEL_ROOT_SIZE; i++, Time++)
+        {
+            if ((i && !(Time & KTIMER_WHEEL_ROOT_MASK)) ||
+                !DListIsEmpty(&Wheel->Root[Time & KTIMER_WHEEL_ROOT_MASK]))
+            {
+                break;
+            }
+        }
 
-Cleanup:
-    KiUnlockTimerList(TimerList, PrevIrql2);
-    KiUnlockWaitHeader(&Timer->WaitHeader, PrevIrql);
+        *ExpirationTimeAbsolute = Time;
+        Status = E_SUCCESS;
+    }
+
+    KeReleaseSpinlock(&Wheel->Lock);
 
     return Status;
 }
 
-ESTATUS
-KiRemoveTimer(
-    IN KTIMER_LIST *TimerList,
-    IN KTIMER *Timer)
+VOID
+KiCascadeTimers(
+    IN KTIMER_WHEEL *Wheel)
 {
-    KIRQL PrevIrql;
-    KIRQL PrevIrql2;
+    U32 Shift = KTIMER_WHEEL_ROOT_BITS;
 
-    do
+    //
+    // Called when the root wraps around. Move timers in the current slot of each level
+    // down to the lower levels, until a level which does not wrap around.
+    //
+
+    for (U32 Level = 0; Level < KTIMER_WHEEL_LEVELS; Level++)
     {
-        if (!KiTryLockWaitHeader(&Timer->WaitHeader, &PrevIrql))
-            continue;
+        U32 Index = (U32)(Wheel->CurrentTime >> Shift) & KTIMER_WHEEL_LEVEL_MASK;
+        DLIST_ENTRY *Slot = &Wheel->Level[Level][Index];
 
-        if (!KiTryLockTimerList(TimerList, &PrevIrql2))
+        if (!DListIsEmpty(Slot))
         {
-            KiUnlockWaitHeader(&Timer->WaitHeader, PrevIrql);
-            continue;
+            DLIST_ENTRY CascadeList;
+            DListInitializeHead(&CascadeList);
+            DListMoveAfter(&CascadeList, Slot);
+
+            while (!DListIsEmpty(&CascadeList))
+            {
+                KTIMER *Timer = CONTAINING_RECORD(CascadeList.Next, KTIMER, TimerList);
+                DListRemoveEntry(&Timer->TimerList);
+                KiInsertTimerToWheel(Wheel, Timer);
+            }
         }
 
-        break;
-    } while (FALSE);
+        if (Index)
+        {
+            break;
+        }
 
-    ESTATUS Status = E_SUCCESS;
+        Shift += KTIMER_WHEEL_LEVEL_BITS;
+    }
+}
 
-    if (!Timer->Inserted)
+VOID
+KiExpireTimer(
+    IN KTIMER_WHEEL *Wheel,
+    IN KTIMER *Timer)
+{
+    // Timeout was longer than the wheel. Not yet.
+    if (Timer->ExpirationTimeAbsolute >= Wheel->CurrentTime)
     {
-        Status = E_INVALID_PARAMETER;
-        goto Cleanup;
+        KiInsertTimerToWheel(Wheel, Timer);
+        return;
     }
 
-    U64 ExpirationTimeAbsolute = Timer->ExpirationTimeAbsolute;
-    RS_BINARY_TREE_LINK *BaseNode = NULL;
+    KIRQL PrevIrql;
 
-    if (!RsBtLookup(&TimerList->Tree, &ExpirationTimeAbsolute, &BaseNode))
+    if (!KiTryLockWaitHeader(&Timer->WaitHeader, &PrevIrql))
     {
-        Status = E_LOOKUP_FAILED;
-        goto Cleanup;
+        // Timer is being restarted or removed. Retry on the next tick.
+        KiInsertTimerToWheel(Wheel, Timer);
+        return;
     }
 
-    DASSERT(BaseNode);
-
-    KTIMER_NODE *TimerNode = (KTIMER_NODE *)BaseNode;
+    KiSignalWaitHeader(&Timer->WaitHeader);
+    Wheel->ExpiredCount++;
 
-    // Remove from timer listhead.
-    DListRemoveEntry(&Timer->TimerList);
-    Timer->Inserted = FALSE;
+    KTRACE_EVENT2(EventTraceTimerExpire, Timer, Timer->ExpirationTimeAbsolute);
 
-    if (DListIsEmpty(&TimerNode->ListHead))
+    if (Timer->Type == TimerPeriodic)
     {
-        // Timer node is empty. Remove it.
-        DASSERT(RsAvlDeleteByKey(&TimerList->Tree, &ExpirationTimeAbsolute));
+        Timer->ExpirationTimeAbsolute += Timer->Interval;
+        KiInsertTimerToWheel(Wheel, Timer);
+    }
+    else
+    {
+        Wheel->Count--;
+        Timer->Inserted = FALSE;
+        Timer->Wheel = NULL;
     }
 
-Cleanup:
-    KiUnlockTimerList(TimerList, PrevIrql2);
     KiUnlockWaitHeader(&Timer->WaitHeader, PrevIrql);
-
-    return Status;
 }
 
-ESTATUS
-KiLookupFirstExpiredTimerNode(
-    IN KTIMER_LIST *TimerList,
-    IN U64 ExpirationTimeAbsolute,
-    OUT KTIMER_NODE **TimerNode)
+VOID
+KiExpireTimers(
+    VOID)
 {
-    KTIMER_NODE *StartingNode = NULL;
-    U64 AbsoluteTime = 0;
+    KTIMER_WHEEL *Wheel = KeGetCurrentProcessor()->TimerWheel;
+    U64 TickCount = HalGetTickCount();
+    KIRQL PrevIrql;
 
-    if (!RsBtLookup2(&TimerList->Tree, &AbsoluteTime, 
-        RS_BT_LOOKUP_NEAREST_ABOVE | RS_BT_LOOKUP_FLAG_EQUAL, 
-        (RS_BINARY_TREE_LINK **)&StartingNode))
+    if (!Wheel)
     {
-        return E_NOT_FOUND;
+        return;
     }
 
-    if (StartingNode->Key > ExpirationTimeAbsolute)
-    {
-        return E_NOT_FOUND;
-    }
+    KiLockTimerWheel(Wheel, &PrevIrql);
 
-    if (TimerNode)
+    while (Wheel->CurrentTime <= TickCount)
     {
-        *TimerNode = StartingNode;
+        if (!Wheel->Count)
+        {
+            // Nothing to expire. Skip the empty slots.
+            Wheel->CurrentTime = TickCount + 1;
+            break;
+        }
+
+        U32 Index = (U32)Wheel->CurrentTime & KTIMER_WHEEL_ROOT_MASK;
+
+        if (!Index)
+        {
+            KiCascadeTimers(Wheel);
+        }
+
+        DLIST_ENTRY ExpiredList;
+        DListInitializeHead(&ExpiredList);
+
+        if (!DListIsEmpty(&Wheel->Root[Index]))
+        {
+            DListMoveAfter(&ExpiredList, &Wheel->Root[Index]);
+        }
+
+        // Timers reinserted from here go to the next tick.
+        Wheel->CurrentTime++;
+
+        while (!DListIsEmpty(&ExpiredList))
+        {
+            KTIMER *Timer = CONTAINING_RECORD(ExpiredList.Next, KTIMER, TimerList);
+            DListRemoveEntry(&Timer->TimerList);
+            KiExpireTimer(Wheel, Timer);
+        }
     }
 
-    return E_SUCCESS;
+    KiUnlockTimerWheel(Wheel, PrevIrql);
 }
 
 ESTATUS
@@ -319,12 +428,79 @@ KeStartTimer(
     IN KTIMER_TYPE Type,
     IN U64 ExpirationTimeRelative)
 {
-    return KiInsertTimer(&KiTimerList, Timer, Type, ExpirationTimeRelative);
+    return KiInsertTimer(Timer, Type, ExpirationTimeRelative);
 }
 
 ESTATUS
 KeRemoveTimer(
     IN KTIMER *Timer)
 {
-    return KiRemoveTimer(&KiTimerList, Timer);
+    return KiRemoveTimer(Timer);
+}
+
+/**
+ * @brief Inserts and cancels KE_TIMER_BENCHMARK_TIMERS timers KE_TIMER_BENCHMARK_ITERATIONS times.\n
+ *        Timeouts are spread over all levels of the timer wheel.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeTimerBenchmark(
+    VOID)
+{
+    KTIMER *Timers = (KTIMER *)MmAllocatePool(PoolTypeNonPaged,
+        sizeof(KTIMER) * KE_TIMER_BENCHMARK_TIMERS, 0x10, 0);
+
+    if (!Timers)
+    {
+        FATAL("Failed to allocate timers for benchmark");
+    }
+
+    for (U32 i = 0; i < KE_TIMER_BENCHMARK_TIMERS; i++)
+    {
+        KiInitializeTimer(&Timers[i]);
+    }
+
+    U64 InsertCycles = 0;
+    U64 RemoveCycles = 0;
+    U32 Failures = 0;
+    U32 Seed = 0x12345678;
+
+    for (U32 n = 0; n < KE_TIMER_BENCHMARK_ITERATIONS; n++)
+    {
+        U64 Tsc = __rdtsc();
+
+        for (U32 i = 0; i < KE_TIMER_BENCHMARK_TIMERS; i++)
+        {
+            Seed = Seed * 1103515245 + 12345;
+            U64 Timeout = KE_TIMER_BENCHMARK_TIMEOUT_MIN + (Seed >> (i & 0x1f));
+
+            if (!E_IS_SUCCESS(KeStartTimer(&Timers[i], TimerOneshot, Timeout)))
+                Failures++;
+        }
+
+        InsertCycles += __rdtsc() - Tsc;
+        Tsc = __rdtsc();
+
+        for (U32 i = 0; i < KE_TIMER_BENCHMARK_TIMERS; i++)
+        {
+            if (!E_IS_SUCCESS(KeRemoveTimer(&Timers[i])))
+                Failures++;
+        }
+
+        RemoveCycles += __rdtsc() - Tsc;
+    }
+
+    if (Failures)
+    {
+        FATAL("Timer benchmark failed (%d)", Failures);
+    }
+
+    U64 Count = (U64)KE_TIMER_BENCHMARK_TIMERS * KE_TIMER_BENCHMARK_ITERATIONS;
+
+    DbgTraceF(TraceLevelDebug, "Timer wheel: %lld timers, %lld cycles/insert, %lld cycles/cancel\n",
+        Count, InsertCycles / Count, RemoveCycles / Count);
+
+    MmFreePool(Timers);
 }
@@ -3,35 +3,61 @@
 
 #include <ke/wait.h>
 
+//
+// Per-processor hierarchical timer wheel.
+// Root level has 256 slots of 1 tick (1ms) each. Each upper level has 64 slots which
+// covers all slots of the level below, and is cascaded down when the level below wraps around.
+// Timeouts beyond the span of the wheel are placed at the end of the wheel and cascaded again.
+//
+
+#define KTIMER_WHEEL_ROOT_BITS              8
+#define KTIMER_WHEEL_ROOT_SIZE              (1 << KTIMER_WHEEL_ROOT_BITS)
+#define KTIMER_WHEEL_ROOT_MASK              (KTIMER_WHEEL_ROOT_SIZE - 1)
+#define KTIMER_WHEEL_LEVEL_BITS             6
+#define KTIMER_WHEEL_LEVEL_SIZE             (1 << KTIMER_WHEEL_LEVEL_BITS)
+#define KTIMER_WHEEL_LEVEL_MASK             (KTIMER_WHEEL_LEVEL_SIZE - 1)
+#define KTIMER_WHEEL_LEVELS                 3       //!< Number of levels above the root.
+#define KTIMER_WHEEL_SPAN_BITS              (KTIMER_WHEEL_ROOT_BITS + KTIMER_WHEEL_LEVEL_BITS * KTIMER_WHEEL_LEVELS)
+#define KTIMER_WHEEL_SPAN_MAX               ((1ULL << KTIMER_WHEEL_SPAN_BITS) - 1)
+
+#ifndef KE_TIMER_BENCHMARK_AT_BOOT
+#define KE_TIMER_BENCHMARK_AT_BOOT          0           //!< Runs KeTimerBenchmark() at boot if non-zero.
+#endif
+
+#define KE_TIMER_BENCHMARK_TIMERS           0x1000
+#define KE_TIMER_BENCHMARK_ITERATIONS       0x400       //!< Each timer is inserted and cancelled this many times.
+#define KE_TIMER_BENCHMARK_TIMEOUT_MIN      60000       //!< No timer expires while the benchmark is running.
+
 typedef enum _KTIMER_TYPE
 {
     TimerOneshot,
     TimerPeriodic,
 } KTIMER_TYPE;
 
+typedef struct _KTIMER_WHEEL        KTIMER_WHEEL;
+
 typedef struct _KTIMER
 {
     // wait_all only
     KWAIT_HEADER WaitHeader;
-    DLIST_ENTRY TimerList;      // Links to timer list
+    DLIST_ENTRY TimerList;      // Links to timer wheel slot
+    KTIMER_WHEEL *Wheel;        // Timer wheel which the timer is inserted to
     KTIMER_TYPE Type;
     U64 ExpirationTimeAbsolute;
     U64 Interval;
     BOOLEAN Inserted;
 } KTIMER;
 
-typedef struct _KTIMER_NODE
-{
-    RS_AVL_NODE BaseNode;
-    U64 Key;
-    DLIST_ENTRY ListHead;
-} KTIMER_NODE;
-
-typedef struct _KTIMER_LIST
+typedef struct _KTIMER_WHEEL
 {
     KSPIN_LOCK Lock;
-    RS_AVL_TREE Tree;
-} KTIMER_LIST;
+    U32 ProcessorId;
+    U32 Count;                  // Number of timers in the wheel
+    U64 CurrentTime;            // Next tick to be processed
+    U64 ExpiredCount;
+    DLIST_ENTRY Root[KTIMER_WHEEL_ROOT_SIZE];
+    DLIST_ENTRY Level[KTIMER_WHEEL_LEVELS][KTIMER_WHEEL_LEVEL_SIZE];
+} KTIMER_WHEEL;
 
 
 VOID
@@ -39,38 +65,44 @@ KiInitializeTimer(
     OUT KTIMER *Timer);
 
 VOID
-KiInitializeTimerList(
-    IN KTIMER_LIST *TimerList);
+KiInitializeTimerWheel(
+    OUT KTIMER_WHEEL *Wheel,
+    IN U32 ProcessorId);
+
+VOID
+KiInitializeTimers(
+    VOID);
 
 
-BOOLEAN
-KiTryLockTimerList(
-    IN KTIMER_LIST *TimerList,
-    OUT KIRQL *Irql);
-    
 VOID
-KiLockTimerList(
-    IN KTIMER_LIST *TimerList,
+KiLockTimerWheel(
+    IN KTIMER_WHEEL *Wheel,
     OUT KIRQL *Irql);
 
 VOID
-KiUnlockTimerList(
-    IN KTIMER_LIST *TimerList,
+KiUnlockTimerWheel(
+    IN KTIMER_WHEEL *Wheel,
     IN KIRQL PrevIrql);
 
 
 ESTATUS
 KiInsertTimer(
-    IN KTIMER_LIST *TimerList,
     IN KTIMER *Timer,
     IN KTIMER_TYPE Type,
     IN U64 ExpirationTimeRelative);
 
 ESTATUS
-KiLookupFirstExpiredTimerNode(
-    IN KTIMER_LIST *TimerList,
-    IN U64 ExpirationTimeAbsolute,
-    OUT KTIMER_NODE **TimerNode);
+KiRemoveTimer(
+    IN KTIMER *Timer);
+
+ESTATUS
+KiGetNextTimerExpiration(
+    IN KTIMER_WHEEL *Wheel,
+    OUT U64 *ExpirationTimeAbsolute);
+
+VOID
+KiExpireTimers(
+    VOID);
 
 ESTATUS
 KeStartTimer(
@@ -82,5 +114,7 @@ ESTATUS
 KeRemoveTimer(
     IN KTIMER *Timer);
 
-
-
+VOID
+KERNELAPI
+KeTimerBenchmark(
+    VOID);
@@ -0,0 +1,299 @@
+/**
+ * @file tlb.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements multi-processor TLB shootdown.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <mm/pool.h>
+#include <mm/paging.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/process.h>
+#include <ke/pcid.h>
+#include <ke/tlb.h>
+#include <hal/processor.h>
+
+
+VOID
+KiInitializeTlbShootdown(
+    IN KPROCESSOR *Processor)
+{
+    KTLB_SHOOTDOWN_QUEUE *Queue = (KTLB_SHOOTDOWN_QUEUE *)MmAllocatePool(PoolTypeNonPaged,
+        sizeof(KTLB_SHOOTDOWN_QUEUE), 0x10, 0);
+    if (!Queue)
+    {
+        FATAL("Failed to allocate TLB shootdown queue");
+    }
+
+    KeInitializeSpinlock(&Queue->Lock);
+    KeRegisterSpinlockStatistics(&Queue->Lock, "TlbShootdown", Processor->ProcessorId);
+    Queue->Ready = FALSE;
+    Queue->FlushAll = FALSE;
+    Queue->RangeCount = 0;
+    Queue->PageCount = 0;
+    Queue->RequestSequence = 0;
+    Queue->CompletedSequence = 0;
+    Queue->LazyFlush = 0;
+    Queue->IpiCount = 0;
+    Queue->FullFlushCount = 0;
+
+    Processor->TlbShootdown = Queue;
+}
+
+VOID
+KiEnableTlbShootdown(
+    VOID)
+{
+    KTLB_SHOOTDOWN_QUEUE *Queue = KeGetCurrentProcessor()->TlbShootdown;
+
+    Queue->Ready = TRUE;
+    _mm_mfence();
+
+    // Shootdowns before this point have skipped the processor.
+    KiFlushTlbAll();
+}
+
+VOID
+KiFlushTlbLocal(
+    IN U64 Address,
+    IN U64 PageCount)
+{
+    if (PageCount > KE_TLB_FULL_FLUSH_PAGES)
+    {
+        KiFlushTlbAll();
+        return;
+    }
+
+    for (U64 i = 0; i < PageCount; i++)
+    {
+        KiInvalidateTlbAddress((PVOID)(Address + (i << PAGE_SHIFT)));
+    }
+}
+
+static
+VOID
+KiQueueTlbFlushRange(
+    IN KTLB_SHOOTDOWN_QUEUE *Queue,
+    IN U64 Address,
+    IN U64 PageCount)
+{
+    if (Queue->FlushAll)
+    {
+        return;
+    }
+
+    Queue->PageCount += PageCount;
+
+    if (Queue->PageCount > KE_TLB_FULL_FLUSH_PAGES ||
+        Queue->RangeCount >= KE_TLB_SHOOTDOWN_RANGES_MAX)
+    {
+        Queue->FlushAll = TRUE;
+        Queue->RangeCount = 0;
+        Queue->PageCount = 0;
+        return;
+    }
+
+    if (Queue->RangeCount)
+    {
+        // Merge with the last range if adjacent.
+        KTLB_FLUSH_RANGE *Last = &Queue->Ranges[Queue->RangeCount - 1];
+        if (Last->Address + (Last->PageCount << PAGE_SHIFT) == Address)
+        {
+            Last->PageCount += PageCount;
+            return;
+        }
+    }
+
+    Queue->Ranges[Queue->RangeCount].Address = Address;
+    Queue->Ranges[Queue->RangeCount].PageCount = PageCount;
+    Queue->RangeCount++;
+}
+
+VOID
+KiProcessTlbShootdown(
+    VOID)
+{
+    KTLB_SHOOTDOWN_QUEUE *Queue = KeGetCurrentProcessor()->TlbShootdown;
+
+    if (Queue->RequestSequence == Queue->CompletedSequence)
+    {
+        return;
+    }
+
+    BOOLEAN PrevState = FALSE;
+    KeAcquireSpinlockDisableInterrupt(&Queue->Lock, &PrevState);
+
+    if (Queue->FlushAll)
+    {
+        KiFlushTlbAll();
+        Queue->FullFlushCount++;
+    }
+    else
+    {
+        for (U32 i = 0; i < Queue->RangeCount; i++)
+        {
+            KiFlushTlbLocal(Queue->Ranges[i].Address, Queue->Ranges[i].PageCount);
+        }
+    }
+
+    Queue->FlushAll = FALSE;
+    Queue->RangeCount = 0;
+    Queue->PageCount = 0;
+
+    // Initiators waiting for this sequence may proceed.
+    _InterlockedExchange64((volatile long long *)&Queue->CompletedSequence, Queue->RequestSequence);
+
+    KeReleaseSpinlockRestoreInterrupt(&Queue->Lock, PrevState);
+}
+
+BOOLEAN
+KiConsumeLazyTlbFlush(
+    IN KPROCESSOR *Processor)
+{
+    KTLB_SHOOTDOWN_QUEUE *Queue = Processor->TlbShootdown;
+
+    if (!Queue)
+    {
+        return FALSE;
+    }
+
+    // Locked exchange also orders the preceding store of ActiveAddressSpace.
+    return !!_InterlockedExchange(&Queue->LazyFlush, 0);
+}
+
+/**
+ * @brief Invalidates the TLB entries of given range on all processors which may cache them.\n
+ *        Caller must update the page tables before calling this function.\n
+ *        Caller must not hold any spinlock. This function waits for the targets to flush, and a target
+ *        waiting for the lock with interrupts disabled cannot handle the shootdown IPI.
+ *
+ * @param [in] Process      Process whose mappings are changed.\n
+ *                          NULL for kernel mappings which are shared by all processes.
+ * @param [in] Address      Start address.
+ * @param [in] Size         Size in bytes.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeFlushTlbRange(
+    IN KPROCESS *Process OPTIONAL,
+    IN PVOID Address,
+    IN SIZE_T Size)
+{
+    U64 Start = (U64)Address & ~(U64)PAGE_MASK;
+    U64 PageCount = SIZE_TO_PAGES((U64)Address + Size - Start);
+
+    if (!PageCount)
+    {
+        return;
+    }
+
+    // Stay on this processor until all targets are flushed.
+    KIRQL PrevIrql = KeGetCurrentIrql();
+    if (PrevIrql < IRQL_CONTEXT_SWITCH)
+    {
+        KeRaiseIrql(IRQL_CONTEXT_SWITCH);
+    }
+
+    KiFlushTlbLocal(Start, PageCount);
+
+    // Processor block is not registered while the processor is being initialized.
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+    KTLB_SHOOTDOWN_QUEUE *CurrentQueue = Processor ? Processor->TlbShootdown : NULL;
+    U64 CurrentMask = Processor ? AFFINITY_PROCESSOR(Processor->ProcessorId) : 0;
+
+    U64 AddressSpace = Process ? (U64)Process->TopLevelPageTablePhysicalBase : 0;
+    U64 Sequence[PCID_PROCESSORS_MAX];
+    U64 IpiMask = 0;
+    U64 WaitMask = 0;
+    U64 Mask = KiProcessorMask & ~CurrentMask;
+
+    while (Mask)
+    {
+        unsigned long ProcessorId;
+        _BitScanForward64(&ProcessorId, Mask);
+        Mask &= Mask - 1;
+
+        KPROCESSOR *Target = KiProcessorBlocks[ProcessorId];
+        KTLB_SHOOTDOWN_QUEUE *Queue = Target->TlbShootdown;
+
+        if (!Queue || !Queue->Ready)
+        {
+            // Flushes all when it gets ready.
+            continue;
+        }
+
+        if (Process && Target->ActiveAddressSpace != AddressSpace)
+        {
+            // Flushed on the next address space switch.
+            // Checks again as the processor may have switched to the page tables in the meantime.
+            _InterlockedExchange(&Queue->LazyFlush, 1);
+            if (Target->ActiveAddressSpace != AddressSpace)
+            {
+                continue;
+            }
+        }
+
+        BOOLEAN PrevState = FALSE;
+        KeAcquireSpinlockDisableInterrupt(&Queue->Lock, &PrevState);
+
+        // IPI is already on the way if the queue is not empty.
+        if (!Queue->FlushAll && !Queue->RangeCount)
+        {
+            IpiMask |= AFFINITY_PROCESSOR(ProcessorId);
+            Queue->IpiCount++;
+        }
+
+        KiQueueTlbFlushRange(Queue, Start, PageCount);
+        Sequence[ProcessorId] = ++Queue->RequestSequence;
+
+        KeReleaseSpinlockRestoreInterrupt(&Queue->Lock, PrevState);
+
+        WaitMask |= AFFINITY_PROCESSOR(ProcessorId);
+    }
+
+    if (IpiMask)
+    {
+        HalSendIpi(IpiMask, VECTOR_IPI_TLB_SHOOTDOWN);
+    }
+
+    while (WaitMask)
+    {
+        Mask = WaitMask;
+
+        while (Mask)
+        {
+            unsigned long ProcessorId;
+            _BitScanForward64(&ProcessorId, Mask);
+            Mask &= Mask - 1;
+
+            KTLB_SHOOTDOWN_QUEUE *Queue = KiProcessorBlocks[ProcessorId]->TlbShootdown;
+            if ((S64)(Queue->CompletedSequence - Sequence[ProcessorId]) >= 0)
+            {
+                WaitMask &= ~AFFINITY_PROCESSOR(ProcessorId);
+            }
+        }
+
+        // Serves shootdowns from other processors in case interrupts are disabled.
+        if (CurrentQueue && CurrentQueue->Ready)
+        {
+            KiProcessTlbShootdown();
+        }
+
+        _mm_pause();
+    }
+
+    if (PrevIrql < IRQL_CONTEXT_SWITCH)
+    {
+        KeLowerIrql(PrevIrql);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <ke/interrupt.h>
+
+typedef struct _KPROCESSOR          KPROCESSOR;
+typedef struct _KPROCESS            KPROCESS;
+
+//
+// TLB shootdown.
+// Each processor has a queue of ranges to be invalidated. Initiator appends the range to the
+// queues of target processors and sends IPI only to the processors whose queue was empty,
+// so requests from several initiators are flushed by one IPI.
+// Queue falls back to full flush when it overflows or the total size exceeds the threshold.
+//
+// Shootdown of process mappings skips the processors which are not using the page tables.
+// Those processors flush their TLB on the next address space switch instead.
+//
+// Initiator waits for the targets to flush, so KeFlushTlbRange() must not be called with a
+// spinlock held. A target spinning on that lock with interrupts disabled never takes the IPI.
+//
+
+#define VECTOR_IPI_TLB_SHOOTDOWN            (IRQL_TO_VECTOR_START(IRQL_IPI) + 0)
+
+#define KE_TLB_SHOOTDOWN_RANGES_MAX         16          //!< Ranges queued per processor.
+#define KE_TLB_FULL_FLUSH_PAGES             32          //!< Pages flushed one by one before falling back to full flush.
+
+typedef struct _KTLB_FLUSH_RANGE
+{
+    U64 Address;
+    U64 PageCount;
+} KTLB_FLUSH_RANGE;
+
+typedef struct _KTLB_SHOOTDOWN_QUEUE
+{
+    KSPIN_LOCK Lock;                        // Taken with interrupts disabled
+    volatile BOOLEAN Ready;                 // IPI handler is connected
+    BOOLEAN FlushAll;                       // Queued ranges are replaced by full flush
+    U32 RangeCount;
+    U64 PageCount;                          // Total pages of queued ranges
+    volatile U64 RequestSequence;           // Incremented for each request
+    volatile U64 CompletedSequence;         // Last request flushed by the processor
+    volatile long LazyFlush;                // Full flush on next address space switch
+    U64 IpiCount;                           // Shootdown IPIs sent to the processor
+    U64 FullFlushCount;
+    KTLB_FLUSH_RANGE Ranges[KE_TLB_SHOOTDOWN_RANGES_MAX];
+} KTLB_SHOOTDOWN_QUEUE;
+
+
+VOID
+KiInitializeTlbShootdown(
+    IN KPROCESSOR *Processor);
+
+VOID
+KiEnableTlbShootdown(
+    VOID);
+
+VOID
+KiFlushTlbLocal(
+    IN U64 Address,
+    IN U64 PageCount);
+
+VOID
+KiProcessTlbShootdown(
+    VOID);
+
+BOOLEAN
+KiConsumeLazyTlbFlush(
+    IN KPROCESSOR *Processor);
+
+VOID
+KERNELAPI
+KeFlushTlbRange(
+    IN KPROCESS *Process OPTIONAL,
+    IN PVOID Address,
+    IN SIZE_T Size);
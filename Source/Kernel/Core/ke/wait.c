@@ -9,6 +9,8 @@
 #include <ke/sched.h>
 #include <ke/timer.h>
 #include <ke/wait.h>
+#include <ke/semaphore.h>
+#include <ke/mutex.h>
 
 
 VOID
@@ -21,7 +23,8 @@ KiInitializeWaitHeader(
     DListInitializeHead(&Object->WaiterBlockLinks);
     Object->State = 0;
     Object->Flags = Flags;
-    Object->WaitContext = NULL;
+    Object->Type = WaitObjectGeneric;
+    Object->WaitContext = WaitContext;
 }
 
 BOOLEAN
@@ -49,3 +52,324 @@ KiUnlockWaitHeader(
     KeReleaseSpinlockLowerIrql(&WaitHeader->Lock, PrevIrql);
 }
 
+
+BOOLEAN
+KiIsObjectSignaled(
+    IN KWAIT_HEADER *Object,
+    IN KTHREAD *Thread)
+{
+    // Owner can acquire the mutex recursively.
+    if (Object->Type == WaitObjectMutex && 
+        CONTAINING_RECORD(Object, KMUTEX, Header)->Owner == Thread)
+    {
+        return TRUE;
+    }
+
+    return !!(Object->State & WAIT_STATE_SIGNALED);
+}
+
+VOID
+KiConsumeObject(
+    IN KWAIT_HEADER *Object,
+    IN KTHREAD *Thread)
+{
+    switch (Object->Type)
+    {
+    case WaitObjectSemaphore:
+    {
+        KSEMAPHORE *Semaphore = CONTAINING_RECORD(Object, KSEMAPHORE, Header);
+
+        if (!--Semaphore->Count)
+        {
+            Object->State &= ~WAIT_STATE_SIGNALED;
+        }
+    }
+        break;
+
+    case WaitObjectMutex:
+        KiAcquireMutexOwnership(CONTAINING_RECORD(Object, KMUTEX, Header), Thread);
+        break;
+
+    default:
+        if (Object->Flags & WAIT_FLAG_WAKE_ONE)
+        {
+            Object->State &= ~WAIT_STATE_SIGNALED;
+        }
+        break;
+    }
+}
+
+BOOLEAN
+KiUnwaitThread(
+    IN KTHREAD *Thread,
+    IN U32 WaitKey)
+{
+    KIRQL PrevIrql = KiLockThread(Thread);
+
+    // Already unwaited by other object.
+    if (!Thread->InWaiting)
+    {
+        KiUnlockThread(Thread, PrevIrql);
+        return FALSE;
+    }
+
+    BOOLEAN Parked = Thread->WaitParked;
+
+    Thread->InWaiting = FALSE;
+    Thread->WaitParked = FALSE;
+    Thread->WaitKey = WaitKey;
+    Thread->State = ThreadStateReady;
+
+    KiUnlockThread(Thread, PrevIrql);
+
+    // Thread which is not switched out yet is requeued by the scheduler.
+    if (Parked)
+    {
+        DASSERT(KiSchedReadyThread(Thread));
+    }
+
+    return TRUE;
+}
+
+VOID
+KiSignalWaitHeader(
+    IN KWAIT_HEADER *Object)
+{
+    DLIST_ENTRY *Head = &Object->WaiterBlockLinks;
+
+    if (!(Object->Flags & WAIT_FLAG_WAKE_ONE))
+    {
+        // Notification object. Wakes all waiters as it stays signaled.
+        Object->State |= WAIT_STATE_SIGNALED;
+
+        while (!DListIsEmpty(Head))
+        {
+            KWAITER_BLOCK *WaiterBlock = CONTAINING_RECORD(Head->Next, KWAITER_BLOCK, WaiterBlockLinks);
+            KTHREAD *Thread = WaiterBlock->Thread;
+            U32 WaitKey = WaiterBlock->WaitKey;
+
+            DListRemoveEntry(&WaiterBlock->WaiterBlockLinks);
+
+            // Other objects of wait-all are checked again by the waiter, except the timeout timer.
+            if (Thread->WaitType == WaitAll && WaitKey != Thread->WaitCount)
+            {
+                WaitKey = WAIT_KEY_NONE;
+            }
+
+            KiUnwaitThread(Thread, WaitKey);
+        }
+
+        return;
+    }
+
+    // Synchronization object. It is handed off to the wait-any waiters without
+    // being signaled, so no other thread can take it before the waiters run.
+    Object->State |= WAIT_STATE_SIGNALED;
+
+    while (!DListIsEmpty(Head) && (Object->State & WAIT_STATE_SIGNALED))
+    {
+        KWAITER_BLOCK *WaiterBlock = CONTAINING_RECORD(Head->Next, KWAITER_BLOCK, WaiterBlockLinks);
+        KTHREAD *Thread = WaiterBlock->Thread;
+
+        DListRemoveEntry(&WaiterBlock->WaiterBlockLinks);
+
+        if (Thread->WaitType == WaitAll)
+        {
+            // Wakes to check all objects again. Takes the object only if nobody else does.
+            KiUnwaitThread(Thread, WAIT_KEY_NONE);
+            continue;
+        }
+
+        if (KiUnwaitThread(Thread, WaiterBlock->WaitKey))
+        {
+            KiConsumeObject(Object, Thread);
+        }
+    }
+}
+
+BOOLEAN
+KiTestWait(
+    IN KWAIT_HEADER **Objects,
+    IN U32 Count,
+    IN KWAIT_TYPE WaitType,
+    IN KTHREAD *Thread,
+    OUT U32 *SignaledIndex)
+{
+    if (WaitType == WaitAny)
+    {
+        for (U32 i = 0; i < Count; i++)
+        {
+            if (KiIsObjectSignaled(Objects[i], Thread))
+            {
+                KiConsumeObject(Objects[i], Thread);
+                *SignaledIndex = i;
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        if (!KiIsObjectSignaled(Objects[i], Thread))
+        {
+            return FALSE;
+        }
+    }
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        KiConsumeObject(Objects[i], Thread);
+    }
+
+    *SignaledIndex = 0;
+
+    return TRUE;
+}
+
+ESTATUS
+KeWaitForMultipleObjects(
+    IN U32 Count,
+    IN KWAIT_HEADER **Objects,
+    IN KWAIT_TYPE WaitType,
+    IN U64 Timeout,
+    OUT U32 *SignaledIndex OPTIONAL)
+{
+    KTHREAD *Thread = KeGetCurrentThread();
+    KWAIT_HEADER *WaitObjects[MAXIMUM_WAITER_BLOCKS_ALLOWED];
+    KSPIN_LOCK *Locks[MAXIMUM_WAITER_BLOCKS_ALLOWED];
+    U32 LockCount = Count;
+    U32 Index = WAIT_KEY_NONE;
+    ESTATUS Status = E_SUCCESS;
+    KIRQL PrevIrql;
+
+    if (!Count || Count > MAXIMUM_WAIT_OBJECTS || !Objects || 
+        (WaitType != WaitAny && WaitType != WaitAll))
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    // Thread cannot be switched out above IRQL_NORMAL.
+    DASSERT(Timeout == 0 || KeGetCurrentIrql() < IRQL_CONTEXT_SWITCH);
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        // Same lock cannot be acquired twice.
+        for (U32 j = 0; j < i; j++)
+        {
+            if (Objects[i] == Objects[j])
+            {
+                return E_INVALID_PARAMETER;
+            }
+        }
+
+        WaitObjects[i] = Objects[i];
+        Locks[i] = &Objects[i]->Lock;
+    }
+
+    if (Timeout != 0 && Timeout != WAIT_TIMEOUT_INFINITE)
+    {
+        // Timeout timer is waited as the last object.
+        Status = KeStartTimer(&Thread->WaitTimer, TimerOneshot, Timeout);
+        if (Status != E_SUCCESS)
+        {
+            return Status;
+        }
+
+        WaitObjects[LockCount] = &Thread->WaitTimer.WaitHeader;
+        Locks[LockCount] = &Thread->WaitTimer.WaitHeader.Lock;
+        LockCount++;
+    }
+
+    for (U32 i = 0; i < LockCount; i++)
+    {
+        DListInitializeHead(&Thread->WaiterBlocks[i].WaiterBlockLinks);
+    }
+
+    for (;;)
+    {
+        KeAcquireSpinlockMultipleRaiseIrql(Locks, LockCount, IRQL_CONTEXT_SWITCH, &PrevIrql);
+
+        // Unlink waiter blocks of the previous round.
+        // Blocks of the signaled objects are already unlinked.
+        for (U32 i = 0; i < LockCount; i++)
+        {
+            DListRemoveEntry(&Thread->WaiterBlocks[i].WaiterBlockLinks);
+        }
+
+        if (Index < Count)
+        {
+            // Object is handed off to us, or notification object is signaled.
+            break;
+        }
+
+        if (Index == Count)
+        {
+            // Timeout timer is signaled.
+            Status = E_TIMEOUT;
+            break;
+        }
+
+        if (KiTestWait(WaitObjects, Count, WaitType, Thread, &Index))
+        {
+            break;
+        }
+
+        if (Timeout == 0)
+        {
+            Status = E_TIMEOUT;
+            break;
+        }
+
+        KIRQL PrevIrqlThread = KiLockThread(Thread);
+        Thread->InWaiting = TRUE;
+        Thread->WaitParked = FALSE;
+        Thread->WaitType = WaitType;
+        Thread->WaitCount = Count;
+        Thread->WaitKey = WAIT_KEY_NONE;
+        Thread->State = ThreadStateWait;
+        KiUnlockThread(Thread, PrevIrqlThread);
+
+        for (U32 i = 0; i < LockCount; i++)
+        {
+            KWAITER_BLOCK *WaiterBlock = &Thread->WaiterBlocks[i];
+
+            WaiterBlock->Object = WaitObjects[i];
+            WaiterBlock->Thread = Thread;
+            WaiterBlock->WaitKey = i;
+            DListInsertBefore(&WaitObjects[i]->WaiterBlockLinks, &WaiterBlock->WaiterBlockLinks);
+        }
+
+        KeReleaseSpinlockMultipleLowerIrql(Locks, LockCount, PrevIrql);
+
+        // Switched out until one of the objects unwaits us.
+        // If it is already unwaited, we are just requeued.
+        KiYieldThread();
+
+        Index = Thread->WaitKey;
+    }
+
+    KeReleaseSpinlockMultipleLowerIrql(Locks, LockCount, PrevIrql);
+
+    if (LockCount > Count)
+    {
+        // Timer may be expired already.
+        KeRemoveTimer(&Thread->WaitTimer);
+    }
+
+    if (Status == E_SUCCESS && SignaledIndex)
+    {
+        *SignaledIndex = Index;
+    }
+
+    return Status;
+}
+
+ESTATUS
+KeWaitForSingleObject(
+    IN KWAIT_HEADER *Object,
+    IN U64 Timeout)
+{
+    return KeWaitForMultipleObjects(1, &Object, WaitAny, Timeout, NULL);
+}
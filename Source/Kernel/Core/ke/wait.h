@@ -10,11 +10,28 @@ typedef struct _KTHREAD             KTHREAD;
 
 #define WAIT_FLAG_WAKE_ONE          0x00000001 // default: wake all
 
+#define WAIT_TIMEOUT_INFINITE       ((U64)-1)
+#define WAIT_KEY_NONE               0xffffffff
+
+typedef enum _KWAIT_OBJECT_TYPE
+{
+    WaitObjectGeneric,  // Signaled state is cleared by wait if WAIT_FLAG_WAKE_ONE
+    WaitObjectSemaphore,
+    WaitObjectMutex,
+} KWAIT_OBJECT_TYPE;
+
+typedef enum _KWAIT_TYPE
+{
+    WaitAny,            // Satisfied if one of the objects is signaled
+    WaitAll,            // Satisfied if all objects are signaled
+} KWAIT_TYPE;
+
 typedef struct _KWAIT_HEADER
 {
     KSPIN_LOCK Lock;
     U32 State;          // See WAIT_STATE_XXX.
     U32 Flags;          // See WAIT_FLAG_XXX.
+    KWAIT_OBJECT_TYPE Type;
     DLIST_ENTRY WaiterBlockLinks;
     PVOID WaitContext;
 } KWAIT_HEADER;
@@ -24,6 +41,7 @@ typedef struct _KWAITER_BLOCK
     KWAIT_HEADER *Object;           // Object that thread is waiting
     KTHREAD *Thread;                // Waiter thread
     DLIST_ENTRY WaiterBlockLinks;   // Links to waiter blocks
+    U32 WaitKey;                    // Index of the object
 } KWAITER_BLOCK;
 
 
@@ -48,3 +66,19 @@ KiUnlockWaitHeader(
     IN KWAIT_HEADER *WaitHeader,
     IN KIRQL PrevIrql);
 
+VOID
+KiSignalWaitHeader(
+    IN KWAIT_HEADER *Object);
+
+ESTATUS
+KeWaitForMultipleObjects(
+    IN U32 Count,
+    IN KWAIT_HEADER **Objects,
+    IN KWAIT_TYPE WaitType,
+    IN U64 Timeout,
+    OUT U32 *SignaledIndex OPTIONAL);
+
+ESTATUS
+KeWaitForSingleObject(
+    IN KWAIT_HEADER *Object,
+    IN U64 Timeout);
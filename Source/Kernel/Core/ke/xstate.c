@@ -0,0 +1,318 @@
+/**
+ * @file xstate.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements extended processor state (XSAVE) management.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <init/bootgfx.h>
+#include <ke/lock.h>
+#include <mm/pool.h>
+#include <ke/interrupt.h>
+#include <ke/kprocessor.h>
+#include <ke/thread.h>
+#include <ke/xstate.h>
+
+U64 KiXStateMask;                       // Components enabled in XCR0
+U32 KiXStateSize;                       // Size of the area for KiXStateSaveType
+U32 KiXStateAreaSizeMax;                // Size of the area for any save type
+U32 KiXStateSaveTypeSupported;          // Bitmap of KXSTATE_SAVE_TYPE
+KXSTATE_SAVE_TYPE KiXStateSaveType;
+BOOLEAN KiXStateEagerSwitch = KE_XSTATE_EAGER_SWITCH;
+
+CHAR *KiXStateSaveTypeName[] = 
+{
+    "FXSAVE", 
+    "XSAVE", 
+    "XSAVEOPT", 
+    "XSAVES", 
+};
+
+C_ASSERT(COUNTOF(KiXStateSaveTypeName) == XStateSaveTypeMaximum);
+
+VOID
+KiDetectExtendedState(
+    VOID)
+{
+    int Info[4];
+
+    KiXStateMask = XSTATE_MASK_LEGACY;
+    KiXStateSize = XSTATE_LEGACY_AREA_SIZE;
+    KiXStateAreaSizeMax = XSTATE_LEGACY_AREA_SIZE;
+    KiXStateSaveTypeSupported = 1 << XStateSaveFxsave;
+    KiXStateSaveType = XStateSaveFxsave;
+
+    __cpuid(Info, 0x00000001);
+    if (!(Info[2] & (1 << 26)))
+    {
+        // ECX[26] = XSAVE
+        return;
+    }
+
+    // EDX:EAX = Components supported by XCR0
+    __cpuidex(Info, 0x0000000d, 0);
+    U64 Mask = ((U64)(U32)Info[3] << 32 | (U32)Info[0]) & XSTATE_MASK_SUPPORTED;
+
+    // AVX-512 components are enabled together on top of AVX.
+    if (!(Mask & XSTATE_MASK_AVX) || (Mask & XSTATE_MASK_AVX512) != XSTATE_MASK_AVX512)
+    {
+        Mask &= ~XSTATE_MASK_AVX512;
+    }
+
+    KiXStateMask = Mask;
+    KiXStateSaveTypeSupported |= 1 << XStateSaveXsave;
+    KiXStateSaveType = XStateSaveXsave;
+
+    __cpuidex(Info, 0x0000000d, 1);
+    if (Info[0] & (1 << 0))
+    {
+        // EAX[0] = XSAVEOPT
+        KiXStateSaveTypeSupported |= 1 << XStateSaveXsaveopt;
+        KiXStateSaveType = XStateSaveXsaveopt;
+    }
+
+    if (Info[0] & (1 << 3))
+    {
+        // EAX[3] = XSAVES/XRSTORS and IA32_XSS
+        KiXStateSaveTypeSupported |= 1 << XStateSaveXsaves;
+        KiXStateSaveType = XStateSaveXsaves;
+    }
+}
+
+VOID
+KiInitializeExtendedState(
+    VOID)
+{
+    int Info[4];
+
+    // Processors are assumed to be identical. The bootstrap processor detects the features.
+    if (!KiXStateSize)
+    {
+        KiDetectExtendedState();
+    }
+
+    if (!(KiXStateSaveTypeSupported & (1 << XStateSaveXsave)))
+    {
+        return;
+    }
+
+    __writecr4(__readcr4() | ARCH_X64_CR4_OSXSAVE);
+    _xsetbv(0, KiXStateMask);
+
+    if (KiXStateSaveTypeSupported & (1 << XStateSaveXsaves))
+    {
+        // No supervisor state is managed.
+        __writemsr(IA32_XSS, 0);
+    }
+
+    if (KiXStateAreaSizeMax > XSTATE_LEGACY_AREA_SIZE)
+    {
+        return;
+    }
+
+    // EBX = Size of the standard format for the components enabled in XCR0
+    __cpuidex(Info, 0x0000000d, 0);
+    U32 StandardSize = (U32)Info[1];
+    U32 CompactedSize = StandardSize;
+
+    if (KiXStateSaveTypeSupported & (1 << XStateSaveXsaves))
+    {
+        // EBX = Size of the compacted format for the components enabled in XCR0 | IA32_XSS
+        __cpuidex(Info, 0x0000000d, 1);
+        CompactedSize = (U32)Info[1];
+    }
+
+    KiXStateSize = (KiXStateSaveType == XStateSaveXsaves) ? CompactedSize : StandardSize;
+    KiXStateAreaSizeMax = StandardSize > CompactedSize ? StandardSize : CompactedSize;
+
+    DbgTraceF(TraceLevelDebug, "XSAVE enabled (XCR0 0x%llx, %s, %d bytes, %s switch)\n", 
+        KiXStateMask, KiXStateSaveTypeName[KiXStateSaveType], KiXStateSize, 
+        KiXStateEagerSwitch ? "eager" : "lazy");
+}
+
+VOID
+KiInitializeExtendedStateArea(
+    OUT KTHREAD_XSAVE64 *XState,
+    IN U32 Size,
+    IN KXSTATE_SAVE_TYPE SaveType)
+{
+    memset(XState, 0, Size);
+
+    XState->Legacy.FCW = XSTATE_FCW_DEFAULT;
+    XState->Legacy.MXCSR = XSTATE_MXCSR_DEFAULT;
+
+    if (SaveType == XStateSaveFxsave)
+    {
+        return;
+    }
+
+    // Other components are loaded in the initial state.
+    XState->XStateBv = XSTATE_MASK_LEGACY;
+
+    if (SaveType == XStateSaveXsaves)
+    {
+        XState->XCompBv = XSTATE_COMPACTION_ENABLED | KiXStateMask;
+    }
+}
+
+KTHREAD_XSAVE64 *
+KiAllocateExtendedStateArea(
+    VOID)
+{
+    DASSERT(KiXStateSize);
+
+    KTHREAD_XSAVE64 *XState = (KTHREAD_XSAVE64 *)MmAllocatePool(PoolTypeNonPaged, 
+        KiXStateSize, XSTATE_AREA_ALIGNMENT, 0);
+
+    if (!XState)
+    {
+        return NULL;
+    }
+
+    KiInitializeExtendedStateArea(XState, KiXStateSize, KiXStateSaveType);
+
+    return XState;
+}
+
+VOID
+KiFreeExtendedStateArea(
+    IN KTHREAD_XSAVE64 *XState)
+{
+    MmFreePool(XState);
+}
+
+VOID
+KiSaveExtendedStateByType(
+    OUT KTHREAD_XSAVE64 *XState,
+    IN KXSTATE_SAVE_TYPE SaveType)
+{
+    switch (SaveType)
+    {
+    case XStateSaveXsaves:
+        _xsaves64(XState, KiXStateMask);
+        break;
+    case XStateSaveXsaveopt:
+        _xsaveopt64(XState, KiXStateMask);
+        break;
+    case XStateSaveXsave:
+        _xsave64(XState, KiXStateMask);
+        break;
+    default:
+        _fxsave64(XState);
+        break;
+    }
+}
+
+VOID
+KiRestoreExtendedStateByType(
+    IN KTHREAD_XSAVE64 *XState,
+    IN KXSTATE_SAVE_TYPE SaveType)
+{
+    switch (SaveType)
+    {
+    case XStateSaveXsaves:
+        _xrstors64(XState, KiXStateMask);
+        break;
+    case XStateSaveXsaveopt:
+    case XStateSaveXsave:
+        _xrstor64(XState, KiXStateMask);
+        break;
+    default:
+        _fxrstor64(XState);
+        break;
+    }
+}
+
+VOID
+KiSaveExtendedState(
+    OUT KTHREAD_XSAVE64 *XState)
+{
+    KiSaveExtendedStateByType(XState, KiXStateSaveType);
+}
+
+VOID
+KiRestoreExtendedState(
+    IN KTHREAD_XSAVE64 *XState)
+{
+    KiRestoreExtendedStateByType(XState, KiXStateSaveType);
+}
+
+/**
+ * @brief Measures the cost of saving and restoring the extended state in a context switch.\n
+ *        Eager switch is measured for each supported instruction, and lazy switch is measured
+ *        for a thread which uses the extended state in every quantum (save + #NM + restore).
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+KeExtendedStateBenchmark(
+    VOID)
+{
+    KTHREAD *Thread = KeGetCurrentThread();
+    KTHREAD_XSAVE64 *XState = (KTHREAD_XSAVE64 *)MmAllocatePool(PoolTypeNonPaged, 
+        KiXStateAreaSizeMax, XSTATE_AREA_ALIGNMENT, 0);
+
+    if (!XState)
+    {
+        FATAL("Failed to allocate extended state area for benchmark");
+    }
+
+    BOOLEAN InterruptEnabled = !!(__readeflags() & RFLAG_IF);
+    _disable();
+
+    // Registers must hold the state of the current thread.
+    if (__readcr0() & ARCH_X64_CR0_TS)
+    {
+        __writecr0(__readcr0() & ~ARCH_X64_CR0_TS);
+        KiRestoreExtendedState(Thread->XState);
+    }
+
+    for (U32 SaveType = 0; SaveType < XStateSaveTypeMaximum; SaveType++)
+    {
+        if (!(KiXStateSaveTypeSupported & (1 << SaveType)))
+        {
+            continue;
+        }
+
+        KiInitializeExtendedStateArea(XState, KiXStateAreaSizeMax, SaveType);
+        KiSaveExtendedStateByType(XState, SaveType);
+
+        U64 Tsc = __rdtsc();
+
+        for (U32 i = 0; i < KE_XSTATE_BENCHMARK_ITERATIONS; i++)
+        {
+            KiSaveExtendedStateByType(XState, SaveType);
+            KiRestoreExtendedStateByType(XState, SaveType);
+        }
+
+        DbgTraceF(TraceLevelDebug, "Extended state: eager %s, %lld cycles/switch\n", 
+            KiXStateSaveTypeName[SaveType], (__rdtsc() - Tsc) / KE_XSTATE_BENCHMARK_ITERATIONS);
+    }
+
+    U64 Tsc = __rdtsc();
+
+    for (U32 i = 0; i < KE_XSTATE_BENCHMARK_ITERATIONS; i++)
+    {
+        KiSaveExtendedState(Thread->XState);
+        __writecr0(__readcr0() | ARCH_X64_CR0_TS);
+
+        // Raises #NM as CR0.MP and CR0.TS are set. Handler restores the state.
+        __asm__ __volatile__ ("fwait\n\t" : : : "memory");
+    }
+
+    DbgTraceF(TraceLevelDebug, "Extended state: lazy %s, %lld cycles/switch\n", 
+        KiXStateSaveTypeName[KiXStateSaveType], (__rdtsc() - Tsc) / KE_XSTATE_BENCHMARK_ITERATIONS);
+
+    if (InterruptEnabled)
+    {
+        _enable();
+    }
+
+    MmFreePool(XState);
+}
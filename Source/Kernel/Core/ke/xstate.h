@@ -0,0 +1,84 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/thread.h>
+
+//
+// Extended processor state (x87, SSE, AVX and AVX-512) of threads.
+// Enabled components and the area size are taken from CPUID.0Dh, and the area is
+// saved with the best instruction available (XSAVES > XSAVEOPT > XSAVE > FXSAVE).
+// XSAVEOPT and XSAVES skip the components which are in the initial state or not
+// modified since the last restore.
+//
+// Lazy switch saves the state only if the thread used it in its quantum (CR0.TS is clear),
+// and restores it on #NM. Eager switch saves and restores it on every context switch.
+//
+
+#ifndef KE_XSTATE_EAGER_SWITCH
+#define KE_XSTATE_EAGER_SWITCH              0           //!< Default of KiXStateEagerSwitch.
+#endif
+
+#ifndef KE_XSTATE_BENCHMARK_AT_BOOT
+#define KE_XSTATE_BENCHMARK_AT_BOOT         0           //!< Runs KeExtendedStateBenchmark() at boot if non-zero.
+#endif
+
+#define KE_XSTATE_BENCHMARK_ITERATIONS      0x1000
+
+#define XSTATE_AREA_ALIGNMENT               0x40
+#define XSTATE_LEGACY_AREA_SIZE             sizeof(KTHREAD_FXSAVE64)
+
+#define XSTATE_MASK_X87                     (1ULL << 0)
+#define XSTATE_MASK_SSE                     (1ULL << 1)
+#define XSTATE_MASK_AVX                     (1ULL << 2)
+#define XSTATE_MASK_OPMASK                  (1ULL << 5)
+#define XSTATE_MASK_ZMM_HI256               (1ULL << 6)
+#define XSTATE_MASK_HI16_ZMM                (1ULL << 7)
+#define XSTATE_MASK_LEGACY                  (XSTATE_MASK_X87 | XSTATE_MASK_SSE)
+#define XSTATE_MASK_AVX512                  (XSTATE_MASK_OPMASK | XSTATE_MASK_ZMM_HI256 | XSTATE_MASK_HI16_ZMM)
+#define XSTATE_MASK_SUPPORTED               (XSTATE_MASK_LEGACY | XSTATE_MASK_AVX | XSTATE_MASK_AVX512)
+#define XSTATE_COMPACTION_ENABLED           (1ULL << 63)
+
+#define XSTATE_FCW_DEFAULT                  0x037f      //!< All x87 exceptions masked.
+#define XSTATE_MXCSR_DEFAULT                0x1f80      //!< All SIMD exceptions masked.
+
+#define IA32_XSS                            0xda0
+
+typedef enum _KXSTATE_SAVE_TYPE
+{
+    XStateSaveFxsave,
+    XStateSaveXsave,
+    XStateSaveXsaveopt,
+    XStateSaveXsaves,
+    XStateSaveTypeMaximum,
+} KXSTATE_SAVE_TYPE;
+
+
+extern U64 KiXStateMask;
+extern U32 KiXStateSize;
+extern KXSTATE_SAVE_TYPE KiXStateSaveType;
+extern BOOLEAN KiXStateEagerSwitch;
+
+VOID
+KiInitializeExtendedState(
+    VOID);
+
+KTHREAD_XSAVE64 *
+KiAllocateExtendedStateArea(
+    VOID);
+
+VOID
+KiFreeExtendedStateArea(
+    IN KTHREAD_XSAVE64 *XState);
+
+VOID
+KiSaveExtendedState(
+    OUT KTHREAD_XSAVE64 *XState);
+
+VOID
+KiRestoreExtendedState(
+    IN KTHREAD_XSAVE64 *XState);
+
+VOID
+KERNELAPI
+KeExtendedStateBenchmark(
+    VOID);
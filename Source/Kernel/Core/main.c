@@ -44,6 +44,11 @@
 #include <init/bootgfx.h>
 #include <ke/ke.h>
 #include <ke/kprocessor.h>
+#include <ke/sched_balance.h>
+#include <ke/timer.h>
+#include <ke/xstate.h>
+#include <ke/evtrace.h>
+#include <ke/profile.h>
 #include <mm/mminit.h>
 #include <mm/pool.h>
 
@@ -55,6 +60,8 @@ ESTATUS
 KiYieldThread(
     VOID);
 
+PTR KiLoadedBase;
+
 /**
  * @brief Kernel main entry point.
  * 
@@ -73,6 +80,8 @@ KiKernelStart(
 	IN U32 SizeOfLoaderBlock, 
 	IN PTR Reserved)
 {
+	KiLoadedBase = LoadedBase;
+
 	DbgInitialize(LoaderBlock, TraceLevelDebug);
 
 	DbgTraceF(TraceLevelDebug, "%s (%p, %p, %X, %p)\n",
@@ -115,6 +124,35 @@ KiKernelStart(
     KiInitialize();
     HalInitialize();
 
+#if DBG_ASYNC_LOG
+    // All processors are started. Output is queued to the log thread from now on.
+    DbgStartLogThread();
+#endif
+
+#if KE_LOCK_BENCHMARK_AT_BOOT
+    KeSpinlockContentionBenchmark();
+#endif
+
+#if KE_TIMER_BENCHMARK_AT_BOOT
+    KeTimerBenchmark();
+#endif
+
+#if KE_XSTATE_BENCHMARK_AT_BOOT
+    KeExtendedStateBenchmark();
+#endif
+
+#if KE_LOCK_STATISTICS
+    KeDumpSpinlockStatistics(KE_LOCK_STATISTICS_DUMP_COUNT);
+#endif
+
+#if KE_EVENT_TRACE_AT_BOOT
+    KeEventTraceAtBoot();
+#endif
+
+#if KE_PROFILE_AT_BOOT
+    KeProfileAtBoot();
+#endif
+
     //
     // Test!
     //
@@ -137,7 +175,7 @@ KiKernelStart(
 
     for (U64 c = 0; ; c++)
     {
-        __halt();
+        HalIdleProcessor();
 
         DebugText[0] = '\0';
         DebugTextLength = 0;
@@ -147,7 +185,8 @@ KiKernelStart(
             HAL_PRIVATE_DATA *PrivateData = (HAL_PRIVATE_DATA *)KiProcessorBlocks[i]->HalPrivateData;
             DebugTextLength += ClStrFormatU8(
                 DebugText + DebugTextLength, COUNTOF(DebugText) - DebugTextLength, 
-                "P%d: %7d | ", i, PrivateData->ApicTickCount);
+                "P%d: %7d q%d | ", i, PrivateData->ApicTickCount, 
+                KiSchedGetLoad(KiProcessorBlocks[i]->SchedNormalClass));
             //BGXTRACE("P%d: %7d | ", i, PrivateData->ApicTickCount);
         }
 
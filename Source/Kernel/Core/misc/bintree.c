@@ -1215,6 +1215,9 @@ RsAvlInsert(
 
     Tree->Operations.SetKey(Tree->CallerContext, NewNode, Key);
 
+    // Leaf height is 1, same as RsAvlUpdateHeight() gives.
+    BINARY_TREE_NODE_TO_AVL_NODE(NewNode)->Height = 1;
+
     if (!RsBtInsertLeaf(Tree, NewNode))
     {
         // Failed to insert node
@@ -1302,7 +1305,8 @@ RsAvlDelete(
 {
     if (Node->Links.Parent ||
         Node->Links.LeftChild ||
-        Node->Links.RightChild)
+        Node->Links.RightChild ||
+        Tree->Root == &Node->Links) // Root without children has no links
     {
         // Unlink first
         if (!RsAvlRemove(Tree, BINARY_TREE_NODE_TO_AVL_NODE(Node)))
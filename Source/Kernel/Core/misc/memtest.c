@@ -0,0 +1,302 @@
+
+/**
+ * @file memtest.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements self-test and benchmark of the runtime memory routines.
+ * @version 0.1
+ * @date 2026-10-18
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <mm/pool.h>
+#include <misc/memtest.h>
+
+#define CL_MEMORY_TEST_BUFFER_SIZE      (CL_MEMORY_TEST_SIZE_MAX + CL_MEMORY_TEST_ALIGNMENT_MAX * 2)
+
+U8 ClMemoryTestSource[CL_MEMORY_TEST_BUFFER_SIZE];
+U8 ClMemoryTestDestination[CL_MEMORY_TEST_BUFFER_SIZE];
+U8 ClMemoryTestExpected[CL_MEMORY_TEST_BUFFER_SIZE];
+
+//
+// Byte-at-a-time reference routines (previous implementation).
+//
+
+static
+PVOID
+KERNELAPI
+ClReferenceMemset(
+    IN PVOID Destination,
+    IN INT Value,
+    IN SIZE_T Size)
+{
+    U8 *p = (U8 *)Destination;
+
+    while (Size-- > 0)
+        *p++ = (U8)Value;
+
+    return Destination;
+}
+
+static
+INT
+KERNELAPI
+ClReferenceMemcmp(
+    IN PVOID Buffer1,
+    IN PVOID Buffer2,
+    IN SIZE_T Size)
+{
+    U8 *p1 = (U8 *)Buffer1;
+    U8 *p2 = (U8 *)Buffer2;
+
+    while (Size-- > 0)
+    {
+        INT Diff = *p1 - *p2;
+        if (Diff != 0)
+            return Diff;
+        p1++, p2++;
+    }
+
+    return 0;
+}
+
+static
+PVOID
+KERNELAPI
+ClReferenceMemcpy(
+    IN PVOID Destination,
+    IN PVOID Source,
+    IN SIZE_T Size)
+{
+    U8 *s = (U8 *)Source;
+    U8 *d = (U8 *)Destination;
+
+    while (Size-- > 0)
+        *d++ = *s++;
+
+    return Destination;
+}
+
+static
+PVOID
+KERNELAPI
+ClReferenceMemmove(
+    IN PVOID Destination,
+    IN PVOID Source,
+    IN SIZE_T Size)
+{
+    U8 *s = (U8 *)Source;
+    U8 *d = (U8 *)Destination;
+
+    if (d <= s)
+        return ClReferenceMemcpy(Destination, Source, Size);
+
+    while (Size-- > 0)
+        d[Size] = s[Size];
+
+    return Destination;
+}
+
+static
+VOID
+KERNELAPI
+ClFillTestPattern(
+    OUT U8 *Buffer,
+    IN SIZE_T Size,
+    IN U32 Seed)
+{
+    for (SIZE_T i = 0; i < Size; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Buffer[i] = (U8)(Seed >> 16);
+    }
+}
+
+static
+INT
+KERNELAPI
+ClSign(
+    IN INT Value)
+{
+    return (Value > 0) - (Value < 0);
+}
+
+/**
+ * @brief Tests memset, memcpy, memmove and memcmp against byte-at-a-time reference routines.\n
+ *        Sizes up to CL_MEMORY_TEST_SIZE_MAX (crossing the rep movs/stos threshold) are tested\n
+ *        with all source/destination offsets within a word.
+ * 
+ * @return TRUE if all tests pass, FALSE otherwise.
+ */
+BOOLEAN
+KERNELAPI
+ClTestMemoryRoutines(
+    VOID)
+{
+    U8 *Source = ClMemoryTestSource;
+    U8 *Destination = ClMemoryTestDestination;
+    U8 *Expected = ClMemoryTestExpected;
+    SIZE_T BufferSize = CL_MEMORY_TEST_BUFFER_SIZE;
+
+    for (SIZE_T Size = 0; Size <= CL_MEMORY_TEST_SIZE_MAX; 
+        Size += (Size < CL_MEMORY_TEST_SIZE_STEP_START) ? 1 : CL_MEMORY_TEST_SIZE_STEP)
+    {
+        for (U32 DestinationOffset = 0; DestinationOffset < CL_MEMORY_TEST_ALIGNMENT_MAX; DestinationOffset++)
+        {
+            //
+            // memset
+            //
+
+            ClFillTestPattern(Destination, BufferSize, (U32)Size);
+            ClReferenceMemcpy(Expected, Destination, BufferSize);
+            ClReferenceMemset(Expected + DestinationOffset, 0xa5, Size);
+
+            if (memset(Destination + DestinationOffset, 0xa5, Size) != Destination + DestinationOffset || 
+                ClReferenceMemcmp(Destination, Expected, BufferSize))
+            {
+                DbgTraceF(TraceLevelError, "memset failed (size 0x%llx, offset %d)\n", (U64)Size, DestinationOffset);
+                return FALSE;
+            }
+
+            for (U32 SourceOffset = 0; SourceOffset < CL_MEMORY_TEST_ALIGNMENT_MAX; SourceOffset++)
+            {
+                //
+                // memcpy
+                //
+
+                ClFillTestPattern(Source, BufferSize, (U32)Size + SourceOffset);
+                ClFillTestPattern(Destination, BufferSize, ~(U32)Size);
+                ClReferenceMemcpy(Expected, Destination, BufferSize);
+                ClReferenceMemcpy(Expected + DestinationOffset, Source + SourceOffset, Size);
+
+                if (memcpy(Destination + DestinationOffset, Source + SourceOffset, Size) != Destination + DestinationOffset || 
+                    ClReferenceMemcmp(Destination, Expected, BufferSize))
+                {
+                    DbgTraceF(TraceLevelError, "memcpy failed (size 0x%llx, offset %d/%d)\n", (U64)Size, DestinationOffset, SourceOffset);
+                    return FALSE;
+                }
+
+                //
+                // memcmp (equal, and one different byte at the start/middle/end)
+                //
+
+                ClReferenceMemcpy(Destination + DestinationOffset, Source + SourceOffset, Size);
+
+                if (memcmp(Destination + DestinationOffset, Source + SourceOffset, Size))
+                {
+                    DbgTraceF(TraceLevelError, "memcmp failed (size 0x%llx, offset %d/%d)\n", (U64)Size, DestinationOffset, SourceOffset);
+                    return FALSE;
+                }
+
+                if (Size)
+                {
+                    SIZE_T Positions[3] = { 0, Size / 2, Size - 1 };
+
+                    for (U32 i = 0; i < COUNTOF(Positions); i++)
+                    {
+                        U8 *p = Destination + DestinationOffset + Positions[i];
+                        U8 Saved = *p;
+
+                        *p = (U8)(Saved + 1 + i);
+
+                        if (ClSign(memcmp(Destination + DestinationOffset, Source + SourceOffset, Size)) != 
+                            ClSign(ClReferenceMemcmp(Destination + DestinationOffset, Source + SourceOffset, Size)))
+                        {
+                            DbgTraceF(TraceLevelError, "memcmp failed (size 0x%llx, offset %d/%d, position 0x%llx)\n", 
+                                (U64)Size, DestinationOffset, SourceOffset, (U64)Positions[i]);
+                            return FALSE;
+                        }
+
+                        *p = Saved;
+                    }
+                }
+
+                //
+                // memmove (overlapped, both directions)
+                //
+
+                ClFillTestPattern(Destination, BufferSize, (U32)Size ^ SourceOffset);
+                ClReferenceMemcpy(Expected, Destination, BufferSize);
+                ClReferenceMemmove(Expected + DestinationOffset, Expected + SourceOffset, Size);
+
+                if (memmove(Destination + DestinationOffset, Destination + SourceOffset, Size) != Destination + DestinationOffset || 
+                    ClReferenceMemcmp(Destination, Expected, BufferSize))
+                {
+                    DbgTraceF(TraceLevelError, "memmove failed (size 0x%llx, offset %d/%d)\n", (U64)Size, DestinationOffset, SourceOffset);
+                    return FALSE;
+                }
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief Measures cycles per call of the memory routines and the byte-at-a-time reference routines.\n
+ *        Sizes from CL_MEMORY_BENCHMARK_SIZE_MIN to CL_MEMORY_BENCHMARK_SIZE_MAX are measured.
+ * 
+ * @return None.
+ */
+VOID
+KERNELAPI
+ClBenchmarkMemoryRoutines(
+    VOID)
+{
+    SIZE_T BufferSize = CL_MEMORY_BENCHMARK_SIZE_MAX;
+    U8 *Source = MmAllocatePool(PoolTypeNonPaged, BufferSize, 0x40, TAG4('M', 'B', 'E', 'N'));
+    U8 *Destination = MmAllocatePool(PoolTypeNonPaged, BufferSize, 0x40, TAG4('M', 'B', 'E', 'N'));
+
+    if (!Source || !Destination)
+    {
+        DbgTraceF(TraceLevelWarning, "Memory benchmark skipped (insufficient pool)\n");
+        goto Cleanup;
+    }
+
+    ClFillTestPattern(Source, BufferSize, 0);
+    ClReferenceMemcpy(Destination, Source, BufferSize);
+
+    DbgTraceF(TraceLevelDebug, "Size       Iter  memset(old/new)         memcpy(old/new)         memcmp(old/new)\n");
+
+    for (SIZE_T Size = CL_MEMORY_BENCHMARK_SIZE_MIN; Size <= CL_MEMORY_BENCHMARK_SIZE_MAX; Size <<= 2)
+    {
+        U64 Cycles[6] = { 0 };
+        U32 Iterations = (U32)(CL_MEMORY_BENCHMARK_BYTES / Size);
+
+        if (Iterations > CL_MEMORY_BENCHMARK_ITERATIONS_MAX)
+            Iterations = CL_MEMORY_BENCHMARK_ITERATIONS_MAX;
+
+        for (U32 Type = 0; Type < COUNTOF(Cycles); Type++)
+        {
+            U64 Start = __rdtsc();
+
+            for (U32 i = 0; i < Iterations; i++)
+            {
+                switch (Type)
+                {
+                case 0: ClReferenceMemset(Destination, (INT)i, Size); break;
+                case 1: memset(Destination, (INT)i, Size); break;
+                case 2: ClReferenceMemcpy(Destination, Source, Size); break;
+                case 3: memcpy(Destination, Source, Size); break;
+                case 4: ClReferenceMemcmp(Destination, Source, Size); break;
+                case 5: memcmp(Destination, Source, Size); break;
+                }
+            }
+
+            Cycles[Type] = (__rdtsc() - Start) / Iterations;
+        }
+
+        DbgTraceF(TraceLevelDebug, "0x%-8llx %-5d %-11lld %-11lld %-11lld %-11lld %-11lld %-11lld\n", 
+            (U64)Size, Iterations, Cycles[0], Cycles[1], Cycles[2], Cycles[3], Cycles[4], Cycles[5]);
+    }
+
+Cleanup:
+    if (Source)
+        MmFreePool(Source);
+
+    if (Destination)
+        MmFreePool(Destination);
+}
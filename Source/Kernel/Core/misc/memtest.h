@@ -0,0 +1,33 @@
+#pragma once
+
+//
+// Self-test and benchmark of the runtime memory routines (memset, memcpy, memmove, memcmp).
+//
+
+#ifndef CL_MEMORY_TEST_AT_BOOT
+#define CL_MEMORY_TEST_AT_BOOT              0       //!< Runs ClTestMemoryRoutines() at boot if non-zero.
+#endif
+
+#ifndef CL_MEMORY_BENCHMARK_AT_BOOT
+#define CL_MEMORY_BENCHMARK_AT_BOOT         0       //!< Runs ClBenchmarkMemoryRoutines() at boot if non-zero.
+#endif
+
+#define CL_MEMORY_TEST_SIZE_MAX             0x120   //!< Maximum size tested.
+#define CL_MEMORY_TEST_SIZE_STEP_START      0x40    //!< Sizes below this are all tested. Above, CL_MEMORY_TEST_SIZE_STEP is used.
+#define CL_MEMORY_TEST_SIZE_STEP            7
+#define CL_MEMORY_TEST_ALIGNMENT_MAX        8       //!< Offsets 0..CL_MEMORY_TEST_ALIGNMENT_MAX-1 are tested.
+
+#define CL_MEMORY_BENCHMARK_SIZE_MIN        0x8
+#define CL_MEMORY_BENCHMARK_SIZE_MAX        0x800000
+#define CL_MEMORY_BENCHMARK_BYTES           0x1000000   //!< Approximate bytes processed for each size.
+#define CL_MEMORY_BENCHMARK_ITERATIONS_MAX  0x1000
+
+BOOLEAN
+KERNELAPI
+ClTestMemoryRoutines(
+    VOID);
+
+VOID
+KERNELAPI
+ClBenchmarkMemoryRoutines(
+    VOID);
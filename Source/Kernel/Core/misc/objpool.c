@@ -16,23 +16,66 @@
 #include <mm/pool.h>
 
 /**
- * @brief Calculates maximum tree depth by object count.
+ * @brief Calculates the number of words in each level of the bitmap.
  * 
  * @param [in] MaximumObjectCount       Maximum object count.
+ * @param [out] LevelWordCount          Caller-supplied array that receives the word count of each level.\n
+ *                                      This parameter is optional.
  * 
- * @return Maximum tree depth.
+ * @return Number of levels. 0 if MaximumObjectCount is 0.
  */
 U32
-PoolGetMaximumDepth(
+PoolBitmapGetLevels(
+    IN U32 MaximumObjectCount,
+    OPTIONAL OUT U32 *LevelWordCount)
+{
+    U32 LevelCount = 0;
+    U32 BitCount = MaximumObjectCount;
+
+    if (!BitCount)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        U32 WordCount = (BitCount + OBJPOOL_BITMAP_WORD_MASK) >> OBJPOOL_BITMAP_WORD_SHIFT;
+
+        if (LevelWordCount)
+            LevelWordCount[LevelCount] = WordCount;
+
+        LevelCount++;
+
+        if (WordCount == 1)
+            break;
+
+        BitCount = WordCount;
+    }
+
+    return LevelCount;
+}
+
+/**
+ * @brief Calculates required bitmap size by object count.
+ * 
+ * @param [in] MaximumObjectCount       Maximum object count.
+ * 
+ * @return Bitmap size in bytes.
+ */
+U32
+PoolGetBitmapSize(
     IN U32 MaximumObjectCount)
 {
-    for (U32 i = 0; i < 32; i++)
+    U32 LevelWordCount[OBJPOOL_BITMAP_LEVEL_MAX];
+    U32 LevelCount = PoolBitmapGetLevels(MaximumObjectCount, LevelWordCount);
+    U32 WordCount = 0;
+
+    for (U32 i = 0; i < LevelCount; i++)
     {
-        if (MaximumObjectCount <= (1U << i))
-            return i;
+        WordCount += LevelWordCount[i];
     }
 
-    return 0;
+    return WordCount * sizeof(U64);
 }
 
 /**
@@ -41,7 +84,8 @@ PoolGetMaximumDepth(
  * @param [out] PoolBitmap          Pool bitmap structure to be initialized.
  * @param [in] MaximumObjectCount   Maximum object count.
  * @param [in] InitialBitmap        Initial bitmap. If this parameter is NULL, a new bitmap will be allocated.\n
- *                                  Otherwise, PoolBitmapInitialize does not allocate bitmap and uses InitialBitmap instead.
+ *                                  Otherwise, PoolBitmapInitialize does not allocate bitmap and uses InitialBitmap instead.\n
+ *                                  InitialBitmap must be 8-byte aligned.
  * @param [in] InitialBitmapSize    Initial bitmap size in bytes. This parameter is ignored if InitialBitmap is NULL.
  * 
  * @return TRUE if succeeds, FALSE otherwise.
@@ -53,29 +97,24 @@ PoolBitmapInitialize(
     OPTIONAL IN PVOID InitialBitmap,
     OPTIONAL IN U32 InitialBitmapSize)
 {
-    U32 MaximumDepth = PoolGetMaximumDepth(MaximumObjectCount);
-    if (!MaximumDepth)
+    U32 LevelWordCount[OBJPOOL_BITMAP_LEVEL_MAX];
+    U32 LevelCount = PoolBitmapGetLevels(MaximumObjectCount, LevelWordCount);
+    if (!LevelCount)
     {
         // size is too small
         return FALSE;
     }
 
-    // (1 << (MaximumDepth + 1)) - 1 = 1 + 1..2 + 1..4 + ... + 1..(1 << MaximumDepth)
-    U32 BitmapSize = POOL_BITMAP_SIZE_MINIMUM_BY_MAXIMUM_DEPTH(MaximumDepth);
-    if (!BitmapSize)
-    {
-        // size is too small
-        return FALSE;
-    }
+    U32 BitmapSize = PoolGetBitmapSize(MaximumObjectCount);
 
-    U8 *Bitmap = NULL;
+    U64 *Bitmap = NULL;
     BOOLEAN BitmapSpecified = FALSE;
 
     if (InitialBitmap)
     {
-        if (BitmapSize > InitialBitmapSize)
+        if (BitmapSize > InitialBitmapSize || ((UPTR)InitialBitmap & (sizeof(U64) - 1)))
         {
-            // insufficient bitmap size
+            // insufficient bitmap size or misaligned bitmap
             return FALSE;
         }
 
@@ -84,20 +123,41 @@ PoolBitmapInitialize(
     }
     else
     {
-        Bitmap = (U8 *)MmAllocatePool(PoolTypeNonPaged, BitmapSize, 0x10, TAG4('o', 'b', 'j', 'p'));
+        Bitmap = (U64 *)MmAllocatePool(PoolTypeNonPaged, BitmapSize, 0x10, TAG4('o', 'b', 'j', 'p'));
         if (!Bitmap)
         {
             // failed to allocate bitmap
             return FALSE;
         }
+    }
+
+    memset(Bitmap, 0, BitmapSize);
+
+    //
+    // Mark the bits past the end of each level as allocated.
+    //
+
+    U32 Offset = 0;
+    U32 BitCount = MaximumObjectCount;
+
+    for (U32 i = 0; i < LevelCount; i++)
+    {
+        U32 PaddingStart = BitCount & OBJPOOL_BITMAP_WORD_MASK;
+        if (PaddingStart)
+        {
+            Bitmap[Offset + LevelWordCount[i] - 1] = OBJPOOL_BITMAP_WORD_FULL << PaddingStart;
+        }
 
-        memset(Bitmap, 0, BitmapSize);
+        PoolBitmap->LevelOffset[i] = Offset;
+        Offset += LevelWordCount[i];
+        BitCount = LevelWordCount[i];
     }
 
     PoolBitmap->Bitmap = Bitmap;
     PoolBitmap->BitmapSize = BitmapSize;
-    PoolBitmap->MaximumDepth = MaximumDepth;
+    PoolBitmap->LevelCount = LevelCount;
     PoolBitmap->MaximumObjectCount = MaximumObjectCount;
+    PoolBitmap->AllocatedCount = 0;
     PoolBitmap->BitmapSpecified = BitmapSpecified;
 
     return TRUE;
@@ -114,7 +174,7 @@ BOOLEAN
 PoolBitmapFree(
     IN OBJECT_POOL_BITMAP *PoolBitmap)
 {
-    U8 *Bitmap = PoolBitmap->Bitmap;
+    U64 *Bitmap = PoolBitmap->Bitmap;
     if (!Bitmap)
     {
         return FALSE;
@@ -131,10 +191,10 @@ PoolBitmapFree(
 }
 
 /**
- * @brief Tests whether specified bit is set.
+ * @brief Tests whether specified object bit is set.
  * 
  * @param [in] PoolBitmap       Pool bitmap structure.
- * @param [in] BitIndex         Bit index to test.
+ * @param [in] BitIndex         Object index to test.
  * 
  * @return TRUE if specified bit is set, FALSE otherwise.
  * 
@@ -145,14 +205,16 @@ PoolBitmapGetBit(
     IN OBJECT_POOL_BITMAP *PoolBitmap,
     IN U32 BitIndex)
 {
-    return !!(PoolBitmap->Bitmap[BitIndex >> 3] & (1 << (BitIndex & 0x07)));
+    return !!(PoolBitmap->Bitmap[BitIndex >> OBJPOOL_BITMAP_WORD_SHIFT] & 
+        (1ULL << (BitIndex & OBJPOOL_BITMAP_WORD_MASK)));
 }
 
 /**
- * @brief Sets/clears specified bit.
+ * @brief Sets/clears specified object bit.\n
+ *        Summary levels are not updated. Use PoolBitmapSetAllocate/PoolBitmapSetFree instead.
  * 
  * @param [in] PoolBitmap       Pool bitmap structure.
- * @param [in] BitIndex         Bit index to modify.
+ * @param [in] BitIndex         Object index to modify.
  * @param [in] Set              If non-zero, specified bit will be set.\n
  *                              Otherwise, specified bit will be cleared.
  * 
@@ -167,12 +229,14 @@ PoolBitmapSetBit(
     IN U32 BitIndex,
     IN BOOLEAN Set)
 {
-    BOOLEAN PrevBit = PoolBitmapGetBit(PoolBitmap, BitIndex);
+    U64 *Word = &PoolBitmap->Bitmap[BitIndex >> OBJPOOL_BITMAP_WORD_SHIFT];
+    U64 Mask = 1ULL << (BitIndex & OBJPOOL_BITMAP_WORD_MASK);
+    BOOLEAN PrevBit = !!(*Word & Mask);
 
     if (Set)
-        PoolBitmap->Bitmap[BitIndex >> 3] |= (1 << (BitIndex & 0x07));
+        *Word |= Mask;
     else
-        PoolBitmap->Bitmap[BitIndex >> 3] &= ~(1 << (BitIndex & 0x07));
+        *Word &= ~Mask;
 
     return PrevBit;
 }
@@ -191,56 +255,37 @@ PoolBitmapFindFree(
     IN OBJECT_POOL_BITMAP *PoolBitmap,
     OUT INT *FreeBitIndex)
 {
-    U32 StartIndex = OBJPOOL_NODE_INDEX_ROOT;
-    if (PoolBitmapGetBit(PoolBitmap, StartIndex))
-    {
-        // Cannot find freed
-        return -1;
-    }
+    U32 Index = 0;
 
-    U32 Depth = 0;
-    U32 IndexLimit = OBJPOOL_NODE_INDEX_START(PoolBitmap->MaximumDepth) + PoolBitmap->MaximumObjectCount - 1;
+    //
+    // Descend from the top level. Each level narrows the search to a single word.
+    //
 
-    while (Depth < PoolBitmap->MaximumDepth)
+    for (U32 Level = PoolBitmap->LevelCount; Level-- > 0; )
     {
-        BOOLEAN NextDepthFound = FALSE;
+        U64 Word = PoolBitmap->Bitmap[PoolBitmap->LevelOffset[Level] + Index];
+        unsigned long Bit = 0;
 
-        for (U32 i = 0; i < 2; i++)
-        {
-            U32 ChildIndex = OBJPOOL_NODE_CHILD(StartIndex, i);
-
-            if (IndexLimit < ChildIndex)
-                break;
-
-            if (!PoolBitmapGetBit(PoolBitmap, ChildIndex))
-            {
-                StartIndex = ChildIndex;
-                NextDepthFound = TRUE;
-                break;
-            }
-        }
-
-        if (!NextDepthFound)
+        if (!_BitScanForward64(&Bit, ~Word))
         {
+            // Cannot find freed
             return -1;
         }
 
-        Depth++;
+        Index = (Index << OBJPOOL_BITMAP_WORD_SHIFT) | Bit;
     }
 
-    INT ObjectIndex = StartIndex - OBJPOOL_NODE_INDEX_START(Depth);
-
     if (FreeBitIndex)
-        *FreeBitIndex = StartIndex;
+        *FreeBitIndex = Index;
 
-    return ObjectIndex;
+    return (INT)Index;
 }
 
 /**
  * @brief Sets the pool bitmap to allocated state.
  * 
  * @param [in] PoolBitmap       Pool bitmap structure.
- * @param [in] Index            Bit index.
+ * @param [in] Index            Object index.
  * 
  * @return TRUE if succeeds, FALSE otherwise.
  */
@@ -249,10 +294,7 @@ PoolBitmapSetAllocate(
     IN OBJECT_POOL_BITMAP *PoolBitmap,
     IN U32 Index)
 {
-    U32 Start = OBJPOOL_NODE_INDEX_START(PoolBitmap->MaximumDepth);
-    U32 End = OBJPOOL_NODE_INDEX_END(PoolBitmap->MaximumDepth);
-
-    if (Start > Index || Index > End)
+    if (Index >= PoolBitmap->MaximumObjectCount)
         return FALSE;
 
     if (PoolBitmapSetBit(PoolBitmap, Index, TRUE))
@@ -261,33 +303,24 @@ PoolBitmapSetAllocate(
         return FALSE;
     }
 
-    U32 CurrentIndex = Index;
-    while (CurrentIndex != OBJPOOL_NODE_INDEX_ROOT)
-    {
-        U32 ParentIndex = OBJPOOL_NODE_PARENT(CurrentIndex);
-
-        //
-        // Set parent bit if both left and right child are set
-        //
+    PoolBitmap->AllocatedCount++;
 
-        /**
-         *       0              0
-         *     /   \          /   \
-         *    0     0   =>   1     0
-         *   / \   / \      / \   / \
-         *  1   0 1   0    1   1 1   0
-         *      ^              ^
-         */
+    //
+    // Set the summary bit while the word below is full.
+    //
 
-        BOOLEAN LeftBit = PoolBitmapGetBit(PoolBitmap, OBJPOOL_NODE_CHILD(ParentIndex, 0));
-        BOOLEAN RightBit = PoolBitmapGetBit(PoolBitmap, OBJPOOL_NODE_CHILD(ParentIndex, 1));
+    U32 CurrentIndex = Index >> OBJPOOL_BITMAP_WORD_SHIFT;
+    U32 Level = 0;
 
-        if (!LeftBit || !RightBit)
+    while (PoolBitmap->Bitmap[PoolBitmap->LevelOffset[Level] + CurrentIndex] == OBJPOOL_BITMAP_WORD_FULL)
+    {
+        if (++Level >= PoolBitmap->LevelCount)
             break;
 
-        PoolBitmapSetBit(PoolBitmap, ParentIndex, TRUE);
+        PoolBitmap->Bitmap[PoolBitmap->LevelOffset[Level] + (CurrentIndex >> OBJPOOL_BITMAP_WORD_SHIFT)] |= 
+            1ULL << (CurrentIndex & OBJPOOL_BITMAP_WORD_MASK);
 
-        CurrentIndex = ParentIndex;
+        CurrentIndex >>= OBJPOOL_BITMAP_WORD_SHIFT;
     }
 
     return TRUE;
@@ -297,7 +330,7 @@ PoolBitmapSetAllocate(
  * @brief Sets the pool bitmap to freed state.
  * 
  * @param [in] PoolBitmap       Pool bitmap structure.
- * @param [in] Index            Bit index.
+ * @param [in] Index            Object index.
  * 
  * @return TRUE if succeeds, FALSE otherwise.
  */
@@ -306,38 +339,33 @@ PoolBitmapSetFree(
     IN OBJECT_POOL_BITMAP *PoolBitmap,
     IN U32 Index)
 {
-    U32 Start = OBJPOOL_NODE_INDEX_START(PoolBitmap->MaximumDepth);
-    U32 End = OBJPOOL_NODE_INDEX_END(PoolBitmap->MaximumDepth);
-
-    if (Start > Index || Index > End)
+    if (Index >= PoolBitmap->MaximumObjectCount)
         return FALSE;
 
+    BOOLEAN WasFull = (PoolBitmap->Bitmap[Index >> OBJPOOL_BITMAP_WORD_SHIFT] == OBJPOOL_BITMAP_WORD_FULL);
+
     if (!PoolBitmapSetBit(PoolBitmap, Index, FALSE))
     {
         // Already freed
         return FALSE;
     }
 
-    U32 CurrentIndex = Index;
-    while (CurrentIndex != OBJPOOL_NODE_INDEX_ROOT)
-    {
-        //
-        // Clear parent bit.
-        //
+    PoolBitmap->AllocatedCount--;
+
+    //
+    // Clear the summary bit while the word below was full.
+    //
 
-        /**
-         *       1              0
-         *     /   \          /   \
-         *    1     1   =>   0     1
-         *   / \   / \      / \   / \
-         *  1   1 1   1    1   0 1   1
-         *      ^              ^
-         */
+    U32 CurrentIndex = Index >> OBJPOOL_BITMAP_WORD_SHIFT;
 
-        U32 ParentIndex = OBJPOOL_NODE_PARENT(CurrentIndex);
-        PoolBitmapSetBit(PoolBitmap, ParentIndex, FALSE);
+    for (U32 Level = 1; WasFull && Level < PoolBitmap->LevelCount; Level++)
+    {
+        U64 *Word = &PoolBitmap->Bitmap[PoolBitmap->LevelOffset[Level] + (CurrentIndex >> OBJPOOL_BITMAP_WORD_SHIFT)];
 
-        CurrentIndex = ParentIndex;
+        WasFull = (*Word == OBJPOOL_BITMAP_WORD_FULL);
+        *Word &= ~(1ULL << (CurrentIndex & OBJPOOL_BITMAP_WORD_MASK));
+
+        CurrentIndex >>= OBJPOOL_BITMAP_WORD_SHIFT;
     }
 
     return TRUE;
@@ -449,17 +477,14 @@ PVOID
 PoolAllocateObject(
     IN OBJECT_POOL *Pool)
 {
-    INT FreeBitIndex = -1;
-    INT Index = PoolBitmapFindFree(&Pool->AllocationBitmap, &FreeBitIndex);
+    INT Index = PoolBitmapFindFree(&Pool->AllocationBitmap, NULL);
 
     if (Index < 0)
     {
         return NULL;
     }
 
-    //ASSERT(FreeBitIndex >= 0);
-
-    if (!PoolBitmapSetAllocate(&Pool->AllocationBitmap, FreeBitIndex))
+    if (!PoolBitmapSetAllocate(&Pool->AllocationBitmap, (U32)Index))
     {
         // ASSERT(FALSE);
         return NULL;
@@ -470,6 +495,71 @@ PoolAllocateObject(
     return Object;
 }
 
+/**
+ * @brief Allocates multiple objects from the pool.\n
+ *        Either all objects are allocated or none of them.
+ * 
+ * @param [in] Pool         Pool structure.
+ * @param [in] Count        Number of objects to allocate.
+ * @param [out] Objects     Caller-supplied array that receives Count object pointers.
+ * 
+ * @return TRUE if succeeds, FALSE otherwise.
+ */
+BOOLEAN
+PoolAllocateObjects(
+    IN OBJECT_POOL *Pool,
+    IN U32 Count,
+    OUT PVOID *Objects)
+{
+    OBJECT_POOL_BITMAP *PoolBitmap = &Pool->AllocationBitmap;
+
+    if (Count > PoolBitmap->MaximumObjectCount - PoolBitmap->AllocatedCount)
+    {
+        return FALSE;
+    }
+
+    U32 Allocated = 0;
+
+    while (Allocated < Count)
+    {
+        INT Index = PoolBitmapFindFree(PoolBitmap, NULL);
+        if (Index < 0)
+        {
+            // Bitmap is inconsistent with AllocatedCount
+            break;
+        }
+
+        //
+        // Take as many free bits as possible from the level 0 word found.
+        //
+
+        U32 WordBase = (U32)Index & ~OBJPOOL_BITMAP_WORD_MASK;
+        U64 FreeBits = ~PoolBitmap->Bitmap[WordBase >> OBJPOOL_BITMAP_WORD_SHIFT];
+
+        while (FreeBits && Allocated < Count)
+        {
+            unsigned long Bit = 0;
+            _BitScanForward64(&Bit, FreeBits);
+            FreeBits &= FreeBits - 1;
+
+            PoolBitmapSetAllocate(PoolBitmap, WordBase + Bit);
+            Objects[Allocated++] = (PVOID)((U8 *)Pool->Pool + Pool->SizeOfObject * (WordBase + Bit));
+        }
+    }
+
+    if (Allocated < Count)
+    {
+        while (Allocated > 0)
+        {
+            PoolFreeObject(Pool, Objects[--Allocated]);
+        }
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  * @brief Frees the object from the pool.
  * 
@@ -491,8 +581,7 @@ PoolFreeObject(
         return FALSE;
     }
 
-    U32 Index = OBJPOOL_NODE_INDEX_START(Pool->AllocationBitmap.MaximumDepth) + 
-        (Offset / Pool->SizeOfObject);
+    U32 Index = Offset / Pool->SizeOfObject;
 
     if (!PoolBitmapSetFree(&Pool->AllocationBitmap, Index))
     {
@@ -501,4 +590,3 @@ PoolFreeObject(
 
     return TRUE;
 }
-
@@ -2,17 +2,33 @@
 #pragma once
 
 
-#define	OBJPOOL_NODE_INDEX_ROOT             0
-#define	OBJPOOL_NODE_PARENT(_index)         ( ((_index) - 1) >> 1 )
-#define	OBJPOOL_NODE_CHILD(_index, _child)  ( ((_index) << 1) + 1 + (_child) )
-#define	OBJPOOL_NODE_INDEX_START(_level)    ( (1 << (_level)) - 1 )
-#define	OBJPOOL_NODE_INDEX_END(_level)      ( ((1 << (_level)) - 1) << 1 )
+//
+// Multi-level allocation bitmap.
+//
+// Level 0 holds one bit per object (set = allocated). Each bit of level N + 1
+// is set if the corresponding 64-bit word of level N is full. The top level is
+// a single word, so a free object is found by scanning one word per level.
+//
+// Bitmap Layout (U64 words):
+// [Level 0] [Level 1] ... [Level LevelCount - 1]
+//
+// Bits past the end of each level are set at initialization so that they are
+// never reported as free.
+//
+
+#define OBJPOOL_BITMAP_BITS_PER_WORD        64
+#define OBJPOOL_BITMAP_WORD_SHIFT           6
+#define OBJPOOL_BITMAP_WORD_MASK            (OBJPOOL_BITMAP_BITS_PER_WORD - 1)
+#define OBJPOOL_BITMAP_WORD_FULL            0xffffffffffffffffULL
+#define OBJPOOL_BITMAP_LEVEL_MAX            6   // 64^6 > 2^32
 
 typedef struct _OBJECT_POOL_BITMAP
 {
-    U32 MaximumDepth;       // int(ceil(log2(MaximumObjectCount)))
     U32 MaximumObjectCount;
-    U8 *Bitmap;             // size = int(ceil(MaximumObjectCount / 8)))
+    U32 AllocatedCount;
+    U32 LevelCount;
+    U32 LevelOffset[OBJPOOL_BITMAP_LEVEL_MAX];      // word offset of each level
+    U64 *Bitmap;            // size = PoolGetBitmapSize(MaximumObjectCount)
     U32 BitmapSize;
     BOOLEAN BitmapSpecified;
 } OBJECT_POOL_BITMAP;
@@ -25,17 +41,19 @@ typedef struct _OBJECT_POOL
     BOOLEAN PoolSpecified;
 } OBJECT_POOL;
 
-#define POOL_BITMAP_SIZE_MINIMUM_BY_MAXIMUM_DEPTH(_max_depth)    \
-    ( (1 << ((_max_depth) + 1)) >> 3 )
-
 #define POOL_BITMAP_SIZE_MINIMUM(_obj_count)    \
-    POOL_BITMAP_SIZE_MINIMUM_BY_MAXIMUM_DEPTH(PoolGetMaximumDepth(_obj_count))
+    PoolGetBitmapSize(_obj_count)
+
 
 
 
+U32
+PoolBitmapGetLevels(
+    IN U32 MaximumObjectCount,
+    OPTIONAL OUT U32 *LevelWordCount);
 
 U32
-PoolGetMaximumDepth(
+PoolGetBitmapSize(
     IN U32 MaximumObjectCount);
 
 BOOLEAN
@@ -93,6 +111,12 @@ PVOID
 PoolAllocateObject(
     IN OBJECT_POOL *Pool);
 
+BOOLEAN
+PoolAllocateObjects(
+    IN OBJECT_POOL *Pool,
+    IN U32 Count,
+    OUT PVOID *Objects);
+
 BOOLEAN
 PoolFreeObject(
     IN OBJECT_POOL *Pool,
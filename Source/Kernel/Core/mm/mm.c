@@ -8,8 +8,6 @@
  * 
  * @copyright Copyright (c) 2021
  * 
- * @todo Acquire lock when accessing XAD structure.
- * 
  */
 
 #include <mm/mm.h>
@@ -239,6 +237,82 @@ MmFreeVirtualMemory(
 }
 
 
+/**
+ * @brief Looks up the address descriptor which contains given address.\n
+ *        The tree is locked as shared, so lookups from multiple processors can proceed in parallel.
+ * 
+ * @param [in] XadTree      XAD tree.
+ * @param [in] Address      Address to lookup.
+ * @param [out] Result      Caller-supplied variable that receives a copy of the address descriptor.
+ * 
+ * @return ESTATUS code.
+ */
+static
+ESTATUS
+KERNELAPI
+MiQueryXadAddress(
+    IN MMXAD_TREE *XadTree,
+    IN PTR Address,
+    OUT ADDRESS *Result)
+{
+    MMXAD *Xad = NULL;
+
+    if (!Result)
+    {
+        return E_INVALID_PARAMETER;
+    }
+
+    MmXadAcquireLockShared(XadTree);
+
+    ESTATUS Status = MmXadLookupAddress(XadTree, &Xad, Address, 0, 0, XAD_LAF_ADDRESS);
+
+    if (E_IS_SUCCESS(Status))
+    {
+        // XAD can be merged or deleted after unlock, so return a copy.
+        *Result = Xad->Address;
+    }
+
+    MmXadReleaseLockShared(XadTree);
+
+    return Status;
+}
+
+/**
+ * @brief Queries the virtual address range which contains given address.
+ * 
+ * @param [in] Address      Virtual address.
+ * @param [out] Result      Caller-supplied variable that receives the address range and type.
+ * 
+ * @return ESTATUS code.
+ */
+KEXPORT
+ESTATUS
+KERNELAPI
+MmQueryVirtualMemory(
+    IN PTR Address,
+    OUT ADDRESS *Result)
+{
+    return MiQueryXadAddress(&MiVadTree, ROUNDDOWN_TO_PAGE_SIZE(Address), Result);
+}
+
+/**
+ * @brief Queries the physical address range which contains given address.
+ * 
+ * @param [in] Address      Physical address.
+ * @param [out] Result      Caller-supplied variable that receives the address range and type.
+ * 
+ * @return ESTATUS code.
+ */
+KEXPORT
+ESTATUS
+KERNELAPI
+MmQueryPhysicalMemory(
+    IN PTR Address,
+    OUT ADDRESS *Result)
+{
+    return MiQueryXadAddress(&MiPadTree, ROUNDDOWN_TO_PAGE_SIZE(Address), Result);
+}
+
 /**
  * @brief Reallocates physical memory for given address.
  *
@@ -590,6 +664,7 @@ ExitLoop:
 
     if (AllocatedSize != Size)
     {
+        MmXadReleaseLock(&MiPadTree);
         return E_NOT_ENOUGH_MEMORY;
     }
 
@@ -757,7 +832,6 @@ MmAllocateAndMapPagesGather(
  * 
  * @return ESTATUS code.
  * 
- * @todo Currently unmapping is not performed as MmUnmapPages() is not implemented.
  */
 KEXPORT
 ESTATUS
@@ -770,14 +844,17 @@ MmFreeAndUnmapPagesGather(
         return E_INVALID_PARAMETER;
     }
 
-    // todo: unmap virtual memory! (not implemented)
-    ESTATUS Status = E_SUCCESS; /* MmUnmapPages(...); */
-    /* if (!E_IS_SUCCESS(Status))
+    if (!MiArchX64SetPageMappingNotPresent(MiPML4TBase, MiRPML4TBase, 
+        PhysicalAddresses->StartingVirtualAddress, PhysicalAddresses->AllocatedSize))
     {
-        return Status;
-    } */
+        // Simply panic as operations cannot be undone
+        FATAL("Failed to unmap pages (large page is not supported)");
+    }
+
+    // Other processors must not access the pages through stale TLB entries once they are freed.
+    MiArchX64InvalidatePage(PhysicalAddresses->StartingVirtualAddress, PhysicalAddresses->AllocatedSize);
 
-    Status = MmFreeVirtualMemory(
+    ESTATUS Status = MmFreeVirtualMemory(
         PhysicalAddresses->StartingVirtualAddress, PhysicalAddresses->AllocatedSize);
 
     if (!E_IS_SUCCESS(Status))
@@ -19,6 +19,9 @@ extern MMXAD_TREE MiVadTree; //!< Virtual address tree for shared kernel space.
 
 extern XAD_CONTEXT MiXadContext;
 
+extern struct _SLAB_CACHE MiXadCache;
+extern struct _SLAB_CACHE MiXadCachePreInit;
+
 extern BOOLEAN MiXadInitialized;
 
 
@@ -158,6 +161,20 @@ MmFreeVirtualMemory(
 	IN PTR Address,
 	IN SIZE_T Size);
 
+KEXPORT
+ESTATUS
+KERNELAPI
+MmQueryVirtualMemory(
+    IN PTR Address,
+    OUT ADDRESS *Result);
+
+KEXPORT
+ESTATUS
+KERNELAPI
+MmQueryPhysicalMemory(
+    IN PTR Address,
+    OUT ADDRESS *Result);
+
 ESTATUS
 KERNELAPI
 MmReallocatePhysicalMemory(
@@ -18,6 +18,7 @@
 #include <mm/mminit.h>
 #include <mm/paging.h>
 #include <mm/mm.h>
+#include <mm/slab.h>
 
 
 #define IS_IN_ADDRESS_RANGE(_test_addr, _test_size, _start_addr, _size) \
@@ -91,7 +92,7 @@ MiPrePoolInitialize(
         + LoaderBlock->LoaderData.OffsetToVirtualBase;
 
     return MiInitializePoolBlockList(&MiPoolList[PoolTypeNonPagedPreInit],
-        PreInitPoolBase, LoaderBlock->LoaderData.PreInitPoolSize, 0);
+        PreInitPoolBase, LoaderBlock->LoaderData.PreInitPoolSize, POOL_FLAG_VERIFY_DEFAULT);
 }
 
 ESTATUS
@@ -163,6 +164,11 @@ MiPreInitialize(
 
     BGXTRACE("Initializing XADs...\n");
 
+    if (!E_IS_SUCCESS(MmInitializeSlabCache(&MiXadCachePreInit, "XadPreInit", PoolTypeNonPagedPreInit, sizeof(MMXAD), 8, NULL, NULL)))
+    {
+        return E_FAILED;
+    }
+
     MiXadContext.UsePreInitPool = TRUE;
     MiXadContext.DebugPrintPort = TRUE;
     MiXadContext.DebugPrintScreen = TRUE;
@@ -332,12 +338,16 @@ MiPreDumpXad(
 
     DbgTraceF(TraceLevelDebug, "Listing PAD tree...\n");
     MiXadContext.DebugPrintScreen = FALSE;
+    MmXadAcquireLockShared(&MiPadTree);
     RsBtTraverse(&MiPadTree.Tree, NULL, (PRS_BINARY_TREE_TRAVERSE)MmXadDebugTraverse);
+    MmXadReleaseLockShared(&MiPadTree);
 
     BGXTRACE("Listing VAD tree...\n");
     DbgTraceF(TraceLevelDebug, "Listing VAD tree...\n");
     MiXadContext.DebugPrintScreen = TRUE;
+    MmXadAcquireLockShared(&MiVadTree);
     RsBtTraverse(&MiVadTree.Tree, NULL, (PRS_BINARY_TREE_TRAVERSE)MmXadDebugTraverse);
+    MmXadReleaseLockShared(&MiVadTree);
     
     BGXTRACE("\n");
 }
@@ -403,7 +413,7 @@ MmInitialize(
 
         MiArchX64InvalidatePage(PoolVirtualBase, PoolSize);
 
-        if (!MiInitializePoolBlockList(&MiPoolList[PoolType], PoolVirtualBase, PoolSize, 0))
+        if (!MiInitializePoolBlockList(&MiPoolList[PoolType], PoolVirtualBase, PoolSize, POOL_FLAG_VERIFY_DEFAULT))
         {
             FATAL("Failed to initialize pool");
         }
@@ -421,5 +431,10 @@ MmInitialize(
     DbgTraceF(TraceLevelDebug, "Leave\n");
 
     // Now it is safe to use other pools.
+    if (!E_IS_SUCCESS(MmInitializeSlabCache(&MiXadCache, "Xad", PoolTypeNonPaged, sizeof(MMXAD), 8, NULL, NULL)))
+    {
+        FATAL("Failed to initialize XAD cache");
+    }
+
     MiXadContext.UsePreInitPool = FALSE;
 }
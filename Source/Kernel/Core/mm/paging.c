@@ -16,6 +16,9 @@
 #include <mm/mminit.h>
 #include <misc/objpool.h>
 #include <mm/paging.h>
+#include <ke/pcid.h>
+#include <ke/tlb.h>
+#include <ke/evtrace.h>
 
 U64 *MiPML4TPhysicalBase; //!< PML4 table physical base.
 U64 *MiPML4TBase; //!< PML4 table base.
@@ -23,6 +26,19 @@ U64 *MiRPML4TBase; //!< Reverse PML4 table base.
 
 OBJECT_POOL MiPreInitPxePool; //!< Pre-init PXE pool
 
+#define MI_PXE_RESERVE_MAX      16
+
+/**
+ * @brief PXE tables reserved by MiArchX64SetPageMapping.
+ */
+typedef struct _MI_PXE_RESERVE {
+    OBJECT_POOL *PxePool;
+    U64 Remaining;                          //!< Upper bound of tables still needed.
+    U32 Next;
+    U32 Count;
+    PVOID Tables[MI_PXE_RESERVE_MAX];
+} MI_PXE_RESERVE;
+
 
 /**
  * @brief Allocates the 512 entries of PXE.
@@ -38,6 +54,89 @@ MiAllocatePxePreInit(
     return PoolAllocateObject(&MiPreInitPxePool);
 }
 
+/**
+ * @brief Calculates the maximum number of PXE tables needed to map given page range.
+ * 
+ * @param [in] PageNumber       First source page number.
+ * @param [in] PageCount        Number of pages.
+ * 
+ * @return Maximum number of PDPT, PD and PT tables.
+ */
+static
+U64
+KERNELAPI
+MiArchX64GetMaximumPxeCount(
+    IN U64 PageNumber,
+    IN U64 PageCount)
+{
+    if (!PageCount)
+        return 0;
+
+    U64 LastPageNumber = PageNumber + PageCount - 1;
+
+    return ((LastPageNumber >> 27) - (PageNumber >> 27) + 1) + 
+        ((LastPageNumber >> 18) - (PageNumber >> 18) + 1) + 
+        ((LastPageNumber >> 9) - (PageNumber >> 9) + 1);
+}
+
+/**
+ * @brief Takes a PXE table from the reservation.\n
+ *        If the reservation is empty, up to MI_PXE_RESERVE_MAX tables are allocated at once.
+ * 
+ * @param [in] Reserve      PXE reservation.
+ * 
+ * @return Address of PXE table.\n
+ *         NULL is returned when allocation fails.
+ */
+static
+U64 *
+KERNELAPI
+MiTakeReservedPxe(
+    IN MI_PXE_RESERVE *Reserve)
+{
+    if (Reserve->Next >= Reserve->Count)
+    {
+        U32 Count = (U32)(Reserve->Remaining < MI_PXE_RESERVE_MAX ? Reserve->Remaining : MI_PXE_RESERVE_MAX);
+
+        if (Count <= 1 || !PoolAllocateObjects(Reserve->PxePool, Count, Reserve->Tables))
+        {
+            // Fall back to single allocation (upper bound may exceed the free tables).
+            Reserve->Tables[0] = PoolAllocateObject(Reserve->PxePool);
+            if (!Reserve->Tables[0])
+                return NULL;
+
+            Count = 1;
+        }
+
+        Reserve->Next = 0;
+        Reserve->Count = Count;
+    }
+
+    if (Reserve->Remaining)
+        Reserve->Remaining--;
+
+    return Reserve->Tables[Reserve->Next++];
+}
+
+/**
+ * @brief Returns unused PXE tables of the reservation to the pool.
+ * 
+ * @param [in] Reserve      PXE reservation.
+ * 
+ * @return None.
+ */
+static
+VOID
+KERNELAPI
+MiReleaseReservedPxe(
+    IN MI_PXE_RESERVE *Reserve)
+{
+    while (Reserve->Next < Reserve->Count)
+    {
+        PoolFreeObject(Reserve->PxePool, Reserve->Tables[Reserve->Next++]);
+    }
+}
+
 /**
  * @brief Invalidates the TLB for given address.
  * 
@@ -63,7 +162,8 @@ MiArchX64InvalidateSinglePage(
 }
 
 /**
- * @brief Invalidates the TLB for given address range.
+ * @brief Invalidates the TLB for given address range on all processors.\n
+ *        Kernel mappings are shared by all processors, so other processors are notified by TLB shootdown.
  * 
  * @param [in] InvalidateAddress    Address to be invalidated.
  * @param [in] Size                 Size to be invalidated.
@@ -76,11 +176,7 @@ MiArchX64InvalidatePage(
     IN VIRTUAL_ADDRESS InvalidateAddress, 
     IN SIZE_T Size)
 {
-    for (SIZE_T Offset = 0; Offset < Size; Offset += PAGE_SIZE)
-    {
-        MiArchX64InvalidateSinglePage(InvalidateAddress);
-        InvalidateAddress += Size;
-    }
+    KeFlushTlbRange(NULL, (PVOID)InvalidateAddress, Size);
 }
 
 /**
@@ -303,6 +399,13 @@ MiArchX64SetPageMapping(
 
     U64 PageCount2M = SIZE_TO_PAGES(PAGE_SIZE_2M);
 
+    MI_PXE_RESERVE Reserve = {
+        .PxePool = PxePool,
+        .Remaining = MiArchX64GetMaximumPxeCount(SourcePageNumber, PageCount),
+    };
+
+    BOOLEAN Result = FALSE;
+
     for (U64 i = 0; i < PageCount; )
     {
         BOOLEAN UseMapping2M = FALSE;
@@ -333,9 +436,9 @@ MiArchX64SetPageMapping(
         if (!(PML4TE & ARCH_X64_PXE_PRESENT))
         {
             // Allocate new PDPTEs
-            NewTableBase = PoolAllocateObject(PxePool);
+            NewTableBase = MiTakeReservedPxe(&Reserve);
             if (!NewTableBase)
-                return FALSE;
+                goto Cleanup;
 
             DASSERT(MiTranslateVirtualToPhysical(PML4TBase, RPML4TBase, (U64)NewTableBase, &PhysicalTableBaseTemp));
 
@@ -351,9 +454,9 @@ MiArchX64SetPageMapping(
         if (!(PDPTE & ARCH_X64_PXE_PRESENT))
         {
             // Allocate new PDEs
-            NewTableBase = PoolAllocateObject(PxePool);
+            NewTableBase = MiTakeReservedPxe(&Reserve);
             if (!NewTableBase)
-                return FALSE;
+                goto Cleanup;
 
             DASSERT(MiTranslateVirtualToPhysical(PML4TBase, RPML4TBase, (U64)NewTableBase, &PhysicalTableBaseTemp));
 
@@ -377,9 +480,9 @@ MiArchX64SetPageMapping(
             else
             {
                 // Allocate new PDEs
-                NewTableBase = PoolAllocateObject(PxePool);
+                NewTableBase = MiTakeReservedPxe(&Reserve);
                 if (!NewTableBase)
-                    return FALSE;
+                    goto Cleanup;
 
                 DASSERT(MiTranslateVirtualToPhysical(PML4TBase, RPML4TBase, (U64)NewTableBase, &PhysicalTableBaseTemp));
 
@@ -414,6 +517,80 @@ MiArchX64SetPageMapping(
         }
     }
 
+    Result = TRUE;
+
+    // Reverse mapping is set along with the forward mapping.
+    if (!ReverseMapping)
+    {
+        KTRACE_EVENT4(EventTracePageMap, VirtualAddress, PhysicalAddress, Size, PteFlags);
+    }
+
+Cleanup:
+    MiReleaseReservedPxe(&Reserve);
+
+    return Result;
+}
+
+/**
+ * @brief Clears the present bit of 4K pages.\n
+ *        Caller must invalidate the TLB for given range after the call.
+ * 
+ * @param [in] PML4TBase                Base address of PML4T.
+ * @param [in] RPML4TBase               Base address of RPML4T.
+ * @param [in] VirtualAddress           Virtual address.
+ * @param [in] Size                     Unmap size.
+ * 
+ * @return TRUE if succeeds, FALSE if the range contains large page.
+ */
+BOOLEAN
+KERNELAPI
+MiArchX64SetPageMappingNotPresent(
+    IN U64 *PML4TBase, 
+    IN U64 *RPML4TBase, 
+    IN VIRTUAL_ADDRESS VirtualAddress, 
+    IN SIZE_T Size)
+{
+    U64 PageCount = SIZE_TO_PAGES(Size);
+    U64 SourcePageNumber = PAGE_TO_PAGE_NUMBER_4K(VirtualAddress);
+
+    for (U64 i = 0; i < PageCount; i++, SourcePageNumber++)
+    {
+        U64 PML4TEi = ARCH_X64_PAGE_NUMBER_TO_PML4EI(SourcePageNumber);
+        U64 PDPTEi = ARCH_X64_PAGE_NUMBER_TO_PDPTEI(SourcePageNumber);
+        U64 PDEi = ARCH_X64_PAGE_NUMBER_TO_PDEI(SourcePageNumber);
+        U64 PTEi = ARCH_X64_PAGE_NUMBER_TO_PTEI(SourcePageNumber);
+
+        U64 PML4TE = PML4TBase[PML4TEi];
+        if (!(PML4TE & ARCH_X64_PXE_PRESENT))
+            continue;
+
+        // PML4T -> PDPT
+        U64 *PDPTBase = NULL;
+        DASSERT(MiTranslatePhysicalToVirtual(RPML4TBase, (PML4TE & ARCH_X64_PXE_4K_BASE_MASK), (U64 *)&PDPTBase));
+
+        U64 PDPTE = PDPTBase[PDPTEi];
+        if (!(PDPTE & ARCH_X64_PXE_PRESENT))
+            continue;
+
+        // PDPT -> PD
+        U64 *PDBase = NULL;
+        DASSERT(MiTranslatePhysicalToVirtual(RPML4TBase, (PDPTE & ARCH_X64_PXE_4K_BASE_MASK), (U64 *)&PDBase));
+
+        U64 PDE = PDBase[PDEi];
+        if (!(PDE & ARCH_X64_PXE_PRESENT))
+            continue;
+
+        // Splitting large pages is not supported
+        if (PDE & ARCH_X64_PXE_LARGE_SIZE)
+            return FALSE;
+
+        // PD -> PT
+        U64 *PTBase = NULL;
+        DASSERT(MiTranslatePhysicalToVirtual(RPML4TBase, (PDE & ARCH_X64_PXE_4K_BASE_MASK), (U64 *)&PTBase));
+
+        PTBase[PTEi] &= ~ARCH_X64_PXE_PRESENT;
+    }
+
     return TRUE;
 }
 
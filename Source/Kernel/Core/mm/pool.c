@@ -13,9 +13,11 @@
 
 #include <base/base.h>
 #include <ke/ke.h>
+#include <ke/kprocessor.h>
 #include <mm/paging.h>
 #include <mm/mm.h>
 #include <mm/pool.h>
+#include <ke/evtrace.h>
 
 
 POOL_BLOCK_LIST MiPoolList[PoolTypeMaximum];
@@ -28,17 +30,29 @@ KERNELAPI
 MiComputePoolChecksum(
     IN PPOOL_HEADER Header)
 {
-    U16 Checksum = 0;
+    U64 *Words = (U64 *)Header;
+    U64 Hash = (UPTR)Header;
     U32 i = 0;
 
-    for (i = 0; i < sizeof(*Header); i++)
+    //
+    // Word-wide hash over the header, seeded with the header address.
+    // The checksum field itself (bits 32..47 of the first word) is masked out.
+    //
+
+    for (i = 0; i < sizeof(*Header) / sizeof(U64); i++)
     {
-        Checksum += *((U8 *)Header + i);
+        U64 Word = Words[i];
+
+        if (!i)
+            Word &= ~(0xffffULL << 32);
+
+        Hash = (Hash ^ Word) * 0x9e3779b97f4a7c15ULL;
     }
 
-    Checksum -= (U8)(Header->Checksum >> 0x08) + (U8)Header->Checksum;
+    Hash ^= Hash >> 32;
+    Hash ^= Hash >> 16;
 
-    return Checksum;
+    return (U16)Hash;
 }
 
 BOOLEAN
@@ -53,6 +67,41 @@ MiPoolChecksumMismatch(
 }
 
 
+VOID
+KERNELAPI
+MiVerifyPoolBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN PPOOL_HEADER BlockHeader)
+{
+    PDLIST_ENTRY ListHead = &BlockList->BlockListHead;
+    PDLIST_ENTRY ListCurrent;
+
+    if (!(BlockList->Flags & POOL_FLAG_VERIFY_MASK))
+        return;
+
+    POOL_ASSERT( KeIsSpinlockAcquired(&BlockList->Lock) );
+
+    if (BlockList->Flags & POOL_FLAG_VERIFY_FULL)
+    {
+        for (ListCurrent = ListHead->Next; ListCurrent != ListHead; ListCurrent = ListCurrent->Next)
+        {
+            POOL_ASSERT( !MiPoolChecksumMismatch(CONTAINING_RECORD(ListCurrent, POOL_HEADER, BlockList)) );
+        }
+
+        return;
+    }
+
+    POOL_ASSERT( !MiPoolChecksumMismatch(BlockHeader) );
+
+    ListCurrent = BlockHeader->BlockList.Prev;
+    if (ListCurrent != ListHead)
+        POOL_ASSERT( !MiPoolChecksumMismatch(CONTAINING_RECORD(ListCurrent, POOL_HEADER, BlockList)) );
+
+    ListCurrent = BlockHeader->BlockList.Next;
+    if (ListCurrent != ListHead)
+        POOL_ASSERT( !MiPoolChecksumMismatch(CONTAINING_RECORD(ListCurrent, POOL_HEADER, BlockList)) );
+}
+
 PPOOL_BLOCK_LIST
 KERNELAPI
 MiLookupPoolByAddress(
@@ -101,7 +150,7 @@ MiInitializePoolHeader(
     Header->BlockSizeUnused = BlockSizeUnused;
     Header->Checksum = 0;
     Header->Tag = Tag;
-    Header->Reserved1 = 0;
+    Header->BlockFlags = 0;
     Header->Reserved2 = 0;
 
     Header->BlockList.Prev = NULL;
@@ -142,11 +191,13 @@ MiInitializePoolBlockList(
     IN U32 Flags)
 {
     PPOOL_HEADER FirstHeader;
+    U32 i;
 
     if (!AreaSize || AreaSize < sizeof(POOL_HEADER))
         return FALSE;
 
     KeInitializeSpinlock(&PoolObject->Lock);
+    KeRegisterSpinlockStatistics(&PoolObject->Lock, "Pool", (U32)(PoolObject - MiPoolList));
 
     PoolObject->AreaStart = AreaStart;
     PoolObject->AreaSize = AreaSize;
@@ -154,6 +205,14 @@ MiInitializePoolBlockList(
 
     DListInitializeHead(&PoolObject->BlockListHead);
 
+    PoolObject->SizeClassNonEmpty = 0;
+    for (i = 0; i < POOL_SIZE_CLASS_COUNT; i++)
+    {
+        DListInitializeHead(&PoolObject->SizeClass[i].FreeListHead);
+        PoolObject->SizeClass[i].Depth = 0;
+        PoolObject->SizeClass[i].Reserved = 0;
+    }
+
     // Initialize the first free.
     FirstHeader = (PPOOL_HEADER)AreaStart;
     MiInitializePoolHeader(FirstHeader, TAG4('I', 'N', 'I', 'T'), 0, 0, AreaSize - sizeof(POOL_HEADER), 0);
@@ -164,143 +223,287 @@ MiInitializePoolBlockList(
     return TRUE;
 }
 
-VOID *
+U32
 KERNELAPI
-MmAllocatePool(
-    IN POOL_TYPE Type,
-    IN SIZE_T Size, 
-    IN U16 Alignment, 
-    IN U32 Tag)
+MiPoolSizeToClass(
+    IN SIZE_T Size)
 {
-    PPOOL_BLOCK_LIST BlockList;
-    PDLIST_ENTRY ListHead;
-    PDLIST_ENTRY ListCurrent;
-    SIZE_T AlignedSize;
-    U8 AlignmentShift = 0;
+    unsigned long Shift;
+    SIZE_T Offset;
+
+    if (!Size || Size > POOL_SIZE_CLASS_MAX)
+        return POOL_SIZE_CLASS_INVALID;
+
+    if (Size <= POOL_SIZE_CLASS_LINEAR_MAX)
+        return (U32)((Size - 1) >> POOL_SIZE_CLASS_LINEAR_SHIFT);
+
+    // 4 classes for each power of two: (2^n, 2^n + 2^(n-2) * k], k = 1..4.
+    Offset = Size - 1;
+    _BitScanReverse64(&Shift, Offset);
+    Offset = (Offset - (1ULL << Shift)) >> (Shift - 2);
 
+    return POOL_SIZE_CLASS_LINEAR_COUNT + (U32)((Shift - 8) << 2) + (U32)Offset;
+}
+
+SIZE_T
+KERNELAPI
+MiPoolClassToSize(
+    IN U32 Class)
+{
+    U32 Shift;
+
+    POOL_ASSERT(Class < POOL_SIZE_CLASS_COUNT);
+
+    if (Class < POOL_SIZE_CLASS_LINEAR_COUNT)
+        return (SIZE_T)(Class + 1) << POOL_SIZE_CLASS_LINEAR_SHIFT;
+
+    Class -= POOL_SIZE_CLASS_LINEAR_COUNT;
+    Shift = 8 + (Class >> 2);
+
+    return (1ULL << Shift) + ((SIZE_T)((Class & 3) + 1) << (Shift - 2));
+}
+
+C_ASSERT(POOL_SIZE_CLASS_LINEAR_MAX == 0x100);
+C_ASSERT(POOL_SIZE_CLASS_COUNT == POOL_SIZE_CLASS_LINEAR_COUNT + 4 * 4);
+
+VOID
+KERNELAPI
+MiPushSizeClassBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN PPOOL_HEADER BlockHeader,
+    IN U32 Class)
+{
+    PDLIST_ENTRY Link = (PDLIST_ENTRY)(BlockHeader + 1);
+    SIZE_T ClassSize = MiPoolClassToSize(Class);
+
+    POOL_ASSERT( KeIsSpinlockAcquired(&BlockList->Lock) );
+    POOL_ASSERT( BlockHeader->BlockSize + BlockHeader->BlockSizeReserved == ClassSize );
+
+    // fill the magic number except the link.
+    memset(Link + 1, 0xee, ClassSize - sizeof(*Link));
+
+    BlockHeader->BlockFlags |= POOL_BLOCK_FLAG_CACHED;
+    MiUpdatePoolHeaderChecksum(BlockHeader);
+
+    DListInitializeHead(Link);
+    DListInsertAfter(&BlockList->SizeClass[Class].FreeListHead, Link);
+    BlockList->SizeClass[Class].Depth++;
+    BlockList->SizeClassNonEmpty |= (1ULL << Class);
+}
+
+PPOOL_HEADER
+KERNELAPI
+MiPopSizeClassBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN U32 Class)
+{
+    PPOOL_SIZE_CLASS SizeClass = &BlockList->SizeClass[Class];
+    PDLIST_ENTRY Link;
     PPOOL_HEADER BlockHeader;
-    UPTR BlockAddress = 0;
 
-    U32 BitsCount = 0;
-    U32 i;
+    POOL_ASSERT( KeIsSpinlockAcquired(&BlockList->Lock) );
 
-    AlignedSize = (Size + POOL_HEADER_ALIGNMENT - 1) & ~(POOL_HEADER_ALIGNMENT - 1);
+    if (!SizeClass->Depth)
+        return NULL;
 
-    BlockList = MiLookupPool(Type);
-    if (!BlockList)
-        return FALSE;
+    Link = SizeClass->FreeListHead.Next;
+    DListRemoveEntry(Link);
 
-    for (i = 0; i < sizeof(Alignment) * 8; i++)
-    {
-        if (Alignment & (1 << i))
-        {
-            BitsCount++;
-            AlignmentShift = (U8)i;
-        }
-    }
+    if (!--SizeClass->Depth)
+        BlockList->SizeClassNonEmpty &= ~(1ULL << Class);
 
-    if (BitsCount >= 2)
-        return FALSE;
+    BlockHeader = (PPOOL_HEADER)Link - 1;
+    MiVerifyPoolBlock(BlockList, BlockHeader);
+    POOL_ASSERT( BlockHeader->BlockFlags & POOL_BLOCK_FLAG_CACHED );
 
-    if (Alignment < POOL_HEADER_ALIGNMENT)
-    {
-        Alignment = POOL_HEADER_ALIGNMENT;
-        AlignmentShift = POOL_HEADER_ALIGNMENT_SHIFT;
-    }
+    BlockHeader->BlockFlags &= ~POOL_BLOCK_FLAG_CACHED;
+
+    return BlockHeader;
+}
+
+PPOOL_HEADER
+KERNELAPI
+MiSplitPoolBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN PPOOL_HEADER BlockHeader,
+    IN SIZE_T Size,
+    IN SIZE_T AlignedSize,
+    IN U16 Alignment,
+    IN U8 AlignmentShift,
+    IN U32 Tag)
+{
+    PDLIST_ENTRY ListHead = &BlockList->BlockListHead;
+    PPOOL_HEADER BlockHeader2 = NULL;
+    PPOOL_HEADER BlockHeader3 = NULL;
+    UPTR BlockHeaderNextTemp;
+    UPTR BlockHeaderNext;
+    UPTR BlockEnd;
+
+    UPTR BlockStartUnaligned;
+    UPTR BlockStartAligned;
+    UPTR BlockSizeUnused;
+
+    BlockEnd = POOL_BLOCK_END(BlockHeader);
+
+    BlockHeaderNextTemp = BlockEnd - BlockHeader->BlockSizeUnused;
+    POOL_ASSERT( !(BlockHeaderNextTemp & (POOL_HEADER_ALIGNMENT - 1)) );
 
+    BlockStartUnaligned = (BlockHeaderNextTemp + sizeof(POOL_HEADER) + POOL_HEADER_ALIGNMENT - 1) & ~(POOL_HEADER_ALIGNMENT - 1);
+    BlockStartAligned = (BlockStartUnaligned + Alignment - 1) & ~(Alignment - 1);
+
+    if (BlockStartAligned + AlignedSize > BlockEnd)
+        return NULL;
+
+    BlockHeaderNext = BlockStartAligned - sizeof(POOL_HEADER);
+    BlockSizeUnused = BlockEnd - (BlockStartAligned + AlignedSize);
+
+    // Create the new header.
+    // HHHH|XXXXRUUUUUUUUUUUUUUUUU -> HHHH|XXXXRUUHHHH|XXXXXXXXRUU
+    BlockHeader2 = (PPOOL_HEADER)BlockHeaderNext;
+    if (BlockHeader->BlockList.Next != ListHead)
+        BlockHeader3 = CONTAINING_RECORD(BlockHeader->BlockList.Next, POOL_HEADER, BlockList);
+
+    MiInitializePoolHeader(BlockHeader2, Tag, Size, (U32)(AlignedSize - Size), BlockSizeUnused, AlignmentShift);
+    DListInitializeHead(&BlockHeader2->BlockList);
+    DListInsertAfter(&BlockHeader->BlockList, &BlockHeader2->BlockList);
+
+    // Set previous header.
+    BlockHeader->BlockSizeUnused = BlockHeaderNext
+        - ((UPTR)BlockHeader + sizeof(POOL_HEADER) + BlockHeader->BlockSize + BlockHeader->BlockSizeReserved);
+
+    // Update the checksum.
+    MiUpdatePoolHeaderChecksum(BlockHeader);
+    MiUpdatePoolHeaderChecksum(BlockHeader2);
+
+    if (BlockHeader3)
+        MiUpdatePoolHeaderChecksum(BlockHeader3);
+
+    return BlockHeader2;
+}
+
+PPOOL_HEADER
+KERNELAPI
+MiAllocatePoolBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN SIZE_T Size,
+    IN SIZE_T AlignedSize,
+    IN U16 Alignment,
+    IN U8 AlignmentShift,
+    IN U32 Tag)
+{
+    PDLIST_ENTRY ListHead;
+    PDLIST_ENTRY ListCurrent;
+    PPOOL_HEADER BlockHeader = NULL;
 
-    KeAcquireSpinlock(&BlockList->Lock);
+    POOL_ASSERT( KeIsSpinlockAcquired(&BlockList->Lock) );
 
     ListHead = &BlockList->BlockListHead;
     ListCurrent = ListHead->Next;
 
     while (ListCurrent != ListHead)
     {
-        PPOOL_HEADER BlockHeader2 = NULL;
-        PPOOL_HEADER BlockHeader3 = NULL;
-        UPTR BlockHeaderNextTemp;
-        UPTR BlockHeaderNext;
-        UPTR BlockEnd;
-
-        UPTR BlockStartUnaligned;
-        UPTR BlockStartAligned;
-        UPTR BlockSizeUnused;
-
-        BlockHeader = CONTAINING_RECORD(ListCurrent, POOL_HEADER, BlockList);
+        PPOOL_HEADER BlockHeaderPrev = CONTAINING_RECORD(ListCurrent, POOL_HEADER, BlockList);
         ListCurrent = ListCurrent->Next;
 
-        BlockEnd = POOL_BLOCK_END(BlockHeader);
+        BlockHeader = MiSplitPoolBlock(BlockList, BlockHeaderPrev, Size, AlignedSize, Alignment, AlignmentShift, Tag);
+        if (BlockHeader)
+            break;
+    }
 
-        BlockHeaderNextTemp = BlockEnd - BlockHeader->BlockSizeUnused;
-        POOL_ASSERT( !(BlockHeaderNextTemp & (POOL_HEADER_ALIGNMENT - 1)) );
+    if (BlockHeader)
+        MiVerifyPoolBlock(BlockList, BlockHeader);
 
-        BlockStartUnaligned = (BlockHeaderNextTemp + sizeof(POOL_HEADER) + POOL_HEADER_ALIGNMENT - 1) & ~(POOL_HEADER_ALIGNMENT - 1);
-        BlockStartAligned = (BlockStartUnaligned + Alignment - 1) & ~(Alignment - 1);
+    return BlockHeader;
+}
 
-        if (BlockStartAligned + AlignedSize > BlockEnd)
-            continue;
+PPOOL_HEADER
+KERNELAPI
+MiAllocateSizeClassBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN SIZE_T Size,
+    IN U32 Class,
+    IN U8 AlignmentShift,
+    IN U32 Tag)
+{
+    PPOOL_HEADER BlockHeader;
+    PPOOL_HEADER BlockHeaderRefill;
+    SIZE_T ClassSize;
+    U64 Candidates;
+    U32 RefillCount;
+    U32 i;
 
-        BlockHeaderNext = BlockStartAligned - sizeof(POOL_HEADER);
-        BlockSizeUnused = BlockEnd - (BlockStartAligned + AlignedSize);
+    //
+    // 1. Exact class or one of the next 2 classes (bounded internal fragmentation).
+    //
 
-        // Create the new header.
-        // HHHH|XXXXRUUUUUUUUUUUUUUUUU -> HHHH|XXXXRUUHHHH|XXXXXXXXRUU
-        BlockHeader2 = (PPOOL_HEADER)BlockHeaderNext;
-        if (BlockHeader->BlockList.Next != ListHead)
-            BlockHeader3 = CONTAINING_RECORD(BlockHeader->BlockList.Next, POOL_HEADER, BlockList);
+    Candidates = (BlockList->SizeClassNonEmpty >> Class) & 0x07;
+    if (Candidates)
+    {
+        unsigned long Index;
 
-        MiInitializePoolHeader(BlockHeader2, Tag, Size, (U32)(AlignedSize - Size), BlockSizeUnused, AlignmentShift);
-        DListInitializeHead(&BlockHeader2->BlockList);
-        DListInsertAfter(&BlockHeader->BlockList, &BlockHeader2->BlockList);
+        _BitScanForward64(&Index, Candidates);
+        Class += Index;
 
-        // Set previous header.
-        BlockHeader->BlockSizeUnused = BlockHeaderNext
-            - ((UPTR)BlockHeader + sizeof(POOL_HEADER) + BlockHeader->BlockSize + BlockHeader->BlockSizeReserved);
+        BlockHeader = MiPopSizeClassBlock(BlockList, Class);
+        POOL_ASSERT(BlockHeader != NULL);
 
-        // Update the checksum.
+        // Capacity of the block never changes, so it returns to the same class on free.
+        ClassSize = BlockHeader->BlockSize + BlockHeader->BlockSizeReserved;
+        BlockHeader->Tag = Tag;
+        BlockHeader->AlignmemtShift = AlignmentShift;
+        BlockHeader->BlockSize = Size;
+        BlockHeader->BlockSizeReserved = (U32)(ClassSize - Size);
         MiUpdatePoolHeaderChecksum(BlockHeader);
-        MiUpdatePoolHeaderChecksum(BlockHeader2);
 
-        if (BlockHeader3)
-            MiUpdatePoolHeaderChecksum(BlockHeader3);
+        return BlockHeader;
+    }
 
-        if (1)
-        {
-            PDLIST_ENTRY head = &BlockList->BlockListHead;
-            PDLIST_ENTRY curr = head->Next;
-            while (curr != head)
-            {
-                PPOOL_HEADER hdr = CONTAINING_RECORD(curr, POOL_HEADER, BlockList);
-                if (MiPoolChecksumMismatch(hdr))
-                {
-                    // printf("CHECKSUM MISMATCH AT BLOCK HEADER 0x%llx\n", (U64)hdr);
-                    POOL_ASSERT(FALSE);
-                }
-                curr = curr->Next;
-            }
-        }
+    //
+    // 2. Carve a batch of class-sized blocks from the block list.
+    //    Blocks are carved back-to-back, so only the first one needs the walk.
+    //
 
+    ClassSize = MiPoolClassToSize(Class);
+    BlockHeader = MiAllocatePoolBlock(BlockList, Size, ClassSize,
+        POOL_SIZE_CLASS_ALIGNMENT, AlignmentShift, Tag);
 
-        // Set return block address.
-        BlockAddress = BlockStartAligned;
+    if (!BlockHeader)
+        return NULL;
 
-        break;
-    }
+    BlockHeader->BlockFlags |= POOL_BLOCK_FLAG_SIZE_CLASS;
+    MiUpdatePoolHeaderChecksum(BlockHeader);
+
+    RefillCount = (U32)(POOL_SIZE_CLASS_REFILL_BYTES / ClassSize);
+    if (RefillCount > POOL_SIZE_CLASS_REFILL_MAX)
+        RefillCount = POOL_SIZE_CLASS_REFILL_MAX;
+
+    BlockHeaderRefill = BlockHeader;
+    for (i = 1; i < RefillCount; i++)
+    {
+        if (BlockList->SizeClass[Class].Depth >= POOL_SIZE_CLASS_DEPTH_MAX)
+            break;
 
-    KeReleaseSpinlock(&BlockList->Lock);
+        BlockHeaderRefill = MiSplitPoolBlock(BlockList, BlockHeaderRefill, ClassSize, ClassSize,
+            POOL_SIZE_CLASS_ALIGNMENT, POOL_HEADER_ALIGNMENT_SHIFT, Tag);
 
-    return (VOID *)BlockAddress;
+        if (!BlockHeaderRefill)
+            break;
+
+        BlockHeaderRefill->BlockFlags |= POOL_BLOCK_FLAG_SIZE_CLASS;
+        MiPushSizeClassBlock(BlockList, BlockHeaderRefill, Class);
+    }
+
+    return BlockHeader;
 }
 
 VOID
 KERNELAPI
-MmFreePool(
-    IN VOID *Address)
+MiFreePoolBlock(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN PPOOL_HEADER BlockHeaderCurrent)
 {
-    PPOOL_BLOCK_LIST BlockList;
     PDLIST_ENTRY ListHead;
     PDLIST_ENTRY ListCurrent;
-    PPOOL_HEADER BlockHeaderCurrent;
 
     PPOOL_HEADER BlockHeaderPrev = NULL;
     PPOOL_HEADER BlockHeaderNext = NULL;
@@ -310,22 +513,33 @@ MmFreePool(
 
     UPTR BlockSizeUnusedIncrement;
 
-    BlockList = MiLookupPoolByAddress((UPTR)Address);
-    POOL_ASSERT(BlockList != NULL);
-
-    // Pool header must be in the same pool area
-    BlockHeaderCurrent = (PPOOL_HEADER)((UPTR)Address - sizeof(POOL_HEADER));
-    POOL_ASSERT(MiLookupPoolByAddress((UPTR)BlockHeaderCurrent) == BlockList);
+    POOL_ASSERT( KeIsSpinlockAcquired(&BlockList->Lock) );
 
     ListHead = &BlockList->BlockListHead;
 
-    KeAcquireSpinlock(&BlockList->Lock);
-
     //
     // Verify the header checksum.
     //
 
-    POOL_ASSERT( !MiPoolChecksumMismatch(BlockHeaderCurrent) );
+    MiVerifyPoolBlock(BlockList, BlockHeaderCurrent);
+    POOL_ASSERT( !(BlockHeaderCurrent->BlockFlags & POOL_BLOCK_FLAG_CACHED) );
+
+    //
+    // Return the size class block to its free list unless the class is full.
+    //
+
+    if (BlockHeaderCurrent->BlockFlags & POOL_BLOCK_FLAG_SIZE_CLASS)
+    {
+        U32 Class = MiPoolSizeToClass(BlockHeaderCurrent->BlockSize + BlockHeaderCurrent->BlockSizeReserved);
+
+        POOL_ASSERT(Class != POOL_SIZE_CLASS_INVALID);
+
+        if (BlockList->SizeClass[Class].Depth < POOL_SIZE_CLASS_DEPTH_MAX)
+        {
+            MiPushSizeClassBlock(BlockList, BlockHeaderCurrent, Class);
+            return;
+        }
+    }
 
     //
     // Merge the block.
@@ -414,9 +628,340 @@ MmFreePool(
     if (BlockHeaderUpdate)
         MiUpdatePoolHeaderChecksum(BlockHeaderUpdate);
 
-    KeReleaseSpinlock(&BlockList->Lock);
+    MiVerifyPoolBlock(BlockList, BlockHeaderPrev);
+}
+
+
+PPOOL_PROCESSOR_CACHE
+KERNELAPI
+MiGetCurrentPoolCache(
+    VOID)
+{
+    // Pool is used before the processor block is ready.
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+
+    if (!Processor)
+        return NULL;
+
+    return Processor->PoolCache;
+}
+
+VOID
+KERNELAPI
+MiRefillPoolMagazine(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN OUT PPOOL_MAGAZINE Magazine,
+    IN U32 Class)
+{
+    SIZE_T ClassSize = MiPoolClassToSize(Class);
+    BOOLEAN PrevState;
+    U32 i;
+
+    KeAcquireSpinlockDisableInterrupt(&BlockList->Lock, &PrevState);
+
+    for (i = 0; i < POOL_MAGAZINE_BATCH && Magazine->Count < POOL_MAGAZINE_SIZE; i++)
+    {
+        // Header is stamped here, under the lock. It is not touched when handed out.
+        PPOOL_HEADER BlockHeader = MiAllocateSizeClassBlock(BlockList, ClassSize, Class,
+            POOL_HEADER_ALIGNMENT_SHIFT, TAG4('P', 'M', 'A', 'G'));
+
+        if (!BlockHeader)
+            break;
+
+        Magazine->Blocks[Magazine->Count++] = BlockHeader;
+    }
+
+    KeReleaseSpinlockRestoreInterrupt(&BlockList->Lock, PrevState);
+}
+
+VOID
+KERNELAPI
+MiDrainPoolMagazine(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN OUT PPOOL_MAGAZINE Magazine)
+{
+    U32 Count = POOL_MAGAZINE_BATCH;
+    BOOLEAN PrevState;
+    U32 i;
+
+    if (Count > Magazine->Count)
+        Count = Magazine->Count;
+
+    // Oldest blocks (bottom of the magazine) are returned first.
+    KeAcquireSpinlockDisableInterrupt(&BlockList->Lock, &PrevState);
+
+    for (i = 0; i < Count; i++)
+        MiFreePoolBlock(BlockList, Magazine->Blocks[i]);
+
+    KeReleaseSpinlockRestoreInterrupt(&BlockList->Lock, PrevState);
+
+    for (i = Count; i < Magazine->Count; i++)
+        Magazine->Blocks[i - Count] = Magazine->Blocks[i];
+
+    Magazine->Count -= Count;
+}
+
+PPOOL_HEADER
+KERNELAPI
+MiAllocateFromPoolCache(
+    IN POOL_TYPE Type,
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN U32 Class)
+{
+    BOOLEAN InterruptState = !!(__readeflags() & RFLAG_IF);
+    PPOOL_PROCESSOR_CACHE Cache;
+    PPOOL_MAGAZINE Magazine;
+    PPOOL_HEADER BlockHeader = NULL;
+
+    _disable();
+
+    Cache = MiGetCurrentPoolCache();
+    if (Cache)
+    {
+        Magazine = &Cache->Magazines[Type][Class];
+
+        if (Magazine->Count)
+        {
+            Cache->Statistics.AllocateHits++;
+        }
+        else
+        {
+            Cache->Statistics.AllocateMisses++;
+            Cache->Statistics.Refills++;
+            MiRefillPoolMagazine(BlockList, Magazine, Class);
+        }
+
+        // No lock is taken on hit. Neighbours rewrite this header under the pool lock.
+        if (Magazine->Count)
+            BlockHeader = Magazine->Blocks[--Magazine->Count];
+    }
+
+    if (InterruptState)
+        _enable();
+
+    return BlockHeader;
+}
+
+BOOLEAN
+KERNELAPI
+MiFreeToPoolCache(
+    IN PPOOL_BLOCK_LIST BlockList,
+    IN PPOOL_HEADER BlockHeader)
+{
+    BOOLEAN InterruptState;
+    PPOOL_PROCESSOR_CACHE Cache;
+    PPOOL_MAGAZINE Magazine;
+    U32 Class;
+
+    // BlockFlags and block capacity do not change while the block is allocated.
+    if (!(BlockHeader->BlockFlags & POOL_BLOCK_FLAG_SIZE_CLASS))
+        return FALSE;
+
+    Class = MiPoolSizeToClass(BlockHeader->BlockSize + BlockHeader->BlockSizeReserved);
+    POOL_ASSERT(Class != POOL_SIZE_CLASS_INVALID);
+
+    InterruptState = !!(__readeflags() & RFLAG_IF);
+    _disable();
+
+    Cache = MiGetCurrentPoolCache();
+    if (Cache)
+    {
+        Magazine = &Cache->Magazines[BlockList - MiPoolList][Class];
+
+        if (Magazine->Count < POOL_MAGAZINE_SIZE)
+        {
+            Cache->Statistics.FreeHits++;
+        }
+        else
+        {
+            Cache->Statistics.FreeMisses++;
+            Cache->Statistics.Drains++;
+            MiDrainPoolMagazine(BlockList, Magazine);
+        }
+
+        Magazine->Blocks[Magazine->Count++] = BlockHeader;
+    }
+
+    if (InterruptState)
+        _enable();
+
+    return !!Cache;
+}
+
+VOID *
+KERNELAPI
+MmAllocatePool(
+    IN POOL_TYPE Type,
+    IN SIZE_T Size, 
+    IN U16 Alignment, 
+    IN U32 Tag)
+{
+    PPOOL_BLOCK_LIST BlockList;
+    SIZE_T AlignedSize;
+    U8 AlignmentShift = 0;
+
+    PPOOL_HEADER BlockHeader;
+    BOOLEAN PrevState;
+    U32 Class;
+
+    U32 BitsCount = 0;
+    U32 i;
+
+    AlignedSize = (Size + POOL_HEADER_ALIGNMENT - 1) & ~(POOL_HEADER_ALIGNMENT - 1);
+
+    BlockList = MiLookupPool(Type);
+    if (!BlockList)
+        return FALSE;
+
+    for (i = 0; i < sizeof(Alignment) * 8; i++)
+    {
+        if (Alignment & (1 << i))
+        {
+            BitsCount++;
+            AlignmentShift = (U8)i;
+        }
+    }
+
+    if (BitsCount >= 2)
+        return FALSE;
+
+    if (Alignment < POOL_HEADER_ALIGNMENT)
+    {
+        Alignment = POOL_HEADER_ALIGNMENT;
+        AlignmentShift = POOL_HEADER_ALIGNMENT_SHIFT;
+    }
+
+    // Small and medium allocations are served from the size classes.
+    // Large or over-aligned allocations fall back to the first-fit walk.
+    Class = POOL_SIZE_CLASS_INVALID;
+    if (Alignment <= POOL_SIZE_CLASS_ALIGNMENT)
+        Class = MiPoolSizeToClass(Size);
+
+
+    if (Class != POOL_SIZE_CLASS_INVALID)
+    {
+        BlockHeader = MiAllocateFromPoolCache(Type, BlockList, Class);
+        if (BlockHeader)
+        {
+            KTRACE_EVENT3(EventTracePoolAllocate, Type, Size, BlockHeader + 1);
+            return (VOID *)(BlockHeader + 1);
+        }
+    }
+
+    KeAcquireSpinlockDisableInterrupt(&BlockList->Lock, &PrevState);
+
+    if (Class != POOL_SIZE_CLASS_INVALID)
+        BlockHeader = MiAllocateSizeClassBlock(BlockList, Size, Class, AlignmentShift, Tag);
+    else
+        BlockHeader = MiAllocatePoolBlock(BlockList, Size, AlignedSize, Alignment, AlignmentShift, Tag);
+
+    KeReleaseSpinlockRestoreInterrupt(&BlockList->Lock, PrevState);
+
+    if (!BlockHeader)
+        return NULL;
+
+    KTRACE_EVENT3(EventTracePoolAllocate, Type, Size, BlockHeader + 1);
+
+    return (VOID *)(BlockHeader + 1);
 }
 
+VOID
+KERNELAPI
+MmFreePool(
+    IN VOID *Address)
+{
+    PPOOL_BLOCK_LIST BlockList;
+    PPOOL_HEADER BlockHeader;
+    BOOLEAN PrevState;
+
+    KTRACE_EVENT1(EventTracePoolFree, Address);
+
+    BlockList = MiLookupPoolByAddress((UPTR)Address);
+    POOL_ASSERT(BlockList != NULL);
+
+    // Pool header must be in the same pool area
+    BlockHeader = (PPOOL_HEADER)((UPTR)Address - sizeof(POOL_HEADER));
+    POOL_ASSERT(MiLookupPoolByAddress((UPTR)BlockHeader) == BlockList);
+
+    if (MiFreeToPoolCache(BlockList, BlockHeader))
+        return;
+
+    KeAcquireSpinlockDisableInterrupt(&BlockList->Lock, &PrevState);
+    MiFreePoolBlock(BlockList, BlockHeader);
+
+    KeReleaseSpinlockRestoreInterrupt(&BlockList->Lock, PrevState);
+}
+
+ESTATUS
+KERNELAPI
+MmSetPoolVerifyMode(
+    IN POOL_TYPE Type,
+    IN U32 VerifyFlags)
+{
+    PPOOL_BLOCK_LIST BlockList = MiLookupPool(Type);
+    BOOLEAN PrevState;
+
+    if (!BlockList || (VerifyFlags & ~POOL_FLAG_VERIFY_MASK))
+        return E_INVALID_PARAMETER;
+
+    KeAcquireSpinlockDisableInterrupt(&BlockList->Lock, &PrevState);
+    BlockList->Flags = (BlockList->Flags & ~POOL_FLAG_VERIFY_MASK) | VerifyFlags;
+    KeReleaseSpinlockRestoreInterrupt(&BlockList->Lock, PrevState);
+
+    return E_SUCCESS;
+}
+
+POOL_PROCESSOR_CACHE *
+KERNELAPI
+MiAllocateProcessorPoolCache(
+    VOID)
+{
+    POOL_PROCESSOR_CACHE *Cache = MmAllocatePool(PoolTypeNonPaged, sizeof(*Cache), 0x40, TAG4('P', 'C', 'C', 'H'));
+
+    if (Cache)
+        memset(Cache, 0, sizeof(*Cache));
+
+    return Cache;
+}
+
+ESTATUS
+KERNELAPI
+MmQueryPoolCacheStatistics(
+    IN U8 ProcessorId,
+    OUT POOL_CACHE_STATISTICS *Statistics)
+{
+    KPROCESSOR *Processor = KiProcessorBlocks[ProcessorId];
+
+    if (!Processor || !Processor->PoolCache)
+        return E_NOT_FOUND;
+
+    // Counters are updated without a lock; this is a snapshot.
+    *Statistics = Processor->PoolCache->Statistics;
+
+    return E_SUCCESS;
+}
+
+VOID
+KERNELAPI
+MmDumpPoolCacheStatistics(
+    VOID)
+{
+    POOL_CACHE_STATISTICS Statistics;
+    U32 i;
+
+    DbgTraceF(TraceLevelDebug, "CPU  AllocHit   AllocMiss  FreeHit    FreeMiss   Refill     Drain\n");
+
+    for (i = 0; i < COUNTOF(KiProcessorBlocks); i++)
+    {
+        if (!E_IS_SUCCESS(MmQueryPoolCacheStatistics((U8)i, &Statistics)))
+            continue;
+
+        DbgTraceF(TraceLevelDebug, "%3d  %-10lld %-10lld %-10lld %-10lld %-10lld %-10lld\n", i,
+            Statistics.AllocateHits, Statistics.AllocateMisses,
+            Statistics.FreeHits, Statistics.FreeMisses,
+            Statistics.Refills, Statistics.Drains);
+    }
+}
 
 
 #if 0
@@ -427,8 +972,9 @@ MmEnumeratePoolBlockList(
 {
     PDLIST_ENTRY ListHead;
     PDLIST_ENTRY ListCurrent;
+    BOOLEAN PrevState;
 
-    KeAcquireSpinlock(&BlockList->Lock);
+    KeAcquireSpinlockDisableInterrupt(&BlockList->Lock, &PrevState);
 
     ListHead = &BlockList->BlockListHead;
     ListCurrent = ListHead->Next;
@@ -449,7 +995,7 @@ MmEnumeratePoolBlockList(
             BlockStart, BlockHeader->BlockSize, BlockHeader->BlockSizeReserved, BlockHeader->BlockSizeUnused);
     }
 
-    KeReleaseSpinlock(&BlockList->Lock);
+    KeReleaseSpinlockRestoreInterrupt(&BlockList->Lock, PrevState);
 }
 
 VOID
@@ -7,6 +7,42 @@
 #define POOL_FLAG_PAGED                 0x00000001
 #define POOL_FLAG_DEBUG_BOUNDTEST       0x00000002
 
+//
+// Pool verification mode.
+// None of the bits set means verification is off.
+//
+
+#define POOL_FLAG_VERIFY_NEIGHBOURS     0x00000004  //!< Verify the touched header and its neighbours.
+#define POOL_FLAG_VERIFY_FULL           0x00000008  //!< Verify every header in the pool.
+#define POOL_FLAG_VERIFY_MASK           (POOL_FLAG_VERIFY_NEIGHBOURS | POOL_FLAG_VERIFY_FULL)
+#define POOL_FLAG_VERIFY_DEFAULT        POOL_FLAG_VERIFY_NEIGHBOURS
+
+//
+// Size classes for small/medium allocations.
+//
+// Class  0..15 : 16-byte steps up to 256 bytes.
+// Class 16..31 : 4 steps per power of two up to 4K.
+//
+
+#define POOL_SIZE_CLASS_COUNT           32
+#define POOL_SIZE_CLASS_LINEAR_COUNT    16
+#define POOL_SIZE_CLASS_LINEAR_SHIFT    4
+#define POOL_SIZE_CLASS_LINEAR_MAX      (POOL_SIZE_CLASS_LINEAR_COUNT << POOL_SIZE_CLASS_LINEAR_SHIFT)
+#define POOL_SIZE_CLASS_MAX             0x1000
+#define POOL_SIZE_CLASS_ALIGNMENT       0x10
+#define POOL_SIZE_CLASS_INVALID         ((U32)-1)
+
+#define POOL_SIZE_CLASS_DEPTH_MAX       32      //!< Maximum number of cached blocks per class.
+#define POOL_SIZE_CLASS_REFILL_BYTES    0x2000  //!< Bytes carved at once when a class is empty.
+#define POOL_SIZE_CLASS_REFILL_MAX      16
+
+//
+// Pool block flags (POOL_HEADER.BlockFlags).
+//
+
+#define POOL_BLOCK_FLAG_SIZE_CLASS      0x01    //!< Block is sized to its size class.
+#define POOL_BLOCK_FLAG_CACHED          0x02    //!< Block is on the size class free list.
+
 typedef enum _POOL_TYPE {
     PoolTypeNonPaged,
     PoolTypePaged,
@@ -20,7 +56,7 @@ typedef struct _POOL_HEADER {
     U32 Tag;
     U16 Checksum;
     U8 AlignmemtShift;
-    U8 Reserved1;
+    U8 BlockFlags;
 
     // Pool Area Layout:
     // <PoolBlock1> <PoolBlock2> ... <PoolBlockN>
@@ -46,6 +82,12 @@ C_ASSERT(!(sizeof(POOL_HEADER) & 0x07));
     )
 
 
+typedef struct _POOL_SIZE_CLASS {
+    DLIST_ENTRY FreeListHead;   //!< Cached free blocks (link is stored in the block body).
+    U32 Depth;                  //!< Number of cached blocks.
+    U32 Reserved;
+} POOL_SIZE_CLASS, *PPOOL_SIZE_CLASS;
+
 typedef struct _POOL_BLOCK_LIST {
     KSPIN_LOCK Lock;
     U32 Flags;
@@ -54,8 +96,46 @@ typedef struct _POOL_BLOCK_LIST {
     UPTR AreaSize;
 
     DLIST_ENTRY BlockListHead;
+
+    U64 SizeClassNonEmpty;      //!< Bitmap of non-empty size classes.
+    POOL_SIZE_CLASS SizeClass[POOL_SIZE_CLASS_COUNT];
 } POOL_BLOCK_LIST, *PPOOL_BLOCK_LIST;
 
+C_ASSERT(POOL_SIZE_CLASS_COUNT <= 64);
+
+//
+// Per-processor magazines for size class blocks.
+// Blocks in a magazine stay allocated from the view of POOL_BLOCK_LIST, and
+// their headers are only modified while the pool lock is held (refill, drain and
+// neighbour split/merge). Handing out a block does not touch its header, so the
+// header keeps the magazine tag and class size, or the tag and size of its last owner.
+// Magazines are used with interrupts disabled, so the pool lock is always taken
+// with interrupts disabled too (a preempted holder would stall the magazine path).
+//
+
+#define POOL_MAGAZINE_SIZE              16
+#define POOL_MAGAZINE_BATCH             (POOL_MAGAZINE_SIZE / 2)   //!< Blocks moved per refill/drain.
+
+typedef struct _POOL_MAGAZINE {
+    U32 Count;
+    U32 Reserved;
+    PPOOL_HEADER Blocks[POOL_MAGAZINE_SIZE];
+} POOL_MAGAZINE, *PPOOL_MAGAZINE;
+
+typedef struct _POOL_CACHE_STATISTICS {
+    U64 AllocateHits;
+    U64 AllocateMisses;
+    U64 FreeHits;
+    U64 FreeMisses;
+    U64 Refills;
+    U64 Drains;
+} POOL_CACHE_STATISTICS, *PPOOL_CACHE_STATISTICS;
+
+typedef struct _POOL_PROCESSOR_CACHE {
+    POOL_CACHE_STATISTICS Statistics;
+    POOL_MAGAZINE Magazines[PoolTypeMaximum][POOL_SIZE_CLASS_COUNT];
+} POOL_PROCESSOR_CACHE, *PPOOL_PROCESSOR_CACHE;
+
 extern POOL_BLOCK_LIST MiPoolList[PoolTypeMaximum];
 
 
@@ -81,3 +161,25 @@ KERNELAPI
 MmFreePool(
     IN VOID *Address);
 
+ESTATUS
+KERNELAPI
+MmSetPoolVerifyMode(
+    IN POOL_TYPE Type,
+    IN U32 VerifyFlags);
+
+POOL_PROCESSOR_CACHE *
+KERNELAPI
+MiAllocateProcessorPoolCache(
+    VOID);
+
+ESTATUS
+KERNELAPI
+MmQueryPoolCacheStatistics(
+    IN U8 ProcessorId,
+    OUT POOL_CACHE_STATISTICS *Statistics);
+
+VOID
+KERNELAPI
+MmDumpPoolCacheStatistics(
+    VOID);
+
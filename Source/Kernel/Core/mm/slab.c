@@ -0,0 +1,444 @@
+
+/**
+ * @file slab.c
+ * @author Pseudo-Kernel (sandbox.isolated@gmail.com)
+ * @brief Implements slab cache for fixed-size kernel objects.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <base/base.h>
+#include <ke/ke.h>
+#include <ke/kprocessor.h>
+#include <mm/paging.h>
+#include <mm/mm.h>
+#include <mm/pool.h>
+#include <mm/slab.h>
+
+
+#define SLAB_ASSERT(_cond)              DASSERT(_cond)
+
+#define SLAB_HEADER_SIZE                ((sizeof(SLAB) + SLAB_COLOR_ALIGNMENT - 1) & ~(SLAB_COLOR_ALIGNMENT - 1))
+#define SLAB_FROM_OBJECT(_cache, _obj)  (*(SLAB **)((UPTR)(_obj) + (_cache)->ObjectSize))
+#define SLAB_NEXT_OBJECT(_obj)          (*(PVOID *)(_obj))
+
+
+/**
+ * @brief Initializes the slab cache.
+ *
+ * @param [out] Cache               Slab cache.
+ * @param [in] Name                 Name of the cache.
+ * @param [in] PoolType             Pool type which slabs are allocated from.
+ * @param [in] ObjectSize           Size of the object.
+ * @param [in] ObjectAlignment      Alignment of the object. Must be power of 2 and less than or equal to SLAB_COLOR_ALIGNMENT.
+ * @param [in] Constructor          Optional constructor which is called on each allocation.
+ * @param [in] ConstructorContext   Context for the constructor.
+ *
+ * @return ESTATUS code.
+ */
+ESTATUS
+KERNELAPI
+MmInitializeSlabCache(
+    OUT SLAB_CACHE *Cache,
+    IN CHAR *Name,
+    IN POOL_TYPE PoolType,
+    IN SIZE_T ObjectSize,
+    IN SIZE_T ObjectAlignment,
+    IN PSLAB_OBJECT_CONSTRUCTOR Constructor OPTIONAL,
+    IN PVOID ConstructorContext OPTIONAL)
+{
+    SIZE_T SlabSize;
+    SIZE_T ObjectStride;
+    SIZE_T ObjectsPerSlab = 0;
+    U32 i;
+
+    if (!ObjectSize || (ObjectAlignment & (ObjectAlignment - 1)) || ObjectAlignment > SLAB_COLOR_ALIGNMENT)
+        return E_INVALID_PARAMETER;
+
+    if (ObjectAlignment < SLAB_OBJECT_ALIGNMENT_MIN)
+        ObjectAlignment = SLAB_OBJECT_ALIGNMENT_MIN;
+
+    ObjectSize = (ObjectSize + ObjectAlignment - 1) & ~(ObjectAlignment - 1);
+    ObjectStride = (ObjectSize + sizeof(SLAB *) + ObjectAlignment - 1) & ~(ObjectAlignment - 1);
+
+    // Grow the slab until it holds SLAB_OBJECTS_MIN objects.
+    for (SlabSize = SLAB_SIZE_MIN; SlabSize <= SLAB_SIZE_MAX; SlabSize <<= 1)
+    {
+        ObjectsPerSlab = (SlabSize - SLAB_HEADER_SIZE) / ObjectStride;
+        if (ObjectsPerSlab >= SLAB_OBJECTS_MIN)
+            break;
+    }
+
+    if (SlabSize > SLAB_SIZE_MAX)
+        SlabSize = SLAB_SIZE_MAX;
+
+    if (!ObjectsPerSlab)
+        return E_INVALID_PARAMETER;
+
+    memset(Cache, 0, sizeof(*Cache));
+
+    KeInitializeSpinlock(&Cache->Lock);
+    Cache->PoolType = PoolType;
+    Cache->ObjectSize = ObjectSize;
+    Cache->ObjectStride = ObjectStride;
+    Cache->ObjectAlignment = ObjectAlignment;
+    Cache->SlabSize = SlabSize;
+    Cache->ObjectsPerSlab = (U32)ObjectsPerSlab;
+
+    // Unused tail of the slab is used for coloring.
+    Cache->ColorNext = 0;
+    Cache->ColorMax = (U32)((SlabSize - SLAB_HEADER_SIZE - ObjectsPerSlab * ObjectStride) & ~(SLAB_COLOR_ALIGNMENT - 1));
+
+    Cache->Constructor = Constructor;
+    Cache->ConstructorContext = ConstructorContext;
+
+    DListInitializeHead(&Cache->PartialList);
+    DListInitializeHead(&Cache->FullList);
+    DListInitializeHead(&Cache->EmptyList);
+
+    for (i = 0; i < SLAB_CACHE_NAME_MAX_LENGTH - 1 && Name && Name[i]; i++)
+        Cache->Name[i] = Name[i];
+
+    Cache->Name[i] = 0;
+
+    return E_SUCCESS;
+}
+
+SLAB *
+KERNELAPI
+MiCreateSlab(
+    IN SLAB_CACHE *Cache)
+{
+    SLAB *Slab;
+    UPTR Object;
+    U32 i;
+
+    SLAB_ASSERT( KeIsSpinlockAcquired(&Cache->Lock) );
+
+    Slab = (SLAB *)MmAllocatePool(Cache->PoolType, Cache->SlabSize, SLAB_COLOR_ALIGNMENT, TAG4('S', 'L', 'A', 'B'));
+    if (!Slab)
+        return NULL;
+
+    SLAB_ASSERT( !((UPTR)Slab & (SLAB_COLOR_ALIGNMENT - 1)) );
+
+    DListInitializeHead(&Slab->Links);
+    Slab->Cache = Cache;
+    Slab->FreeList = NULL;
+    Slab->InUse = 0;
+    Slab->Capacity = Cache->ObjectsPerSlab;
+
+    //
+    // Each slab starts at a different cache line offset so that
+    // objects of different slabs do not compete for the same cache sets.
+    //
+
+    Object = (UPTR)Slab + SLAB_HEADER_SIZE + Cache->ColorNext;
+
+    Cache->ColorNext += SLAB_COLOR_ALIGNMENT;
+    if (Cache->ColorNext > Cache->ColorMax)
+        Cache->ColorNext = 0;
+
+    Object += (UPTR)(Slab->Capacity - 1) * Cache->ObjectStride;
+    for (i = 0; i < Slab->Capacity; i++)
+    {
+        SLAB_FROM_OBJECT(Cache, Object) = Slab;
+        SLAB_NEXT_OBJECT(Object) = Slab->FreeList;
+        Slab->FreeList = (PVOID)Object;
+        Object -= Cache->ObjectStride;
+    }
+
+    Cache->SlabCount++;
+
+    return Slab;
+}
+
+VOID
+KERNELAPI
+MiDeleteSlab(
+    IN SLAB_CACHE *Cache,
+    IN SLAB *Slab)
+{
+    SLAB_ASSERT( KeIsSpinlockAcquired(&Cache->Lock) );
+    SLAB_ASSERT( !Slab->InUse );
+
+    DListRemoveEntry(&Slab->Links);
+    Cache->SlabCount--;
+
+    MmFreePool(Slab);
+}
+
+PVOID
+KERNELAPI
+MiAllocateSlabObjectLocked(
+    IN SLAB_CACHE *Cache)
+{
+    SLAB *Slab;
+    PVOID Object;
+
+    SLAB_ASSERT( KeIsSpinlockAcquired(&Cache->Lock) );
+
+    if (!DListIsEmpty(&Cache->PartialList))
+    {
+        Slab = CONTAINING_RECORD(Cache->PartialList.Next, SLAB, Links);
+    }
+    else if (!DListIsEmpty(&Cache->EmptyList))
+    {
+        Slab = CONTAINING_RECORD(Cache->EmptyList.Next, SLAB, Links);
+        DListRemoveEntry(&Slab->Links);
+        DListInsertAfter(&Cache->PartialList, &Slab->Links);
+        Cache->EmptyCount--;
+    }
+    else
+    {
+        Slab = MiCreateSlab(Cache);
+        if (!Slab)
+            return NULL;
+
+        DListInsertAfter(&Cache->PartialList, &Slab->Links);
+    }
+
+    Object = Slab->FreeList;
+    SLAB_ASSERT(Object != NULL);
+
+    Slab->FreeList = SLAB_NEXT_OBJECT(Object);
+    Slab->InUse++;
+    Cache->ObjectsInUse++;
+
+    if (!Slab->FreeList)
+    {
+        DListRemoveEntry(&Slab->Links);
+        DListInsertAfter(&Cache->FullList, &Slab->Links);
+    }
+
+    return Object;
+}
+
+VOID
+KERNELAPI
+MiFreeSlabObjectLocked(
+    IN SLAB_CACHE *Cache,
+    IN PVOID Object)
+{
+    SLAB *Slab = SLAB_FROM_OBJECT(Cache, Object);
+    BOOLEAN WasFull;
+
+    SLAB_ASSERT( KeIsSpinlockAcquired(&Cache->Lock) );
+    SLAB_ASSERT( Slab->Cache == Cache );
+    SLAB_ASSERT( Slab->InUse > 0 );
+
+    WasFull = !Slab->FreeList;
+
+    SLAB_NEXT_OBJECT(Object) = Slab->FreeList;
+    Slab->FreeList = Object;
+    Slab->InUse--;
+    Cache->ObjectsInUse--;
+
+    if (!Slab->InUse)
+    {
+        DListRemoveEntry(&Slab->Links);
+
+        if (Cache->EmptyCount >= SLAB_EMPTY_MAX)
+        {
+            // Enough empty slabs are kept. Return this one to the pool.
+            MiDeleteSlab(Cache, Slab);
+            return;
+        }
+
+        DListInsertAfter(&Cache->EmptyList, &Slab->Links);
+        Cache->EmptyCount++;
+    }
+    else if (WasFull)
+    {
+        DListRemoveEntry(&Slab->Links);
+        DListInsertAfter(&Cache->PartialList, &Slab->Links);
+    }
+}
+
+SLAB_PROCESSOR_LIST *
+KERNELAPI
+MiGetSlabProcessorList(
+    IN SLAB_CACHE *Cache)
+{
+    // Processor block is not ready in early initialization.
+    KPROCESSOR *Processor = KeTryGetCurrentProcessor();
+
+    if (!Processor || Processor->ProcessorId >= SLAB_PROCESSOR_MAX)
+        return NULL;
+
+    return &Cache->ProcessorList[Processor->ProcessorId];
+}
+
+/**
+ * @brief Allocates an object from the slab cache.
+ *
+ * @param [in] Cache    Slab cache.
+ *
+ * @return Allocated object. NULL if failed.
+ */
+PVOID
+KERNELAPI
+MmAllocateSlabObject(
+    IN SLAB_CACHE *Cache)
+{
+    BOOLEAN InterruptState = !!(__readeflags() & RFLAG_IF);
+    SLAB_PROCESSOR_LIST *List;
+    PVOID Object = NULL;
+
+    // Per-processor list is only accessed by its owner with interrupts disabled.
+    _disable();
+
+    List = MiGetSlabProcessorList(Cache);
+    if (List)
+    {
+        if (!List->Count)
+        {
+            KeAcquireSpinlock(&Cache->Lock);
+
+            while (List->Count < SLAB_PROCESSOR_LIST_BATCH)
+            {
+                PVOID NewObject = MiAllocateSlabObjectLocked(Cache);
+                if (!NewObject)
+                    break;
+
+                SLAB_NEXT_OBJECT(NewObject) = List->Head;
+                List->Head = NewObject;
+                List->Count++;
+            }
+
+            KeReleaseSpinlock(&Cache->Lock);
+        }
+
+        if (List->Count)
+        {
+            Object = List->Head;
+            List->Head = SLAB_NEXT_OBJECT(Object);
+            List->Count--;
+        }
+    }
+    else
+    {
+        KeAcquireSpinlock(&Cache->Lock);
+        Object = MiAllocateSlabObjectLocked(Cache);
+        KeReleaseSpinlock(&Cache->Lock);
+    }
+
+    if (InterruptState)
+        _enable();
+
+    if (Object && Cache->Constructor)
+        Cache->Constructor(Object, Cache->ConstructorContext);
+
+    return Object;
+}
+
+/**
+ * @brief Frees an object to the slab cache.
+ *
+ * @param [in] Cache    Slab cache which the object is allocated from.
+ * @param [in] Object   Object to free.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+MmFreeSlabObject(
+    IN SLAB_CACHE *Cache,
+    IN PVOID Object)
+{
+    BOOLEAN InterruptState = !!(__readeflags() & RFLAG_IF);
+    SLAB_PROCESSOR_LIST *List;
+    U32 i;
+
+    SLAB_ASSERT( SLAB_FROM_OBJECT(Cache, Object)->Cache == Cache );
+
+    _disable();
+
+    List = MiGetSlabProcessorList(Cache);
+    if (List)
+    {
+        if (List->Count >= SLAB_PROCESSOR_LIST_MAX)
+        {
+            KeAcquireSpinlock(&Cache->Lock);
+
+            for (i = 0; i < SLAB_PROCESSOR_LIST_BATCH; i++)
+            {
+                PVOID OldObject = List->Head;
+                List->Head = SLAB_NEXT_OBJECT(OldObject);
+                List->Count--;
+
+                MiFreeSlabObjectLocked(Cache, OldObject);
+            }
+
+            KeReleaseSpinlock(&Cache->Lock);
+        }
+
+        SLAB_NEXT_OBJECT(Object) = List->Head;
+        List->Head = Object;
+        List->Count++;
+    }
+    else
+    {
+        KeAcquireSpinlock(&Cache->Lock);
+        MiFreeSlabObjectLocked(Cache, Object);
+        KeReleaseSpinlock(&Cache->Lock);
+    }
+
+    if (InterruptState)
+        _enable();
+}
+
+/**
+ * @brief Returns the empty slabs to the pool.\n
+ *        Objects in the per-processor list of the current processor are returned to the slabs first.
+ *        Per-processor lists of other processors are not touched.
+ *
+ * @param [in] Cache    Slab cache.
+ *
+ * @return Number of slabs freed.
+ */
+U32
+KERNELAPI
+MmReclaimSlabCache(
+    IN SLAB_CACHE *Cache)
+{
+    BOOLEAN InterruptState = !!(__readeflags() & RFLAG_IF);
+    SLAB_PROCESSOR_LIST *List;
+    U32 Count = 0;
+
+    _disable();
+
+    List = MiGetSlabProcessorList(Cache);
+
+    KeAcquireSpinlock(&Cache->Lock);
+
+    if (List)
+    {
+        while (List->Count)
+        {
+            PVOID Object = List->Head;
+            List->Head = SLAB_NEXT_OBJECT(Object);
+            List->Count--;
+
+            MiFreeSlabObjectLocked(Cache, Object);
+        }
+    }
+
+    while (!DListIsEmpty(&Cache->EmptyList))
+    {
+        SLAB *Slab = CONTAINING_RECORD(Cache->EmptyList.Next, SLAB, Links);
+
+        Cache->EmptyCount--;
+        MiDeleteSlab(Cache, Slab);
+        Count++;
+    }
+
+    KeReleaseSpinlock(&Cache->Lock);
+
+    if (InterruptState)
+        _enable();
+
+    return Count;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <base/base.h>
+#include <ke/lock.h>
+#include <mm/paging.h>
+#include <mm/pool.h>
+
+//
+// Slab cache for fixed-size objects.
+//
+// Slab Layout (SlabSize bytes, aligned to SLAB_COLOR_ALIGNMENT):
+// [SLAB] [Color] [Object0|Owner] [Object1|Owner] ... [ObjectN-1|Owner] [Unused]
+//
+// Slab is aligned to the cache line only. Aligning it to its size costs the pool
+// up to SlabSize of padding per slab and makes the first-fit search longer.
+// The owning slab of an object is found by the pointer stored after the object.
+//
+
+#define SLAB_SIZE_MIN                   PAGE_SIZE
+#define SLAB_SIZE_MAX                   0x8000
+#define SLAB_OBJECTS_MIN                8           //!< Slab is grown up to SLAB_SIZE_MAX to hold this many objects.
+#define SLAB_OBJECT_ALIGNMENT_MIN       sizeof(PVOID)
+#define SLAB_COLOR_ALIGNMENT            0x40        //!< Cache line size.
+#define SLAB_EMPTY_MAX                  1           //!< Empty slabs kept before freeing them to the pool.
+
+#define SLAB_PROCESSOR_MAX              64          //!< Same as the number of bits in KiProcessorMask.
+#define SLAB_PROCESSOR_LIST_MAX         16          //!< Maximum number of objects in per-processor list.
+#define SLAB_PROCESSOR_LIST_BATCH       (SLAB_PROCESSOR_LIST_MAX / 2)
+
+#define SLAB_CACHE_NAME_MAX_LENGTH      32
+
+/**
+ * @brief Object constructor. Called for each object returned by MmAllocateSlabObject().
+ */
+typedef
+VOID
+(KERNELAPI *PSLAB_OBJECT_CONSTRUCTOR)(
+    IN PVOID Object,
+    IN PVOID Context);
+
+typedef struct _SLAB_CACHE SLAB_CACHE;
+
+typedef struct _SLAB {
+    DLIST_ENTRY Links;          //!< Links to Partial/Full/Empty list of the cache.
+    SLAB_CACHE *Cache;          //!< Owner cache.
+    PVOID FreeList;             //!< Free objects (link is stored in the object).
+    U32 InUse;                  //!< Number of objects in use.
+    U32 Capacity;               //!< Number of objects.
+} SLAB;
+
+typedef struct _SLAB_PROCESSOR_LIST {
+    PVOID Head;
+    U32 Count;
+    U32 Reserved1;
+    U8 Reserved2[0x30];         //!< Pads to the cache line size.
+} SLAB_PROCESSOR_LIST;
+
+C_ASSERT(sizeof(SLAB_PROCESSOR_LIST) == SLAB_COLOR_ALIGNMENT);
+
+typedef struct _SLAB_CACHE {
+    KSPIN_LOCK Lock;
+    POOL_TYPE PoolType;
+
+    SIZE_T ObjectSize;          //!< Object size rounded up to the object alignment.
+    SIZE_T ObjectStride;        //!< Object size plus the owner pointer, rounded up to the object alignment.
+    SIZE_T ObjectAlignment;
+    SIZE_T SlabSize;
+    U32 ObjectsPerSlab;
+
+    U32 ColorNext;              //!< Color offset of the next slab.
+    U32 ColorMax;               //!< Maximum color offset.
+
+    PSLAB_OBJECT_CONSTRUCTOR Constructor;
+    PVOID ConstructorContext;
+
+    DLIST_ENTRY PartialList;
+    DLIST_ENTRY FullList;
+    DLIST_ENTRY EmptyList;
+    U32 EmptyCount;
+    U32 SlabCount;
+
+    U64 ObjectsInUse;           //!< Objects handed out from slabs (includes per-processor lists).
+
+    CHAR Name[SLAB_CACHE_NAME_MAX_LENGTH];
+
+    SLAB_PROCESSOR_LIST ProcessorList[SLAB_PROCESSOR_MAX];
+} SLAB_CACHE;
+
+
+
+ESTATUS
+KERNELAPI
+MmInitializeSlabCache(
+    OUT SLAB_CACHE *Cache,
+    IN CHAR *Name,
+    IN POOL_TYPE PoolType,
+    IN SIZE_T ObjectSize,
+    IN SIZE_T ObjectAlignment,
+    IN PSLAB_OBJECT_CONSTRUCTOR Constructor OPTIONAL,
+    IN PVOID ConstructorContext OPTIONAL);
+
+PVOID
+KERNELAPI
+MmAllocateSlabObject(
+    IN SLAB_CACHE *Cache);
+
+VOID
+KERNELAPI
+MmFreeSlabObject(
+    IN SLAB_CACHE *Cache,
+    IN PVOID Object);
+
+U32
+KERNELAPI
+MmReclaimSlabCache(
+    IN SLAB_CACHE *Cache);
@@ -18,6 +18,12 @@
 #include <ke/lock.h>
 #include <mm/pool.h>
 #include <mm/mm.h>
+#include <mm/slab.h>
+#include <ke/evtrace.h>
+
+
+SLAB_CACHE MiXadCache;          //!< XAD cache for non-paged pool.
+SLAB_CACHE MiXadCachePreInit;   //!< XAD cache for pre-init pool.
 
 
 /**
@@ -63,13 +69,17 @@ KERNELAPI
 MiXadAllocate(
     IN XAD_CONTEXT *CallerContext)
 {
-    U32 Type = PoolTypeNonPagedPreInit;
+    SLAB_CACHE *Cache = &MiXadCachePreInit;
     if (!CallerContext->UsePreInitPool)
     {
-        Type = PoolTypeNonPaged;
+        Cache = &MiXadCache;
     }
 
-    MMXAD *Xad = MmAllocatePool(Type, sizeof(MMXAD), 8, 0);
+    MMXAD *Xad = MmAllocateSlabObject(Cache);
+    if (!Xad)
+    {
+        return NULL;
+    }
 
     MiXadInitialize(Xad, 0, 0);
 
@@ -90,9 +100,18 @@ MiXadDelete(
     IN PVOID CallerContext,
     IN MMXAD *Xad)
 {
+    POOL_BLOCK_LIST *PreInitPool = &MiPoolList[PoolTypeNonPagedPreInit];
+    SLAB_CACHE *Cache = &MiXadCache;
+
     DListRemoveEntry(&Xad->Links);
 
-    MmFreePool(Xad);
+    // XADs allocated in pre-init stage still belong to the pre-init cache.
+    if (PreInitPool->AreaStart <= (UPTR)Xad && (UPTR)Xad < PreInitPool->AreaStart + PreInitPool->AreaSize)
+    {
+        Cache = &MiXadCachePreInit;
+    }
+
+    MmFreeSlabObject(Cache, Xad);
 }
 
 /**
@@ -361,11 +380,13 @@ MmXadInitializeTree(
         DListInitializeHead(&XadTree->SizeLinks[i]);
     }
 
+    KeInitializeRwSpinlock(&XadTree->Lock);
+
     return TRUE;
 }
 
 /**
- * @brief Locks XAD tree.
+ * @brief Locks XAD tree exclusively. Required to modify the tree.
  *
  * @param [in] XadTree          XAD tree.
  *
@@ -376,11 +397,11 @@ KERNELAPI
 MmXadAcquireLock(
     IN MMXAD_TREE *XadTree)
 {
-    // Not implemented
+    KeAcquireRwSpinlockExclusive(&XadTree->Lock);
 }
 
 /**
- * @brief Unlocks XAD tree.
+ * @brief Unlocks XAD tree locked by MmXadAcquireLock.
  *
  * @param [in] XadTree          XAD tree.
  *
@@ -391,7 +412,37 @@ KERNELAPI
 MmXadReleaseLock(
     IN MMXAD_TREE *XadTree)
 {
-    // Not implemented
+    KeReleaseRwSpinlockExclusive(&XadTree->Lock);
+}
+
+/**
+ * @brief Locks XAD tree as shared. Lookups can proceed in parallel.
+ *
+ * @param [in] XadTree          XAD tree.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+MmXadAcquireLockShared(
+    IN MMXAD_TREE *XadTree)
+{
+    KeAcquireRwSpinlockShared(&XadTree->Lock);
+}
+
+/**
+ * @brief Unlocks XAD tree locked by MmXadAcquireLockShared.
+ *
+ * @param [in] XadTree          XAD tree.
+ *
+ * @return None.
+ */
+VOID
+KERNELAPI
+MmXadReleaseLockShared(
+    IN MMXAD_TREE *XadTree)
+{
+    KeReleaseRwSpinlockShared(&XadTree->Lock);
 }
 
 /**
@@ -869,6 +920,8 @@ MmXadReclaimAddress(
             MiXadMergeAdjacentAddresses(XadTree, e1);
         }
 
+        KTRACE_EVENT4(EventTraceXadReclaim, s2, e2, t2, t1);
+
         return E_SUCCESS;
     }
 
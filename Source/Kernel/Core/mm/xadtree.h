@@ -4,6 +4,7 @@
 #include <base/base.h>
 #include <base/gerror.h>
 #include <misc/misc.h>
+#include <ke/lock.h>
 
 
 //
@@ -52,7 +53,7 @@ C_ASSERT(MMXAD_MAX_SIZE_LEVELS > 1);
 typedef struct _MMXAD_TREE
 {
 	RS_AVL_TREE Tree;		// AVL tree header.
-	PVOID Lock;				// Tree lock.
+	KRW_SPIN_LOCK Lock;		// Tree lock.
 
 	DLIST_ENTRY SizeLinks[MMXAD_MAX_SIZE_LEVELS]; // Size ordered links.
 } MMXAD_TREE;
@@ -87,6 +88,16 @@ KERNELAPI
 MmXadReleaseLock(
     IN MMXAD_TREE *XadTree);
 
+VOID
+KERNELAPI
+MmXadAcquireLockShared(
+    IN MMXAD_TREE *XadTree);
+
+VOID
+KERNELAPI
+MmXadReleaseLockShared(
+    IN MMXAD_TREE *XadTree);
+
 BOOLEAN
 KERNELAPI
 MmXadInitializeTree(
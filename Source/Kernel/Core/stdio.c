@@ -7,9 +7,67 @@
 // standard runtime functions.
 //
 
+//
+// Sizes at or above MEM_REP_THRESHOLD use rep movs/stos.
+// Below it, the startup cost of the string instructions dominates.
+//
+
+#define MEM_REP_THRESHOLD	128
+
+typedef U64 __attribute__((__may_alias__, __aligned__(1))) mem_word_t;
+
+static int mem_erms = -1;
+
+//
+// Tests whether the processor supports ERMS (Enhanced REP MOVSB/STOSB).
+// The result is cached on first use. Memory routines are used before
+// processor initialization, so this can't rely on KiTestProcessorFeature.
+//
+
+static int mem_has_erms(void)
+{
+	if (mem_erms < 0)
+	{
+		int info[4];
+		int erms = 0;
+
+		__cpuid(info, 0);
+		if (info[0] >= 7)
+		{
+			// CPUID.(EAX=07H, ECX=0):EBX[9] = ERMS
+			__cpuidex(info, 7, 0);
+			erms = !!(info[1] & (1 << 9));
+		}
+
+		mem_erms = erms;
+	}
+
+	return mem_erms;
+}
+
 void *memset(void *dest, int v, size_t size)
 {
 	unsigned char *p = (unsigned char *)dest;
+	U64 pattern = (U64)(unsigned char)v * 0x0101010101010101ULL;
+
+	if (size >= MEM_REP_THRESHOLD)
+	{
+		if (mem_has_erms())
+		{
+			__asm__ __volatile__ ("rep stosb" : "+D"(p), "+c"(size) : "a"(pattern) : "memory");
+			return dest;
+		}
+
+		size_t count = size >> 3;
+		__asm__ __volatile__ ("rep stosq" : "+D"(p), "+c"(count) : "a"(pattern) : "memory");
+		size &= 7;
+	}
+
+	while (size >= 8)
+	{
+		*(mem_word_t *)p = pattern;
+		p += 8, size -= 8;
+	}
 
 	while (size-- > 0)
 		*p++ = (unsigned char)v;
@@ -22,6 +80,22 @@ int memcmp(const void *s1, const void *s2, size_t size)
 	unsigned char *p1 = (unsigned char *)s1;
 	unsigned char *p2 = (unsigned char *)s2;
 
+	while (size >= 8)
+	{
+		U64 diff = *(mem_word_t *)p1 ^ *(mem_word_t *)p2;
+		if (diff)
+		{
+			// Little-endian: the lowest set bit belongs to the first different byte.
+			unsigned long index = 0;
+			_BitScanForward64(&index, diff);
+			index >>= 3;
+
+			return p1[index] - p2[index];
+		}
+
+		p1 += 8, p2 += 8, size -= 8;
+	}
+
 	while (size-- > 0)
 	{
 		int diff = *p1 - *p2;
@@ -38,12 +112,61 @@ void *memcpy(void *dest, const void *src, size_t size)
 	unsigned char *s = (unsigned char *)src;
 	unsigned char *d = (unsigned char *)dest;
 
+	if (size >= MEM_REP_THRESHOLD)
+	{
+		if (mem_has_erms())
+		{
+			__asm__ __volatile__ ("rep movsb" : "+D"(d), "+S"(s), "+c"(size) : : "memory");
+			return dest;
+		}
+
+		size_t count = size >> 3;
+		__asm__ __volatile__ ("rep movsq" : "+D"(d), "+S"(s), "+c"(count) : : "memory");
+		size &= 7;
+	}
+
+	while (size >= 8)
+	{
+		*(mem_word_t *)d = *(mem_word_t *)s;
+		d += 8, s += 8, size -= 8;
+	}
+
 	while (size-- > 0)
 		*d++ = *s++;
 
 	return dest;
 }
 
+void *memmove(void *dest, const void *src, size_t size)
+{
+	unsigned char *s = (unsigned char *)src;
+	unsigned char *d = (unsigned char *)dest;
+
+	if (d <= s || d >= s + size)
+	{
+		// Forward copy is safe (string instructions copy in ascending order).
+		return memcpy(dest, src, size);
+	}
+
+	//
+	// Destination overlaps the tail of the source. Copy backwards.
+	// Backward rep movs (DF=1) does not use fast strings, so use words instead.
+	//
+
+	d += size, s += size;
+
+	while (size >= 8)
+	{
+		d -= 8, s -= 8, size -= 8;
+		*(mem_word_t *)d = *(mem_word_t *)s;
+	}
+
+	while (size-- > 0)
+		*--d = *--s;
+
+	return dest;
+}
+
 size_t strlen(const char *s)
 {
 	size_t len = 0;
@@ -46,6 +46,8 @@ typedef enum _OS_MEMORY_TYPE
 #define ARCH_X64_PXE_WRITE_THROUGH          (1ULL << 3)
 #define ARCH_X64_PXE_CACHE_DISABLED         (1ULL << 4)
 #define ARCH_X64_PXE_LARGE_SIZE             (1ULL << 7)
+#define ARCH_X64_PTE_PAT                    (1ULL << 7) // only available for PTE
+#define ARCH_X64_PDE_LARGE_PAT              (1ULL << 12) // only available for 2M PDE
 #define ARCH_X64_PXE_EXECUTE_DISABLED       (1ULL << 63)
 
 #define ARCH_X64_PXE_4K_BASE_MASK           0x000ffffffffff000ULL // [51:12], 4K
@@ -53,6 +55,18 @@ typedef enum _OS_MEMORY_TYPE
 
 #define ARCH_X64_CR3_PML4_BASE_MASK         0xfffffffffffff000ULL // [M-1:12], 4K
 
+//
+// PAT entry 5 is set to WC before transferring to the kernel (same as the kernel's PAT).
+// Other entries are left as the firmware set.
+//
+
+#define IA32_PAT                            0x277
+#define PAT_INDEX_WRITE_COMBINING           5
+#define PAT_MSR_MEMORY_TYPE_WRITE_COMBINING 0x01
+
+// PAT=1, PCD=0, PWT=1 (4K PTE only).
+#define ARCH_X64_PXE_WRITE_COMBINING        (ARCH_X64_PTE_PAT | ARCH_X64_PXE_WRITE_THROUGH)
+
 #if 0
 typedef union _ARCH_X64_VIRTUAL_ADDRESS
 {
@@ -245,3 +259,19 @@ EFIAPI
 OslArchX64SetCr3(
     IN UINT64 Cr3);
 
+UINT64
+EFIAPI
+OslArchX64ReadMsr(
+    IN UINT32 Msr);
+
+VOID
+EFIAPI
+OslArchX64WriteMsr(
+    IN UINT32 Msr,
+    IN UINT64 Value);
+
+VOID
+EFIAPI
+OslArchX64SetPatWriteCombining(
+    VOID);
+
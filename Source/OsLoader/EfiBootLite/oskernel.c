@@ -61,6 +61,9 @@ OslTransferToKernel(
     // Disables the interrupts.
     OslDisableInterrupts();
 
+    // Framebuffer is mapped as WC.
+    OslArchX64SetPatWriteCombining();
+
     // Set our page mapping. This will invalidate the TLB.
     OslArchX64SetCr3(
         (OslArchX64GetCr3() & ~ARCH_X64_CR3_PML4_BASE_MASK) | 
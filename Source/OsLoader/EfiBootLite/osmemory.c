@@ -700,6 +700,102 @@ OslArchX64IsPageMappingExists(
     return TRUE;
 }
 
+/**
+ * @brief Changes the memory type of existing virtual-to-physical page mapping.\n
+ * 
+ * @param [in] PML4TBase        Base address of PML4T.
+ * @param [in] VirtualAddress   Virtual address.
+ * @param [in] Size             Map size.
+ * @param [in] PteFlags         PAT/PCD/PWT flags in 4K PTE format.
+ * 
+ * @return TRUE if succeeds.\n
+ *         FALSE if the range is not mapped or partially covers the 2M page.
+ */
+BOOLEAN
+EFIAPI
+OslArchX64SetPageCacheAttribute(
+    IN UINT64 *PML4TBase, 
+    IN EFI_VIRTUAL_ADDRESS VirtualAddress, 
+    IN UINT64 Size,
+    IN UINT64 PteFlags)
+{
+    UINT64 PageCount = EFI_SIZE_TO_PAGES(Size);
+    UINT64 VfnStart = ARCH_X64_VA_TO_4K_VFN(VirtualAddress);
+
+    UINT64 SourcePageNumber = VfnStart;
+
+    UINT64 PageCount2M = EFI_SIZE_TO_PAGES(0x200000);
+
+    UINT64 CacheMask = ARCH_X64_PXE_WRITE_THROUGH | ARCH_X64_PXE_CACHE_DISABLED;
+    UINT64 CacheFlags = PteFlags & CacheMask;
+
+    for (UINT64 i = 0; i < PageCount; )
+    {
+        UINT64 PML4TEi = ARCH_X64_VFN_TO_PML4EI(SourcePageNumber);
+        UINT64 PDPTEi = ARCH_X64_VFN_TO_PDPTEI(SourcePageNumber);
+        UINT64 PDEi = ARCH_X64_VFN_TO_PDEI(SourcePageNumber);
+        UINT64 PTEi = ARCH_X64_VFN_TO_PTEI(SourcePageNumber);
+
+        UINT64 PML4TE = PML4TBase[PML4TEi];
+        if (!(PML4TE & ARCH_X64_PXE_PRESENT))
+        {
+            return FALSE;
+        }
+
+        // PML4T -> PDPT
+        UINT64 *PDPTBase = (UINT64 *)(PML4TE & ARCH_X64_PXE_4K_BASE_MASK);
+        UINT64 PDPTE = PDPTBase[PDPTEi];
+        if (!(PDPTE & ARCH_X64_PXE_PRESENT))
+        {
+            return FALSE;
+        }
+
+        // PDPT -> PD
+        UINT64 *PDBase = (UINT64 *)(PDPTE & ARCH_X64_PXE_4K_BASE_MASK);
+        UINT64 PDE = PDBase[PDEi];
+        if (!(PDE & ARCH_X64_PXE_PRESENT))
+        {
+            return FALSE;
+        }
+
+        if (PDE & ARCH_X64_PXE_LARGE_SIZE)
+        {
+            // Splitting the 2M page is not supported.
+            if ((SourcePageNumber & (PageCount2M - 1)) || i + PageCount2M > PageCount)
+            {
+                return FALSE;
+            }
+
+            PDE &= ~(CacheMask | ARCH_X64_PDE_LARGE_PAT);
+            PDE |= CacheFlags | ((PteFlags & ARCH_X64_PTE_PAT) ? ARCH_X64_PDE_LARGE_PAT : 0);
+            PDBase[PDEi] = PDE;
+
+            i += PageCount2M;
+            SourcePageNumber += PageCount2M;
+        }
+        else
+        {
+            // PD -> PT
+            UINT64 *PTBase = (UINT64 *)(PDE & ARCH_X64_PXE_4K_BASE_MASK);
+            UINT64 PTE = PTBase[PTEi];
+
+            if (!(PTE & ARCH_X64_PXE_PRESENT))
+            {
+                return FALSE;
+            }
+
+            PTE &= ~(CacheMask | ARCH_X64_PTE_PAT);
+            PTE |= CacheFlags | (PteFlags & ARCH_X64_PTE_PAT);
+            PTBase[PTEi] = PTE;
+
+            i++;
+            SourcePageNumber++;
+        }
+    }
+
+    return TRUE;
+}
+
 /**
  * @brief Fixes the reverse mapping table to point virtual address for lower level tables.\n
  * 
@@ -877,6 +973,75 @@ OslArchX64SetCr3(
     );
 }
 
+/**
+ * @brief Reads the MSR.
+ * 
+ * @param [in] Msr  MSR index.
+ * 
+ * @return Value of the MSR.
+ */
+UINT64
+EFIAPI
+OslArchX64ReadMsr(
+    IN UINT32 Msr)
+{
+    UINT32 Low = 0;
+    UINT32 High = 0;
+
+    __asm__ __volatile__
+    (
+        "rdmsr\n\t"
+        : "=a"(Low), "=d"(High)
+        : "c"(Msr)
+        :
+    );
+
+    return ((UINT64)High << 32) | Low;
+}
+
+/**
+ * @brief Writes to the MSR.
+ * 
+ * @param [in] Msr      MSR index.
+ * @param [in] Value    Value to be written.
+ * 
+ * @return None.
+ */
+VOID
+EFIAPI
+OslArchX64WriteMsr(
+    IN UINT32 Msr,
+    IN UINT64 Value)
+{
+    __asm__ __volatile__
+    (
+        "wrmsr\n\t"
+        :
+        : "c"(Msr), "a"((UINT32)Value), "d"((UINT32)(Value >> 32))
+        : "memory"
+    );
+}
+
+/**
+ * @brief Sets the PAT entry for ARCH_X64_PXE_WRITE_COMBINING to WC.\n
+ *        Firmware does not use the entry as it only uses PCD and PWT.
+ * 
+ * @return None.
+ */
+VOID
+EFIAPI
+OslArchX64SetPatWriteCombining(
+    VOID)
+{
+    UINT64 Shift = PAT_INDEX_WRITE_COMBINING * 8;
+    UINT64 Pat = OslArchX64ReadMsr(IA32_PAT);
+
+    Pat &= ~(0xffULL << Shift);
+    Pat |= (UINT64)PAT_MSR_MEMORY_TYPE_WRITE_COMBINING << Shift;
+
+    OslArchX64WriteMsr(IA32_PAT, Pat);
+}
+
 BOOLEAN
 EFIAPI
 OslIsAddressInRange(
@@ -1038,7 +1203,8 @@ OslSetupPaging(
 	}
 
     //
-    // Map video framebuffer.
+    // Map video framebuffer as WC.
+    // Kernel writes the framebuffer with non-temporal stores from the first output.
     //
 
     UINT64 FramebufferBase = LoaderBlock->LoaderData.VideoFramebufferBase;
@@ -1049,11 +1215,17 @@ OslSetupPaging(
     {
         // Set framebuffer mapping (identity mapping).
         if (!OslArchX64SetPageMapping((UINT64 *)PML4TBase, FramebufferBase, FramebufferBase, 
-            FramebufferSize, ARCH_X64_PXE_WRITABLE | ARCH_X64_PXE_CACHE_DISABLED, FALSE, FALSE))
+            FramebufferSize, ARCH_X64_PXE_WRITABLE | ARCH_X64_PXE_WRITE_COMBINING, FALSE, FALSE))
         {
             return FALSE;
         }
     }
+    else if (!OslArchX64SetPageCacheAttribute((UINT64 *)PML4TBase, 
+        FramebufferBase, FramebufferSize, ARCH_X64_PXE_WRITE_COMBINING))
+    {
+        // Still usable, but slow.
+        TRACEF(L"Failed to set framebuffer mapping to WC\r\n");
+    }
 
     //
     // Prevent null page from getting accessed.
@@ -0,0 +1,108 @@
+#pragma once
+
+//
+// Host replacement of base/base.h.
+// Provides the kernel base types, macros and intrinsics on top of the host C library,
+// so that the kernel sources can be compiled as they are.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Kernel headers define NULL by themselves.
+#undef NULL
+
+#define __int8                      char
+#define __int16                     short
+#define __int32                     int
+#define __int64                     long long
+
+typedef __int8                      CHAR8, *PCHAR8;
+typedef __int16                     CHAR16, *PCHAR16;
+
+typedef __int8                      S8, *PS8;
+typedef __int16                     S16, *PS16;
+typedef __int32                     S32, *PS32;
+typedef __int64                     S64, *PS64;
+typedef unsigned __int8             U8, *PU8;
+typedef unsigned __int16            U16, *PU16;
+typedef unsigned __int32            U32, *PU32;
+typedef unsigned __int64            U64, *PU64;
+
+typedef void                        VOID;
+typedef VOID                        *PVOID, **PPVOID;
+
+typedef __int64                     PTR, *PPTR, **PPPTR;
+typedef __int64                     SPTR, *PSPTR, **PPSPTR;
+typedef unsigned __int64            UPTR, *PUPTR, **PPUPTR;
+typedef U64                         SIZE_T, *PSIZE_T;
+typedef S64                         SSIZE_T, *PSSIZE_T;
+
+typedef U8                          BOOLEAN, *PBOOLEAN;
+typedef CHAR8                       CHAR, *PCHAR;
+typedef PCHAR                       PSZ;
+typedef unsigned int                ULONG;      // Kernel is LLP64
+typedef unsigned int                UINT;
+typedef int                         LONG;
+typedef int                         INT;
+
+typedef U64                         PHYSICAL_ADDRESS, *PPHYSICAL_ADDRESS;
+typedef U64                         VIRTUAL_ADDRESS, *PVIRTUAL_ADDRESS;
+typedef U64                         EFI_VIRTUAL_ADDRESS;
+
+#include <base/compiler.h>
+#include <base/macros.h>
+
+// Host calling convention is used everywhere.
+#undef KERNELAPI
+#undef VARCALL
+#define KERNELAPI
+#define VARCALL
+
+#define RFLAG_IF                    (1 << 9)
+
+//
+// Intrinsics.
+// Interrupt flag is emulated, so that the interrupt state save/restore paths still work.
+//
+
+extern U64 HtEflags;
+
+static inline U64 __readeflags(void) { return HtEflags; }
+static inline void _disable(void) { HtEflags &= ~RFLAG_IF; }
+static inline void _enable(void) { HtEflags |= RFLAG_IF; }
+static inline void __halt(void) { abort(); }
+static inline void _mm_pause(void) { }
+
+static inline U64 __rdtsc(void)
+{
+    return __builtin_ia32_rdtsc();
+}
+
+static inline unsigned char _BitScanForward64(unsigned long *Index, unsigned long long Mask)
+{
+    if (!Mask)
+        return 0;
+
+    *Index = (unsigned long)__builtin_ctzll(Mask);
+    return 1;
+}
+
+static inline unsigned char _BitScanReverse64(unsigned long *Index, unsigned long long Mask)
+{
+    if (!Mask)
+        return 0;
+
+    *Index = (unsigned long)(63 - __builtin_clzll(Mask));
+    return 1;
+}
+
+typedef struct _OS_LOADER_BLOCK OS_LOADER_BLOCK;
+
+#include <base/gerror.h>
+
+#include <misc/misc.h>
+#include <dbg/dbg.h>
@@ -0,0 +1,17 @@
+#pragma once
+
+//
+// Host replacement of init/bootgfx.h. Screen output goes to stdout.
+//
+
+#include <base/base.h>
+
+#define BGX_COLOR_LIGHT_YELLOW      0
+
+#define BGXTRACE                    BootGfxPrintTextFormat
+
+BOOLEAN
+VARCALL
+BootGfxPrintTextFormat(
+    IN CHAR8 *Format,
+    ...);
@@ -0,0 +1,8 @@
+#pragma once
+
+//
+// Host replacement of ke/ke.h. Only locks are provided.
+//
+
+#include <ke/lock.h>
+#include <ke/irql.h>
@@ -0,0 +1,28 @@
+#pragma once
+
+//
+// Host replacement of ke/kprocessor.h.
+// Single processor whose pool cache is set up by the harness.
+//
+
+#include <base/base.h>
+
+typedef struct _POOL_PROCESSOR_CACHE POOL_PROCESSOR_CACHE;
+
+typedef struct _KPROCESSOR
+{
+    U8 ProcessorId;
+    POOL_PROCESSOR_CACHE *PoolCache;
+} KPROCESSOR;
+
+extern KPROCESSOR *KiProcessorBlocks[0x100];
+
+KPROCESSOR *
+KERNELAPI
+KeTryGetCurrentProcessor(
+    VOID);
+
+U32
+KERNELAPI
+KeGetProcessorCount(
+    VOID);
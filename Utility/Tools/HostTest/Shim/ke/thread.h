@@ -0,0 +1,16 @@
+#pragma once
+
+//
+// Host replacement of ke/thread.h. Only the runner queue fields are provided.
+//
+
+#include <base/base.h>
+
+typedef struct _KRUNNER_QUEUE       KRUNNER_QUEUE;
+
+typedef struct _KTHREAD
+{
+    DLIST_ENTRY RunnerLinks;        // Link to runner queue
+    KRUNNER_QUEUE *RunnerQueue;
+    U32 RunnerLevel;
+} KTHREAD;
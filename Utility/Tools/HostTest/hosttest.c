@@ -0,0 +1,278 @@
+//
+// Host test harness for the kernel data structures.
+//
+// Usage: hosttest test  [suite...] [-n iterations] [-s seed]
+//        hosttest bench [suite...] [-n iterations]
+//        Runs all suites if none is given.
+//
+
+#include <time.h>
+
+#include <hosttest.h>
+#include <ke/kprocessor.h>
+#include <mm/pool.h>
+
+#define HT_TEST_ITERATIONS_DEFAULT      20000
+#define HT_BENCH_ITERATIONS_DEFAULT     200000
+#define HT_POOL_ALIGNMENT               0x1000      // Pool is page aligned in the kernel
+
+static const HT_SUITE *HtSuites[] =
+{
+    &HtSuiteAvl,
+    &HtSuiteXad,
+    &HtSuiteObjectPool,
+    &HtSuitePool,
+    &HtSuiteRunnerQueue,
+};
+
+static U64 HtRandomState;
+static U64 HtCurrentSeed;
+static PVOID HtPoolArea[PoolTypeMaximum];
+
+
+VOID
+HtFail(
+    IN const char *File,
+    IN int Line,
+    IN const char *Expression)
+{
+    fprintf(stderr, "%s:%d: check failed: %s (seed %llu)\n",
+        File, Line, Expression, (unsigned long long)HtCurrentSeed);
+    exit(1);
+}
+
+VOID
+HtSeed(
+    IN U64 Seed)
+{
+    HtCurrentSeed = Seed;
+    HtRandomState = Seed ? Seed : 0x9e3779b97f4a7c15ULL;
+}
+
+U64
+HtRandom(
+    VOID)
+{
+    // xorshift64*
+    HtRandomState ^= HtRandomState >> 12;
+    HtRandomState ^= HtRandomState << 25;
+    HtRandomState ^= HtRandomState >> 27;
+
+    return HtRandomState * 0x2545f4914f6cdd1dULL;
+}
+
+U64
+HtRandomRange(
+    IN U64 Limit)
+{
+    return Limit ? HtRandom() % Limit : 0;
+}
+
+U64
+HtNow(
+    VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return (U64)Time.tv_sec * 1000000000ULL + (U64)Time.tv_nsec;
+}
+
+VOID
+HtLatencyInitialize(
+    OUT HT_LATENCY *Latency,
+    IN const char *Name,
+    IN U32 Capacity)
+{
+    Latency->Name = Name;
+    Latency->Samples = malloc(sizeof(U64) * (Capacity ? Capacity : 1));
+    Latency->Count = 0;
+    Latency->Capacity = Capacity;
+    Latency->TotalNs = 0;
+
+    if (!Latency->Samples)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+static
+int
+HtCompareU64(
+    const void *A,
+    const void *B)
+{
+    U64 X = *(const U64 *)A;
+    U64 Y = *(const U64 *)B;
+
+    return (X > Y) - (X < Y);
+}
+
+VOID
+HtLatencyReport(
+    IN OUT HT_LATENCY *Latency)
+{
+    if (Latency->Count)
+    {
+        qsort(Latency->Samples, Latency->Count, sizeof(U64), &HtCompareU64);
+
+        U64 P50 = Latency->Samples[(Latency->Count - 1) * 50 / 100];
+        U64 P99 = Latency->Samples[(Latency->Count - 1) * 99 / 100];
+        double OpsPerSecond = Latency->TotalNs ? Latency->Count * 1e9 / Latency->TotalNs : 0.0;
+
+        printf("  %-24s %10u ops %14.0f ops/s  p50 %6llu ns  p99 %6llu ns\n",
+            Latency->Name, Latency->Count, OpsPerSecond,
+            (unsigned long long)P50, (unsigned long long)P99);
+    }
+
+    free(Latency->Samples);
+    Latency->Samples = NULL;
+}
+
+PVOID
+HtAllocateAligned(
+    IN SIZE_T Size,
+    IN SIZE_T Alignment)
+{
+    PVOID Address = aligned_alloc(Alignment, (Size + Alignment - 1) & ~(Alignment - 1));
+
+    if (!Address)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return Address;
+}
+
+/**
+ * @brief Sets up all pool types on host memory, and the pool cache of the processor.
+ */
+VOID
+HtInitializePool(
+    IN SIZE_T Size,
+    IN U32 Flags)
+{
+    for (U32 Type = 0; Type < PoolTypeMaximum; Type++)
+    {
+        HtPoolArea[Type] = HtAllocateAligned(Size, HT_POOL_ALIGNMENT);
+
+        if (!MiInitializePoolBlockList(&MiPoolList[Type], (UPTR)HtPoolArea[Type], Size, Flags))
+            HtFail(__FILE__, __LINE__, "MiInitializePoolBlockList");
+    }
+
+    KiProcessorBlocks[0]->PoolCache = MiAllocateProcessorPoolCache();
+    HT_CHECK(KiProcessorBlocks[0]->PoolCache != NULL);
+}
+
+VOID
+HtDeletePool(
+    VOID)
+{
+    KiProcessorBlocks[0]->PoolCache = NULL;
+
+    for (U32 Type = 0; Type < PoolTypeMaximum; Type++)
+    {
+        free(HtPoolArea[Type]);
+        HtPoolArea[Type] = NULL;
+    }
+
+    memset(MiPoolList, 0, sizeof(MiPoolList));
+}
+
+static
+int
+HtUsage(
+    VOID)
+{
+    fprintf(stderr,
+        "Usage: hosttest test  [suite...] [-n iterations] [-s seed]\n"
+        "       hosttest bench [suite...] [-n iterations]\n"
+        "Suites:");
+
+    for (U32 i = 0; i < COUNTOF(HtSuites); i++)
+        fprintf(stderr, " %s", HtSuites[i]->Name);
+
+    fprintf(stderr, "\n");
+
+    return 2;
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    BOOLEAN Selected[COUNTOF(HtSuites)] = { 0 };
+    BOOLEAN AnySelected = FALSE;
+    BOOLEAN Bench;
+    U32 Iterations = 0;
+    U64 Seed = (U64)time(NULL);
+
+    if (argc < 2)
+        return HtUsage();
+
+    if (!strcmp(argv[1], "test"))
+        Bench = FALSE;
+    else if (!strcmp(argv[1], "bench"))
+        Bench = TRUE;
+    else
+        return HtUsage();
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            Iterations = (U32)strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            Seed = strtoull(argv[++i], NULL, 0);
+        }
+        else
+        {
+            U32 j;
+
+            for (j = 0; j < COUNTOF(HtSuites); j++)
+            {
+                if (!strcmp(argv[i], HtSuites[j]->Name))
+                    break;
+            }
+
+            if (j == COUNTOF(HtSuites))
+                return HtUsage();
+
+            Selected[j] = TRUE;
+            AnySelected = TRUE;
+        }
+    }
+
+    if (!Iterations)
+        Iterations = Bench ? HT_BENCH_ITERATIONS_DEFAULT : HT_TEST_ITERATIONS_DEFAULT;
+
+    for (U32 i = 0; i < COUNTOF(HtSuites); i++)
+    {
+        if (AnySelected && !Selected[i])
+            continue;
+
+        if (Bench)
+        {
+            printf("%s: %u iterations\n", HtSuites[i]->Name, Iterations);
+            HtSeed(1);
+            HtSuites[i]->Bench(Iterations);
+        }
+        else
+        {
+            // Seed is printed so that a failure can be reproduced with -s.
+            printf("%s: %u iterations, seed %llu\n",
+                HtSuites[i]->Name, Iterations, (unsigned long long)Seed);
+            HtSeed(Seed);
+            HtSuites[i]->Test(Iterations);
+            printf("%s: passed\n", HtSuites[i]->Name);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+//
+// Host test harness.
+// Each suite has a randomized correctness test which is checked against a simple model,
+// and a benchmark which reports throughput and per-operation latency.
+//
+
+#include <stdio.h>
+
+#include <base/base.h>
+#include <ke/ke.h>
+
+typedef struct _HT_SUITE
+{
+    const char *Name;
+    VOID (*Test)(U32 Iterations);
+    VOID (*Bench)(U32 Iterations);
+} HT_SUITE;
+
+//
+// Checks the condition and stops the test with the location if it fails.
+//
+
+#define HT_CHECK(_cond)     do {                                                \
+        if (!(_cond))                                                           \
+            HtFail(__FILE__, __LINE__, #_cond);                                 \
+    } while (0)
+
+//
+// Latency samples of one operation.
+// Timestamps are taken around each operation, so the clock overhead (tens of ns)
+// is included in both latency and throughput.
+//
+
+typedef struct _HT_LATENCY
+{
+    const char *Name;
+    U64 *Samples;
+    U32 Count;
+    U32 Capacity;
+    U64 TotalNs;
+} HT_LATENCY;
+
+
+VOID
+HtFail(
+    IN const char *File,
+    IN int Line,
+    IN const char *Expression);
+
+VOID
+HtSeed(
+    IN U64 Seed);
+
+U64
+HtRandom(
+    VOID);
+
+U64
+HtRandomRange(
+    IN U64 Limit);
+
+U64
+HtNow(
+    VOID);
+
+VOID
+HtLatencyInitialize(
+    OUT HT_LATENCY *Latency,
+    IN const char *Name,
+    IN U32 Capacity);
+
+static inline
+VOID
+HtLatencyAdd(
+    IN OUT HT_LATENCY *Latency,
+    IN U64 Ns)
+{
+    if (Latency->Count < Latency->Capacity)
+        Latency->Samples[Latency->Count++] = Ns;
+
+    Latency->TotalNs += Ns;
+}
+
+VOID
+HtLatencyReport(
+    IN OUT HT_LATENCY *Latency);
+
+PVOID
+HtAllocateAligned(
+    IN SIZE_T Size,
+    IN SIZE_T Alignment);
+
+VOID
+HtInitializePool(
+    IN SIZE_T Size,
+    IN U32 Flags);
+
+VOID
+HtDeletePool(
+    VOID);
+
+
+extern const HT_SUITE HtSuiteAvl;
+extern const HT_SUITE HtSuiteXad;
+extern const HT_SUITE HtSuiteObjectPool;
+extern const HT_SUITE HtSuitePool;
+extern const HT_SUITE HtSuiteRunnerQueue;
@@ -0,0 +1,315 @@
+//
+// Host implementation of the kernel services used by the tested sources.
+// Harness is single-threaded, so locks only check that they are used correctly
+// (no recursive acquisition, no release of a free lock).
+//
+
+#include <stdio.h>
+
+#include <base/base.h>
+#include <ke/ke.h>
+#include <ke/kprocessor.h>
+#include <init/bootgfx.h>
+
+U64 HtEflags = RFLAG_IF;
+
+static KPROCESSOR HtProcessor;
+KPROCESSOR *KiProcessorBlocks[0x100] = { &HtProcessor };
+
+
+//
+// Processor.
+//
+
+KPROCESSOR *
+KERNELAPI
+KeTryGetCurrentProcessor(
+    VOID)
+{
+    return &HtProcessor;
+}
+
+U32
+KERNELAPI
+KeGetProcessorCount(
+    VOID)
+{
+    return 1;
+}
+
+
+//
+// IRQL.
+//
+
+static KIRQL HtIrql;
+
+KIRQL
+KERNELAPI
+KeGetCurrentIrql(
+    VOID)
+{
+    return HtIrql;
+}
+
+KIRQL
+KERNELAPI
+KeRaiseIrql(
+    IN KIRQL TargetIrql)
+{
+    KIRQL PrevIrql = HtIrql;
+
+    DASSERT(PrevIrql <= TargetIrql);
+    HtIrql = TargetIrql;
+
+    return PrevIrql;
+}
+
+KIRQL
+KERNELAPI
+KeLowerIrql(
+    IN KIRQL TargetIrql)
+{
+    KIRQL PrevIrql = HtIrql;
+
+    DASSERT(TargetIrql <= PrevIrql);
+    HtIrql = TargetIrql;
+
+    return PrevIrql;
+}
+
+
+//
+// Spinlocks.
+//
+
+VOID
+KERNELAPI
+KeInitializeSpinlock(
+    OUT PKSPIN_LOCK Lock)
+{
+    memset(Lock, 0, sizeof(*Lock));
+}
+
+BOOLEAN
+KERNELAPI
+KeTryAcquireSpinlock(
+    IN PKSPIN_LOCK Lock)
+{
+    if (Lock->Owner != Lock->Next)
+        return FALSE;
+
+    Lock->Next++;
+
+    return TRUE;
+}
+
+VOID
+KERNELAPI
+KeAcquireSpinlock(
+    IN PKSPIN_LOCK Lock)
+{
+    // Would spin forever on a single processor.
+    DASSERT(KeTryAcquireSpinlock(Lock));
+}
+
+VOID
+KERNELAPI
+KeReleaseSpinlock(
+    IN PKSPIN_LOCK Lock)
+{
+    DASSERT(Lock->Owner != Lock->Next);
+    Lock->Owner++;
+}
+
+BOOLEAN
+KERNELAPI
+KeIsSpinlockAcquired(
+    IN PKSPIN_LOCK Lock)
+{
+    return Lock->Owner != Lock->Next;
+}
+
+VOID
+KERNELAPI
+KeAcquireSpinlockDisableInterrupt(
+    IN PKSPIN_LOCK Lock,
+    OUT BOOLEAN *PrevState)
+{
+    *PrevState = !!(__readeflags() & RFLAG_IF);
+    _disable();
+    KeAcquireSpinlock(Lock);
+}
+
+VOID
+KERNELAPI
+KeReleaseSpinlockRestoreInterrupt(
+    IN PKSPIN_LOCK Lock,
+    IN BOOLEAN PrevState)
+{
+    KeReleaseSpinlock(Lock);
+
+    if (PrevState)
+        _enable();
+}
+
+VOID
+KERNELAPI
+KeInitializeRwSpinlock(
+    OUT PKRW_SPIN_LOCK Lock)
+{
+    Lock->Lock = 0;
+}
+
+VOID
+KERNELAPI
+KeAcquireRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    DASSERT(!Lock->Lock);
+    Lock->Lock = KRW_SPIN_LOCK_WRITER;
+}
+
+VOID
+KERNELAPI
+KeReleaseRwSpinlockExclusive(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    DASSERT(Lock->Lock == KRW_SPIN_LOCK_WRITER);
+    Lock->Lock = 0;
+}
+
+VOID
+KERNELAPI
+KeAcquireRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    DASSERT(!(Lock->Lock & KRW_SPIN_LOCK_WRITER));
+    Lock->Lock++;
+}
+
+VOID
+KERNELAPI
+KeReleaseRwSpinlockShared(
+    IN PKRW_SPIN_LOCK Lock)
+{
+    DASSERT(Lock->Lock & KRW_SPIN_LOCK_READER_MASK);
+    Lock->Lock--;
+}
+
+
+//
+// Debug output.
+//
+
+BOOLEAN
+VARCALL
+DbgTraceF(
+    IN DBG_TRACE_LEVEL TraceLevel,
+    IN CHAR8 *Format,
+    ...)
+{
+    va_list VarList;
+
+    va_start(VarList, Format);
+    vfprintf(stderr, Format, VarList);
+    va_end(VarList);
+
+    return TRUE;
+}
+
+BOOLEAN
+KERNELAPI
+DbgTraceN(
+    IN DBG_TRACE_LEVEL TraceLevel,
+    IN CHAR8 *TraceMessage,
+    IN SIZE_T Length)
+{
+    fwrite(TraceMessage, 1, Length, stderr);
+
+    return TRUE;
+}
+
+VOID
+KERNELAPI
+DbgFlushLogPanic(
+    VOID)
+{
+    fflush(stdout);
+}
+
+BOOLEAN
+VARCALL
+BootGfxPrintTextFormat(
+    IN CHAR8 *Format,
+    ...)
+{
+    va_list VarList;
+
+    va_start(VarList, Format);
+    vprintf(Format, VarList);
+    va_end(VarList);
+
+    return TRUE;
+}
+
+
+//
+// Strings.
+//
+
+SIZE_T
+KERNELAPI
+ClStrFormatU8V(
+    OUT CHAR8 *Buffer,
+    IN SIZE_T BufferLength,
+    IN CHAR8 *Format,
+    IN va_list VarList)
+{
+    int Length = vsnprintf(Buffer, BufferLength, Format, VarList);
+
+    if (Length < 0)
+        return 0;
+
+    // Kernel version returns the number of characters written without the terminator.
+    if (BufferLength && (SIZE_T)Length >= BufferLength)
+        return BufferLength - 1;
+
+    return (SIZE_T)Length;
+}
+
+SIZE_T
+VARCALL
+ClStrFormatU8(
+    OUT CHAR8 *Buffer,
+    IN SIZE_T BufferLength,
+    IN CHAR8 *Format,
+    ...)
+{
+    va_list VarList;
+    SIZE_T Length;
+
+    va_start(VarList, Format);
+    Length = ClStrFormatU8V(Buffer, BufferLength, Format, VarList);
+    va_end(VarList);
+
+    return Length;
+}
+
+SIZE_T
+KERNELAPI
+ClStrTerminateU8(
+    IN OUT CHAR8 *Buffer,
+    IN SIZE_T BufferLength,
+    IN SIZE_T Position)
+{
+    if (!BufferLength || Position > BufferLength)
+        return 0;
+
+    if (Position == BufferLength)
+        Position--;
+
+    Buffer[Position] = 0;
+
+    return 1;
+}
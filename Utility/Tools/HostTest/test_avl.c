@@ -0,0 +1,299 @@
+//
+// AVL tree (misc/bintree.c).
+//
+
+#include <hosttest.h>
+
+#define AVL_TEST_KEY_SPACE      0x1000
+#define AVL_TEST_VERIFY_PERIOD  0x100
+
+typedef struct _AVL_TEST_NODE
+{
+    RS_AVL_NODE AvlNode;
+    U64 Key;
+} AVL_TEST_NODE;
+
+static
+RS_BINARY_TREE_LINK *
+AvlTestAllocateNode(
+    IN PVOID CallerContext)
+{
+    AVL_TEST_NODE *Node = calloc(1, sizeof(*Node));
+
+    HT_CHECK(Node != NULL);
+
+    return &Node->AvlNode.Links;
+}
+
+static
+VOID
+AvlTestDeleteNode(
+    IN PVOID CallerContext,
+    IN RS_BINARY_TREE_LINK *Node)
+{
+    free(CONTAINING_RECORD(Node, AVL_TEST_NODE, AvlNode.Links));
+}
+
+static
+PVOID
+AvlTestGetKey(
+    IN PVOID CallerContext,
+    IN RS_BINARY_TREE_LINK *Node)
+{
+    return &CONTAINING_RECORD(Node, AVL_TEST_NODE, AvlNode.Links)->Key;
+}
+
+static
+VOID
+AvlTestSetKey(
+    IN PVOID CallerContext,
+    IN RS_BINARY_TREE_LINK *Node,
+    IN PVOID Key)
+{
+    CONTAINING_RECORD(Node, AVL_TEST_NODE, AvlNode.Links)->Key = *(U64 *)Key;
+}
+
+static
+INT
+AvlTestCompareKey(
+    IN PVOID CallerContext,
+    IN PVOID Key1,
+    IN PVOID Key2)
+{
+    U64 A = *(U64 *)Key1;
+    U64 B = *(U64 *)Key2;
+
+    return (A > B) - (A < B);
+}
+
+static
+SIZE_T
+AvlTestKeyToString(
+    IN PVOID CallerContext,
+    IN PVOID Key,
+    OUT CHAR *Buffer,
+    IN SIZE_T BufferLength)
+{
+    return ClStrFormatU8(Buffer, BufferLength, "%llu", *(unsigned long long *)Key);
+}
+
+static
+VOID
+AvlTestInitialize(
+    OUT RS_AVL_TREE *Tree)
+{
+    RS_BINARY_TREE_OPERATIONS Operations =
+    {
+        .AllocateNode = &AvlTestAllocateNode,
+        .DeleteNode = &AvlTestDeleteNode,
+        .GetKey = &AvlTestGetKey,
+        .SetKey = &AvlTestSetKey,
+        .CompareKey = &AvlTestCompareKey,
+        .KeyToString = &AvlTestKeyToString,
+    };
+
+    memset(Tree, 0, sizeof(*Tree));
+    RsBtInitialize(Tree, &Operations, NULL);
+}
+
+/**
+ * @brief Checks links, ordering and balance of the subtree.
+ *
+ * @return Height of the subtree (0 if empty).
+ */
+static
+INT
+AvlTestVerifySubtree(
+    IN RS_BINARY_TREE_LINK *Node,
+    IN RS_BINARY_TREE_LINK *Parent,
+    IN OUT U32 *Count,
+    IN OUT U64 *PreviousKey,
+    IN OUT BOOLEAN *HasPreviousKey)
+{
+    if (!Node)
+        return 0;
+
+    HT_CHECK(Node->Parent == Parent);
+
+    INT LeftHeight = AvlTestVerifySubtree(Node->LeftChild, Node, Count, PreviousKey, HasPreviousKey);
+
+    U64 Key = CONTAINING_RECORD(Node, AVL_TEST_NODE, AvlNode.Links)->Key;
+    HT_CHECK(!*HasPreviousKey || *PreviousKey < Key);
+    *PreviousKey = Key;
+    *HasPreviousKey = TRUE;
+    (*Count)++;
+
+    INT RightHeight = AvlTestVerifySubtree(Node->RightChild, Node, Count, PreviousKey, HasPreviousKey);
+
+    HT_CHECK(LeftHeight - RightHeight <= 1 && RightHeight - LeftHeight <= 1);
+
+    return (LeftHeight > RightHeight ? LeftHeight : RightHeight) + 1;
+}
+
+static
+VOID
+AvlTestVerify(
+    IN RS_AVL_TREE *Tree,
+    IN U32 ExpectedCount)
+{
+    U32 Count = 0;
+    U64 PreviousKey = 0;
+    BOOLEAN HasPreviousKey = FALSE;
+
+    AvlTestVerifySubtree(Tree->Root, NULL, &Count, &PreviousKey, &HasPreviousKey);
+
+    HT_CHECK(Count == ExpectedCount);
+    HT_CHECK(Tree->NodeCount == ExpectedCount);
+}
+
+static
+VOID
+AvlTest(
+    IN U32 Iterations)
+{
+    static BOOLEAN Present[AVL_TEST_KEY_SPACE];
+    RS_AVL_TREE Tree;
+    U32 Count = 0;
+
+    memset(Present, 0, sizeof(Present));
+    AvlTestInitialize(&Tree);
+
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        U64 Key = HtRandomRange(AVL_TEST_KEY_SPACE);
+        RS_BINARY_TREE_LINK *Node = NULL;
+
+        switch (HtRandomRange(4))
+        {
+        case 0:
+        case 1:
+            // Insert (twice as likely, so that the tree grows)
+            HT_CHECK(RsAvlInsert(&Tree, &Key, &Node) == !Present[Key]);
+            if (!Present[Key])
+            {
+                HT_CHECK(*(U64 *)AvlTestGetKey(NULL, Node) == Key);
+                Present[Key] = TRUE;
+                Count++;
+            }
+            break;
+
+        case 2:
+            HT_CHECK(RsBtLookup(&Tree, &Key, &Node) == Present[Key]);
+            if (Present[Key])
+                HT_CHECK(*(U64 *)AvlTestGetKey(NULL, Node) == Key);
+            break;
+
+        case 3:
+            if (HtRandomRange(2) && Present[Key])
+            {
+                HT_CHECK(RsBtLookup(&Tree, &Key, &Node));
+                HT_CHECK(RsAvlDelete(&Tree, BINARY_TREE_NODE_TO_AVL_NODE(Node)));
+            }
+            else
+            {
+                HT_CHECK(RsAvlDeleteByKey(&Tree, &Key) == Present[Key]);
+            }
+
+            if (Present[Key])
+            {
+                Present[Key] = FALSE;
+                Count--;
+            }
+            break;
+        }
+
+        if (!(i % AVL_TEST_VERIFY_PERIOD))
+            AvlTestVerify(&Tree, Count);
+    }
+
+    AvlTestVerify(&Tree, Count);
+
+    // Drain in random order.
+    for (U64 Key = HtRandomRange(AVL_TEST_KEY_SPACE); Count; Key = (Key + 1) % AVL_TEST_KEY_SPACE)
+    {
+        if (!Present[Key])
+            continue;
+
+        HT_CHECK(RsAvlDeleteByKey(&Tree, &Key));
+        Present[Key] = FALSE;
+        Count--;
+    }
+
+    AvlTestVerify(&Tree, 0);
+    HT_CHECK(Tree.Root == NULL);
+}
+
+static
+VOID
+AvlBench(
+    IN U32 Iterations)
+{
+    U64 *Keys = malloc(sizeof(U64) * Iterations);
+    HT_LATENCY Insert, Lookup, Delete;
+    RS_AVL_TREE Tree;
+    U32 Count = 0;
+
+    HT_CHECK(Keys != NULL);
+    AvlTestInitialize(&Tree);
+
+    HtLatencyInitialize(&Insert, "insert", Iterations);
+    HtLatencyInitialize(&Lookup, "lookup", Iterations);
+    HtLatencyInitialize(&Delete, "delete", Iterations);
+
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        U64 Key = HtRandom();
+        RS_BINARY_TREE_LINK *Node = NULL;
+
+        U64 Start = HtNow();
+        BOOLEAN Inserted = RsAvlInsert(&Tree, &Key, &Node);
+        HtLatencyAdd(&Insert, HtNow() - Start);
+
+        // Collision is very unlikely, but skip it anyway.
+        if (Inserted)
+            Keys[Count++] = Key;
+    }
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        U64 Key = Keys[HtRandomRange(Count)];
+        RS_BINARY_TREE_LINK *Node = NULL;
+
+        U64 Start = HtNow();
+        BOOLEAN Found = RsBtLookup(&Tree, &Key, &Node);
+        HtLatencyAdd(&Lookup, HtNow() - Start);
+
+        HT_CHECK(Found);
+    }
+
+    // Delete in random order.
+    for (U32 i = Count; i > 1; i--)
+    {
+        U32 j = (U32)HtRandomRange(i);
+        U64 Temp = Keys[i - 1];
+        Keys[i - 1] = Keys[j];
+        Keys[j] = Temp;
+    }
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        U64 Start = HtNow();
+        BOOLEAN Deleted = RsAvlDeleteByKey(&Tree, &Keys[i]);
+        HtLatencyAdd(&Delete, HtNow() - Start);
+
+        HT_CHECK(Deleted);
+    }
+
+    HtLatencyReport(&Insert);
+    HtLatencyReport(&Lookup);
+    HtLatencyReport(&Delete);
+
+    free(Keys);
+}
+
+const HT_SUITE HtSuiteAvl =
+{
+    .Name = "avl",
+    .Test = &AvlTest,
+    .Bench = &AvlBench,
+};
@@ -0,0 +1,234 @@
+//
+// Object pool (misc/objpool.c).
+//
+
+#include <hosttest.h>
+#include <mm/pool.h>
+
+#define OBJPOOL_TEST_ROUNDS         8
+#define OBJPOOL_TEST_COUNT_MAX      0x2000
+#define OBJPOOL_TEST_BATCH_MAX      0x20
+#define OBJPOOL_TEST_POOL_SIZE      0x1000000
+
+static
+VOID
+ObjpoolTestStamp(
+    IN OBJECT_POOL *Pool,
+    IN PVOID Object,
+    IN U32 Value)
+{
+    // Objects are at least 8 bytes in the test, so the head and tail stamps do not overlap.
+    // Overlapped objects are caught on free.
+    U8 *Bytes = (U8 *)Object;
+
+    HT_CHECK(Bytes >= (U8 *)Pool->Pool);
+    HT_CHECK(!(((U8 *)Object - (U8 *)Pool->Pool) % Pool->SizeOfObject));
+    HT_CHECK((U8 *)Object - (U8 *)Pool->Pool < (SSIZE_T)Pool->AllocationBitmap.MaximumObjectCount * Pool->SizeOfObject);
+
+    memcpy(Bytes, &Value, sizeof(Value));
+    memcpy(Bytes + Pool->SizeOfObject - sizeof(Value), &Value, sizeof(Value));
+}
+
+static
+VOID
+ObjpoolTestRound(
+    IN U32 MaximumCount,
+    IN U32 SizeOfObject,
+    IN BOOLEAN UseKernelPool,
+    IN U32 Iterations)
+{
+    OBJECT_POOL Pool;
+    PVOID *Objects = malloc(sizeof(PVOID) * MaximumCount);
+    U32 Count = 0;
+    U32 Value;
+    PVOID Bitmap = NULL;
+    PVOID Buffer = NULL;
+
+    HT_CHECK(Objects != NULL);
+
+    if (UseKernelPool)
+    {
+        HT_CHECK(PoolInitialize(&Pool, MaximumCount, SizeOfObject, NULL, 0, NULL, 0));
+    }
+    else
+    {
+        U32 BitmapSize = PoolGetBitmapSize(MaximumCount);
+
+        Bitmap = HtAllocateAligned(BitmapSize, sizeof(U64));
+        Buffer = malloc((SIZE_T)MaximumCount * SizeOfObject);
+        HT_CHECK(Buffer != NULL);
+
+        // Too small buffers must be rejected.
+        HT_CHECK(!PoolInitialize(&Pool, MaximumCount, SizeOfObject, Bitmap, BitmapSize, Buffer, (U64)MaximumCount * SizeOfObject - 1));
+        HT_CHECK(PoolInitialize(&Pool, MaximumCount, SizeOfObject, Bitmap, BitmapSize, Buffer, (U64)MaximumCount * SizeOfObject));
+    }
+
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        switch (HtRandomRange(5))
+        {
+        case 0:
+        case 1:
+        {
+            PVOID Object = PoolAllocateObject(&Pool);
+
+            HT_CHECK(!!Object == (Count < MaximumCount));
+            if (Object)
+            {
+                ObjpoolTestStamp(&Pool, Object, Count);
+                Objects[Count++] = Object;
+            }
+            break;
+        }
+
+        case 2:
+        {
+            PVOID Batch[OBJPOOL_TEST_BATCH_MAX];
+            U32 BatchCount = 1 + (U32)HtRandomRange(OBJPOOL_TEST_BATCH_MAX);
+
+            HT_CHECK(PoolAllocateObjects(&Pool, BatchCount, Batch) == (BatchCount <= MaximumCount - Count));
+            if (BatchCount <= MaximumCount - Count)
+            {
+                for (U32 j = 0; j < BatchCount; j++)
+                {
+                    ObjpoolTestStamp(&Pool, Batch[j], Count);
+                    Objects[Count++] = Batch[j];
+                }
+            }
+            break;
+        }
+
+        case 3:
+        case 4:
+        {
+            if (!Count)
+                break;
+
+            U32 j = (U32)HtRandomRange(Count);
+            PVOID Object = Objects[j];
+
+            // Stamp is broken if another object overlaps this one.
+            memcpy(&Value, Object, sizeof(Value));
+            HT_CHECK(Objects[Value] == Object);
+            memcpy(&Value, (U8 *)Object + SizeOfObject - sizeof(Value), sizeof(Value));
+            HT_CHECK(Objects[Value] == Object);
+
+            HT_CHECK(PoolFreeObject(&Pool, Object));
+            HT_CHECK(!PoolFreeObject(&Pool, Object));
+
+            if (SizeOfObject > 1)
+                HT_CHECK(!PoolFreeObject(&Pool, (U8 *)Object + 1));
+
+            // Keep the stamp of the moved object in sync.
+            Objects[j] = Objects[--Count];
+            if (j < Count)
+                ObjpoolTestStamp(&Pool, Objects[j], j);
+            break;
+        }
+        }
+
+        HT_CHECK(Pool.AllocationBitmap.AllocatedCount == Count);
+    }
+
+    HT_CHECK(PoolFree(&Pool));
+
+    free(Buffer);
+    free(Bitmap);
+    free(Objects);
+}
+
+static
+VOID
+ObjpoolTest(
+    IN U32 Iterations)
+{
+    // Counts around the word and level boundaries of the bitmap are picked more often.
+    static const U32 Counts[] = { 1, 63, 64, 65, 4095, 4096, 4097 };
+
+    HtInitializePool(OBJPOOL_TEST_POOL_SIZE, POOL_FLAG_VERIFY_DEFAULT);
+
+    for (U32 Round = 0; Round < OBJPOOL_TEST_ROUNDS; Round++)
+    {
+        U32 MaximumCount = HtRandomRange(2) ?
+            Counts[HtRandomRange(COUNTOF(Counts))] : 1 + (U32)HtRandomRange(OBJPOOL_TEST_COUNT_MAX);
+        U32 SizeOfObject = 2 * sizeof(U32) + (U32)HtRandomRange(0x40);
+
+        ObjpoolTestRound(MaximumCount, SizeOfObject, !!(Round & 1), Iterations / OBJPOOL_TEST_ROUNDS);
+    }
+
+    HtDeletePool();
+}
+
+static
+VOID
+ObjpoolBench(
+    IN U32 Iterations)
+{
+    U32 Count = Iterations;
+    PVOID *Objects = malloc(sizeof(PVOID) * Count);
+    HT_LATENCY Allocate, Free, Steady;
+    OBJECT_POOL Pool;
+
+    HT_CHECK(Objects != NULL);
+
+    HtInitializePool((SIZE_T)Count * 0x40 + 0x1000000, POOL_FLAG_VERIFY_DEFAULT);
+    HT_CHECK(PoolInitialize(&Pool, Count, 0x20, NULL, 0, NULL, 0));
+
+    HtLatencyInitialize(&Allocate, "alloc", Count);
+    HtLatencyInitialize(&Free, "free", Count);
+    HtLatencyInitialize(&Steady, "free+alloc (half full)", Count);
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        U64 Start = HtNow();
+        Objects[i] = PoolAllocateObject(&Pool);
+        HtLatencyAdd(&Allocate, HtNow() - Start);
+
+        HT_CHECK(Objects[i] != NULL);
+    }
+
+    // Free the half in random order.
+    for (U32 i = Count; i > 1; i--)
+    {
+        U32 j = (U32)HtRandomRange(i);
+        PVOID Temp = Objects[i - 1];
+        Objects[i - 1] = Objects[j];
+        Objects[j] = Temp;
+    }
+
+    for (U32 i = Count / 2; i < Count; i++)
+    {
+        U64 Start = HtNow();
+        BOOLEAN Freed = PoolFreeObject(&Pool, Objects[i]);
+        HtLatencyAdd(&Free, HtNow() - Start);
+
+        HT_CHECK(Freed);
+    }
+
+    for (U32 i = 0; i < Count && Count / 2; i++)
+    {
+        U32 j = (U32)HtRandomRange(Count / 2);
+
+        U64 Start = HtNow();
+        BOOLEAN Freed = PoolFreeObject(&Pool, Objects[j]);
+        Objects[j] = PoolAllocateObject(&Pool);
+        HtLatencyAdd(&Steady, HtNow() - Start);
+
+        HT_CHECK(Freed && Objects[j]);
+    }
+
+    HtLatencyReport(&Allocate);
+    HtLatencyReport(&Free);
+    HtLatencyReport(&Steady);
+
+    HT_CHECK(PoolFree(&Pool));
+    free(Objects);
+    HtDeletePool();
+}
+
+const HT_SUITE HtSuiteObjectPool =
+{
+    .Name = "objpool",
+    .Test = &ObjpoolTest,
+    .Bench = &ObjpoolBench,
+};
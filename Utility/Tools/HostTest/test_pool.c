@@ -0,0 +1,171 @@
+//
+// Kernel pool (mm/pool.c), including size classes and the per-processor magazines.
+//
+
+#include <hosttest.h>
+#include <mm/pool.h>
+
+#define POOL_TEST_POOL_SIZE         0x1000000
+#define POOL_TEST_LIVE_MAX          0x400
+#define POOL_TEST_LARGE_MAX         0x10000
+#define POOL_TEST_ALIGNMENT_SHIFT   12
+
+#define POOL_BENCH_POOL_SIZE        0x4000000
+#define POOL_BENCH_LIVE             0x400
+
+typedef struct _POOL_TEST_BLOCK
+{
+    U8 *Address;
+    SIZE_T Size;
+    U8 Pattern;
+} POOL_TEST_BLOCK;
+
+static
+SIZE_T
+PoolTestRandomSize(
+    VOID)
+{
+    // Mostly size class allocations, sometimes large ones.
+    switch (HtRandomRange(4))
+    {
+    case 0: return 1 + HtRandomRange(POOL_SIZE_CLASS_LINEAR_MAX);
+    case 1: return 1 + HtRandomRange(POOL_SIZE_CLASS_MAX);
+    case 2: return POOL_SIZE_CLASS_LINEAR_MAX / 2 + HtRandomRange(POOL_SIZE_CLASS_LINEAR_MAX);
+    default: return 1 + HtRandomRange(POOL_TEST_LARGE_MAX);
+    }
+}
+
+static
+VOID
+PoolTestFree(
+    IN OUT POOL_TEST_BLOCK *Block)
+{
+    // Pattern is broken if another block overlaps this one.
+    for (SIZE_T i = 0; i < Block->Size; i++)
+        HT_CHECK(Block->Address[i] == Block->Pattern);
+
+    MmFreePool(Block->Address);
+    Block->Address = NULL;
+}
+
+static
+VOID
+PoolTest(
+    IN U32 Iterations)
+{
+    static POOL_TEST_BLOCK Blocks[POOL_TEST_LIVE_MAX];
+    U32 Count = 0;
+
+    HtInitializePool(POOL_TEST_POOL_SIZE, POOL_FLAG_VERIFY_FULL);
+
+    // Cannot be satisfied at all.
+    HT_CHECK(MmAllocatePool(PoolTypeNonPaged, POOL_TEST_POOL_SIZE, 0, TAG4('T', 'E', 'S', 'T')) == NULL);
+
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        POOL_TYPE Type = HtRandomRange(2) ? PoolTypeNonPaged : PoolTypePaged;
+
+        if (Count < POOL_TEST_LIVE_MAX && (!Count || HtRandomRange(2)))
+        {
+            POOL_TEST_BLOCK *Block = &Blocks[Count];
+            U16 Alignment = HtRandomRange(2) ? 0 : (U16)(1 << HtRandomRange(POOL_TEST_ALIGNMENT_SHIFT + 1));
+
+            Block->Size = PoolTestRandomSize();
+            Block->Pattern = (U8)HtRandom();
+            Block->Address = MmAllocatePool(Type, Block->Size, Alignment, TAG4('T', 'E', 'S', 'T'));
+
+            HT_CHECK(Block->Address != NULL);
+            HT_CHECK(!((UPTR)Block->Address & (POOL_HEADER_ALIGNMENT - 1)));
+            HT_CHECK(!Alignment || !((UPTR)Block->Address & (Alignment - 1)));
+
+            memset(Block->Address, Block->Pattern, Block->Size);
+            Count++;
+        }
+        else
+        {
+            U32 j = (U32)HtRandomRange(Count);
+
+            PoolTestFree(&Blocks[j]);
+            Blocks[j] = Blocks[--Count];
+        }
+
+        // Switching the verify mode must not affect the pool.
+        if (!HtRandomRange(0x1000))
+            HT_CHECK(E_IS_SUCCESS(MmSetPoolVerifyMode(Type, HtRandomRange(2) ? POOL_FLAG_VERIFY_FULL : POOL_FLAG_VERIFY_NEIGHBOURS)));
+    }
+
+    while (Count)
+        PoolTestFree(&Blocks[--Count]);
+
+    HtDeletePool();
+}
+
+static
+VOID
+PoolBenchProfile(
+    IN const char *Name,
+    IN SIZE_T SizeMin,
+    IN SIZE_T SizeMax,
+    IN U32 Iterations)
+{
+    static PVOID Blocks[POOL_BENCH_LIVE];
+    char AllocateName[64], FreeName[64];
+    HT_LATENCY Allocate, Free;
+
+    snprintf(AllocateName, sizeof(AllocateName), "alloc %s", Name);
+    snprintf(FreeName, sizeof(FreeName), "free %s", Name);
+
+    HtInitializePool(POOL_BENCH_POOL_SIZE, POOL_FLAG_VERIFY_DEFAULT);
+
+    HtLatencyInitialize(&Allocate, AllocateName, Iterations);
+    HtLatencyInitialize(&Free, FreeName, Iterations);
+
+    for (U32 i = 0; i < POOL_BENCH_LIVE; i++)
+    {
+        Blocks[i] = MmAllocatePool(PoolTypeNonPaged, SizeMin + HtRandomRange(SizeMax - SizeMin + 1), 0, TAG4('B', 'N', 'C', 'H'));
+        HT_CHECK(Blocks[i] != NULL);
+    }
+
+    // Steady state: a random block is replaced by a new one.
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        U32 j = (U32)HtRandomRange(POOL_BENCH_LIVE);
+        SIZE_T Size = SizeMin + HtRandomRange(SizeMax - SizeMin + 1);
+
+        U64 Start = HtNow();
+        MmFreePool(Blocks[j]);
+        U64 Middle = HtNow();
+        Blocks[j] = MmAllocatePool(PoolTypeNonPaged, Size, 0, TAG4('B', 'N', 'C', 'H'));
+        U64 End = HtNow();
+
+        HT_CHECK(Blocks[j] != NULL);
+
+        HtLatencyAdd(&Free, Middle - Start);
+        HtLatencyAdd(&Allocate, End - Middle);
+    }
+
+    HtLatencyReport(&Allocate);
+    HtLatencyReport(&Free);
+
+    for (U32 i = 0; i < POOL_BENCH_LIVE; i++)
+        MmFreePool(Blocks[i]);
+
+    HtDeletePool();
+}
+
+static
+VOID
+PoolBench(
+    IN U32 Iterations)
+{
+    PoolBenchProfile("small", 1, POOL_SIZE_CLASS_LINEAR_MAX, Iterations);
+    PoolBenchProfile("medium", POOL_SIZE_CLASS_LINEAR_MAX + 1, POOL_SIZE_CLASS_MAX, Iterations);
+    PoolBenchProfile("large", POOL_SIZE_CLASS_MAX + 1, POOL_TEST_LARGE_MAX, Iterations);
+}
+
+const HT_SUITE HtSuitePool =
+{
+    .Name = "pool",
+    .Test = &PoolTest,
+    .Bench = &PoolBench,
+};
@@ -0,0 +1,152 @@
+//
+// Runner queue (ke/runner_q.c).
+//
+
+#include <hosttest.h>
+#include <ke/thread.h>
+#include <ke/runner_q.h>
+
+#define RUNNERQ_TEST_THREADS        0x100
+#define RUNNERQ_TEST_LEVELS         32
+
+static
+VOID
+RunnerqTest(
+    IN U32 Iterations)
+{
+    static KTHREAD Threads[RUNNERQ_TEST_THREADS];
+    U32 ThreadLevel[RUNNERQ_TEST_THREADS];
+    U32 LevelCount[RUNNERQ_TEST_LEVELS] = { 0 };
+    KRUNNER_QUEUE Queue;
+    U32 Count = 0;
+
+    memset(Threads, 0, sizeof(Threads));
+    for (U32 i = 0; i < RUNNERQ_TEST_THREADS; i++)
+        DListInitializeHead(&Threads[i].RunnerLinks);
+
+    HT_CHECK(E_IS_SUCCESS(KiRqInitialize(&Queue, NULL, RUNNERQ_TEST_LEVELS)));
+    HT_CHECK(!E_IS_SUCCESS(KiRqInitialize(&Queue, NULL, RUNNER_QUEUE_MAX_LEVELS + 1)));
+    HT_CHECK(E_IS_SUCCESS(KiRqInitialize(&Queue, NULL, RUNNERQ_TEST_LEVELS)));
+
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        KTHREAD *Thread = &Threads[HtRandomRange(RUNNERQ_TEST_THREADS)];
+        ULONG Flags = HtRandomRange(2) ? RQ_FLAG_INSERT_REMOVE_REVERSE_DIRECTION : 0;
+
+        switch (HtRandomRange(3))
+        {
+        case 0:
+            if (!Thread->RunnerQueue)
+            {
+                ULONG Level = (ULONG)HtRandomRange(RUNNERQ_TEST_LEVELS);
+
+                HT_CHECK(E_IS_SUCCESS(KiRqEnqueue(&Queue, Thread, Level, Flags)));
+                HT_CHECK(Thread->RunnerQueue == &Queue && Thread->RunnerLevel == Level);
+                ThreadLevel[Thread - Threads] = Level;
+                LevelCount[Level]++;
+                Count++;
+            }
+            break;
+
+        case 1:
+            if (Thread->RunnerQueue)
+            {
+                LevelCount[Thread->RunnerLevel]--;
+                Count--;
+                HT_CHECK(E_IS_SUCCESS(KiRqRemove(Thread)));
+                HT_CHECK(Thread->RunnerQueue == NULL);
+            }
+            break;
+
+        case 2:
+        {
+            // Highest (or lowest) non-empty level is served first.
+            BOOLEAN Ascending = !!HtRandomRange(2);
+            KTHREAD *Dequeued = NULL;
+            INT Target = -1;
+
+            for (INT Level = 0; Level < RUNNERQ_TEST_LEVELS; Level++)
+            {
+                if (LevelCount[Level] && (Target < 0 || !Ascending))
+                    Target = Level;
+            }
+
+            Flags |= RQ_FLAG_NO_LEVEL | (Ascending ? RQ_FLAG_SEARCH_ASCENDING_ORDER : 0);
+
+            ESTATUS Status = KiRqDequeue(&Queue, &Dequeued, RUNNERQ_TEST_LEVELS - 1, Flags);
+
+            HT_CHECK(E_IS_SUCCESS(Status) == (Target >= 0));
+            if (E_IS_SUCCESS(Status))
+            {
+                HT_CHECK(Dequeued >= Threads && Dequeued < Threads + RUNNERQ_TEST_THREADS);
+                HT_CHECK(Dequeued->RunnerQueue == NULL);
+                HT_CHECK(ThreadLevel[Dequeued - Threads] == (U32)Target);
+                LevelCount[Target]--;
+                Count--;
+            }
+            break;
+        }
+        }
+
+        HT_CHECK(Queue.Count == Count);
+        HT_CHECK(KiRqIsEmpty(&Queue) == !Count);
+
+        for (U32 Level = 0; Level < RUNNERQ_TEST_LEVELS; Level++)
+            HT_CHECK(!!(Queue.QueuedState & (1ULL << Level)) == !!LevelCount[Level]);
+    }
+}
+
+static
+VOID
+RunnerqBench(
+    IN U32 Iterations)
+{
+    static KTHREAD Threads[RUNNERQ_TEST_THREADS];
+    HT_LATENCY Enqueue, Dequeue;
+    KRUNNER_QUEUE Queue;
+
+    memset(Threads, 0, sizeof(Threads));
+    for (U32 i = 0; i < RUNNERQ_TEST_THREADS; i++)
+        DListInitializeHead(&Threads[i].RunnerLinks);
+
+    HT_CHECK(E_IS_SUCCESS(KiRqInitialize(&Queue, NULL, RUNNERQ_TEST_LEVELS)));
+
+    HtLatencyInitialize(&Enqueue, "enqueue", Iterations);
+    HtLatencyInitialize(&Dequeue, "dequeue", Iterations);
+
+    for (U32 i = 0; i < RUNNERQ_TEST_THREADS / 2; i++)
+        HT_CHECK(E_IS_SUCCESS(KiRqEnqueue(&Queue, &Threads[i], (ULONG)HtRandomRange(RUNNERQ_TEST_LEVELS), 0)));
+
+    // Steady state: a thread is dequeued and another one is enqueued.
+    for (U32 i = 0, Next = RUNNERQ_TEST_THREADS / 2; i < Iterations; i++)
+    {
+        KTHREAD *Thread = NULL;
+
+        U64 Start = HtNow();
+        ESTATUS Status = KiRqDequeue(&Queue, &Thread, RUNNERQ_TEST_LEVELS - 1, RQ_FLAG_NO_LEVEL);
+        U64 Middle = HtNow();
+        HT_CHECK(E_IS_SUCCESS(Status));
+
+        ULONG Level = (ULONG)HtRandomRange(RUNNERQ_TEST_LEVELS);
+        KTHREAD *NewThread = &Threads[Next];
+        Next = (U32)(Thread - Threads);
+
+        U64 EnqueueStart = HtNow();
+        Status = KiRqEnqueue(&Queue, NewThread, Level, 0);
+        U64 End = HtNow();
+        HT_CHECK(E_IS_SUCCESS(Status));
+
+        HtLatencyAdd(&Dequeue, Middle - Start);
+        HtLatencyAdd(&Enqueue, End - EnqueueStart);
+    }
+
+    HtLatencyReport(&Enqueue);
+    HtLatencyReport(&Dequeue);
+}
+
+const HT_SUITE HtSuiteRunnerQueue =
+{
+    .Name = "runnerq",
+    .Test = &RunnerqTest,
+    .Bench = &RunnerqBench,
+};
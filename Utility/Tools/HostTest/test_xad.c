@@ -0,0 +1,430 @@
+//
+// XAD tree (mm/xadtree.c).
+// Addresses are handled in pages. Model keeps the type of each page (-1 if not in the tree).
+//
+
+#include <hosttest.h>
+#include <mm/mm.h>
+#include <mm/pool.h>
+#include <mm/slab.h>
+
+#define XAD_TEST_BASE           0x100000000ULL
+#define XAD_TEST_PAGES          0x200
+#define XAD_TEST_RANGE_MAX      0x20        // Pages per inserted range
+#define XAD_TEST_TYPES          4
+#define XAD_TEST_POOL_SIZE      0x400000
+
+#define XAD_PAGE_TO_ADDRESS(_p) (XAD_TEST_BASE + ((U64)(_p) << PAGE_SHIFT))
+#define XAD_ADDRESS_TO_PAGE(_a) ((U32)(((_a) - XAD_TEST_BASE) >> PAGE_SHIFT))
+
+INT
+KERNELAPI
+MiXadSizeToSizeLevel(
+    IN U64 Size);
+
+static XAD_CONTEXT XadTestContext;
+static S32 XadTestType[XAD_TEST_PAGES];
+static MMXAD *XadTestList[XAD_TEST_PAGES];
+static U32 XadTestCount;
+
+static
+VOID
+XadTestInitialize(
+    OUT MMXAD_TREE *Tree,
+    IN SIZE_T PoolSize)
+{
+    HtInitializePool(PoolSize, POOL_FLAG_VERIFY_DEFAULT);
+
+    HT_CHECK(E_IS_SUCCESS(MmInitializeSlabCache(&MiXadCachePreInit, "XadPreInit", PoolTypeNonPagedPreInit, sizeof(MMXAD), 8, NULL, NULL)));
+    HT_CHECK(E_IS_SUCCESS(MmInitializeSlabCache(&MiXadCache, "Xad", PoolTypeNonPaged, sizeof(MMXAD), 8, NULL, NULL)));
+
+    memset(&XadTestContext, 0, sizeof(XadTestContext));
+    MmXadInitializeTree(Tree, &XadTestContext);
+}
+
+static
+MMXAD *
+XadTestFirst(
+    IN MMXAD_TREE *Tree)
+{
+    RS_BINARY_TREE_LINK *Node = Tree->Tree.Root;
+
+    while (Node && Node->LeftChild)
+        Node = Node->LeftChild;
+
+    return (MMXAD *)Node;
+}
+
+static
+MMXAD *
+XadTestNext(
+    IN MMXAD *Xad)
+{
+    // RsBtGetInorderSuccessor() only looks into the right subtree.
+    RS_BINARY_TREE_LINK *Node = &Xad->AvlNode.Links;
+
+    if (Node->RightChild)
+        return (MMXAD *)RsBtGetInorderSuccessor(Node);
+
+    while (Node->Parent && Node->Parent->RightChild == Node)
+        Node = Node->Parent;
+
+    return (MMXAD *)Node->Parent;
+}
+
+/**
+ * @brief Checks the tree and the size links against the model, and collects XADs in order.
+ */
+static
+VOID
+XadTestVerify(
+    IN MMXAD_TREE *Tree)
+{
+    U32 Pages = 0;
+    U32 ModelPages = 0;
+    U32 Linked = 0;
+    U64 PreviousEnd = 0;
+
+    XadTestCount = 0;
+
+    for (MMXAD *Xad = XadTestFirst(Tree); Xad; Xad = XadTestNext(Xad))
+    {
+        ADDRESS_RANGE *Range = &Xad->Address.Range;
+
+        HT_CHECK(Range->Start < Range->End);
+        HT_CHECK(Range->Start >= PreviousEnd);
+        HT_CHECK(Range->Start >= XAD_TEST_BASE && Range->End <= XAD_PAGE_TO_ADDRESS(XAD_TEST_PAGES));
+        HT_CHECK(!(Range->Start & PAGE_MASK) && !(Range->End & PAGE_MASK));
+
+        for (U32 Page = XAD_ADDRESS_TO_PAGE(Range->Start); Page < XAD_ADDRESS_TO_PAGE(Range->End); Page++)
+        {
+            HT_CHECK(XadTestType[Page] == (S32)Xad->Address.Type);
+            Pages++;
+        }
+
+        PreviousEnd = Range->End;
+        XadTestList[XadTestCount++] = Xad;
+    }
+
+    for (U32 Page = 0; Page < XAD_TEST_PAGES; Page++)
+    {
+        if (XadTestType[Page] >= 0)
+            ModelPages++;
+    }
+
+    HT_CHECK(Pages == ModelPages);
+    HT_CHECK(Tree->Tree.NodeCount == XadTestCount);
+
+    for (INT Level = 0; Level < MMXAD_MAX_SIZE_LEVELS; Level++)
+    {
+        DLIST_ENTRY *Head = &Tree->SizeLinks[Level];
+
+        for (DLIST_ENTRY *Link = Head->Next; Link != Head; Link = Link->Next)
+        {
+            MMXAD *Xad = CONTAINING_RECORD(Link, MMXAD, Links);
+
+            HT_CHECK(MiXadSizeToSizeLevel(Xad->Address.Range.End - Xad->Address.Range.Start) == Level);
+            Linked++;
+        }
+    }
+
+    HT_CHECK(Linked == XadTestCount);
+}
+
+static
+VOID
+XadTestInsert(
+    IN MMXAD_TREE *Tree)
+{
+    U32 Start = (U32)HtRandomRange(XAD_TEST_PAGES);
+    ADDRESS Address;
+    MMXAD *Xad = NULL;
+
+    if (XadTestType[Start] >= 0)
+    {
+        // Range inside of an existing XAD must be rejected.
+        Address.Range.Start = XAD_PAGE_TO_ADDRESS(Start);
+        Address.Range.End = XAD_PAGE_TO_ADDRESS(Start + 1);
+        Address.Type = 0;
+
+        HT_CHECK(!E_IS_SUCCESS(MmXadInsertAddress(Tree, &Xad, &Address)));
+        return;
+    }
+
+    U32 End = Start + 1 + (U32)HtRandomRange(XAD_TEST_RANGE_MAX);
+
+    if (End > XAD_TEST_PAGES)
+        End = XAD_TEST_PAGES;
+
+    for (U32 Page = Start + 1; Page < End; Page++)
+    {
+        if (XadTestType[Page] >= 0)
+        {
+            End = Page;
+            break;
+        }
+    }
+
+    Address.Range.Start = XAD_PAGE_TO_ADDRESS(Start);
+    Address.Range.End = XAD_PAGE_TO_ADDRESS(End);
+    Address.Type = (U32)HtRandomRange(XAD_TEST_TYPES);
+
+    HT_CHECK(E_IS_SUCCESS(MmXadInsertAddress(Tree, &Xad, &Address)));
+    HT_CHECK(Xad && Xad->Address.Range.Start == Address.Range.Start && Xad->Address.Range.End == Address.Range.End);
+
+    for (U32 Page = Start; Page < End; Page++)
+        XadTestType[Page] = (S32)Address.Type;
+}
+
+static
+VOID
+XadTestReclaim(
+    IN MMXAD_TREE *Tree)
+{
+    if (!XadTestCount)
+        return;
+
+    MMXAD *Xad = XadTestList[HtRandomRange(XadTestCount)];
+    ADDRESS Target = Xad->Address;
+    U32 Start = XAD_ADDRESS_TO_PAGE(Target.Range.Start);
+    U32 End = XAD_ADDRESS_TO_PAGE(Target.Range.End);
+    U32 ReclaimStart = Start + (U32)HtRandomRange(End - Start);
+    U32 ReclaimEnd = ReclaimStart + 1 + (U32)HtRandomRange(End - ReclaimStart);
+
+    // Touch the edges more often, as only those are merged.
+    switch (HtRandomRange(4))
+    {
+    case 0: ReclaimStart = Start; break;
+    case 1: ReclaimEnd = End; break;
+    case 2: ReclaimStart = Start; ReclaimEnd = End; break;
+    }
+
+    ADDRESS Reclaim =
+    {
+        .Range.Start = XAD_PAGE_TO_ADDRESS(ReclaimStart),
+        .Range.End = XAD_PAGE_TO_ADDRESS(ReclaimEnd),
+        .Type = (U32)HtRandomRange(XAD_TEST_TYPES),
+    };
+
+    // Neighbours which must be merged into the reclaimed range.
+    MMXAD *Neighbour = NULL;
+    U64 MergedStart = Reclaim.Range.Start;
+    U64 MergedEnd = Reclaim.Range.End;
+
+    if (ReclaimStart == Start && Start > 0 && XadTestType[Start - 1] == (S32)Reclaim.Type &&
+        E_IS_SUCCESS(MmXadLookupAddress(Tree, &Neighbour, XAD_PAGE_TO_ADDRESS(Start - 1), 0, 0, XAD_LAF_ADDRESS)))
+    {
+        MergedStart = Neighbour->Address.Range.Start;
+    }
+
+    if (ReclaimEnd == End && End < XAD_TEST_PAGES && XadTestType[End] == (S32)Reclaim.Type &&
+        E_IS_SUCCESS(MmXadLookupAddress(Tree, &Neighbour, XAD_PAGE_TO_ADDRESS(End), 0, 0, XAD_LAF_ADDRESS)))
+    {
+        MergedEnd = Neighbour->Address.Range.End;
+    }
+
+    // Either XAD or address hint is used to find the target.
+    if (HtRandomRange(2))
+        HT_CHECK(E_IS_SUCCESS(MmXadReclaimAddress(Tree, Xad, NULL, &Reclaim)));
+    else
+        HT_CHECK(E_IS_SUCCESS(MmXadReclaimAddress(Tree, NULL, &Target, &Reclaim)));
+
+    for (U32 Page = ReclaimStart; Page < ReclaimEnd; Page++)
+        XadTestType[Page] = (S32)Reclaim.Type;
+
+    HT_CHECK(E_IS_SUCCESS(MmXadLookupAddress(Tree, &Xad, Reclaim.Range.Start, 0, 0, XAD_LAF_ADDRESS)));
+    HT_CHECK(Xad->Address.Type == Reclaim.Type);
+    HT_CHECK(Xad->Address.Range.Start <= MergedStart && MergedEnd <= Xad->Address.Range.End);
+}
+
+static
+VOID
+XadTestDelete(
+    IN MMXAD_TREE *Tree)
+{
+    if (!XadTestCount)
+        return;
+
+    ADDRESS Address = XadTestList[HtRandomRange(XadTestCount)]->Address;
+
+    HT_CHECK(E_IS_SUCCESS(MmXadDeleteAddress(Tree, &Address)));
+
+    for (U32 Page = XAD_ADDRESS_TO_PAGE(Address.Range.Start); Page < XAD_ADDRESS_TO_PAGE(Address.Range.End); Page++)
+        XadTestType[Page] = -1;
+}
+
+static
+VOID
+XadTestLookup(
+    IN MMXAD_TREE *Tree)
+{
+    U32 Page = (U32)HtRandomRange(XAD_TEST_PAGES);
+    MMXAD *Xad = NULL;
+
+    ESTATUS Status = MmXadLookupAddress(Tree, &Xad, XAD_PAGE_TO_ADDRESS(Page) + HtRandomRange(PAGE_SIZE), 0, 0, XAD_LAF_ADDRESS);
+
+    HT_CHECK(E_IS_SUCCESS(Status) == (XadTestType[Page] >= 0));
+
+    if (E_IS_SUCCESS(Status))
+    {
+        HT_CHECK(Xad->Address.Range.Start <= XAD_PAGE_TO_ADDRESS(Page) && XAD_PAGE_TO_ADDRESS(Page) < Xad->Address.Range.End);
+        HT_CHECK((S32)Xad->Address.Type == XadTestType[Page]);
+    }
+
+    // Lookup by size and type.
+    U64 Size = (1 + HtRandomRange(XAD_TEST_RANGE_MAX)) << PAGE_SHIFT;
+    U32 Type = (U32)HtRandomRange(XAD_TEST_TYPES);
+    BOOLEAN Exists = FALSE;
+
+    for (U32 i = 0; i < XadTestCount; i++)
+    {
+        ADDRESS *Address = &XadTestList[i]->Address;
+
+        if (Address->Type == Type && Address->Range.End - Address->Range.Start >= Size)
+            Exists = TRUE;
+    }
+
+    Status = MmXadLookupAddress(Tree, &Xad, 0, Size, Type, XAD_LAF_SIZE | XAD_LAF_TYPE);
+
+    HT_CHECK(E_IS_SUCCESS(Status) == Exists);
+
+    if (E_IS_SUCCESS(Status))
+        HT_CHECK(Xad->Address.Type == Type && Xad->Address.Range.End - Xad->Address.Range.Start >= Size);
+}
+
+static
+VOID
+XadTest(
+    IN U32 Iterations)
+{
+    MMXAD_TREE Tree;
+
+    for (U32 Page = 0; Page < XAD_TEST_PAGES; Page++)
+        XadTestType[Page] = -1;
+
+    XadTestInitialize(&Tree, XAD_TEST_POOL_SIZE);
+    XadTestVerify(&Tree);
+
+    for (U32 i = 0; i < Iterations; i++)
+    {
+        switch (HtRandomRange(8))
+        {
+        case 0: case 1: case 2:
+            XadTestInsert(&Tree);
+            break;
+        case 3: case 4: case 5:
+            XadTestReclaim(&Tree);
+            break;
+        case 6:
+            XadTestDelete(&Tree);
+            break;
+        case 7:
+            XadTestLookup(&Tree);
+            break;
+        }
+
+        XadTestVerify(&Tree);
+    }
+
+    while (XadTestCount)
+    {
+        XadTestDelete(&Tree);
+        XadTestVerify(&Tree);
+    }
+
+    HT_CHECK(Tree.Tree.Root == NULL);
+
+    HtDeletePool();
+}
+
+static
+VOID
+XadBench(
+    IN U32 Iterations)
+{
+    // Every other page is reclaimed, so each one is split from and merged back to its neighbours.
+    U32 Count = Iterations;
+    U32 *Pages = malloc(sizeof(U32) * Count);
+    HT_LATENCY Split, Merge, Lookup;
+    MMXAD_TREE Tree;
+
+    HT_CHECK(Pages != NULL);
+
+    XadTestInitialize(&Tree, (SIZE_T)Count * 0x400 + 0x1000000);
+
+    ADDRESS Address =
+    {
+        .Range.Start = XAD_TEST_BASE,
+        .Range.End = XAD_TEST_BASE + ((U64)Count * 2 + 1) * PAGE_SIZE,
+        .Type = 0,
+    };
+
+    HT_CHECK(E_IS_SUCCESS(MmXadInsertAddress(&Tree, NULL, &Address)));
+
+    for (U32 i = 0; i < Count; i++)
+        Pages[i] = i * 2 + 1;
+
+    for (U32 i = Count; i > 1; i--)
+    {
+        U32 j = (U32)HtRandomRange(i);
+        U32 Temp = Pages[i - 1];
+        Pages[i - 1] = Pages[j];
+        Pages[j] = Temp;
+    }
+
+    HtLatencyInitialize(&Split, "reclaim (split)", Count);
+    HtLatencyInitialize(&Lookup, "lookup", Count);
+    HtLatencyInitialize(&Merge, "reclaim (merge)", Count);
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        ADDRESS Hint = { .Range.Start = XAD_PAGE_TO_ADDRESS(Pages[i]), .Range.End = XAD_PAGE_TO_ADDRESS(Pages[i]) + 1, .Type = 0 };
+        ADDRESS Reclaim = { .Range.Start = XAD_PAGE_TO_ADDRESS(Pages[i]), .Range.End = XAD_PAGE_TO_ADDRESS(Pages[i] + 1), .Type = 1 };
+
+        U64 Start = HtNow();
+        ESTATUS Status = MmXadReclaimAddress(&Tree, NULL, &Hint, &Reclaim);
+        HtLatencyAdd(&Split, HtNow() - Start);
+
+        HT_CHECK(E_IS_SUCCESS(Status));
+    }
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        MMXAD *Xad = NULL;
+
+        U64 Start = HtNow();
+        ESTATUS Status = MmXadLookupAddress(&Tree, &Xad, XAD_PAGE_TO_ADDRESS(Pages[HtRandomRange(Count)]), 0, 0, XAD_LAF_ADDRESS);
+        HtLatencyAdd(&Lookup, HtNow() - Start);
+
+        HT_CHECK(E_IS_SUCCESS(Status) && Xad->Address.Type == 1);
+    }
+
+    for (U32 i = 0; i < Count; i++)
+    {
+        ADDRESS Hint = { .Range.Start = XAD_PAGE_TO_ADDRESS(Pages[i]), .Range.End = XAD_PAGE_TO_ADDRESS(Pages[i]) + 1, .Type = 1 };
+        ADDRESS Reclaim = { .Range.Start = XAD_PAGE_TO_ADDRESS(Pages[i]), .Range.End = XAD_PAGE_TO_ADDRESS(Pages[i] + 1), .Type = 0 };
+
+        U64 Start = HtNow();
+        ESTATUS Status = MmXadReclaimAddress(&Tree, NULL, &Hint, &Reclaim);
+        HtLatencyAdd(&Merge, HtNow() - Start);
+
+        HT_CHECK(E_IS_SUCCESS(Status));
+    }
+
+    // Everything is merged back to the initial range.
+    HT_CHECK(Tree.Tree.NodeCount == 1);
+
+    HtLatencyReport(&Split);
+    HtLatencyReport(&Lookup);
+    HtLatencyReport(&Merge);
+
+    free(Pages);
+    HtDeletePool();
+}
+
+const HT_SUITE HtSuiteXad =
+{
+    .Name = "xad",
+    .Test = &XadTest,
+    .Bench = &XadBench,
+};
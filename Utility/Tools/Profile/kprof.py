@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# Converts the profile dumped by KeDumpProfile() to a flat profile.
+#
+# Usage: kprof.py [options] <core.sys> <serial log>
+#        -t, --threads      Also breaks down each function by thread
+#        -c, --cpu N        Only counts samples of processor N
+#        -n, --limit N      Prints top N functions (default 50, 0 for all)
+#
+# Dump lines may be mixed with other debug output. Lines without "#KPROF" are ignored.
+# Sample RIP is dumped as offset from the kernel base, which is resolved against the COFF symbol
+# table of core.sys (kernel is linked with -g, so the table is kept in the image).
+# Samples outside the image are reported as [unknown].
+#
+
+import argparse
+import bisect
+import struct
+import sys
+from collections import defaultdict
+
+# Must match with ke/profile.h
+KPROF_DUMP_PREFIX = "#KPROF "
+KPROF_DUMP_VERSION = 1
+
+SOURCE_NAMES = { 1: "timer", 2: "cycles" }
+
+IMAGE_SCN_MEM_EXECUTE = 0x20000000
+IMAGE_SYM_CLASS_EXTERNAL = 2
+IMAGE_SYM_CLASS_STATIC = 3
+IMAGE_SYM_DTYPE_FUNCTION = 0x20
+
+
+def load_symbols(path):
+    """Returns (sorted RVAs, names, size of image) of functions in core.sys."""
+    with open(path, "rb") as f:
+        image = f.read()
+
+    if image[:2] != b"MZ":
+        raise ValueError("%s: not a PE image" % path)
+
+    pe = struct.unpack_from("<I", image, 0x3c)[0]
+    if image[pe:pe + 4] != b"PE\0\0":
+        raise ValueError("%s: not a PE image" % path)
+
+    (_, section_count, _, symbol_table, symbol_count,
+        optional_size, _) = struct.unpack_from("<HHIIIHH", image, pe + 4)
+
+    optional = pe + 24
+    if struct.unpack_from("<H", image, optional)[0] != 0x20b:
+        raise ValueError("%s: not a PE32+ image" % path)
+
+    size_of_image = struct.unpack_from("<I", image, optional + 56)[0]
+
+    sections = []
+    for i in range(section_count):
+        offset = optional + optional_size + i * 40
+        rva = struct.unpack_from("<I", image, offset + 12)[0]
+        characteristics = struct.unpack_from("<I", image, offset + 36)[0]
+        sections.append((rva, characteristics))
+
+    if not symbol_table or not symbol_count:
+        raise ValueError("%s: no symbol table (stripped?)" % path)
+
+    strings = symbol_table + symbol_count * 18
+    symbols = {}
+    i = 0
+
+    while i < symbol_count:
+        offset = symbol_table + i * 18
+        (raw_name, value, section, type_, storage_class,
+            aux_count) = struct.unpack_from("<8sIhHBB", image, offset)
+        i += 1 + aux_count
+
+        if section <= 0 or section > len(sections):
+            continue
+
+        if storage_class not in (IMAGE_SYM_CLASS_EXTERNAL, IMAGE_SYM_CLASS_STATIC):
+            continue
+
+        # Section definitions have aux symbol but are not functions.
+        if storage_class == IMAGE_SYM_CLASS_STATIC and aux_count and \
+            not (type_ & IMAGE_SYM_DTYPE_FUNCTION):
+            continue
+
+        section_rva, characteristics = sections[section - 1]
+        if not (characteristics & IMAGE_SCN_MEM_EXECUTE):
+            continue
+
+        if raw_name[:4] == b"\0\0\0\0":
+            start = strings + struct.unpack_from("<I", raw_name, 4)[0]
+            name = image[start:image.index(b"\0", start)]
+        else:
+            name = raw_name.rstrip(b"\0")
+
+        # Section names, local labels, ...
+        if name.startswith(b"."):
+            continue
+
+        # Symbol value is relative to the section in linked image.
+        symbols.setdefault(section_rva + value, name.decode("ascii", "replace"))
+
+    rvas = sorted(symbols)
+    return rvas, [symbols[rva] for rva in rvas], size_of_image
+
+
+def resolve(rvas, names, size_of_image, rva):
+    if rva >= size_of_image:
+        return "[unknown]"
+
+    index = bisect.bisect_right(rvas, rva) - 1
+    if index < 0:
+        return "[unknown]"
+
+    return names[index]
+
+
+def parse_dump(path):
+    """Returns header, thread names, per-processor (samples, dropped) and samples."""
+    header = None
+    threads = {}
+    processors = {}
+    samples = []
+    ended = False
+
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            position = line.find(KPROF_DUMP_PREFIX)
+            if position < 0:
+                continue
+
+            fields = line[position + len(KPROF_DUMP_PREFIX):].rstrip("\r\n").split(" ")
+            kind = fields[0]
+
+            if kind == "H":
+                # New dump. Only the last one is used.
+                version = int(fields[1])
+                if version != KPROF_DUMP_VERSION:
+                    raise ValueError("unsupported dump version %d" % version)
+
+                header = {
+                    "processors": int(fields[2]),
+                    "source": int(fields[3]),
+                    "period": int(fields[4]),
+                    "elapsed_ms": int(fields[5]),
+                    "loaded_base": int(fields[6], 16),
+                }
+                threads = {}
+                processors = {}
+                samples = []
+                ended = False
+            elif header is None:
+                continue
+            elif kind == "T":
+                threads[int(fields[1])] = " ".join(fields[2:])
+            elif kind == "P":
+                processors[int(fields[1])] = (int(fields[2]), int(fields[3]))
+            elif kind == "S":
+                samples.append((int(fields[1]), int(fields[2]),
+                    int(fields[3], 16), int(fields[4])))
+            elif kind == "E":
+                ended = True
+
+    if header is None:
+        raise ValueError("%s: no profile dump found" % path)
+
+    if not ended:
+        print("warning: dump is truncated", file=sys.stderr)
+
+    return header, threads, processors, samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flat profile from KeDumpProfile() output.")
+    parser.add_argument("image", help="core.sys (with symbol table)")
+    parser.add_argument("log", help="serial log which contains the dump")
+    parser.add_argument("-t", "--threads", action="store_true", help="break down by thread")
+    parser.add_argument("-c", "--cpu", type=int, default=None, help="only processor N")
+    parser.add_argument("-n", "--limit", type=int, default=50, help="top N functions (0 for all)")
+    args = parser.parse_args()
+
+    try:
+        rvas, names, size_of_image = load_symbols(args.image)
+        header, threads, processors, samples = parse_dump(args.log)
+    except (OSError, ValueError, struct.error) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    functions = defaultdict(int)
+    function_threads = defaultdict(lambda: defaultdict(int))
+    total = 0
+
+    for cpu, thread_id, rva, count in samples:
+        if args.cpu is not None and cpu != args.cpu:
+            continue
+
+        # Offsets below the base are wrapped around to large values, so they're unknown too.
+        name = resolve(rvas, names, size_of_image, rva)
+        functions[name] += count
+        function_threads[name][thread_id] += count
+        total += count
+
+    taken = sum(s for c, (s, d) in processors.items() if args.cpu is None or c == args.cpu)
+    dropped = sum(d for c, (s, d) in processors.items() if args.cpu is None or c == args.cpu)
+
+    source = SOURCE_NAMES.get(header["source"], str(header["source"]))
+    if header["source"] == 2:
+        source += " (%d cycles/sample)" % header["period"]
+
+    print("Source      : %s" % source)
+    print("Processors  : %d" % header["processors"])
+    print("Elapsed     : %d ms" % header["elapsed_ms"])
+    print("Kernel base : 0x%x" % header["loaded_base"])
+    print("Samples     : %d (%d dropped)" % (taken, dropped))
+    print()
+
+    if not total:
+        print("No samples.")
+        return 0
+
+    print("%7s %7s %10s  %s" % ("self%", "cumul%", "samples", "function"))
+
+    cumulative = 0
+    ranked = sorted(functions.items(), key=lambda item: (-item[1], item[0]))
+    if args.limit > 0:
+        ranked = ranked[:args.limit]
+
+    for name, count in ranked:
+        cumulative += count
+        print("%6.2f%% %6.2f%% %10d  %s" % (
+            100.0 * count / total, 100.0 * cumulative / total, count, name))
+
+        if args.threads:
+            by_thread = sorted(function_threads[name].items(), key=lambda item: -item[1])
+            for thread_id, thread_count in by_thread:
+                print("%26d    %s (%d)" % (
+                    thread_count, threads.get(thread_id, "?"), thread_id))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
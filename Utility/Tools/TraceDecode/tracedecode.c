@@ -0,0 +1,553 @@
+//
+// Converts the event trace dumped by KeDumpEventTrace() to Chrome trace JSON.
+//
+// Build: cmake -S . -B build && cmake --build build (or cc -O2 -o tracedecode tracedecode.c)
+// Usage: tracedecode <serial log> [output.json]
+//        Open the output with chrome://tracing or https://ui.perfetto.dev
+//
+// Dump lines may be mixed with other debug output. Lines without "#KTRACE" are ignored.
+// Each processor has two tracks. Running threads and instant events go to "CPU n",
+// interrupt handlers go to "CPU n IRQ".
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+// Must match with ke/evtrace.h
+#define KTRACE_DUMP_PREFIX      "#KTRACE "
+#define KTRACE_DUMP_VERSION     1
+#define KTRACE_ARGS_MAX         4
+#define KTRACE_RECORD_HEADER    16
+
+enum
+{
+    EventTraceContextSwitch,
+    EventTraceInterruptEnter,
+    EventTraceInterruptExit,
+    EventTracePoolAllocate,
+    EventTracePoolFree,
+    EventTraceTimerInsert,
+    EventTraceTimerExpire,
+    EventTraceXadReclaim,
+    EventTracePageMap,
+    EventTraceMaximum,
+};
+
+static const char *EventNames[EventTraceMaximum] =
+{
+    "ContextSwitch",
+    "InterruptEnter",
+    "InterruptExit",
+    "PoolAllocate",
+    "PoolFree",
+    "TimerInsert",
+    "TimerExpire",
+    "XadReclaim",
+    "PageMap",
+};
+
+static const char *EventArgNames[EventTraceMaximum][KTRACE_ARGS_MAX] =
+{
+    { "PreviousThreadId", "NextThreadId", "PreviousWaiting" },
+    { "Vector" },
+    { "Vector" },
+    { "Type", "Size", "Address" },
+    { "Address" },
+    { "Timer", "ExpirationTimeAbsolute", "Interval" },
+    { "Timer", "ExpirationTimeAbsolute" },
+    { "Start", "End", "Type", "PreviousType" },
+    { "VirtualAddress", "PhysicalAddress", "Size", "PteFlags" },
+};
+
+#define PROCESSORS_MAX          256
+#define IRQ_NESTING_MAX         16
+#define IRQ_TRACK_BASE          1000
+
+typedef struct _RECORD
+{
+    uint64_t Timestamp;
+    uint16_t EventId;
+    uint8_t ProcessorId;
+    uint8_t ArgCount;
+    uint64_t Args[KTRACE_ARGS_MAX];
+    size_t Order;                   // Keeps the dump order for same timestamp
+} RECORD;
+
+typedef struct _THREAD_NAME
+{
+    uint64_t ThreadId;
+    char Name[128];
+} THREAD_NAME;
+
+typedef struct _PROCESSOR_STATE
+{
+    int Seen;
+    uint64_t FirstTimestamp;
+    int ThreadRunning;
+    uint64_t ThreadId;
+    uint64_t ThreadStart;
+    int IrqDepth;
+    uint64_t IrqVector[IRQ_NESTING_MAX];
+    uint64_t IrqStart[IRQ_NESTING_MAX];
+} PROCESSOR_STATE;
+
+static RECORD *Records;
+static size_t RecordCount;
+static size_t RecordCapacity;
+
+static THREAD_NAME *Threads;
+static size_t ThreadCount;
+static size_t ThreadCapacity;
+
+static uint64_t TscPerMs;
+static uint64_t StartTsc;
+static size_t MalformedCount;
+
+static PROCESSOR_STATE Processors[PROCESSORS_MAX];
+static int FirstEvent = 1;
+
+
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static uint64_t ReadU64(const uint8_t *p, int Size)
+{
+    uint64_t Value = 0;
+
+    for (int i = Size - 1; i >= 0; i--)
+    {
+        Value = (Value << 8) | p[i];
+    }
+
+    return Value;
+}
+
+static void *Grow(void *Array, size_t *Capacity, size_t ElementSize)
+{
+    *Capacity = *Capacity ? *Capacity * 2 : 0x1000;
+    Array = realloc(Array, *Capacity * ElementSize);
+
+    if (!Array)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    return Array;
+}
+
+static void ParseRecord(const char *Hex)
+{
+    uint8_t Data[KTRACE_RECORD_HEADER + KTRACE_ARGS_MAX * 8];
+    size_t Size = 0;
+
+    while (HexValue(Hex[0]) >= 0 && HexValue(Hex[1]) >= 0)
+    {
+        if (Size >= sizeof(Data))
+        {
+            MalformedCount++;
+            return;
+        }
+
+        Data[Size++] = (uint8_t)(HexValue(Hex[0]) << 4 | HexValue(Hex[1]));
+        Hex += 2;
+    }
+
+    if (Size < KTRACE_RECORD_HEADER ||
+        Data[11] > KTRACE_ARGS_MAX ||
+        Size != KTRACE_RECORD_HEADER + Data[11] * 8u)
+    {
+        // Partially written or mixed with other output.
+        MalformedCount++;
+        return;
+    }
+
+    if (RecordCount == RecordCapacity)
+    {
+        Records = Grow(Records, &RecordCapacity, sizeof(RECORD));
+    }
+
+    RECORD *Record = &Records[RecordCount];
+    memset(Record, 0, sizeof(*Record));
+
+    Record->Timestamp = ReadU64(&Data[0], 8);
+    Record->EventId = (uint16_t)ReadU64(&Data[8], 2);
+    Record->ProcessorId = Data[10];
+    Record->ArgCount = Data[11];
+
+    for (int i = 0; i < Record->ArgCount; i++)
+    {
+        Record->Args[i] = ReadU64(&Data[KTRACE_RECORD_HEADER + i * 8], 8);
+    }
+
+    Record->Order = RecordCount++;
+}
+
+static void ParseLine(char *Line)
+{
+    char *p = strstr(Line, KTRACE_DUMP_PREFIX);
+    if (!p)
+    {
+        return;
+    }
+
+    p += strlen(KTRACE_DUMP_PREFIX);
+    Line[strcspn(Line, "\r\n")] = '\0';
+
+    switch (p[0])
+    {
+    case 'H':
+    {
+        int Version = 0;
+        int ProcessorCount = 0;
+
+        if (sscanf(p + 1, "%d %d %" SCNu64 " %" SCNu64, &Version, &ProcessorCount, &TscPerMs, &StartTsc) != 4)
+        {
+            MalformedCount++;
+        }
+        else if (Version != KTRACE_DUMP_VERSION)
+        {
+            fprintf(stderr, "Unsupported dump version %d\n", Version);
+            exit(1);
+        }
+
+        break;
+    }
+
+    case 'T':
+    {
+        uint64_t ThreadId;
+        int NameOffset = 0;
+
+        if (sscanf(p + 1, " %" SCNu64 " %n", &ThreadId, &NameOffset) < 1 || !NameOffset)
+        {
+            MalformedCount++;
+            break;
+        }
+
+        if (ThreadCount == ThreadCapacity)
+        {
+            Threads = Grow(Threads, &ThreadCapacity, sizeof(THREAD_NAME));
+        }
+
+        Threads[ThreadCount].ThreadId = ThreadId;
+        snprintf(Threads[ThreadCount].Name, sizeof(Threads[ThreadCount].Name), "%s", p + 1 + NameOffset);
+        ThreadCount++;
+        break;
+    }
+
+    case 'P':
+    {
+        int ProcessorId;
+        uint64_t Head;
+        uint64_t Start;
+
+        if (sscanf(p + 1, "%d %" SCNu64 " %" SCNu64, &ProcessorId, &Head, &Start) == 3 && Start)
+        {
+            fprintf(stderr, "Processor %d: %" PRIu64 " oldest records are overwritten\n", ProcessorId, Start);
+        }
+
+        break;
+    }
+
+    case 'R':
+        ParseRecord(p + 2);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int CompareRecord(const void *a, const void *b)
+{
+    const RECORD *r1 = (const RECORD *)a;
+    const RECORD *r2 = (const RECORD *)b;
+
+    if (r1->Timestamp != r2->Timestamp)
+        return r1->Timestamp < r2->Timestamp ? -1 : 1;
+
+    return r1->Order < r2->Order ? -1 : (r1->Order > r2->Order);
+}
+
+static double ToMicroseconds(uint64_t Timestamp)
+{
+    return (double)(int64_t)(Timestamp - StartTsc) * 1000.0 / (double)TscPerMs;
+}
+
+static void WriteJsonString(FILE *Out, const char *s)
+{
+    fputc('"', Out);
+
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(Out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(Out, "\\u%04x", *s);
+        else
+            fputc(*s, Out);
+    }
+
+    fputc('"', Out);
+}
+
+static void BeginEvent(FILE *Out)
+{
+    fputs(FirstEvent ? "\n" : ",\n", Out);
+    FirstEvent = 0;
+}
+
+static const char *LookupThreadName(uint64_t ThreadId)
+{
+    for (size_t i = 0; i < ThreadCount; i++)
+    {
+        if (Threads[i].ThreadId == ThreadId)
+            return Threads[i].Name;
+    }
+
+    return NULL;
+}
+
+static void WriteThreadSlice(FILE *Out, int ProcessorId, uint64_t ThreadId, uint64_t Start, uint64_t End)
+{
+    const char *Name = LookupThreadName(ThreadId);
+    char Buffer[192];
+
+    if (Name)
+        snprintf(Buffer, sizeof(Buffer), "%s (%" PRIu64 ")", Name, ThreadId);
+    else
+        snprintf(Buffer, sizeof(Buffer), "Thread %" PRIu64, ThreadId);
+
+    BeginEvent(Out);
+    fprintf(Out, "{\"name\":");
+    WriteJsonString(Out, Buffer);
+    fprintf(Out, ",\"cat\":\"thread\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+        "\"args\":{\"ThreadId\":%" PRIu64 "}}",
+        ProcessorId, ToMicroseconds(Start), ToMicroseconds(End) - ToMicroseconds(Start), ThreadId);
+}
+
+static const char *VectorName(uint64_t Vector)
+{
+    // Must match with ke/interrupt.h, ke/tlb.h and ke/ipi.h
+    switch (Vector)
+    {
+    case 0x40: return "LocalApicTimer";
+    case 0x41: return "LocalApicError";
+    case 0x60: return "PlatformTimer";
+    case 0x61: return "SerialPort";
+    case 0xd0: return "Spurious";
+    case 0xf0: return "TlbShootdown";
+    case 0xf1: return "IpiGenericCall";
+    default: return NULL;
+    }
+}
+
+static void WriteIrqSlice(FILE *Out, int ProcessorId, uint64_t Vector, uint64_t Start, uint64_t End)
+{
+    const char *Name = VectorName(Vector);
+    char Buffer[64];
+
+    if (Name)
+        snprintf(Buffer, sizeof(Buffer), "IRQ 0x%02" PRIx64 " %s", Vector, Name);
+    else
+        snprintf(Buffer, sizeof(Buffer), "IRQ 0x%02" PRIx64, Vector);
+
+    BeginEvent(Out);
+    fprintf(Out, "{\"name\":\"%s\",\"cat\":\"irq\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+        Buffer, IRQ_TRACK_BASE + ProcessorId, ToMicroseconds(Start), ToMicroseconds(End) - ToMicroseconds(Start));
+}
+
+static void WriteInstant(FILE *Out, RECORD *Record)
+{
+    BeginEvent(Out);
+    fprintf(Out, "{\"name\":\"%s\",\"cat\":\"event\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{",
+        EventNames[Record->EventId], Record->ProcessorId, ToMicroseconds(Record->Timestamp));
+
+    for (int i = 0; i < Record->ArgCount; i++)
+    {
+        const char *ArgName = EventArgNames[Record->EventId][i];
+        fprintf(Out, "%s\"%s\":\"0x%" PRIx64 "\"", i ? "," : "", ArgName ? ArgName : "Arg", Record->Args[i]);
+    }
+
+    fputs("}}", Out);
+}
+
+static void WriteMetadata(FILE *Out, int Tid, const char *Name, int SortIndex)
+{
+    BeginEvent(Out);
+    fprintf(Out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", Tid, Name);
+    BeginEvent(Out);
+    fprintf(Out, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"sort_index\":%d}}", Tid, SortIndex);
+}
+
+static void WriteTrace(FILE *Out)
+{
+    uint64_t LastTimestamp = RecordCount ? Records[RecordCount - 1].Timestamp : StartTsc;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", Out);
+
+    BeginEvent(Out);
+    fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"Kernel\"}}", Out);
+
+    for (size_t i = 0; i < RecordCount; i++)
+    {
+        RECORD *Record = &Records[i];
+        PROCESSOR_STATE *Processor = &Processors[Record->ProcessorId];
+
+        if (!Processor->Seen)
+        {
+            char Name[32];
+
+            Processor->Seen = 1;
+            Processor->FirstTimestamp = Record->Timestamp;
+
+            snprintf(Name, sizeof(Name), "CPU %d", Record->ProcessorId);
+            WriteMetadata(Out, Record->ProcessorId, Name, Record->ProcessorId * 2);
+
+            snprintf(Name, sizeof(Name), "CPU %d IRQ", Record->ProcessorId);
+            WriteMetadata(Out, IRQ_TRACK_BASE + Record->ProcessorId, Name, Record->ProcessorId * 2 + 1);
+        }
+
+        if (Record->EventId >= EventTraceMaximum)
+        {
+            MalformedCount++;
+            continue;
+        }
+
+        switch (Record->EventId)
+        {
+        case EventTraceContextSwitch:
+            // Thread which was running when the trace is started is shown from the first record.
+            WriteThreadSlice(Out, Record->ProcessorId, Record->Args[0],
+                Processor->ThreadRunning ? Processor->ThreadStart : Processor->FirstTimestamp,
+                Record->Timestamp);
+
+            Processor->ThreadRunning = 1;
+            Processor->ThreadId = Record->Args[1];
+            Processor->ThreadStart = Record->Timestamp;
+            break;
+
+        case EventTraceInterruptEnter:
+            if (Processor->IrqDepth < IRQ_NESTING_MAX)
+            {
+                Processor->IrqVector[Processor->IrqDepth] = Record->Args[0];
+                Processor->IrqStart[Processor->IrqDepth] = Record->Timestamp;
+            }
+
+            Processor->IrqDepth++;
+            break;
+
+        case EventTraceInterruptExit:
+            if (Processor->IrqDepth > 0)
+            {
+                Processor->IrqDepth--;
+
+                if (Processor->IrqDepth < IRQ_NESTING_MAX)
+                {
+                    WriteIrqSlice(Out, Record->ProcessorId, Processor->IrqVector[Processor->IrqDepth],
+                        Processor->IrqStart[Processor->IrqDepth], Record->Timestamp);
+                }
+            }
+            else
+            {
+                // Entered before the first record.
+                WriteIrqSlice(Out, Record->ProcessorId, Record->Args[0], Processor->FirstTimestamp, Record->Timestamp);
+            }
+
+            break;
+
+        default:
+            WriteInstant(Out, Record);
+            break;
+        }
+    }
+
+    // Close the slices which are still open.
+    for (int i = 0; i < PROCESSORS_MAX; i++)
+    {
+        PROCESSOR_STATE *Processor = &Processors[i];
+
+        if (Processor->ThreadRunning)
+        {
+            WriteThreadSlice(Out, i, Processor->ThreadId, Processor->ThreadStart, LastTimestamp);
+        }
+
+        while (Processor->IrqDepth > 0)
+        {
+            Processor->IrqDepth--;
+
+            if (Processor->IrqDepth < IRQ_NESTING_MAX)
+            {
+                WriteIrqSlice(Out, i, Processor->IrqVector[Processor->IrqDepth],
+                    Processor->IrqStart[Processor->IrqDepth], LastTimestamp);
+            }
+        }
+    }
+
+    fputs("\n]}\n", Out);
+}
+
+int main(int argc, char **argv)
+{
+    char Line[1024];
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <serial log> [output.json]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *In = fopen(argv[1], "r");
+    if (!In)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while (fgets(Line, sizeof(Line), In))
+    {
+        ParseLine(Line);
+    }
+
+    fclose(In);
+
+    if (!TscPerMs)
+    {
+        // Trace was too short to measure.
+        fprintf(stderr, "TSC frequency is unknown, assuming 1 GHz\n");
+        TscPerMs = 1000000;
+    }
+
+    qsort(Records, RecordCount, sizeof(RECORD), CompareRecord);
+
+    FILE *Out = stdout;
+    if (argc >= 3)
+    {
+        Out = fopen(argv[2], "w");
+        if (!Out)
+        {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+
+    WriteTrace(Out);
+
+    if (Out != stdout)
+    {
+        fclose(Out);
+    }
+
+    fprintf(stderr, "%zu records, %zu threads, %zu malformed lines\n", RecordCount, ThreadCount, MalformedCount);
+
+    return 0;
+}